@@ -0,0 +1,90 @@
+//---------------------------------------------------------------------------
+
+#include "allocation_count.h"
+
+//---------------------------------------------------------------------------
+
+#if JAVELIN_ALLOCATION_STATS
+
+#include <atomic>
+
+//---------------------------------------------------------------------------
+
+static thread_local size_t threadAllocationCount;
+static thread_local size_t threadAllocationBytes;
+static std::atomic<size_t> processAllocationCount;
+static std::atomic<size_t> processAllocationBytes;
+
+AllocationCount AllocationCount::GetThreadTotal() {
+  return AllocationCount{
+      .count = threadAllocationCount,
+      .bytes = threadAllocationBytes,
+  };
+}
+
+AllocationCount AllocationCount::GetProcessTotal() {
+  return AllocationCount{
+      .count = processAllocationCount,
+      .bytes = processAllocationBytes,
+  };
+}
+
+static void CountAllocation(size_t size) {
+  ++threadAllocationCount;
+  threadAllocationBytes += size;
+  ++processAllocationCount;
+  processAllocationBytes += size;
+}
+
+//---------------------------------------------------------------------------
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) {
+  CountAllocation(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  CountAllocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  CountAllocation(size);
+  return __libc_realloc(p, size);
+}
+}
+
+//---------------------------------------------------------------------------
+
+#endif
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#if JAVELIN_ALLOCATION_STATS
+
+#include "unit_test.h"
+#include <stdlib.h>
+
+TEST_BEGIN("AllocationCount: Counts allocations of the current thread") {
+  AllocationCount start = AllocationCount::GetThreadTotal();
+
+  void *volatile p = malloc(100);
+  p = realloc(p, 200);
+  free(p);
+
+  AllocationCount allocations = AllocationCount::GetThreadTotal() - start;
+  assert(allocations.count == 2);
+  assert(allocations.bytes == 300);
+}
+TEST_END
+
+#endif
+
+//---------------------------------------------------------------------------
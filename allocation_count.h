@@ -0,0 +1,36 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+#if JAVELIN_ALLOCATION_STATS
+
+// Heap allocation accounting for host builds.
+//
+// Building with JAVELIN_ALLOCATION_STATS interposes the glibc malloc, calloc
+// and realloc, and counts the allocations made by each thread. It cannot be
+// combined with sanitizers that replace the allocator.
+struct AllocationCount {
+  size_t count;
+  size_t bytes;
+
+  // Returns the allocations made by the current thread since it started.
+  static AllocationCount GetThreadTotal();
+
+  // Returns the allocations made by all threads since the program started.
+  static AllocationCount GetProcessTotal();
+
+  AllocationCount operator-(const AllocationCount &other) const {
+    return AllocationCount{
+        .count = count - other.count,
+        .bytes = bytes - other.bytes,
+    };
+  }
+};
+
+#endif
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,106 @@
+//---------------------------------------------------------------------------
+
+#ifdef RUN_BENCHMARKS
+
+//---------------------------------------------------------------------------
+
+#include "benchmark.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+//---------------------------------------------------------------------------
+
+std::vector<const Benchmark *> &Benchmark::GetBenchmarks() {
+  static std::vector<const Benchmark *> benchmarks;
+  return benchmarks;
+}
+
+std::vector<const char *> &Benchmark::GetArguments() {
+  static std::vector<const char *> arguments;
+  return arguments;
+}
+
+Benchmark::Benchmark(void (*function)(), const char *name)
+    : function(function), name(name) {
+  GetBenchmarks().push_back(this);
+}
+
+uint64_t Benchmark::GetTime() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+void Benchmark::PrintLatency(const char *label,
+                             std::vector<uint64_t> &samples) {
+  if (samples.empty()) {
+    printf("  %s: no samples\n", label);
+    return;
+  }
+
+  std::sort(samples.begin(), samples.end());
+
+  uint64_t total = 0;
+  for (uint64_t sample : samples) {
+    total += sample;
+  }
+
+  size_t count = samples.size();
+  printf("  %s: %zu samples, mean %.2fus, p50 %.2fus, p99 %.2fus, "
+         "max %.2fus\n",
+         label, count, total / 1000.0 / count, samples[count / 2] / 1000.0,
+         samples[count * 99 / 100] / 1000.0, samples[count - 1] / 1000.0);
+}
+
+const char *Benchmark::GetOption(const char *name,
+                                 const char *defaultValue) {
+  size_t nameLength = strlen(name);
+  for (const char *argument : GetArguments()) {
+    if (strncmp(argument, "--", 2) == 0 &&
+        strncmp(argument + 2, name, nameLength) == 0 &&
+        argument[2 + nameLength] == '=') {
+      return argument + 3 + nameLength;
+    }
+  }
+  return defaultValue;
+}
+
+void Benchmark::main(int argc, const char **argv) {
+  std::vector<const char *> filters;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--", 2) == 0) {
+      GetArguments().push_back(argv[i]);
+    } else {
+      filters.push_back(argv[i]);
+    }
+  }
+
+  for (const Benchmark *benchmark : GetBenchmarks()) {
+    bool isSelected = filters.empty();
+    for (const char *filter : filters) {
+      if (strstr(benchmark->name, filter)) {
+        isSelected = true;
+      }
+    }
+    if (!isSelected) {
+      continue;
+    }
+
+    printf("[BENCHMARK] %s\n", benchmark->name);
+    (*benchmark->function)();
+    printf("\n");
+  }
+}
+
+int main(int argc, const char **argv) {
+  Benchmark::main(argc, argv);
+  return 0;
+}
+
+//---------------------------------------------------------------------------
+
+#endif
+
+//---------------------------------------------------------------------------
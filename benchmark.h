@@ -0,0 +1,73 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+//---------------------------------------------------------------------------
+
+// Benchmarks are only compiled on hosts, with both RUN_BENCHMARKS and
+// RUN_TESTS defined. Unit tests are compiled in every build, and use test
+// only members such as Key::history. Benchmarks replace the unit test main().
+//
+// Command line arguments of the form --name=value are available to
+// benchmarks through GetOption(). Any other argument selects the benchmarks
+// whose names contain it.
+class Benchmark {
+public:
+  Benchmark(void (*function)(), const char *name);
+
+  static void main(int argc, const char **argv);
+
+  // Returns the value of --name=value, or defaultValue if it was not given.
+  static const char *GetOption(const char *name, const char *defaultValue);
+
+  // Monotonic time in nanoseconds.
+  static uint64_t GetTime();
+
+  // Prints count, mean, p50, p99 and max of the samples (in nanoseconds).
+  // samples is sorted in place.
+  static void PrintLatency(const char *label, std::vector<uint64_t> &samples);
+
+private:
+  void (*function)();
+  const char *name;
+
+  static std::vector<const Benchmark *> &GetBenchmarks();
+  static std::vector<const char *> &GetArguments();
+};
+
+//---------------------------------------------------------------------------
+
+#ifdef RUN_BENCHMARKS
+
+#define BENCHMARK_BEGIN__(text, line)                                          \
+  namespace Benchmark##line {                                                  \
+    static const char *bDescription = text;                                    \
+    static void Run() {
+
+#define BENCHMARK_END                                                          \
+  }                                                                            \
+  static Benchmark benchmark(&Run, bDescription);                              \
+  }
+
+#else
+
+#define BENCHMARK_BEGIN__(text, line)                                          \
+  namespace Benchmark##line {                                                  \
+    [[maybe_unused]] static void Run() {
+
+#define BENCHMARK_END                                                          \
+  }                                                                            \
+  }
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#define BENCHMARK_BEGIN_(description, line) BENCHMARK_BEGIN__(description, line)
+
+#define BENCHMARK_BEGIN(description) BENCHMARK_BEGIN_(description, __LINE__)
+
+//---------------------------------------------------------------------------
@@ -6,6 +6,12 @@
 
 uint32_t Clock::currentTime = 0;
 
+#else
+
+__attribute__((weak)) uint32_t Clock::GetCurrentTimeUs() {
+  return GetCurrentTime() * 1000;
+}
+
 #endif
 
 //---------------------------------------------------------------------------
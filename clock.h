@@ -8,6 +8,7 @@
 class Clock {
 public:
   static uint32_t GetCurrentTime() { return currentTime; }
+  static uint32_t GetCurrentTimeUs() { return currentTime * 1000; }
 
   static void AdvanceTime(uint32_t amount) { currentTime += amount; }
 
@@ -20,6 +21,12 @@ private:
 class Clock {
 public:
   static uint32_t GetCurrentTime();
+
+  // Microsecond clock used for profiling. The default implementation is
+  // based on GetCurrentTime(), and platforms should provide a higher
+  // resolution version.
+  static uint32_t GetCurrentTimeUs();
+
   static void AdvanceTime(uint32_t amount) { }
 };
 
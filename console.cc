@@ -31,6 +31,10 @@ static ConsoleCommand commands[MAX_COMMAND_COUNT] = {
     HELP_COMMAND,
 };
 
+static size_t (*inputHandler)(void *context, const char *data,
+                              size_t length) = nullptr;
+static void *inputHandlerContext = nullptr;
+
 //---------------------------------------------------------------------------
 
 void Console::RegisterCommand(const ConsoleCommand &command) {
@@ -49,6 +53,18 @@ void Console::RegisterCommand(const char *command, const char *description,
   commandCount++;
 }
 
+void Console::CaptureInput(size_t (*handler)(void *context, const char *data,
+                                            size_t length),
+                           void *context) {
+  inputHandler = handler;
+  inputHandlerContext = context;
+}
+
+void Console::ReleaseInput() {
+  inputHandler = nullptr;
+  inputHandlerContext = nullptr;
+}
+
 //---------------------------------------------------------------------------
 
 #ifdef RUN_TESTS
@@ -86,7 +102,11 @@ void Console::Write(const char *data, size_t length) {
 }
 
 void Console::WriteAsJson(const char *data, char *buffer) {
-  char *p = Str::WriteJson(buffer, data);
+  WriteAsJson(data, strlen(data), buffer);
+}
+
+void Console::WriteAsJson(const char *data, size_t length, char *buffer) {
+  char *p = Str::WriteJson(buffer, data, length);
   Console::Write(buffer, p - buffer);
 }
 
@@ -95,16 +115,26 @@ __attribute__((weak)) void Console::Flush() {}
 //---------------------------------------------------------------------------
 
 void Console::HandleInput(const char *data, size_t length) {
-  for (size_t i = 0; i < length; ++i) {
-    if (data[i] == 0) {
+  size_t i = 0;
+  while (i < length) {
+    if (inputHandler) {
+      size_t usedLength =
+          (*inputHandler)(inputHandlerContext, data + i, length - i);
+      assert(usedLength == length - i || inputHandler == nullptr);
+      i += usedLength;
+      continue;
+    }
+
+    char c = data[i++];
+    if (c == 0) {
       continue;
-    } else if (data[i] == '\n') {
+    } else if (c == '\n') {
       ProcessLineBuffer();
       continue;
     } else if (lineBufferCount == sizeof(lineBuffer) - 1) {
       ProcessLineBuffer();
     }
-    lineBuffer[lineBufferCount++] = data[i];
+    lineBuffer[lineBufferCount++] = c;
   }
 }
 
@@ -167,6 +197,7 @@ void Console::HelpCommand(void *context, const char *line) {
 #if RUN_TESTS
 
 #include "unit_test.h"
+#include <string>
 
 TEST_BEGIN("Console should handle invalid commands") {
   Console console;
@@ -181,6 +212,36 @@ TEST_BEGIN("Console should handle invalid commands") {
 }
 TEST_END
 
+static size_t CaptureUntilPeriod(void *context, const char *data,
+                                 size_t length) {
+  std::vector<char> &captured = *(std::vector<char> *)context;
+  const char *end = (const char *)memchr(data, '.', length);
+  if (end == nullptr) {
+    captured.insert(captured.end(), data, data + length);
+    return length;
+  }
+  captured.insert(captured.end(), data, end);
+  Console::ReleaseInput();
+  return end + 1 - data;
+}
+
+TEST_BEGIN("Console should pass captured input to the handler") {
+  std::vector<char> captured;
+  Console console;
+  Console::CaptureInput(CaptureUntilPeriod, &captured);
+  console.HandleInput("asdf\nqw", 7);
+  console.HandleInput("er.asdf\n", 8);
+
+  assert(std::string(captured.begin(), captured.end()) == "asdf\nqwer");
+  Console::history.push_back(0);
+  assert(
+      Str::Eq(&Console::history.front(),
+              "ERR Invalid command. Use \"help\" for a list of commands\n\n"));
+
+  Console::history.clear();
+}
+TEST_END
+
 #endif
 
 //---------------------------------------------------------------------------
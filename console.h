@@ -27,11 +27,21 @@ public:
                               void (*handler)(void *context, const char *line),
                               void *context);
 
+  // Passes input to handler rather than running it as commands, for
+  // commands that stream data larger than a line. handler returns the number
+  // of bytes it used, which is all of them until it calls ReleaseInput().
+  // Input after that is run as commands again.
+  static void CaptureInput(size_t (*handler)(void *context, const char *data,
+                                             size_t length),
+                           void *context);
+  static void ReleaseInput();
+
   static void HelloCommand(void *context, const char *line);
   static void HelpCommand(void *context, const char *line);
 
   static void Write(const char *data, size_t length);
   static void WriteAsJson(const char *data, char *buffer);
+  static void WriteAsJson(const char *data, size_t length, char *buffer);
 
   static void Printf(const char *format, ...) __printflike(1, 2);
 
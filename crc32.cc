@@ -53,12 +53,15 @@ static constexpr uint32_t CRC32_TABLE[256] = {
 //---------------------------------------------------------------------------
 
 __attribute__((weak)) uint32_t Crc32(const void *v, size_t count) {
+  return Crc32Finish(Crc32Update(CRC32_START, v, count));
+}
+
+uint32_t Crc32Update(uint32_t crc, const void *v, size_t count) {
   const uint8_t *p = (const uint8_t *)v;
-  uint32_t hash = 0xffffffff;
   for (size_t i = 0; i < count; i++) {
-    hash = CRC32_TABLE[(hash ^ *p++) & 0xff] ^ (hash >> 8);
+    crc = CRC32_TABLE[(crc ^ *p++) & 0xff] ^ (crc >> 8);
   }
-  return ~hash;
+  return crc;
 }
 
 //---------------------------------------------------------------------------
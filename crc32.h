@@ -8,4 +8,12 @@
 
 uint32_t Crc32(const void *p, size_t count);
 
+// Crc32(p, count) == Crc32Finish(Crc32Update(CRC32_START, p, count)).
+//
+// Crc32Update can be continued with further data, which gives the hash of
+// every prefix of a buffer in a single pass.
+static const uint32_t CRC32_START = 0xffffffff;
+uint32_t Crc32Update(uint32_t crc, const void *p, size_t count);
+inline uint32_t Crc32Finish(uint32_t crc) { return ~crc; }
+
 //---------------------------------------------------------------------------
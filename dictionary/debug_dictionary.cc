@@ -2,7 +2,6 @@
 
 #include "debug_dictionary.h"
 #include "../console.h"
-#include "../str.h"
 #include "../stroke.h"
 
 //---------------------------------------------------------------------------
@@ -26,10 +25,18 @@ StenoDebugDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
     return StenoDictionaryLookupResult::CreateStaticString(response);
   }
 
-  return StenoDictionaryLookupResult::CreateDynamicString(
-      Str::Asprintf("Debug text"));
+  return StenoDictionaryLookupResult::CreateJoinedString(lookup.arena,
+                                                         "Debug text", nullptr);
 }
 
 const char *StenoDebugDictionary::GetName() const { return "debug"; }
 
+StenoDictionaryLookupFilter StenoDebugDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter{
+      .strokeMask = StrokeMask::ALL,
+      .strokeMatch = trigger,
+      .lengthMask = StenoDictionaryLookupFilter::GetLengthBit(1),
+  };
+}
+
 //---------------------------------------------------------------------------
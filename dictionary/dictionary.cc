@@ -3,6 +3,9 @@
 #include "dictionary.h"
 
 #include "../console.h"
+#include "../lookup_arena.h"
+#include <assert.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -38,6 +41,57 @@ const StenoDictionaryLookupResult::StenoDictionaryLookupResultVtbl
         .destroyMethod = FreeString,
 };
 
+const StenoDictionaryLookupResult::StenoDictionaryLookupResultVtbl
+    StenoDictionaryLookupResult::arenaVtbl = {
+        .getTextMethod = ReturnContextAsString,
+        .destroyMethod = Nop,
+};
+
+StenoDictionaryLookupResult
+StenoDictionaryLookupResult::CreateJoinedString(StenoLookupArena *arena,
+                                                const char *p, ...) {
+  va_list args;
+  va_start(args, p);
+  size_t length = 0;
+  for (const char *s = p; s; s = va_arg(args, const char *)) {
+    length += strlen(s);
+  }
+  va_end(args);
+
+  char *result = arena ? arena->Allocate(length + 1)
+                       : (char *)malloc(length + 1);
+  char *dest = result;
+
+  va_start(args, p);
+  for (const char *s = p; s; s = va_arg(args, const char *)) {
+    size_t partLength = strlen(s);
+    memcpy(dest, s, partLength);
+    dest += partLength;
+  }
+  va_end(args);
+  *dest = '\0';
+
+  return arena ? CreateArenaString(result) : CreateDynamicString(result);
+}
+
+//---------------------------------------------------------------------------
+
+StenoDictionaryPrefixLookup::StenoDictionaryPrefixLookup(
+    const StenoStroke *strokes, size_t count)
+    : strokes(strokes), count(count < MAX_LENGTH ? count : MAX_LENGTH) {
+  uint32_t crc = CRC32_START;
+  for (size_t i = 0; i < this->count; ++i) {
+    crc = Crc32Update(crc, &strokes[i], sizeof(StenoStroke));
+    crcs[i] = crc;
+  }
+}
+
+uint32_t StenoDictionaryPrefixLookup::GetHash(size_t length,
+                                              StenoStroke lastStroke) const {
+  uint32_t crc = length == 1 ? CRC32_START : crcs[length - 2];
+  return Crc32Finish(Crc32Update(crc, &lastStroke, sizeof(StenoStroke)));
+}
+
 //---------------------------------------------------------------------------
 
 void StenoReverseDictionaryLookup::AddResult(
@@ -83,6 +137,33 @@ bool StenoReverseDictionaryLookup::HasResult(const StenoStroke *c,
 
 //---------------------------------------------------------------------------
 
+StenoDictionaryLookupResult
+StenoDictionary::LookupLongest(const StenoDictionaryPrefixLookup &lookup,
+                               size_t minimumLength, size_t maximumLength,
+                               size_t &length) const {
+  assert(maximumLength <= lookup.count);
+  if (maximumLength > GetMaximumOutlineLength()) {
+    maximumLength = GetMaximumOutlineLength();
+  }
+
+  for (size_t i = maximumLength; i >= minimumLength && i > 0; --i) {
+    StenoDictionaryLookupResult result = Lookup(lookup.GetLookup(i));
+    if (result.IsValid()) {
+      length = i;
+      return result;
+    }
+  }
+  return StenoDictionaryLookupResult::CreateInvalid();
+}
+
+StenoDictionaryLookupResult
+StenoDictionary::LookupWithProvider(const StenoDictionaryLookup &lookup,
+                                    const StenoDictionary *&provider) const {
+  StenoDictionaryLookupResult result = Lookup(lookup);
+  provider = result.IsValid() ? this : nullptr;
+  return result;
+}
+
 const StenoDictionary *
 StenoDictionary::GetLookupProvider(const StenoDictionaryLookup &lookup) const {
   StenoDictionaryLookupResult lookupResult = Lookup(lookup);
@@ -99,6 +180,10 @@ bool StenoDictionary::ReverseMapDictionaryLookup(
   return false;
 }
 
+StenoDictionaryLookupFilter StenoDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter::CreateAny(GetMaximumOutlineLength());
+}
+
 void StenoDictionary::PrintInfo(int depth) const {
   Console::Printf("%s%s\n", Spaces(depth), GetName());
 }
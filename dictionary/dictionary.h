@@ -1,6 +1,7 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include "../crc32.h"
 #include "../str.h"
 #include "../stroke.h"
 #include <stdint.h>
@@ -9,6 +10,7 @@
 //---------------------------------------------------------------------------
 
 class StenoDictionary;
+class StenoLookupArena;
 
 //---------------------------------------------------------------------------
 
@@ -24,9 +26,11 @@ private:
   static const StenoDictionaryLookupResultVtbl invalidVtbl;
   static const StenoDictionaryLookupResultVtbl staticVtbl;
   static const StenoDictionaryLookupResultVtbl dynamicVtbl;
+  static const StenoDictionaryLookupResultVtbl arenaVtbl;
 
 public:
   bool IsValid() const { return vtbl->getTextMethod != nullptr; }
+  bool IsStaticString() const { return vtbl == &staticVtbl; }
 
   const char *GetText() const { return vtbl->getTextMethod(this); }
   void Destroy() { vtbl->destroyMethod(this); }
@@ -61,6 +65,19 @@ public:
     result.context = p;
     return result;
   }
+
+  // string is owned by an arena, and remains valid until the arena is reset.
+  static StenoDictionaryLookupResult CreateArenaString(const char *p) {
+    StenoDictionaryLookupResult result;
+    result.vtbl = &arenaVtbl;
+    result.context = p;
+    return result;
+  }
+
+  // Concatenates the nullptr terminated list of strings. The result is
+  // allocated from arena when provided, or is a dynamic string otherwise.
+  static StenoDictionaryLookupResult
+  CreateJoinedString(StenoLookupArena *arena, const char *p, ...);
 };
 
 //---------------------------------------------------------------------------
@@ -70,9 +87,113 @@ struct StenoDictionaryLookup {
       : strokes(strokes), length(length),
         hash(StenoStroke::Hash(strokes, length)) {}
 
+  // hash must be StenoStroke::Hash(strokes, length).
+  StenoDictionaryLookup(const StenoStroke *strokes, size_t length,
+                        uint32_t hash)
+      : strokes(strokes), length(length), hash(hash) {}
+
   const StenoStroke *strokes;
   size_t length;
   uint32_t hash;
+
+  // Optional. Dictionaries that generate text allocate it from the arena
+  // when provided.
+  StenoLookupArena *arena = nullptr;
+};
+
+//---------------------------------------------------------------------------
+
+// Lookups of each prefix of a stroke span.
+//
+// The prefix hashes are computed incrementally in a single pass, rather than
+// hashing all of the strokes again for every candidate length.
+struct StenoDictionaryPrefixLookup {
+  // Only the first MAX_LENGTH strokes are considered.
+  StenoDictionaryPrefixLookup(const StenoStroke *strokes, size_t count);
+
+  const StenoStroke *strokes;
+  size_t count;
+
+  // Optional. Dictionaries that generate text allocate it from the arena
+  // when provided.
+  StenoLookupArena *arena = nullptr;
+
+  uint32_t GetHash(size_t length) const {
+    return Crc32Finish(crcs[length - 1]);
+  }
+
+  // The hash of strokes[0, length) with its last stroke replaced.
+  uint32_t GetHash(size_t length, StenoStroke lastStroke) const;
+
+  StenoDictionaryLookup GetLookup(size_t length) const {
+    StenoDictionaryLookup lookup(strokes, length, GetHash(length));
+    lookup.arena = arena;
+    return lookup;
+  }
+
+  static const size_t MAX_LENGTH = 64;
+
+private:
+  // crcs[i] is the unfinished Crc32 of strokes[0, i].
+  uint32_t crcs[MAX_LENGTH];
+};
+
+//---------------------------------------------------------------------------
+
+// A cheap test of whether a dictionary could match a lookup at all, which
+// StenoDictionaryList evaluates inline before calling into the dictionary.
+struct StenoDictionaryLookupFilter {
+  // Lookups can only match when (strokes[0] & strokeMask) == strokeMatch.
+  StenoStroke strokeMask;
+  StenoStroke strokeMatch;
+
+  // Bit n is set when outlines of length n + 1 can match. Bit 31 also covers
+  // all longer outlines.
+  uint32_t lengthMask;
+
+  bool MayMatch(StenoStroke firstStroke) const {
+    return (firstStroke & strokeMask) == strokeMatch;
+  }
+  bool MayMatch(const StenoDictionaryLookup &lookup) const {
+    return (lengthMask & GetLengthBit(lookup.length)) != 0 &&
+           MayMatch(lookup.strokes[0]);
+  }
+  bool MayMatch(StenoStroke firstStroke, size_t minimumLength,
+                size_t maximumLength) const {
+    return (lengthMask & GetLengthBits(minimumLength, maximumLength)) != 0 &&
+           MayMatch(firstStroke);
+  }
+
+  static uint32_t GetLengthBit(size_t length) {
+    return length >= 32 ? 0x80000000 : (uint32_t)1 << (length - 1);
+  }
+
+  // Bits for lengths [minimumLength, maximumLength]. When maximumLength is 32
+  // or more, the shift overflows to 0, and the subtraction still produces
+  // every bit from minimumLength up.
+  static uint32_t GetLengthBits(size_t minimumLength, size_t maximumLength) {
+    if (maximumLength < minimumLength) {
+      return 0;
+    }
+    return (GetLengthBit(maximumLength) << 1) - GetLengthBit(minimumLength);
+  }
+
+  // Matches any strokes, up to maximumLength.
+  static StenoDictionaryLookupFilter CreateAny(size_t maximumLength) {
+    return StenoDictionaryLookupFilter{
+        .strokeMask = 0,
+        .strokeMatch = 0,
+        .lengthMask = GetLengthBits(1, maximumLength),
+    };
+  }
+
+  static StenoDictionaryLookupFilter CreateNone() {
+    return StenoDictionaryLookupFilter{
+        .strokeMask = 0,
+        .strokeMatch = 0,
+        .lengthMask = 0,
+    };
+  }
 };
 
 //---------------------------------------------------------------------------
@@ -132,6 +253,21 @@ public:
     return Lookup(StenoDictionaryLookup(strokes, length));
   }
 
+  // As Lookup(), and also sets provider to the dictionary that supplied the
+  // result, or nullptr if it is invalid.
+  virtual StenoDictionaryLookupResult
+  LookupWithProvider(const StenoDictionaryLookup &lookup,
+                     const StenoDictionary *&provider) const;
+
+  // Returns the longest valid lookup of strokes[0, length), with
+  // minimumLength <= length <= maximumLength, and sets length to match.
+  //
+  // maximumLength must not exceed lookup.count. The default implementation
+  // calls Lookup() for each candidate length, from the longest down.
+  virtual StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+                size_t maximumLength, size_t &length) const;
+
   virtual const StenoDictionary *
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
 
@@ -141,12 +277,20 @@ public:
   }
 
   virtual void ReverseLookup(StenoReverseDictionaryLookup &result) const;
+
+  // On success, lookup.provider is the dictionary that Lookup() would use
+  // for the outline, so callers do not need to validate it again.
   virtual bool
   ReverseMapDictionaryLookup(StenoReverseMapDictionaryLookup &lookup) const;
 
   virtual size_t GetMaximumOutlineLength() const = 0;
   virtual const char *GetName() const = 0;
 
+  // The filter must accept every lookup that can be valid, and must not
+  // change while the dictionary is in use. The default accepts everything
+  // up to GetMaximumOutlineLength().
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const;
+
   virtual void PrintInfo(int depth) const;
   virtual bool PrintDictionary(bool hasData) const = 0;
 
@@ -0,0 +1,2322 @@
+//---------------------------------------------------------------------------
+//
+// Host side dictionary compiler.
+//
+// Compiles Plover JSON dictionaries into map dictionaries, either as C
+// source in the form of main_dictionary.cc, as a flat binary
+// StenoMapDictionaryCollection that is relocated to the address it will be
+// flashed at, or as a relocatable StenoMapDictionaryFile for hosts.
+//
+// This is only compiled on hosts, with RUN_DICTIONARY_COMPILER defined:
+//
+//   g++ -std=c++20 -O2 -DRUN_DICTIONARY_COMPILER=1 -o dictionary_compiler
+//       dictionary/dictionary_compiler.cc stroke.cc crc32.cc -lpthread
+//
+// Usage: dictionary_compiler [options] dictionary.json...
+//
+//   --output=FILE          Required.
+//   --format=FORMAT        c (the default), binary or relocatable. C
+//                          source takes a single dictionary and defines
+//                          MainDictionary.
+//   --layout-version=N     0 (the default, JSC1) to 3.
+//                          See map_dictionary_definition.h.
+//   --name=NAME            C only. Defaults to the dictionary's file name.
+//   --orthography=FILE     C only. Also defines a StenoOrthography from a
+//                          JSON file such as sample-orthography.json.
+//   --orthography-name=ID  Defaults to mainOrthography.
+//   --base-address=N       Binary only. Defaults to 0.
+//   --pointer-size=N       Binary and relocatable only. Defaults to 4 for
+//                          binary, and this host's for relocatable.
+//   --no-reverse-lookup    Binary and relocatable only. Omits the reverse
+//                          lookup index.
+//   --threads=N            Defaults to the number of hardware threads.
+//
+// Tables for each stroke length of each dictionary are built in parallel.
+//
+//---------------------------------------------------------------------------
+
+#if defined(RUN_TESTS) || defined(RUN_DICTIONARY_COMPILER)
+
+//---------------------------------------------------------------------------
+
+#include "../crc32.h"
+#include "../stroke.h"
+#include "../uint24.h"
+#include "map_dictionary_definition.h"
+#include "map_dictionary_file.h"
+#include <algorithm>
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//---------------------------------------------------------------------------
+
+// Only as much JSON as dictionaries and orthographies need. Numbers are kept
+// as their source text.
+struct StenoCompilerJsonValue {
+  enum class Type {
+    NULL_VALUE,
+    BOOLEAN,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT,
+  };
+
+  Type type = Type::NULL_VALUE;
+  bool boolean = false;
+  std::string string;
+
+  // Object keys are in keys, with values at the same index in values.
+  std::vector<std::string> keys;
+  std::vector<StenoCompilerJsonValue> values;
+
+  const StenoCompilerJsonValue *Find(const char *key) const;
+  const char *GetString(const char *key) const;
+};
+
+const StenoCompilerJsonValue *
+StenoCompilerJsonValue::Find(const char *key) const {
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (keys[i] == key) {
+      return &values[i];
+    }
+  }
+  return nullptr;
+}
+
+const char *StenoCompilerJsonValue::GetString(const char *key) const {
+  const StenoCompilerJsonValue *value = Find(key);
+  return value && value->type == Type::STRING ? value->string.c_str()
+                                              : nullptr;
+}
+
+//---------------------------------------------------------------------------
+
+class StenoCompilerJsonParser {
+public:
+  StenoCompilerJsonParser(const char *p, size_t length)
+      : start(p), p(p), end(p + length) {}
+
+  // Returns false, and sets error, if the text is not valid JSON.
+  bool Parse(StenoCompilerJsonValue &value);
+
+  std::string error;
+
+private:
+  const char *start;
+  const char *p;
+  const char *end;
+
+  void SkipWhitespace();
+  bool ParseValue(StenoCompilerJsonValue &value);
+  bool ParseString(std::string &string);
+  bool ParseHex4(uint32_t &value);
+  bool Expect(char c);
+  bool ExpectWord(const char *word);
+  bool Fail(const char *message);
+
+  static void AppendUtf8(std::string &string, uint32_t c);
+};
+
+bool StenoCompilerJsonParser::Parse(StenoCompilerJsonValue &value) {
+  if (!ParseValue(value)) {
+    return false;
+  }
+  SkipWhitespace();
+  return p == end || Fail("Unexpected trailing text");
+}
+
+void StenoCompilerJsonParser::SkipWhitespace() {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+    ++p;
+  }
+}
+
+bool StenoCompilerJsonParser::Fail(const char *message) {
+  size_t line = 1 + std::count(start, p, '\n');
+  error = std::string(message) + " on line " + std::to_string(line);
+  return false;
+}
+
+bool StenoCompilerJsonParser::Expect(char c) {
+  SkipWhitespace();
+  if (p == end || *p != c) {
+    std::string message = "Expected '";
+    message += c;
+    message += "'";
+    return Fail(message.c_str());
+  }
+  ++p;
+  return true;
+}
+
+bool StenoCompilerJsonParser::ExpectWord(const char *word) {
+  size_t length = strlen(word);
+  if (size_t(end - p) < length || memcmp(p, word, length) != 0) {
+    return Fail("Unexpected character");
+  }
+  p += length;
+  return true;
+}
+
+bool StenoCompilerJsonParser::ParseValue(StenoCompilerJsonValue &value) {
+  SkipWhitespace();
+  if (p == end) {
+    return Fail("Unexpected end of file");
+  }
+
+  switch (*p) {
+  case '{':
+    ++p;
+    value.type = StenoCompilerJsonValue::Type::OBJECT;
+    SkipWhitespace();
+    if (p < end && *p == '}') {
+      ++p;
+      return true;
+    }
+    for (;;) {
+      SkipWhitespace();
+      value.keys.emplace_back();
+      value.values.emplace_back();
+      if (!ParseString(value.keys.back()) || !Expect(':') ||
+          !ParseValue(value.values.back())) {
+        return false;
+      }
+      SkipWhitespace();
+      if (p < end && *p == ',') {
+        ++p;
+        continue;
+      }
+      return Expect('}');
+    }
+
+  case '[':
+    ++p;
+    value.type = StenoCompilerJsonValue::Type::ARRAY;
+    SkipWhitespace();
+    if (p < end && *p == ']') {
+      ++p;
+      return true;
+    }
+    for (;;) {
+      value.values.emplace_back();
+      if (!ParseValue(value.values.back())) {
+        return false;
+      }
+      SkipWhitespace();
+      if (p < end && *p == ',') {
+        ++p;
+        continue;
+      }
+      return Expect(']');
+    }
+
+  case '\"':
+    value.type = StenoCompilerJsonValue::Type::STRING;
+    return ParseString(value.string);
+
+  case 't':
+    value.type = StenoCompilerJsonValue::Type::BOOLEAN;
+    value.boolean = true;
+    return ExpectWord("true");
+
+  case 'f':
+    value.type = StenoCompilerJsonValue::Type::BOOLEAN;
+    return ExpectWord("false");
+
+  case 'n':
+    return ExpectWord("null");
+
+  default:
+    if (*p == '-' || ('0' <= *p && *p <= '9')) {
+      value.type = StenoCompilerJsonValue::Type::NUMBER;
+      const char *numberStart = p;
+      while (p < end && strchr("+-.0123456789eE", *p)) {
+        ++p;
+      }
+      value.string.assign(numberStart, p);
+      return true;
+    }
+    return Fail("Unexpected character");
+  }
+}
+
+bool StenoCompilerJsonParser::ParseHex4(uint32_t &value) {
+  if (end - p < 4) {
+    return Fail("Invalid \\u escape");
+  }
+  value = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    char c = *p++;
+    value <<= 4;
+    if ('0' <= c && c <= '9') {
+      value |= c - '0';
+    } else if ('a' <= c && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else if ('A' <= c && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else {
+      return Fail("Invalid \\u escape");
+    }
+  }
+  return true;
+}
+
+void StenoCompilerJsonParser::AppendUtf8(std::string &string, uint32_t c) {
+  if (c < 0x80) {
+    string += (char)c;
+  } else if (c < 0x800) {
+    string += (char)(0xc0 | (c >> 6));
+    string += (char)(0x80 | (c & 0x3f));
+  } else if (c < 0x10000) {
+    string += (char)(0xe0 | (c >> 12));
+    string += (char)(0x80 | ((c >> 6) & 0x3f));
+    string += (char)(0x80 | (c & 0x3f));
+  } else {
+    string += (char)(0xf0 | (c >> 18));
+    string += (char)(0x80 | ((c >> 12) & 0x3f));
+    string += (char)(0x80 | ((c >> 6) & 0x3f));
+    string += (char)(0x80 | (c & 0x3f));
+  }
+}
+
+bool StenoCompilerJsonParser::ParseString(std::string &string) {
+  if (!Expect('\"')) {
+    return false;
+  }
+
+  for (;;) {
+    if (p == end) {
+      return Fail("Unterminated string");
+    }
+
+    char c = *p++;
+    if (c == '\"') {
+      return true;
+    }
+    if (c != '\\') {
+      string += c;
+      continue;
+    }
+
+    if (p == end) {
+      return Fail("Unterminated string");
+    }
+    c = *p++;
+    switch (c) {
+    case 'b':
+      string += '\b';
+      break;
+    case 'f':
+      string += '\f';
+      break;
+    case 'n':
+      string += '\n';
+      break;
+    case 'r':
+      string += '\r';
+      break;
+    case 't':
+      string += '\t';
+      break;
+    case 'u': {
+      uint32_t value;
+      if (!ParseHex4(value)) {
+        return false;
+      }
+      if (0xd800 <= value && value < 0xdc00) {
+        uint32_t low;
+        if (!ExpectWord("\\u") || !ParseHex4(low) || low < 0xdc00 ||
+            low >= 0xe000) {
+          return Fail("Invalid surrogate pair");
+        }
+        value = 0x10000 + ((value - 0xd800) << 10) + (low - 0xdc00);
+      }
+      if (value == 0) {
+        return Fail("Strings cannot contain \\u0000");
+      }
+      AppendUtf8(string, value);
+      break;
+    }
+    default:
+      string += c;
+      break;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+// Writes target structures with forward references, which are resolved by
+// Relocate() once the address of the output is known.
+class StenoCompilerBinaryWriter {
+public:
+  explicit StenoCompilerBinaryWriter(size_t pointerSize)
+      : pointerSize(pointerSize) {}
+
+  std::vector<uint8_t> bytes;
+
+  size_t CreateLabel();
+  void Bind(size_t label) { labels[label] = bytes.size(); }
+  size_t GetOffset(size_t label) const { return labels[label]; }
+
+  void Align(size_t alignment);
+  void AlignPointer() { Align(pointerSize); }
+  void WriteUint8(uint8_t value) { bytes.push_back(value); }
+  void WriteUint16(uint16_t value) { WriteLittleEndian(value, 2); }
+  void WriteUint32(uint32_t value) { WriteLittleEndian(value, 4); }
+  void WriteSize(uint64_t value);
+  void WriteBytes(const void *data, size_t length);
+
+  // A nullptr if label is NO_LABEL.
+  void WritePointer(size_t label);
+
+  void Relocate(uint64_t baseAddress);
+
+  // Returns a StenoMapDictionaryFile with the current bytes as its image.
+  std::vector<uint8_t> CreateRelocatableFile();
+
+  static constexpr size_t NO_LABEL = (size_t)-1;
+
+private:
+  struct Fixup {
+    size_t offset;
+    size_t label;
+  };
+
+  const size_t pointerSize;
+  std::vector<size_t> labels;
+  std::vector<Fixup> fixups;
+
+  void WriteLittleEndian(uint64_t value, size_t size);
+};
+
+size_t StenoCompilerBinaryWriter::CreateLabel() {
+  labels.push_back(NO_LABEL);
+  return labels.size() - 1;
+}
+
+void StenoCompilerBinaryWriter::Align(size_t alignment) {
+  while (bytes.size() % alignment != 0) {
+    bytes.push_back(0);
+  }
+}
+
+void StenoCompilerBinaryWriter::WriteLittleEndian(uint64_t value,
+                                                  size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    bytes.push_back(uint8_t(value >> (8 * i)));
+  }
+}
+
+void StenoCompilerBinaryWriter::WriteSize(uint64_t value) {
+  Align(pointerSize);
+  WriteLittleEndian(value, pointerSize);
+}
+
+void StenoCompilerBinaryWriter::WriteBytes(const void *data, size_t length) {
+  const uint8_t *p = (const uint8_t *)data;
+  bytes.insert(bytes.end(), p, p + length);
+}
+
+void StenoCompilerBinaryWriter::WritePointer(size_t label) {
+  Align(pointerSize);
+  if (label != NO_LABEL) {
+    fixups.push_back({.offset = bytes.size(), .label = label});
+  }
+  WriteLittleEndian(0, pointerSize);
+}
+
+void StenoCompilerBinaryWriter::Relocate(uint64_t baseAddress) {
+  for (const Fixup &fixup : fixups) {
+    uint64_t address = baseAddress + labels[fixup.label];
+    for (size_t i = 0; i < pointerSize; ++i) {
+      bytes[fixup.offset + i] = uint8_t(address >> (8 * i));
+    }
+  }
+}
+
+std::vector<uint8_t> StenoCompilerBinaryWriter::CreateRelocatableFile() {
+  Relocate(0);
+
+  StenoMapDictionaryFileHeader header = {
+      .magic = STENO_MAP_DICTIONARY_FILE_MAGIC,
+      .pointerSize = (uint8_t)pointerSize,
+      ._padding5 = {},
+      .crc32 = 0,
+      .relocationCount = (uint32_t)fixups.size(),
+      .imageSize = bytes.size(),
+  };
+
+  std::vector<uint8_t> file(header.GetFileSize());
+  memcpy(&file[sizeof(header)], bytes.data(), bytes.size());
+  uint8_t *relocations = &file[header.GetRelocationsOffset()];
+  for (const Fixup &fixup : fixups) {
+    uint32_t offset = fixup.offset;
+    memcpy(relocations, &offset, sizeof(offset));
+    relocations += sizeof(offset);
+  }
+
+  header.crc32 = Crc32(&file[sizeof(header)], file.size() - sizeof(header));
+  memcpy(file.data(), &header, sizeof(header));
+  return file;
+}
+
+//---------------------------------------------------------------------------
+
+struct StenoCompilerEntry {
+  std::vector<StenoStroke> strokes;
+  size_t textIndex;
+  uint32_t hash;
+};
+
+// Builds the layout version 3 minimal perfect hash for the entries of one
+// length.
+class StenoCompilerPerfectHash {
+public:
+  // Index into entries of the entry in each slot.
+  std::vector<size_t> slotEntries;
+  std::vector<uint32_t> partitionOffsets;
+  std::vector<uint16_t> pilots;
+
+  // Holds the seed and sizes. The pointers are not set.
+  StenoMapDictionaryPerfectHashStrokes strokes;
+
+  // Returns false if no seed produced a perfect hash.
+  bool Create(const std::vector<StenoCompilerEntry> &entries);
+
+private:
+  static const size_t PARTITION_SIZE = 1024;
+  static const size_t BUCKET_SIZE = 4;
+  static const size_t MAXIMUM_SEED_COUNT = 64;
+
+  bool Create(const std::vector<StenoCompilerEntry> &entries, uint32_t seed);
+};
+
+bool StenoCompilerPerfectHash::Create(
+    const std::vector<StenoCompilerEntry> &entries) {
+  for (uint32_t i = 0; i < MAXIMUM_SEED_COUNT; ++i) {
+    uint32_t seed = StenoMapDictionaryPerfectHashStrokes::Mix(i + 1);
+    if (Create(entries, seed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool StenoCompilerPerfectHash::Create(
+    const std::vector<StenoCompilerEntry> &entries, uint32_t seed) {
+  const size_t entryCount = entries.size();
+
+  std::vector<uint32_t> keyHashes;
+  for (const StenoCompilerEntry &entry : entries) {
+    keyHashes.push_back(StenoMapDictionaryPerfectHashStrokes::GetKeyHash(
+        entry.strokes.data(), entry.strokes.size(), seed));
+  }
+
+  // Keys with the same hash always share a slot.
+  std::vector<uint32_t> sortedKeyHashes = keyHashes;
+  std::sort(sortedKeyHashes.begin(), sortedKeyHashes.end());
+  if (std::adjacent_find(sortedKeyHashes.begin(), sortedKeyHashes.end()) !=
+      sortedKeyHashes.end()) {
+    return false;
+  }
+
+  strokes = {
+      .entryCount = entryCount,
+      .data = nullptr,
+      .seed = seed,
+      .partitionBits = 0,
+      .bucketBits = 0,
+      ._padding10 = 0,
+      .partitionOffsets = nullptr,
+      .pilots = nullptr,
+  };
+  while ((entryCount >> strokes.partitionBits) > PARTITION_SIZE) {
+    ++strokes.partitionBits;
+  }
+  while ((BUCKET_SIZE << strokes.bucketBits) <
+         (entryCount >> strokes.partitionBits)) {
+    ++strokes.bucketBits;
+  }
+
+  const size_t partitionCount = (size_t)1 << strokes.partitionBits;
+  const size_t bucketCount = (size_t)1 << strokes.bucketBits;
+  std::vector<std::vector<size_t>> partitions(partitionCount);
+  for (size_t i = 0; i < entryCount; ++i) {
+    partitions[strokes.GetPartition(keyHashes[i])].push_back(i);
+  }
+
+  partitionOffsets.clear();
+  pilots.assign(partitionCount * bucketCount, 0);
+  slotEntries.assign(entryCount, (size_t)-1);
+  size_t partitionOffset = 0;
+  for (size_t partition = 0; partition < partitionCount; ++partition) {
+    partitionOffsets.push_back(partitionOffset);
+    const size_t partitionSize = partitions[partition].size();
+
+    std::vector<std::vector<size_t>> buckets(bucketCount);
+    for (size_t entryIndex : partitions[partition]) {
+      buckets[strokes.GetBucket(keyHashes[entryIndex])].push_back(entryIndex);
+    }
+
+    // Place the largest buckets first, while the partition is emptiest.
+    std::vector<size_t> bucketOrder;
+    for (size_t i = 0; i < bucketCount; ++i) {
+      bucketOrder.push_back(i);
+    }
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(),
+                     [&](size_t a, size_t b) {
+                       return buckets[a].size() > buckets[b].size();
+                     });
+
+    std::vector<size_t> bucketSlots;
+    for (size_t bucket : bucketOrder) {
+      if (buckets[bucket].empty()) {
+        break;
+      }
+
+      uint32_t pilot = 0;
+      for (; pilot <= 0xffff; ++pilot) {
+        bucketSlots.clear();
+        for (size_t entryIndex : buckets[bucket]) {
+          size_t slot = partitionOffset +
+                        StenoMapDictionaryPerfectHashStrokes::GetPilotSlot(
+                            keyHashes[entryIndex], pilot, partitionSize);
+          if (slotEntries[slot] != (size_t)-1 ||
+              std::find(bucketSlots.begin(), bucketSlots.end(), slot) !=
+                  bucketSlots.end()) {
+            break;
+          }
+          bucketSlots.push_back(slot);
+        }
+        if (bucketSlots.size() == buckets[bucket].size()) {
+          break;
+        }
+      }
+      if (pilot > 0xffff) {
+        return false;
+      }
+
+      pilots[(partition << strokes.bucketBits) + bucket] = pilot;
+      for (size_t i = 0; i < bucketSlots.size(); ++i) {
+        slotEntries[bucketSlots[i]] = buckets[bucket][i];
+      }
+    }
+    partitionOffset += partitionSize;
+  }
+  partitionOffsets.push_back(partitionOffset);
+
+  return true;
+}
+
+// The compiled hash map for one stroke length of one dictionary.
+struct StenoCompilerStrokesTable {
+  size_t length;
+  std::vector<StenoCompilerEntry> entries;
+
+  size_t hashMapSize = 0;
+  std::vector<uint8_t> data;
+  std::vector<StenoHashMapEntryBlock> blocks;
+  std::vector<StenoHashMapCountedEntryBlock> countedBlocks;
+
+  // Index into entries of each data entry.
+  std::vector<size_t> dataEntries;
+
+  // Layout version 1.
+  std::vector<uint8_t> fingerprints;
+  size_t prefixFilterSize = 0;
+  std::vector<uint32_t> prefixFilter;
+
+  // Layout version 3, which has data in slot order instead of hash map
+  // order, and no hash map or fingerprints.
+  StenoCompilerPerfectHash perfectHash;
+
+  // Returns false if a perfect hash could not be built.
+  bool Build(const std::vector<uint32_t> &textOffsets,
+             const std::vector<uint32_t> &longerPrefixHashes,
+             bool isPerfectHash);
+
+private:
+  void AddDataEntry(size_t index, const std::vector<uint32_t> &textOffsets);
+  void BuildHashMap(const std::vector<uint32_t> &textOffsets);
+};
+
+bool StenoCompilerStrokesTable::Build(
+    const std::vector<uint32_t> &textOffsets,
+    const std::vector<uint32_t> &longerPrefixHashes, bool isPerfectHash) {
+  // Sort so that the output does not depend on the input order.
+  std::sort(entries.begin(), entries.end(),
+            [](const StenoCompilerEntry &a, const StenoCompilerEntry &b) {
+              return memcmp(a.strokes.data(), b.strokes.data(),
+                            a.strokes.size() * sizeof(StenoStroke)) < 0;
+            });
+
+  if (isPerfectHash) {
+    if (!perfectHash.Create(entries)) {
+      return false;
+    }
+    for (size_t index : perfectHash.slotEntries) {
+      AddDataEntry(index, textOffsets);
+    }
+  } else {
+    BuildHashMap(textOffsets);
+  }
+
+  // Lengths without outlines are not written, so do not have a filter.
+  if (!entries.empty() && !longerPrefixHashes.empty()) {
+    prefixFilterSize = 32;
+    while (prefixFilterSize < longerPrefixHashes.size() * 8) {
+      prefixFilterSize *= 2;
+    }
+    prefixFilter.resize(prefixFilterSize / 32);
+    for (uint32_t hash : longerPrefixHashes) {
+      size_t index = hash & (prefixFilterSize - 1);
+      prefixFilter[index / 32] |= 1u << (index % 32);
+    }
+  }
+  return true;
+}
+
+void StenoCompilerStrokesTable::AddDataEntry(
+    size_t index, const std::vector<uint32_t> &textOffsets) {
+  dataEntries.push_back(index);
+
+  const StenoCompilerEntry &entry = entries[index];
+  Uint24 textOffset = Uint24::Create(textOffsets[entry.textIndex]);
+  data.insert(data.end(), textOffset.b, textOffset.b + 3);
+  for (StenoStroke stroke : entry.strokes) {
+    Uint24 keyState = Uint24::Create(stroke.GetKeyState());
+    data.insert(data.end(), keyState.b, keyState.b + 3);
+  }
+}
+
+void StenoCompilerStrokesTable::BuildHashMap(
+    const std::vector<uint32_t> &textOffsets) {
+  hashMapSize = 128;
+  while (hashMapSize < entries.size() * 3 / 2) {
+    hashMapSize *= 2;
+  }
+
+  std::vector<size_t> slots(hashMapSize, (size_t)-1);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    StenoCompilerEntry &entry = entries[i];
+    entry.hash = StenoStroke::Hash(entry.strokes.data(), length);
+    size_t slot = entry.hash & (hashMapSize - 1);
+    while (slots[slot] != (size_t)-1) {
+      slot = (slot + 1) & (hashMapSize - 1);
+    }
+    slots[slot] = i;
+  }
+
+  blocks.resize(hashMapSize / 128);
+  for (size_t slot = 0; slot < hashMapSize; ++slot) {
+    StenoHashMapEntryBlock &block = blocks[slot / 128];
+    if (slot % 128 == 0) {
+      block.baseOffset = dataEntries.size();
+    }
+
+    size_t index = slots[slot];
+    if (index == (size_t)-1) {
+      continue;
+    }
+    block.masks[slot % 128 / 32] |= 1u << (slot % 32);
+    AddDataEntry(index, textOffsets);
+    fingerprints.push_back(StenoMapDictionaryStrokesExtension::GetFingerprint(
+        entries[index].hash));
+  }
+
+  for (const StenoHashMapEntryBlock &block : blocks) {
+    StenoHashMapCountedEntryBlock countedBlock;
+    (StenoHashMapEntryBlock &)countedBlock = block;
+    size_t maskOffset = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      countedBlock.maskOffsets[i] = maskOffset;
+      maskOffset += Bit<sizeof(uint32_t)>::PopCount(block.masks[i]);
+    }
+    countedBlocks.push_back(countedBlock);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+struct StenoCompilerDictionary {
+  std::string name;
+  std::vector<StenoCompilerStrokesTable> tables;
+
+  size_t GetMaximumStrokeCount() const { return tables.size(); }
+};
+
+class StenoDictionaryCompiler {
+public:
+  uint8_t layoutVersion = 0;
+  bool hasReverseLookup = true;
+  size_t threadCount = 1;
+
+  // Returns false, and sets error, if json is not a valid dictionary.
+  bool AddDictionary(const char *name, const char *json, size_t length);
+  bool SetOrthography(const char *json, size_t length);
+
+  // Returns false, and sets error, if a table could not be built.
+  bool Build();
+
+  void WriteBinary(StenoCompilerBinaryWriter &writer) const;
+  std::string WriteCSource(const char *sourceName,
+                           const char *orthographyName) const;
+
+  const std::vector<StenoCompilerDictionary> &GetDictionaries() const {
+    return dictionaries;
+  }
+
+  std::string error;
+  std::vector<std::string> warnings;
+
+private:
+  std::vector<StenoCompilerDictionary> dictionaries;
+  StenoCompilerJsonValue orthography;
+
+  std::vector<std::string> texts;
+  std::unordered_map<std::string, size_t> textIndexes;
+
+  // Valid after Build().
+  std::vector<uint8_t> textBlock;
+  std::vector<uint32_t> textOffsets;
+
+  size_t AddText(const std::string &text);
+  void BuildTextBlock();
+  bool BuildTables();
+  void WriteReverseLookupOffsets(StenoCompilerBinaryWriter &writer,
+                                 size_t textBlockLabel,
+                                 const std::vector<size_t> &dataLabels) const;
+  void WriteCOrthography(std::string &s, const char *name) const;
+
+  static bool ParseOutline(const std::string &outline,
+                           std::vector<StenoStroke> &strokes);
+  static std::string ToCString(const std::string &text);
+};
+
+//---------------------------------------------------------------------------
+
+size_t StenoDictionaryCompiler::AddText(const std::string &text) {
+  auto it = textIndexes.find(text);
+  if (it != textIndexes.end()) {
+    return it->second;
+  }
+  textIndexes[text] = texts.size();
+  texts.push_back(text);
+  return texts.size() - 1;
+}
+
+bool StenoDictionaryCompiler::ParseOutline(const std::string &outline,
+                                           std::vector<StenoStroke> &strokes) {
+  size_t start = 0;
+  for (;;) {
+    size_t strokeEnd = outline.find('/', start);
+    std::string strokeText = outline.substr(start, strokeEnd - start);
+    StenoStroke stroke;
+    stroke.Set(strokeText.c_str());
+    if (stroke.IsEmpty()) {
+      return false;
+    }
+    strokes.push_back(stroke);
+
+    if (strokeEnd == std::string::npos) {
+      return true;
+    }
+    start = strokeEnd + 1;
+  }
+}
+
+bool StenoDictionaryCompiler::AddDictionary(const char *name,
+                                            const char *json, size_t length) {
+  StenoCompilerJsonValue root;
+  StenoCompilerJsonParser parser(json, length);
+  if (!parser.Parse(root)) {
+    error = std::string(name) + ": " + parser.error;
+    return false;
+  }
+  if (root.type != StenoCompilerJsonValue::Type::OBJECT) {
+    error = std::string(name) + ": Expected an object";
+    return false;
+  }
+
+  StenoCompilerDictionary &dictionary = dictionaries.emplace_back();
+  dictionary.name = name;
+
+  // Later definitions of an outline replace earlier ones.
+  std::unordered_map<std::string, size_t> outlines;
+  for (size_t i = 0; i < root.keys.size(); ++i) {
+    const std::string &outline = root.keys[i];
+    const StenoCompilerJsonValue &value = root.values[i];
+    if (value.type != StenoCompilerJsonValue::Type::STRING) {
+      warnings.push_back(std::string(name) +
+                         ": Skipping non-string value for " + outline);
+      continue;
+    }
+
+    StenoCompilerEntry entry;
+    if (!ParseOutline(outline, entry.strokes)) {
+      warnings.push_back(std::string(name) + ": Skipping invalid outline " +
+                         outline);
+      continue;
+    }
+    entry.textIndex = AddText(value.string);
+
+    size_t length = entry.strokes.size();
+    if (dictionary.tables.size() < length) {
+      size_t previousSize = dictionary.tables.size();
+      dictionary.tables.resize(length);
+      for (size_t j = previousSize; j < length; ++j) {
+        dictionary.tables[j].length = j + 1;
+      }
+    }
+
+    std::string key((const char *)entry.strokes.data(),
+                    length * sizeof(StenoStroke));
+    auto it = outlines.find(key);
+    std::vector<StenoCompilerEntry> &entries =
+        dictionary.tables[length - 1].entries;
+    if (it != outlines.end()) {
+      entries[it->second] = std::move(entry);
+    } else {
+      outlines[key] = entries.size();
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  if (dictionary.tables.empty()) {
+    error = std::string(name) + ": No valid outlines";
+    dictionaries.pop_back();
+    return false;
+  }
+  return true;
+}
+
+bool StenoDictionaryCompiler::SetOrthography(const char *json,
+                                             size_t length) {
+  StenoCompilerJsonParser parser(json, length);
+  if (!parser.Parse(orthography)) {
+    error = "Orthography: " + parser.error;
+    return false;
+  }
+  if (orthography.type != StenoCompilerJsonValue::Type::OBJECT) {
+    error = "Orthography: Expected an object";
+    return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+bool StenoDictionaryCompiler::Build() {
+  BuildTextBlock();
+  return BuildTables();
+}
+
+// Texts are sorted, which the reverse lookup index requires.
+//
+// Without a reverse lookup index, the text block is a 0 followed by each
+// nul terminated text.
+//
+// With the index, it is a 0xff followed by each nul terminated text, then
+// the 28-bit offsets of every entry with that text, 7 bits per byte,
+// then a 0xff.
+void StenoDictionaryCompiler::BuildTextBlock() {
+  std::vector<size_t> referenceCounts(texts.size());
+  for (const StenoCompilerDictionary &dictionary : dictionaries) {
+    for (const StenoCompilerStrokesTable &table : dictionary.tables) {
+      for (const StenoCompilerEntry &entry : table.entries) {
+        ++referenceCounts[entry.textIndex];
+      }
+    }
+  }
+
+  std::vector<size_t> order(texts.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return texts[a] < texts[b]; });
+
+  textBlock.clear();
+  textBlock.push_back(hasReverseLookup ? 0xff : 0);
+  textOffsets.resize(texts.size());
+  for (size_t textIndex : order) {
+    // Replaced entries leave unreferenced texts behind.
+    if (referenceCounts[textIndex] == 0) {
+      continue;
+    }
+
+    const std::string &text = texts[textIndex];
+    textOffsets[textIndex] = textBlock.size();
+    textBlock.insert(textBlock.end(), text.begin(), text.end());
+    textBlock.push_back(0);
+    if (hasReverseLookup) {
+      textBlock.insert(textBlock.end(), 4 * referenceCounts[textIndex], 0);
+      textBlock.push_back(0xff);
+    }
+  }
+}
+
+bool StenoDictionaryCompiler::BuildTables() {
+  struct Task {
+    StenoCompilerStrokesTable *table;
+    std::vector<uint32_t> longerPrefixHashes;
+  };
+
+  std::vector<Task> tasks;
+  for (StenoCompilerDictionary &dictionary : dictionaries) {
+    for (StenoCompilerStrokesTable &table : dictionary.tables) {
+      Task &task = tasks.emplace_back();
+      task.table = &table;
+    }
+
+    if (layoutVersion < 1) {
+      continue;
+    }
+    for (size_t i = 0; i < dictionary.tables.size(); ++i) {
+      std::vector<uint32_t> &hashes =
+          tasks[tasks.size() - dictionary.tables.size() + i]
+              .longerPrefixHashes;
+      for (size_t j = i + 1; j < dictionary.tables.size(); ++j) {
+        for (const StenoCompilerEntry &entry : dictionary.tables[j].entries) {
+          hashes.push_back(StenoStroke::Hash(entry.strokes.data(), i + 1));
+        }
+      }
+      std::sort(hashes.begin(), hashes.end());
+      hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    }
+  }
+
+  // Longest tables first, so that the slowest task does not start last.
+  std::sort(tasks.begin(), tasks.end(), [](const Task &a, const Task &b) {
+    return a.table->entries.size() > b.table->entries.size();
+  });
+
+  std::atomic<size_t> nextTask(0);
+  std::atomic<bool> hasFailed(false);
+  auto worker = [&]() {
+    for (;;) {
+      size_t i = nextTask++;
+      if (i >= tasks.size()) {
+        return;
+      }
+      if (!tasks[i].table->Build(textOffsets, tasks[i].longerPrefixHashes,
+                                 layoutVersion == 3)) {
+        hasFailed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  size_t workerCount = std::min(std::max(threadCount, (size_t)1), tasks.size());
+  for (size_t i = 1; i < workerCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  if (hasFailed) {
+    error = "Unable to build a perfect hash";
+    return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+// Layout, which is the order that ReverseMapDictionaryLookup and PrintInfo
+// expect:
+//
+//  StenoMapDictionaryCollection
+//  Text block
+//  For each dictionary:
+//    StenoMapDictionaryDefinition, name
+//    StenoMapDictionaryStrokesDefinition[], or
+//        StenoMapDictionaryPerfectHashStrokes[] (version 3)
+//    StenoMapDictionaryStrokesExtension[] (version >= 1)
+//    For each length: data, blocks, fingerprints and prefix filter, or
+//        data, prefix filter, partition offsets and pilots (version 3)
+void StenoDictionaryCompiler::WriteBinary(
+    StenoCompilerBinaryWriter &writer) const {
+  const size_t textBlockLabel = writer.CreateLabel();
+  std::vector<size_t> definitionLabels;
+  for (size_t i = 0; i < dictionaries.size(); ++i) {
+    definitionLabels.push_back(writer.CreateLabel());
+  }
+
+  writer.WriteUint32(GetStenoMapDictionaryCollectionMagic(layoutVersion));
+  writer.WriteUint16(dictionaries.size());
+  writer.WriteUint8(hasReverseLookup);
+  writer.WriteUint8(0);
+  writer.WritePointer(textBlockLabel);
+  writer.WriteSize(textBlock.size());
+  for (size_t label : definitionLabels) {
+    writer.WritePointer(label);
+  }
+
+  writer.Bind(textBlockLabel);
+  writer.WriteBytes(textBlock.data(), textBlock.size());
+
+  // Data labels of each entry, in the same order as the reverse index.
+  std::vector<size_t> dataLabels;
+
+  for (size_t i = 0; i < dictionaries.size(); ++i) {
+    const StenoCompilerDictionary &dictionary = dictionaries[i];
+    const size_t nameLabel = writer.CreateLabel();
+    const size_t strokesLabel = writer.CreateLabel();
+    const size_t extensionsLabel = writer.CreateLabel();
+
+    struct TableLabels {
+      size_t data;
+      size_t offsets;
+      size_t fingerprints;
+      size_t prefixFilter;
+      size_t partitionOffsets;
+      size_t pilots;
+    };
+    std::vector<TableLabels> tableLabels;
+    for (size_t j = 0; j < dictionary.tables.size(); ++j) {
+      tableLabels.push_back({
+          .data = writer.CreateLabel(),
+          .offsets = writer.CreateLabel(),
+          .fingerprints = writer.CreateLabel(),
+          .prefixFilter = writer.CreateLabel(),
+          .partitionOffsets = writer.CreateLabel(),
+          .pilots = writer.CreateLabel(),
+      });
+    }
+
+    writer.AlignPointer();
+    writer.Bind(definitionLabels[i]);
+    writer.WriteUint8(1);
+    writer.WriteUint8(dictionary.GetMaximumStrokeCount());
+    writer.WriteUint8(layoutVersion);
+    writer.WriteUint8(0);
+    writer.WritePointer(nameLabel);
+    writer.WritePointer(textBlockLabel);
+    writer.WritePointer(strokesLabel);
+    if (layoutVersion >= 1) {
+      writer.WritePointer(extensionsLabel);
+    }
+
+    writer.Bind(nameLabel);
+    writer.WriteBytes(dictionary.name.c_str(), dictionary.name.size() + 1);
+
+    writer.AlignPointer();
+    writer.Bind(strokesLabel);
+    for (size_t j = 0; j < dictionary.tables.size(); ++j) {
+      const StenoCompilerStrokesTable &table = dictionary.tables[j];
+      bool isEmpty = table.entries.empty();
+      if (layoutVersion == 3) {
+        const StenoMapDictionaryPerfectHashStrokes &strokes =
+            table.perfectHash.strokes;
+        writer.WriteSize(strokes.entryCount);
+        writer.WritePointer(isEmpty ? writer.NO_LABEL : tableLabels[j].data);
+        writer.WriteUint32(strokes.seed);
+        writer.WriteUint8(strokes.partitionBits);
+        writer.WriteUint8(strokes.bucketBits);
+        writer.WriteUint16(0);
+        writer.WritePointer(isEmpty ? writer.NO_LABEL
+                                    : tableLabels[j].partitionOffsets);
+        writer.WritePointer(isEmpty ? writer.NO_LABEL : tableLabels[j].pilots);
+        continue;
+      }
+      writer.WriteSize(isEmpty ? 0 : table.hashMapSize);
+      writer.WritePointer(isEmpty ? writer.NO_LABEL : tableLabels[j].data);
+      writer.WritePointer(isEmpty ? writer.NO_LABEL : tableLabels[j].offsets);
+    }
+
+    if (layoutVersion >= 1) {
+      writer.Bind(extensionsLabel);
+      for (size_t j = 0; j < dictionary.tables.size(); ++j) {
+        const StenoCompilerStrokesTable &table = dictionary.tables[j];
+        bool hasFingerprints = !table.entries.empty() && layoutVersion != 3;
+        writer.WritePointer(hasFingerprints ? tableLabels[j].fingerprints
+                                            : writer.NO_LABEL);
+        writer.WriteSize(table.prefixFilterSize);
+        writer.WritePointer(table.prefixFilterSize == 0
+                                ? writer.NO_LABEL
+                                : tableLabels[j].prefixFilter);
+      }
+    }
+
+    for (size_t j = 0; j < dictionary.tables.size(); ++j) {
+      const StenoCompilerStrokesTable &table = dictionary.tables[j];
+      if (table.entries.empty()) {
+        continue;
+      }
+
+      writer.Bind(tableLabels[j].data);
+      const size_t entrySize = 3 + 3 * table.length;
+      for (size_t k = 0; k < table.dataEntries.size(); ++k) {
+        size_t label = writer.CreateLabel();
+        writer.Bind(label);
+        dataLabels.push_back(label);
+        writer.WriteBytes(&table.data[k * entrySize], entrySize);
+      }
+
+      if (layoutVersion == 3) {
+        writer.Align(4);
+        writer.Bind(tableLabels[j].prefixFilter);
+        for (uint32_t bits : table.prefixFilter) {
+          writer.WriteUint32(bits);
+        }
+
+        // Pilots are last, which PrintInfo() expects.
+        writer.Bind(tableLabels[j].partitionOffsets);
+        for (uint32_t offset : table.perfectHash.partitionOffsets) {
+          writer.WriteUint32(offset);
+        }
+        writer.Bind(tableLabels[j].pilots);
+        for (uint16_t pilot : table.perfectHash.pilots) {
+          writer.WriteUint16(pilot);
+        }
+        continue;
+      }
+
+      writer.Align(4);
+      writer.Bind(tableLabels[j].offsets);
+      if (layoutVersion == 2) {
+        for (const StenoHashMapCountedEntryBlock &block : table.countedBlocks) {
+          for (uint32_t mask : block.masks) {
+            writer.WriteUint32(mask);
+          }
+          writer.WriteUint32(block.baseOffset);
+          writer.WriteBytes(block.maskOffsets, 4);
+        }
+      } else {
+        for (const StenoHashMapEntryBlock &block : table.blocks) {
+          for (uint32_t mask : block.masks) {
+            writer.WriteUint32(mask);
+          }
+          writer.WriteUint32(block.baseOffset);
+        }
+      }
+
+      if (layoutVersion >= 1) {
+        writer.Bind(tableLabels[j].fingerprints);
+        writer.WriteBytes(table.fingerprints.data(), table.fingerprints.size());
+        writer.Align(4);
+        writer.Bind(tableLabels[j].prefixFilter);
+        for (uint32_t bits : table.prefixFilter) {
+          writer.WriteUint32(bits);
+        }
+      }
+    }
+  }
+
+  if (hasReverseLookup) {
+    WriteReverseLookupOffsets(writer, textBlockLabel, dataLabels);
+  }
+}
+
+void StenoDictionaryCompiler::WriteReverseLookupOffsets(
+    StenoCompilerBinaryWriter &writer, size_t textBlockLabel,
+    const std::vector<size_t> &dataLabels) const {
+  // Next free offset slot in the text block for each text.
+  std::vector<size_t> textPositions(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    textPositions[i] = writer.GetOffset(textBlockLabel) + textOffsets[i] +
+                       texts[i].size() + 1;
+  }
+
+  size_t dataIndex = 0;
+  for (const StenoCompilerDictionary &dictionary : dictionaries) {
+    for (const StenoCompilerStrokesTable &table : dictionary.tables) {
+      for (size_t entryIndex : table.dataEntries) {
+        const StenoCompilerEntry &entry = table.entries[entryIndex];
+        uint32_t offset = writer.GetOffset(dataLabels[dataIndex++]);
+        uint8_t *p = &writer.bytes[textPositions[entry.textIndex]];
+        textPositions[entry.textIndex] += 4;
+        for (size_t i = 0; i < 4; ++i) {
+          p[i] = (offset >> (7 * i)) & 0x7f;
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+std::string StenoDictionaryCompiler::ToCString(const std::string &text) {
+  std::string result = "\"";
+  for (char c : text) {
+    switch (c) {
+    case '\"':
+      result += "\\\"";
+      break;
+    case '\\':
+      result += "\\\\";
+      break;
+    case '\n':
+      result += "\\n";
+      break;
+    case '\t':
+      result += "\\t";
+      break;
+    default:
+      if ((uint8_t)c < 0x20 || c == '?') {
+        // Octal, since hex escapes would consume following digits.
+        char buffer[8];
+        snprintf(buffer, sizeof(buffer), "\\%03o", (uint8_t)c);
+        result += buffer;
+      } else {
+        result += c;
+      }
+      break;
+    }
+  }
+  result += "\"";
+  return result;
+}
+
+static void AppendCBytes(std::string &s, const uint8_t *data, size_t length) {
+  char buffer[16];
+  for (size_t i = 0; i < length; ++i) {
+    if (i % 16 == 0) {
+      s += "  ";
+    }
+    snprintf(buffer, sizeof(buffer), "0x%02x,", data[i]);
+    s += buffer;
+    s += (i % 16 == 15 || i + 1 == length) ? "\n" : " ";
+  }
+}
+
+static void AppendCFormat(std::string &s, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void AppendCFormat(std::string &s, const char *format, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  s += buffer;
+}
+
+// Mirrors main_dictionary.cc.
+std::string
+StenoDictionaryCompiler::WriteCSource(const char *sourceName,
+                                      const char *orthographyName) const {
+  const StenoCompilerDictionary &dictionary = dictionaries[0];
+
+  std::string s = "// *** Autogenerated file ***\n\n";
+  s += "// This is build using the following dictionaries\n";
+  AppendCFormat(s, "// * %s\n\n", sourceName);
+  s += "#include \"main_dictionary.h\"\n";
+  s += "#include \"map_dictionary_definition.h\"\n";
+  if (orthographyName) {
+    s += "#include \"../orthography.h\"\n";
+  }
+  s += "\n";
+
+  AppendCFormat(s, "const uint8_t textBlock[%zu] = {\n", textBlock.size());
+  AppendCBytes(s, textBlock.data(), textBlock.size());
+  s += "};\n";
+
+  for (const StenoCompilerStrokesTable &table : dictionary.tables) {
+    if (table.entries.empty()) {
+      continue;
+    }
+    size_t n = table.length;
+    if (layoutVersion != 3) {
+      AppendCFormat(s, "const size_t hashMapSize%zu = %zu;\n", n,
+                    table.hashMapSize);
+    }
+    AppendCFormat(s, "const uint8_t data%zu[%zu] = {\n", n, table.data.size());
+    AppendCBytes(s, table.data.data(), table.data.size());
+    s += "};\n";
+
+    if (layoutVersion == 3) {
+      AppendCFormat(s, "const uint32_t partitionOffsets%zu[] = {\n", n);
+      for (uint32_t offset : table.perfectHash.partitionOffsets) {
+        AppendCFormat(s, "  %u,\n", offset);
+      }
+      s += "};\n";
+      AppendCFormat(s, "const uint16_t pilots%zu[] = {\n", n);
+      for (uint16_t pilot : table.perfectHash.pilots) {
+        AppendCFormat(s, "  %u,\n", pilot);
+      }
+    } else if (layoutVersion == 2) {
+      AppendCFormat(s, "const StenoHashMapCountedEntryBlock offsets%zu[] = {\n",
+                    n);
+      for (const StenoHashMapCountedEntryBlock &block : table.countedBlocks) {
+        AppendCFormat(s,
+                      "  { { 0x%08x, 0x%08x, 0x%08x, 0x%08x, %u }, "
+                      "{ %u, %u, %u, %u } },\n",
+                      block.masks[0], block.masks[1], block.masks[2],
+                      block.masks[3], block.baseOffset, block.maskOffsets[0],
+                      block.maskOffsets[1], block.maskOffsets[2],
+                      block.maskOffsets[3]);
+      }
+    } else {
+      AppendCFormat(s, "const StenoHashMapEntryBlock offsets%zu[] = {\n", n);
+      for (const StenoHashMapEntryBlock &block : table.blocks) {
+        AppendCFormat(s, "  { 0x%08x, 0x%08x, 0x%08x, 0x%08x, %u },\n",
+                      block.masks[0], block.masks[1], block.masks[2],
+                      block.masks[3], block.baseOffset);
+      }
+    }
+    s += "};\n";
+
+    if (layoutVersion == 1 || layoutVersion == 2) {
+      AppendCFormat(s, "const uint8_t fingerprints%zu[%zu] = {\n", n,
+                    table.fingerprints.size());
+      AppendCBytes(s, table.fingerprints.data(), table.fingerprints.size());
+      s += "};\n";
+    }
+    if (layoutVersion >= 1) {
+      if (table.prefixFilterSize != 0) {
+        AppendCFormat(s, "const size_t prefixFilterSize%zu = %zu;\n", n,
+                      table.prefixFilterSize);
+        AppendCFormat(s, "const uint32_t prefixFilter%zu[] = {\n", n);
+        for (uint32_t bits : table.prefixFilter) {
+          AppendCFormat(s, "  0x%08x,\n", bits);
+        }
+        s += "};\n";
+      }
+    }
+    s += "\n";
+  }
+
+  if (layoutVersion == 3) {
+    s += "\nconst StenoMapDictionaryPerfectHashStrokes strokes[] = {\n";
+  } else {
+    s += "\nconst StenoMapDictionaryStrokesDefinition strokes[] = {\n";
+  }
+  for (const StenoCompilerStrokesTable &table : dictionary.tables) {
+    size_t n = table.length;
+    if (layoutVersion == 3) {
+      if (table.entries.empty()) {
+        s += "  {.entryCount = 0},\n";
+        continue;
+      }
+      const StenoMapDictionaryPerfectHashStrokes &strokes =
+          table.perfectHash.strokes;
+      AppendCFormat(s,
+                    "  {.entryCount = %zu, .data = data%zu, .seed = 0x%08x, "
+                    ".partitionBits = %u, .bucketBits = %u, ._padding10 = 0, "
+                    ".partitionOffsets = partitionOffsets%zu, .pilots = "
+                    "pilots%zu},\n",
+                    strokes.entryCount, n, strokes.seed, strokes.partitionBits,
+                    strokes.bucketBits, n, n);
+    } else if (table.entries.empty()) {
+      s += "  {.hashMapSize = 0},\n";
+    } else {
+      AppendCFormat(s,
+                    "  {.hashMapSize = hashMapSize%zu, .data = data%zu, "
+                    ".offsets = offsets%zu},\n",
+                    n, n, n);
+    }
+  }
+  s += "};\n\n";
+
+  if (layoutVersion >= 1) {
+    s += "const StenoMapDictionaryStrokesExtension extensions[] = {\n";
+    for (const StenoCompilerStrokesTable &table : dictionary.tables) {
+      size_t n = table.length;
+      std::string fingerprints = layoutVersion == 3
+                                     ? std::string("nullptr")
+                                     : "fingerprints" + std::to_string(n);
+      if (table.entries.empty()) {
+        s += "  {},\n";
+      } else if (table.prefixFilterSize != 0) {
+        AppendCFormat(s,
+                      "  {.fingerprints = %s, .prefixFilterSize "
+                      "= prefixFilterSize%zu, .prefixFilter = "
+                      "prefixFilter%zu},\n",
+                      fingerprints.c_str(), n, n);
+      } else {
+        AppendCFormat(s,
+                      "  {.fingerprints = %s, .prefixFilterSize = 0, "
+                      ".prefixFilter = nullptr},\n",
+                      fingerprints.c_str());
+      }
+    }
+    s += "};\n\n";
+  }
+
+  s += "constexpr StenoMapDictionaryDefinition MainDictionary::definition = "
+       "{\n";
+  s += "  true,\n";
+  AppendCFormat(s, "  %zu,\n", dictionary.GetMaximumStrokeCount());
+  AppendCFormat(s, "  %u,\n", layoutVersion);
+  s += "  0,\n";
+  AppendCFormat(s, "  %s,\n", ToCString(dictionary.name).c_str());
+  s += "  textBlock,\n";
+  if (layoutVersion == 3) {
+    s += "  {.perfectHashStrokes = strokes},\n";
+  } else {
+    s += "  strokes,\n";
+  }
+  if (layoutVersion >= 1) {
+    s += "  extensions,\n";
+  } else {
+    s += "  nullptr,\n";
+  }
+  s += "};\n";
+
+  if (orthographyName) {
+    s += "\n";
+    WriteCOrthography(s, orthographyName);
+  }
+  return s;
+}
+
+//---------------------------------------------------------------------------
+
+void StenoDictionaryCompiler::WriteCOrthography(std::string &s,
+                                                const char *name) const {
+  static const StenoCompilerJsonValue EMPTY_ARRAY = {
+      .type = StenoCompilerJsonValue::Type::ARRAY,
+      .boolean = false,
+      .string = {},
+      .keys = {},
+      .values = {},
+  };
+  auto getArray = [&](const char *key) -> const StenoCompilerJsonValue & {
+    const StenoCompilerJsonValue *value = orthography.Find(key);
+    return value && value->type == StenoCompilerJsonValue::Type::ARRAY
+               ? *value
+               : EMPTY_ARRAY;
+  };
+  auto getString = [](const StenoCompilerJsonValue &value, const char *key) {
+    const char *text = value.GetString(key);
+    return ToCString(text ? text : "");
+  };
+  auto getStroke = [](const StenoCompilerJsonValue &value, const char *key) {
+    StenoStroke stroke;
+    const char *text = value.GetString(key);
+    if (text) {
+      stroke.Set(text);
+    }
+    return stroke;
+  };
+
+  const StenoCompilerJsonValue &rules = getArray("rules");
+  const StenoCompilerJsonValue &aliases = getArray("aliases");
+  const StenoCompilerJsonValue &autoSuffixes = getArray("auto-suffix");
+  const StenoCompilerJsonValue &reverseAutoSuffixes =
+      getArray("reverse-auto-suffix");
+
+  // Empty arrays are omitted, and referenced as nullptr.
+  auto appendArray = [&](const char *declaration, const char *suffix,
+                         const std::string &body) {
+    if (body.empty()) {
+      return std::string("nullptr");
+    }
+    AppendCFormat(s, "static %s %s%s[] = {\n", declaration, name, suffix);
+    s += body;
+    s += "};\n\n";
+    return std::string(name) + suffix;
+  };
+
+  std::string body;
+  for (const StenoCompilerJsonValue &rule : rules.values) {
+    AppendCFormat(body, "  {.testPattern = %s, .replacement = %s},\n",
+                  getString(rule, "pattern").c_str(),
+                  getString(rule, "replacement").c_str());
+  }
+  std::string rulesName =
+      appendArray("const StenoOrthographyRule", "Rules", body);
+
+  body.clear();
+  for (const StenoCompilerJsonValue &alias : aliases.values) {
+    AppendCFormat(body, "  {.text = %s, .alias = %s},\n",
+                  getString(alias, "suffix").c_str(),
+                  getString(alias, "alias").c_str());
+  }
+  std::string aliasesName =
+      appendArray("const StenoOrthographyAlias", "Aliases", body);
+
+  // Auto-suffix text is joined directly to the looked up text, so has a
+  // leading space.
+  StenoStroke autoSuffixMask;
+  std::vector<StenoStroke> autoSuffixStrokes;
+  body.clear();
+  for (const StenoCompilerJsonValue &autoSuffix : autoSuffixes.values) {
+    StenoStroke stroke = getStroke(autoSuffix, "key");
+    const char *suffix = autoSuffix.GetString("suffix");
+    autoSuffixMask |= stroke;
+    autoSuffixStrokes.push_back(stroke);
+    AppendCFormat(body, "  {.stroke = StenoStroke(0x%06x), .text = %s},\n",
+                  stroke.GetKeyState(),
+                  ToCString(std::string(" ") + (suffix ? suffix : ""))
+                      .c_str());
+  }
+  std::string autoSuffixesName =
+      appendArray("StenoOrthographyAutoSuffix", "AutoSuffixes", body);
+
+  // Entries whose key is not an auto-suffix are dropped.
+  size_t reverseAutoSuffixCount = 0;
+  body.clear();
+  for (const StenoCompilerJsonValue &reverse : reverseAutoSuffixes.values) {
+    StenoStroke stroke = getStroke(reverse, "key");
+    auto it =
+        std::find(autoSuffixStrokes.begin(), autoSuffixStrokes.end(), stroke);
+    if (it == autoSuffixStrokes.end()) {
+      continue;
+    }
+    ++reverseAutoSuffixCount;
+    AppendCFormat(body,
+                  "  {.autoSuffix = &%s[%zu], .suppressMask = "
+                  "StenoStroke(0x%06x), .testPattern = %s, .replacement = "
+                  "%s},\n",
+                  autoSuffixesName.c_str(),
+                  size_t(it - autoSuffixStrokes.begin()),
+                  getStroke(reverse, "suppressMask").GetKeyState(),
+                  getString(reverse, "pattern").c_str(),
+                  getString(reverse, "replacement").c_str());
+  }
+  std::string reverseAutoSuffixesName = appendArray(
+      "const StenoOrthographyReverseAutoSuffix", "ReverseAutoSuffixes", body);
+
+  AppendCFormat(s, "extern const StenoOrthography %s = {\n", name);
+  AppendCFormat(s, "  .ruleCount = %zu,\n", rules.values.size());
+  AppendCFormat(s, "  .rules = %s,\n", rulesName.c_str());
+  AppendCFormat(s, "  .aliasCount = %zu,\n", aliases.values.size());
+  AppendCFormat(s, "  .aliases = %s,\n", aliasesName.c_str());
+  AppendCFormat(s, "  .autoSuffixMask = StenoStroke(0x%06x),\n",
+                autoSuffixMask.GetKeyState());
+  AppendCFormat(s, "  .autoSuffixCount = %zu,\n", autoSuffixStrokes.size());
+  AppendCFormat(s, "  .autoSuffixes = %s,\n", autoSuffixesName.c_str());
+  AppendCFormat(s, "  .reverseAutoSuffixCount = %zu,\n",
+                reverseAutoSuffixCount);
+  AppendCFormat(s, "  .reverseAutoSuffixes = %s,\n",
+                reverseAutoSuffixesName.c_str());
+  s += "};\n";
+}
+
+//---------------------------------------------------------------------------
+
+#if RUN_DICTIONARY_COMPILER
+
+static bool ReadFile(const char *filename, std::string &contents) {
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    return false;
+  }
+  char buffer[65536];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+    contents.append(buffer, length);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool WriteFile(const char *filename, const void *data, size_t length) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    return false;
+  }
+  bool success = fwrite(data, 1, length, file) == length;
+  return fclose(file) == 0 && success;
+}
+
+// Returns the value of --name=value options.
+static const char *GetOptionValue(const char *arg, const char *name) {
+  size_t length = strlen(name);
+  if (strncmp(arg, name, length) != 0 || arg[length] != '=') {
+    return nullptr;
+  }
+  return arg + length + 1;
+}
+
+static std::string GetBaseName(const char *filename) {
+  const char *slash = strrchr(filename, '/');
+  return slash ? slash + 1 : filename;
+}
+
+int main(int argc, const char *argv[]) {
+  StenoDictionaryCompiler compiler;
+  compiler.threadCount = std::thread::hardware_concurrency();
+
+  const char *outputFilename = nullptr;
+  const char *format = "c";
+  const char *name = nullptr;
+  const char *orthographyFilename = nullptr;
+  const char *orthographyName = "mainOrthography";
+  uint64_t baseAddress = 0;
+  size_t pointerSize = 0;
+  std::vector<const char *> inputFilenames;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *value;
+    if ((value = GetOptionValue(arg, "--output"))) {
+      outputFilename = value;
+    } else if ((value = GetOptionValue(arg, "--format"))) {
+      format = value;
+    } else if ((value = GetOptionValue(arg, "--layout-version"))) {
+      compiler.layoutVersion = atoi(value);
+    } else if ((value = GetOptionValue(arg, "--name"))) {
+      name = value;
+    } else if ((value = GetOptionValue(arg, "--orthography"))) {
+      orthographyFilename = value;
+    } else if ((value = GetOptionValue(arg, "--orthography-name"))) {
+      orthographyName = value;
+    } else if ((value = GetOptionValue(arg, "--base-address"))) {
+      baseAddress = strtoull(value, nullptr, 0);
+    } else if ((value = GetOptionValue(arg, "--pointer-size"))) {
+      pointerSize = atoi(value);
+    } else if ((value = GetOptionValue(arg, "--threads"))) {
+      compiler.threadCount = atoi(value);
+    } else if (strcmp(arg, "--no-reverse-lookup") == 0) {
+      compiler.hasReverseLookup = false;
+    } else if (arg[0] == '-') {
+      fprintf(stderr, "Unknown option: %s\n", arg);
+      return 1;
+    } else {
+      inputFilenames.push_back(arg);
+    }
+  }
+
+  bool isRelocatable = strcmp(format, "relocatable") == 0;
+  bool isBinary = isRelocatable || strcmp(format, "binary") == 0;
+  if (!isBinary && strcmp(format, "c") != 0) {
+    fprintf(stderr, "Unknown format: %s\n", format);
+    return 1;
+  }
+  if (!outputFilename || inputFilenames.empty()) {
+    fprintf(stderr, "Usage: %s --output=FILE [options] dictionary.json...\n",
+            argv[0]);
+    return 1;
+  }
+  if (compiler.layoutVersion > 3) {
+    fprintf(stderr, "Unsupported layout version: %u\n",
+            compiler.layoutVersion);
+    return 1;
+  }
+  if (!isBinary && inputFilenames.size() != 1) {
+    fprintf(stderr, "C output takes a single dictionary\n");
+    return 1;
+  }
+  if (pointerSize == 0) {
+    pointerSize = isRelocatable ? sizeof(void *) : 4;
+  }
+  if (pointerSize != 4 && pointerSize != 8) {
+    fprintf(stderr, "Unsupported pointer size: %zu\n", pointerSize);
+    return 1;
+  }
+
+  // The reverse lookup index is only used from collections.
+  if (!isBinary) {
+    compiler.hasReverseLookup = false;
+  }
+
+  for (const char *filename : inputFilenames) {
+    std::string json;
+    if (!ReadFile(filename, json)) {
+      fprintf(stderr, "Unable to read %s\n", filename);
+      return 1;
+    }
+    std::string dictionaryName =
+        name && !isBinary ? name : GetBaseName(filename);
+    if (!compiler.AddDictionary(dictionaryName.c_str(), json.data(),
+                                json.size())) {
+      fprintf(stderr, "%s\n", compiler.error.c_str());
+      return 1;
+    }
+  }
+
+  if (orthographyFilename) {
+    std::string json;
+    if (!ReadFile(orthographyFilename, json)) {
+      fprintf(stderr, "Unable to read %s\n", orthographyFilename);
+      return 1;
+    }
+    if (!compiler.SetOrthography(json.data(), json.size())) {
+      fprintf(stderr, "%s\n", compiler.error.c_str());
+      return 1;
+    }
+  }
+
+  for (const std::string &warning : compiler.warnings) {
+    fprintf(stderr, "Warning: %s\n", warning.c_str());
+  }
+
+  if (!compiler.Build()) {
+    fprintf(stderr, "%s\n", compiler.error.c_str());
+    return 1;
+  }
+
+  bool success;
+  if (isBinary) {
+    StenoCompilerBinaryWriter writer(pointerSize);
+    compiler.WriteBinary(writer);
+    if (isRelocatable) {
+      std::vector<uint8_t> file = writer.CreateRelocatableFile();
+      success = WriteFile(outputFilename, file.data(), file.size());
+    } else {
+      writer.Relocate(baseAddress);
+      success =
+          WriteFile(outputFilename, writer.bytes.data(), writer.bytes.size());
+    }
+  } else {
+    std::string source = compiler.WriteCSource(
+        GetBaseName(inputFilenames[0]).c_str(),
+        orthographyFilename ? orthographyName : nullptr);
+    success = WriteFile(outputFilename, source.data(), source.size());
+  }
+
+  if (!success) {
+    fprintf(stderr, "Unable to write %s\n", outputFilename);
+    return 1;
+  }
+  return 0;
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#if RUN_TESTS
+
+#include "../unit_test.h"
+#include "map_dictionary.h"
+#include "reverse_map_dictionary.h"
+#include <assert.h>
+#include <unistd.h>
+
+// spellchecker: disable
+static const char TEST_DICTIONARY_JSON[] = R"({
+  "TEFT": "test",
+  "-G": "{^ing}",
+  "TEFT/-D": "tested",
+  "TEFTS": "tests",
+  "T-S": "tests"
+})";
+// spellchecker: enable
+
+// Returns the collection, compiled with native pointers so that it can be
+// used in place.
+static const StenoMapDictionaryCollection &
+CompileTestCollection(StenoCompilerBinaryWriter &writer, const char *json,
+                      uint8_t layoutVersion) {
+  StenoDictionaryCompiler compiler;
+  compiler.layoutVersion = layoutVersion;
+  compiler.threadCount = 2;
+  bool success = compiler.AddDictionary("test.json", json, strlen(json));
+  assert(success);
+  success = compiler.Build();
+  assert(success);
+  compiler.WriteBinary(writer);
+  writer.Relocate((uintptr_t)writer.bytes.data());
+  return *(const StenoMapDictionaryCollection *)writer.bytes.data();
+}
+
+static void TestCompiledLookups(const StenoMapDictionary &dictionary) {
+  // spellchecker: disable
+  const StenoStroke strokes[2] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+  };
+  const StenoStroke missing[2] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-Z"),
+  };
+  // spellchecker: enable
+
+  auto lookup = dictionary.Lookup(strokes, 1);
+  assert(lookup.IsValid());
+  assert(strcmp(lookup.GetText(), "test") == 0);
+  lookup.Destroy();
+
+  lookup = dictionary.Lookup(strokes, 2);
+  assert(lookup.IsValid());
+  assert(strcmp(lookup.GetText(), "tested") == 0);
+  lookup.Destroy();
+
+  lookup = dictionary.Lookup(missing, 2);
+  assert(!lookup.IsValid());
+}
+
+TEST_BEGIN("DictionaryCompiler: Binary collection lookups") {
+  const uint32_t magics[] = {
+      STENO_MAP_DICTIONARY_COLLECTION_MAGIC,
+      STENO_MAP_DICTIONARY_COLLECTION_MAGIC,
+      STENO_MAP_DICTIONARY_COLLECTION_COUNTED_BLOCKS_MAGIC,
+      STENO_MAP_DICTIONARY_COLLECTION_PERFECT_HASH_MAGIC,
+  };
+  for (uint8_t layoutVersion = 0; layoutVersion <= 3; ++layoutVersion) {
+    StenoCompilerBinaryWriter writer(sizeof(void *));
+    const StenoMapDictionaryCollection &collection =
+        CompileTestCollection(writer, TEST_DICTIONARY_JSON, layoutVersion);
+
+    assert(collection.HasValidMagic());
+    assert(collection.magic == magics[layoutVersion]);
+    assert(collection.dictionaryCount == 1);
+    assert(collection.hasReverseLookup);
+
+    const StenoMapDictionaryDefinition &definition =
+        *collection.dictionaries[0];
+    assert(definition.maximumStrokeCount == 2);
+    assert(definition.layoutVersion == layoutVersion);
+    assert(strcmp(definition.name, "test.json") == 0);
+    assert(definition.textBlock == collection.textBlock);
+
+    TestCompiledLookups(StenoMapDictionary(definition));
+  }
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: Binary collection reverse lookups") {
+  StenoCompilerBinaryWriter writer(sizeof(void *));
+  const StenoMapDictionaryCollection &collection =
+      CompileTestCollection(writer, TEST_DICTIONARY_JSON, 1);
+
+  StenoMapDictionary mapDictionary(*collection.dictionaries[0]);
+  StenoReverseMapDictionary reverseDictionary(
+      &mapDictionary, writer.bytes.data(), collection.textBlock,
+      collection.textBlockLength);
+
+  // spellchecker: disable
+  const StenoStroke tefts = StenoStroke("TEFTS");
+  const StenoStroke ts = StenoStroke("T-S");
+  // spellchecker: enable
+
+  StenoReverseDictionaryLookup lookup(
+      StenoReverseDictionaryLookup::MAX_STROKE_THRESHOLD, "tests");
+  reverseDictionary.ReverseLookup(lookup);
+  assert(lookup.resultCount == 2);
+  assert(lookup.HasResult(&tefts, 1));
+  assert(lookup.HasResult(&ts, 1));
+
+  StenoReverseDictionaryLookup missingLookup(
+      StenoReverseDictionaryLookup::MAX_STROKE_THRESHOLD, "testing");
+  reverseDictionary.ReverseLookup(missingLookup);
+  assert(missingLookup.resultCount == 0);
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: Perfect hash collections") {
+  // spellchecker: disable
+  const StenoStroke strokes[3] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("-G"),
+  };
+  // spellchecker: enable
+
+  StenoCompilerBinaryWriter writer(sizeof(void *));
+  const StenoMapDictionaryCollection &collection =
+      CompileTestCollection(writer, TEST_DICTIONARY_JSON, 3);
+  const StenoMapDictionaryDefinition &definition = *collection.dictionaries[0];
+  assert(definition.HasPerfectHash());
+  StenoMapDictionary dictionary(definition);
+
+  size_t length = 0;
+  StenoDictionaryPrefixLookup prefixLookup(strokes, 3);
+  auto lookup = dictionary.LookupLongest(prefixLookup, 1, 3, length);
+  assert(lookup.IsValid());
+  assert(length == 2);
+  assert(strcmp(lookup.GetText(), "tested") == 0);
+  lookup.Destroy();
+
+  // -D is not an outline, but maps to an occupied slot.
+  assert(!dictionary.Lookup(strokes + 1, 1).IsValid());
+  assert(!dictionary.Lookup(strokes + 1, 2).IsValid());
+
+  // Every entry is reachable, and reverse maps to its own strokes.
+  for (size_t i = 0; i < definition.maximumStrokeCount; ++i) {
+    const StenoMapDictionaryPerfectHashStrokes &perfectHashStrokes =
+        definition.perfectHashStrokes[i];
+    const size_t strokeLength = i + 1;
+    const size_t entrySize = 3 + 3 * strokeLength;
+    for (size_t j = 0; j < perfectHashStrokes.entryCount; ++j) {
+      const uint8_t *entry = perfectHashStrokes.data + j * entrySize;
+      StenoReverseMapDictionaryLookup reverseLookup(entry);
+      assert(dictionary.ReverseMapDictionaryLookup(reverseLookup));
+      assert(reverseLookup.length == strokeLength);
+
+      StenoDictionaryLookupResult result =
+          dictionary.Lookup(reverseLookup.strokes, strokeLength);
+      assert(result.IsValid());
+      const Uint24 &textOffset = *(const Uint24 *)entry;
+      assert(result.GetText() ==
+             (const char *)definition.textBlock + textOffset.ToUint32());
+      result.Destroy();
+    }
+  }
+
+  // The reverse lookup index follows the data in slot order.
+  StenoReverseMapDictionary reverseDictionary(
+      &dictionary, writer.bytes.data(), collection.textBlock,
+      collection.textBlockLength);
+  StenoReverseDictionaryLookup reverseLookup(
+      StenoReverseDictionaryLookup::MAX_STROKE_THRESHOLD, "tests");
+  reverseDictionary.ReverseLookup(reverseLookup);
+  assert(reverseLookup.resultCount == 2);
+}
+TEST_END
+
+#if defined(__linux__)
+
+TEST_BEGIN("DictionaryCompiler: Relocatable files load in place") {
+  StenoDictionaryCompiler compiler;
+  compiler.layoutVersion = 1;
+  assert(compiler.AddDictionary("test.json", TEST_DICTIONARY_JSON,
+                                strlen(TEST_DICTIONARY_JSON)));
+  assert(compiler.Build());
+  StenoCompilerBinaryWriter writer(sizeof(void *));
+  compiler.WriteBinary(writer);
+  std::vector<uint8_t> file = writer.CreateRelocatableFile();
+
+  char filename[] = "/tmp/javelin_dictionary_XXXXXX";
+  int fd = mkstemp(filename);
+  assert(fd >= 0);
+  assert(write(fd, file.data(), file.size()) == (ssize_t)file.size());
+  close(fd);
+
+  StenoMapDictionaryFile dictionaryFile;
+  bool success = dictionaryFile.Open(filename);
+  unlink(filename);
+  assert(success);
+
+  const StenoMapDictionaryCollection &collection =
+      dictionaryFile.GetCollection();
+  assert(collection.dictionaryCount == 1);
+  StenoMapDictionary mapDictionary(*collection.dictionaries[0]);
+  TestCompiledLookups(mapDictionary);
+
+  StenoReverseMapDictionary reverseDictionary(
+      &mapDictionary, dictionaryFile.GetBaseAddress(), collection.textBlock,
+      collection.textBlockLength);
+  StenoReverseDictionaryLookup lookup(
+      StenoReverseDictionaryLookup::MAX_STROKE_THRESHOLD, "tests");
+  reverseDictionary.ReverseLookup(lookup);
+  assert(lookup.resultCount == 2);
+}
+TEST_END
+
+#endif
+
+TEST_BEGIN("DictionaryCompiler: Later definitions replace earlier ones") {
+  // spellchecker: disable
+  const char json[] = R"({
+    "TEFT": "first",
+    "TEFT/-D": "tested",
+    "TEFT": "test",
+    "-G": "{^ing}",
+    "TEFT/-G": "testing"
+  })";
+  // spellchecker: enable
+
+  StenoCompilerBinaryWriter writer(sizeof(void *));
+  const StenoMapDictionaryCollection &collection =
+      CompileTestCollection(writer, json, 0);
+  TestCompiledLookups(StenoMapDictionary(*collection.dictionaries[0]));
+
+  // "first" is no longer referenced, so is not in the text block.
+  assert(memmem(collection.textBlock, collection.textBlockLength, "first",
+                5) == nullptr);
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: Lengths without outlines") {
+  // spellchecker: disable
+  const char json[] = R"({
+    "TEFT": "test",
+    "TEFT/-D/-Z": "testeds"
+  })";
+  const StenoStroke strokes[3] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("-Z"),
+  };
+  // spellchecker: enable
+
+  for (uint8_t layoutVersion = 0; layoutVersion <= 3; ++layoutVersion) {
+    StenoCompilerBinaryWriter writer(sizeof(void *));
+    const StenoMapDictionaryCollection &collection =
+        CompileTestCollection(writer, json, layoutVersion);
+    const StenoMapDictionaryDefinition &definition =
+        *collection.dictionaries[0];
+    assert(!definition.HasOutlines(2));
+
+    StenoMapDictionary dictionary(definition);
+    assert(!dictionary.Lookup(strokes, 2).IsValid());
+    auto lookup = dictionary.Lookup(strokes, 3);
+    assert(lookup.IsValid());
+    assert(strcmp(lookup.GetText(), "testeds") == 0);
+    lookup.Destroy();
+  }
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: Invalid outlines are skipped") {
+  // spellchecker: disable
+  const char json[] = R"({
+    "TEFT": "test",
+    "TEFT/-D": "tested",
+    "TEFT/-X": "invalid",
+    "TEFT/-Z": 1
+  })";
+  // spellchecker: enable
+
+  StenoDictionaryCompiler compiler;
+  assert(compiler.AddDictionary("test.json", json, strlen(json)));
+  assert(compiler.warnings.size() == 2);
+
+  assert(!compiler.AddDictionary("test.json", "[]", 2));
+  assert(!compiler.AddDictionary("test.json", "{\"TEFT\": }", 10));
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: JSON string escapes") {
+  const char json[] = R"({"a": "\"\\\/\b\f\n\r\té😀"})";
+  StenoCompilerJsonValue value;
+  StenoCompilerJsonParser parser(json, strlen(json));
+  assert(parser.Parse(value));
+  assert(strcmp(value.GetString("a"),
+                "\"\\/\b\f\n\r\t\xc3\xa9\xf0\x9f\x98\x80") == 0);
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: C source output") {
+  StenoDictionaryCompiler compiler;
+  compiler.hasReverseLookup = false;
+  compiler.layoutVersion = 1;
+  assert(compiler.AddDictionary("main.json", TEST_DICTIONARY_JSON,
+                                strlen(TEST_DICTIONARY_JSON)));
+  const char orthography[] = R"({
+    "auto-suffix": [
+      { "key": "-Z", "suffix": "{^s}" },
+      { "key": "-D", "suffix": "{^ed}" }
+    ]
+  })";
+  assert(compiler.SetOrthography(orthography, strlen(orthography)));
+  assert(compiler.Build());
+
+  std::string source = compiler.WriteCSource("test.json", "testOrthography");
+  assert(source.find("MainDictionary::definition") != std::string::npos);
+  assert(source.find("const size_t hashMapSize2 = 128;") !=
+         std::string::npos);
+  assert(source.find("prefixFilter1") != std::string::npos);
+  assert(source.find("\" {^ed}\"") != std::string::npos);
+  assert(source.find(".autoSuffixCount = 2,") != std::string::npos);
+}
+TEST_END
+
+TEST_BEGIN("DictionaryCompiler: C source output for perfect hashes") {
+  StenoDictionaryCompiler compiler;
+  compiler.hasReverseLookup = false;
+  compiler.layoutVersion = 3;
+  assert(compiler.AddDictionary("main.json", TEST_DICTIONARY_JSON,
+                                strlen(TEST_DICTIONARY_JSON)));
+  assert(compiler.Build());
+
+  std::string source = compiler.WriteCSource("test.json", nullptr);
+  assert(source.find("const StenoMapDictionaryPerfectHashStrokes strokes[]") !=
+         std::string::npos);
+  assert(source.find("const uint16_t pilots2[] = {") != std::string::npos);
+  assert(source.find("{.perfectHashStrokes = strokes},") != std::string::npos);
+  assert(source.find("hashMapSize") == std::string::npos);
+  assert(source.find("fingerprints1") == std::string::npos);
+}
+TEST_END
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#if RUN_BENCHMARKS
+
+#include "../benchmark.h"
+#include "map_dictionary.h"
+#include <set>
+
+// A single length of a synthetic map dictionary, built by the compiler both
+// as a hash map and as a perfect hash.
+struct StenoBenchmarkMapStrokes {
+  std::vector<StenoStroke> strokes;
+  StenoCompilerStrokesTable table;
+  StenoCompilerStrokesTable perfectHashTable;
+
+  // length is at most 3.
+  void Create(size_t length, size_t entryCount);
+};
+
+void StenoBenchmarkMapStrokes::Create(size_t length, size_t entryCount) {
+  // Outlines in a compiled dictionary are unique.
+  std::set<std::string> outlines;
+  while (outlines.size() < entryCount) {
+    StenoStroke outline[3];
+    for (size_t i = 0; i < length; ++i) {
+      outline[i] = StenoStroke(rand() & StrokeMask::ALL);
+    }
+    if (outlines.insert(std::string((const char *)outline,
+                                    length * sizeof(StenoStroke)))
+            .second) {
+      strokes.insert(strokes.end(), outline, outline + length);
+    }
+  }
+
+  // Every entry uses the text at offset 0.
+  table.length = length;
+  for (size_t i = 0; i < entryCount; ++i) {
+    StenoCompilerEntry &entry = table.entries.emplace_back();
+    entry.strokes.assign(&strokes[i * length], &strokes[(i + 1) * length]);
+    entry.textIndex = 0;
+  }
+  perfectHashTable.length = length;
+  perfectHashTable.entries = table.entries;
+
+  const std::vector<uint32_t> textOffsets = {0};
+  table.Build(textOffsets, {}, false);
+  if (!perfectHashTable.Build(textOffsets, {}, true)) {
+    printf("  Unable to build a perfect hash for length %zu\n", length);
+  }
+}
+
+// Options:
+//   --entries=N  Number of outlines. Defaults to 150,000, split 30%, 50%
+//                and 20% between 1, 2 and 3 stroke outlines.
+//   --repeat=N   Number of passes over the lookups.
+//
+// Half of the lookups are outlines in the dictionary, and half are random
+// strokes. Build with JAVELIN_USE_CUSTOM_POP_COUNT to compare the software
+// popcount. The index is the hash map blocks, or the perfect hash's pilots
+// and partition offsets.
+BENCHMARK_BEGIN("MapDictionary: Block layout lookup throughput") {
+  const size_t entryCount = atoi(Benchmark::GetOption("entries", "150000"));
+  const size_t repeatCount = atoi(Benchmark::GetOption("repeat", "20"));
+  const size_t LENGTH_COUNT = 3;
+  const size_t lengthPercentages[LENGTH_COUNT] = {30, 50, 20};
+
+  srand(0x1234);
+  StenoBenchmarkMapStrokes lengths[LENGTH_COUNT];
+  for (size_t i = 0; i < LENGTH_COUNT; ++i) {
+    lengths[i].Create(i + 1, entryCount * lengthPercentages[i] / 100);
+  }
+
+  static const uint8_t textBlock[] = "x";
+  StenoMapDictionaryStrokesDefinition strokesDefinitions[LENGTH_COUNT];
+  StenoMapDictionaryStrokesDefinition countedStrokesDefinitions[LENGTH_COUNT];
+  StenoMapDictionaryPerfectHashStrokes perfectHashStrokes[LENGTH_COUNT];
+  StenoMapDictionaryStrokesExtension extensions[LENGTH_COUNT];
+  StenoMapDictionaryStrokesExtension perfectHashExtensions[LENGTH_COUNT] = {};
+  size_t offsetsSize = 0;
+  size_t countedOffsetsSize = 0;
+  size_t perfectHashSize = 0;
+  for (size_t i = 0; i < LENGTH_COUNT; ++i) {
+    const StenoCompilerStrokesTable &table = lengths[i].table;
+    strokesDefinitions[i] = {
+        .hashMapSize = table.hashMapSize,
+        .data = table.data.data(),
+        .offsets = table.blocks.data(),
+    };
+    countedStrokesDefinitions[i] = strokesDefinitions[i];
+    countedStrokesDefinitions[i].offsets = table.countedBlocks.data();
+    extensions[i] = {
+        .fingerprints = table.fingerprints.data(),
+        .prefixFilterSize = 0,
+        .prefixFilter = nullptr,
+    };
+
+    offsetsSize += table.blocks.size() * sizeof(StenoHashMapEntryBlock);
+    countedOffsetsSize +=
+        table.countedBlocks.size() * sizeof(StenoHashMapCountedEntryBlock);
+
+    const StenoCompilerStrokesTable &perfectHashTable =
+        lengths[i].perfectHashTable;
+    const StenoCompilerPerfectHash &perfectHash = perfectHashTable.perfectHash;
+    perfectHashStrokes[i] = perfectHash.strokes;
+    perfectHashStrokes[i].data = perfectHashTable.data.data();
+    perfectHashStrokes[i].partitionOffsets =
+        perfectHash.partitionOffsets.data();
+    perfectHashStrokes[i].pilots = perfectHash.pilots.data();
+    perfectHashSize += perfectHash.pilots.size() * sizeof(uint16_t) +
+                       perfectHash.partitionOffsets.size() * sizeof(uint32_t);
+  }
+
+  const StenoMapDictionaryDefinition definition = {
+      .defaultEnabled = true,
+      .maximumStrokeCount = LENGTH_COUNT,
+      .layoutVersion = 1,
+      ._padding3 = 0,
+      .name = "benchmark",
+      .textBlock = textBlock,
+      .strokes = strokesDefinitions,
+      .extensions = extensions,
+  };
+  StenoMapDictionaryDefinition countedDefinition = definition;
+  countedDefinition.layoutVersion = 2;
+  countedDefinition.strokes = countedStrokesDefinitions;
+  StenoMapDictionaryDefinition perfectHashDefinition = definition;
+  perfectHashDefinition.layoutVersion = 3;
+  perfectHashDefinition.perfectHashStrokes = perfectHashStrokes;
+  perfectHashDefinition.extensions = perfectHashExtensions;
+
+  std::vector<StenoStroke> missStrokes;
+  for (size_t i = 0; i < entryCount * LENGTH_COUNT; ++i) {
+    missStrokes.push_back(StenoStroke(rand() & StrokeMask::ALL));
+  }
+
+  std::vector<StenoDictionaryLookup> lookups;
+  for (size_t i = 0; i < entryCount; ++i) {
+    size_t length = 1 + rand() % LENGTH_COUNT;
+    const StenoStroke *strokes;
+    if (i % 2 == 0) {
+      const std::vector<StenoStroke> &outlines = lengths[length - 1].strokes;
+      strokes = &outlines[rand() % (outlines.size() / length) * length];
+    } else {
+      strokes = &missStrokes[i * LENGTH_COUNT];
+    }
+    lookups.push_back(StenoDictionaryLookup(strokes, length));
+  }
+
+  const struct {
+    const char *name;
+    const StenoMapDictionaryDefinition &definition;
+    size_t indexSize;
+  } layouts[] = {
+      {"StenoHashMapEntryBlock", definition, offsetsSize},
+      {"StenoHashMapCountedEntryBlock", countedDefinition, countedOffsetsSize},
+      {"Perfect hash", perfectHashDefinition, perfectHashSize},
+  };
+  const size_t LAYOUT_COUNT = sizeof(layouts) / sizeof(*layouts);
+
+  // Alternate the layouts so that they see the same machine conditions.
+  uint64_t elapsedTimes[LAYOUT_COUNT] = {};
+  size_t hitCounts[LAYOUT_COUNT] = {};
+  for (size_t i = 0; i < repeatCount; ++i) {
+    for (size_t j = 0; j < LAYOUT_COUNT; ++j) {
+      StenoMapDictionary dictionary(layouts[j].definition);
+      uint64_t startTime = Benchmark::GetTime();
+      for (const StenoDictionaryLookup &lookup : lookups) {
+        hitCounts[j] += dictionary.Lookup(lookup).IsValid();
+      }
+      elapsedTimes[j] += Benchmark::GetTime() - startTime;
+    }
+  }
+
+  size_t lookupCount = lookups.size() * repeatCount;
+  for (size_t j = 0; j < LAYOUT_COUNT; ++j) {
+    printf("  %s: %.2f Mlookups/s, %zu hits, index %zu bytes\n",
+           layouts[j].name, lookupCount * 1000.0 / elapsedTimes[j],
+           hitCounts[j] / repeatCount, layouts[j].indexSize);
+  }
+  printf("  Offsets size overhead: %zu bytes (%.1f%%)\n",
+         countedOffsetsSize - offsetsSize,
+         (countedOffsetsSize - offsetsSize) * 100.0 / offsetsSize);
+}
+BENCHMARK_END
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#endif
+
+//---------------------------------------------------------------------------
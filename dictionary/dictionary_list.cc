@@ -14,6 +14,7 @@ StenoDictionaryList::StenoDictionaryList(
     List<StenoDictionaryListEntry> &dictionaries)
     : dictionaries(dictionaries) {
   UpdateMaximumOutlineLength();
+  UpdateLookupFilters();
 }
 
 List<StenoDictionaryListEntry> &
@@ -34,14 +35,10 @@ StenoDictionaryLookupResult
 StenoDictionaryList::Lookup(const StenoDictionaryLookup &lookup) const {
 
   for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
-    if (!dictionaries[i].enabled) {
+    if (!dictionaries[i].filter.MayMatch(lookup)) {
       continue;
     }
     const StenoDictionary *dictionary = dictionaries[i].dictionary;
-    if (dictionary->GetMaximumOutlineLength() < lookup.length) {
-      continue;
-    }
-
     StenoDictionaryLookupResult result = dictionary->Lookup(lookup);
     if (result.IsValid()) {
       return result;
@@ -50,17 +47,62 @@ StenoDictionaryList::Lookup(const StenoDictionaryLookup &lookup) const {
   return StenoDictionaryLookupResult::CreateInvalid();
 }
 
-const StenoDictionary *StenoDictionaryList::GetLookupProvider(
-    const StenoDictionaryLookup &lookup) const {
+StenoDictionaryLookupResult StenoDictionaryList::LookupWithProvider(
+    const StenoDictionaryLookup &lookup,
+    const StenoDictionary *&provider) const {
   for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
-    if (!dictionaries[i].enabled) {
+    if (!dictionaries[i].filter.MayMatch(lookup)) {
       continue;
     }
     const StenoDictionary *dictionary = dictionaries[i].dictionary;
-    if (dictionary->GetMaximumOutlineLength() < lookup.length) {
+    StenoDictionaryLookupResult result =
+        dictionary->LookupWithProvider(lookup, provider);
+    if (result.IsValid()) {
+      return result;
+    }
+  }
+  provider = nullptr;
+  return StenoDictionaryLookupResult::CreateInvalid();
+}
+
+// Dictionaries earlier in the list take priority for outlines of the same
+// length, so each later dictionary only needs to find a longer match.
+StenoDictionaryLookupResult
+StenoDictionaryList::LookupLongest(const StenoDictionaryPrefixLookup &lookup,
+                                   size_t minimumLength, size_t maximumLength,
+                                   size_t &length) const {
+  StenoDictionaryLookupResult bestResult =
+      StenoDictionaryLookupResult::CreateInvalid();
+
+  for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
+    if (minimumLength > maximumLength) {
+      break;
+    }
+    if (!dictionaries[i].filter.MayMatch(lookup.strokes[0], minimumLength,
+                                         maximumLength)) {
       continue;
     }
+    const StenoDictionary *dictionary = dictionaries[i].dictionary;
+    size_t resultLength;
+    StenoDictionaryLookupResult result = dictionary->LookupLongest(
+        lookup, minimumLength, maximumLength, resultLength);
+    if (result.IsValid()) {
+      bestResult.Destroy();
+      bestResult = result;
+      length = resultLength;
+      minimumLength = resultLength + 1;
+    }
+  }
+  return bestResult;
+}
 
+const StenoDictionary *StenoDictionaryList::GetLookupProvider(
+    const StenoDictionaryLookup &lookup) const {
+  for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
+    if (!dictionaries[i].filter.MayMatch(lookup)) {
+      continue;
+    }
+    const StenoDictionary *dictionary = dictionaries[i].dictionary;
     const StenoDictionary *result = dictionary->GetLookupProvider(lookup);
     if (result) {
       return result;
@@ -88,8 +130,10 @@ bool StenoDictionaryList::ReverseMapDictionaryLookup(
     }
     const StenoDictionary *dictionary = dictionaries[i].dictionary;
     if (dictionary->ReverseMapDictionaryLookup(lookup)) {
+      // The dictionary has the outline, so it is the provider unless a
+      // higher priority dictionary also has it.
       StenoDictionaryLookup testLookup(lookup.strokes, lookup.length);
-      if (GetLookupProvider(testLookup) == dictionary) {
+      if (!IsShadowed(i, testLookup)) {
         return true;
       }
     }
@@ -97,6 +141,19 @@ bool StenoDictionaryList::ReverseMapDictionaryLookup(
   return false;
 }
 
+bool StenoDictionaryList::IsShadowed(
+    size_t index, const StenoDictionaryLookup &lookup) const {
+  for (size_t i = 0; i < index; ++i) {
+    if (!dictionaries[i].filter.MayMatch(lookup)) {
+      continue;
+    }
+    if (dictionaries[i].dictionary->GetLookupProvider(lookup)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void StenoDictionaryList::UpdateMaximumOutlineLength() {
   size_t max = 0;
   for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
@@ -111,6 +168,14 @@ void StenoDictionaryList::UpdateMaximumOutlineLength() {
   maximumOutlineLength = max;
 }
 
+void StenoDictionaryList::UpdateLookupFilters() {
+  for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
+    StenoDictionaryListEntry &entry = dictionaries[i];
+    entry.filter = entry.enabled ? entry.dictionary->GetLookupFilter()
+                                 : StenoDictionaryLookupFilter::CreateNone();
+  }
+}
+
 size_t StenoDictionaryList::GetMaximumOutlineLength() const {
   return maximumOutlineLength;
 }
@@ -152,6 +217,7 @@ bool StenoDictionaryList::EnableDictionary(const char *name) {
   for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
     if (Str::Eq(name, dictionaries[i].dictionary->GetName())) {
       dictionaries[i].enabled = true;
+      UpdateLookupFilters();
       SendDictionaryStatus(name, true);
       return true;
     }
@@ -163,6 +229,7 @@ bool StenoDictionaryList::DisableDictionary(const char *name) {
   for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
     if (Str::Eq(name, dictionaries[i].dictionary->GetName())) {
       dictionaries[i].enabled = false;
+      UpdateLookupFilters();
       SendDictionaryStatus(name, false);
       return true;
     }
@@ -174,6 +241,7 @@ bool StenoDictionaryList::ToggleDictionary(const char *name) {
   for (size_t i = 0; i < dictionaries.GetCount(); ++i) {
     if (Str::Eq(name, dictionaries[i].dictionary->GetName())) {
       dictionaries[i].enabled = !dictionaries[i].enabled;
+      UpdateLookupFilters();
       SendDictionaryStatus(name, dictionaries[i].enabled);
       return true;
     }
@@ -209,3 +277,101 @@ void StenoDictionaryList::DisableDictionaryStatus_Binding(
 }
 
 //---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#include "../unit_test.h"
+#include "jeff_numbers_dictionary.h"
+#include "main_dictionary.h"
+#include "map_dictionary.h"
+#include "wrapped_dictionary.h"
+#include <assert.h>
+
+class StenoLookupCountingTestDictionary final : public StenoWrappedDictionary {
+public:
+  StenoLookupCountingTestDictionary(StenoDictionary *dictionary)
+      : StenoWrappedDictionary(dictionary) {}
+
+  virtual StenoDictionaryLookupResult
+  Lookup(const StenoDictionaryLookup &lookup) const {
+    ++lookupCount;
+    return dictionary->Lookup(lookup);
+  }
+
+  virtual const char *GetName() const { return dictionary->GetName(); }
+
+  mutable size_t lookupCount = 0;
+};
+
+TEST_BEGIN("DictionaryList: Lookup filters skip layers that cannot match") {
+  StenoMapDictionary mainDictionary(MainDictionary::definition);
+  StenoLookupCountingTestDictionary numbers(
+      (StenoDictionary *)&StenoJeffNumbersDictionary::instance);
+  StenoLookupCountingTestDictionary main(&mainDictionary);
+
+  const StenoDictionary *dictionaries[] = {&numbers, &main};
+  StenoDictionaryList list(dictionaries, 2);
+
+  // spellchecker: disable
+  const StenoStroke strokes[2] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+  };
+  // spellchecker: enable
+
+  // Numbers requires the number key, so it is never called.
+  StenoDictionaryLookupResult lookup = list.Lookup(strokes, 1);
+  assert(Str::Eq(lookup.GetText(), "test"));
+  lookup.Destroy();
+  assert(numbers.lookupCount == 0);
+  assert(main.lookupCount == 1);
+
+  // Disabling a layer refreshes its filter.
+  list.DisableDictionary("main.json");
+  lookup = list.Lookup(strokes, 2);
+  assert(!lookup.IsValid());
+  assert(main.lookupCount == 1);
+
+  list.EnableDictionary("main.json");
+  lookup = list.Lookup(strokes, 2);
+  assert(Str::Eq(lookup.GetText(), "tested"));
+  lookup.Destroy();
+  assert(main.lookupCount == 2);
+  assert(numbers.lookupCount == 0);
+}
+TEST_END
+
+TEST_BEGIN("DictionaryList: LookupWithProvider returns the providing layer") {
+  StenoMapDictionary mainDictionary(MainDictionary::definition);
+  const StenoDictionary *dictionaries[] = {
+      &StenoJeffNumbersDictionary::instance,
+      &mainDictionary,
+  };
+  StenoDictionaryList list(dictionaries, 2);
+
+  // spellchecker: disable
+  const StenoStroke strokes[2] = {
+      StenoStroke("TEFT"),
+      StenoStroke("1"),
+  };
+  // spellchecker: enable
+
+  const StenoDictionary *provider = nullptr;
+  StenoDictionaryLookupResult lookup =
+      list.LookupWithProvider(StenoDictionaryLookup(strokes, 1), provider);
+  assert(Str::Eq(lookup.GetText(), "test"));
+  assert(provider == &mainDictionary);
+  lookup.Destroy();
+
+  lookup =
+      list.LookupWithProvider(StenoDictionaryLookup(strokes + 1, 1), provider);
+  assert(lookup.IsValid());
+  assert(provider == &StenoJeffNumbersDictionary::instance);
+  lookup.Destroy();
+
+  lookup = list.LookupWithProvider(StenoDictionaryLookup(strokes, 2), provider);
+  assert(!lookup.IsValid());
+  assert(provider == nullptr);
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -12,6 +12,10 @@ struct StenoDictionaryListEntry {
 
   bool enabled;
   const StenoDictionary *dictionary;
+
+  // Maintained by StenoDictionaryList. Rejects everything when disabled.
+  StenoDictionaryLookupFilter filter =
+      StenoDictionaryLookupFilter::CreateNone();
 };
 
 //---------------------------------------------------------------------------
@@ -23,6 +27,15 @@ public:
 
   virtual StenoDictionaryLookupResult
   Lookup(const StenoDictionaryLookup &lookup) const;
+  using StenoDictionary::Lookup;
+
+  virtual StenoDictionaryLookupResult
+  LookupWithProvider(const StenoDictionaryLookup &lookup,
+                     const StenoDictionary *&provider) const;
+
+  virtual StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+                size_t maximumLength, size_t &length) const;
 
   virtual const StenoDictionary *
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
@@ -60,6 +73,10 @@ private:
   static bool isSendDictionaryStatusEnabled;
 
   void UpdateMaximumOutlineLength();
+  void UpdateLookupFilters();
+
+  // Returns true if a dictionary before index provides the lookup.
+  bool IsShadowed(size_t index, const StenoDictionaryLookup &lookup) const;
 
   void SendDictionaryStatus(const char *name, bool enabled) const;
 };
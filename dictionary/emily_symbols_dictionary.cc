@@ -245,8 +245,9 @@ StenoEmilySymbolsDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
   const char *r1 = (c & REPEAT_EXTRA_1).IsNotEmpty() ? text : "";
   const char *r2 = (c & REPEAT_EXTRA_2).IsNotEmpty() ? text : "";
 
-  return StenoDictionaryLookupResult::CreateDynamicString(
-      Str::Join(leftSpace, text, r1, r2, r2, rightSpace, capitalize, nullptr));
+  return StenoDictionaryLookupResult::CreateJoinedString(
+      lookup.arena, leftSpace, text, r1, r2, r2, rightSpace, capitalize,
+      nullptr);
 }
 
 const StenoDictionary *StenoEmilySymbolsDictionary::GetLookupProvider(
@@ -265,6 +266,15 @@ const char *StenoEmilySymbolsDictionary::GetName() const {
   return "emily-symbols";
 }
 
+StenoDictionaryLookupFilter
+StenoEmilySymbolsDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter{
+      .strokeMask = ACTIVATION_MASK,
+      .strokeMatch = ACTIVATION_MATCH,
+      .lengthMask = StenoDictionaryLookupFilter::GetLengthBit(1),
+  };
+}
+
 bool StenoEmilySymbolsDictionary::PrintDictionary(bool hasData) const {
   char strokeBuffer[32];
   char translationBuffer[32];
@@ -39,6 +39,10 @@ constexpr StenoStroke DIGIT_MASKS[] = {
 };
 const char *const DIGIT_VALUES = "1234506789";
 
+// Each stroke adds at most 16 characters, and the final stroke's suffix at
+// most 9 more.
+const size_t MAXIMUM_TEXT_LENGTH = 10 * 16 + 9 + 1;
+
 //---------------------------------------------------------------------------
 
 static bool _EndsWith(char *p, size_t length, const char *suffix,
@@ -63,30 +67,39 @@ bool EndsWith(char *p, size_t length, const char (&suffix)[N]) {
   return _EndsWith(p, length, suffix, N - 1);
 }
 
+// Returns the new end of text.
+static char *Append(char *end, const char *suffix) {
+  size_t length = strlen(suffix);
+  memcpy(end, suffix, length + 1);
+  return end + length;
+}
+
+// Returns the new end of text.
+static char *Prepend(char *text, char *end, char prefix) {
+  memmove(text + 1, text, end - text + 1);
+  *text = prefix;
+  return end + 1;
+}
+
 //---------------------------------------------------------------------------
 
 StenoDictionaryLookupResult
 StenoJeffNumbersDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
-  char *result = nullptr;
-  char scratch[32];
+  char result[MAXIMUM_TEXT_LENGTH];
+  char *end = result;
+  char *words = nullptr;
 
   const StenoStroke *strokes = lookup.strokes;
   size_t length = lookup.length;
+  assert(length <= GetMaximumOutlineLength());
 
   for (size_t i = 0; i < length; ++i) {
     if ((strokes[i] & StrokeMask::NUM).IsEmpty()) {
-      free(result);
       return StenoDictionaryLookupResult::CreateInvalid();
     }
 
-    StenoStroke control = GetDigits(scratch, strokes[i]);
-    if (result) {
-      char *updated = Str::Join(result, scratch, nullptr);
-      free(result);
-      result = updated;
-    } else {
-      result = Str::Dup(scratch);
-    }
+    StenoStroke control = GetDigits(end, strokes[i]);
+    end += strlen(end);
 
     const StenoStroke RB = StrokeMask::RR | StrokeMask::BR;
     const StenoStroke WR = StrokeMask::WL | StrokeMask::RL;
@@ -97,58 +110,43 @@ StenoJeffNumbersDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
     if ((control & RB) == RB) {
       // Dollars
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
       control &= ~RB;
-      char *updated = Str::Asprintf("$%s", result);
-      free(result);
-      result = updated;
+      end = Prepend(result, end, '$');
     } else if ((control & WR) == WR) {
       // Dollars
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
       control &= ~WR;
-      char *updated = Str::Asprintf("$%s", result);
-      free(result);
-      result = updated;
+      end = Prepend(result, end, '$');
     } else if ((control & KR) == KR) {
       // Percent
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
       control &= ~KR;
-      char *updated = Str::Asprintf("%s%%", result);
-      free(result);
-      result = updated;
+      end = Append(end, "%");
     } else if ((control & RG) == RG) {
       // Percent
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
       control &= ~RG;
-      char *updated = Str::Asprintf("%s%%", result);
-      free(result);
-      result = updated;
+      end = Append(end, "%");
     } else if ((control & DZ) == DZ) {
       // Hundreds of dollars.
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
       control &= ~DZ;
-      char *updated = Str::Asprintf("$%s00", result);
-      free(result);
-      result = updated;
+      end = Prepend(result, end, '$');
+      end = Append(end, "00");
     } else if ((control & StrokeMask::KL).IsNotEmpty() ||
                ((control & BG) == BG)) {
       // Time
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
       const char *minutes;
@@ -169,38 +167,37 @@ StenoJeffNumbersDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
         suffix = (control & StrokeMask::STAR).IsNotEmpty() ? " p.m." : " a.m.";
       }
 
-      char *updated = Str::Join(result, minutes, suffix, nullptr);
-      free(result);
-      result = updated;
+      end = Append(end, minutes);
+      end = Append(end, suffix);
       control &=
           ~(StrokeMask::KL | StrokeMask::BR | StrokeMask::GR | StrokeMask::SR);
     } else if ((control & StrokeMask::GR).IsNotEmpty()) {
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
 
-      result = ToWords(result);
+      // Words can be far longer than the digits, so they stay on the heap.
+      words = ToWords(Str::Dup(result));
       if ((control & StrokeMask::WL).IsNotEmpty()) {
         // Ordinal words
-        size_t length = strlen(result);
-        if (EndsWith(result, length, "ty")) {
+        size_t length = strlen(words);
+        if (EndsWith(words, length, "ty")) {
           // cSpell: disable-next-line
-          result = ReplaceSuffix(result, length, 1, "ieth");
-        } else if (EndsWith(result, length, "one")) {
-          result = ReplaceSuffix(result, length, 3, "first");
-        } else if (EndsWith(result, length, "two")) {
-          result = ReplaceSuffix(result, length, 3, "second");
-        } else if (EndsWith(result, length, "three")) {
-          result = ReplaceSuffix(result, length, 5, "third");
-        } else if (EndsWith(result, length, "ve")) {
-          result = ReplaceSuffix(result, length, 2, "fth");
-        } else if (EndsWith(result, length, "eight")) {
-          result = ReplaceSuffix(result, length, 0, "h");
-        } else if (EndsWith(result, length, "nine")) {
-          result = ReplaceSuffix(result, length, 1, "th");
+          words = ReplaceSuffix(words, length, 1, "ieth");
+        } else if (EndsWith(words, length, "one")) {
+          words = ReplaceSuffix(words, length, 3, "first");
+        } else if (EndsWith(words, length, "two")) {
+          words = ReplaceSuffix(words, length, 3, "second");
+        } else if (EndsWith(words, length, "three")) {
+          words = ReplaceSuffix(words, length, 5, "third");
+        } else if (EndsWith(words, length, "ve")) {
+          words = ReplaceSuffix(words, length, 2, "fth");
+        } else if (EndsWith(words, length, "eight")) {
+          words = ReplaceSuffix(words, length, 0, "h");
+        } else if (EndsWith(words, length, "nine")) {
+          words = ReplaceSuffix(words, length, 1, "th");
         } else {
-          result = ReplaceSuffix(result, length, 0, "th");
+          words = ReplaceSuffix(words, length, 0, "th");
         }
       }
 
@@ -208,7 +205,6 @@ StenoJeffNumbersDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
     } else if ((control & (StrokeMask::WL | StrokeMask::BR)).IsNotEmpty()) {
       // Ordinals
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
 
@@ -237,15 +233,12 @@ StenoJeffNumbersDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
         }
       }
 
-      char *updated = Str::Asprintf("%s%s", result, suffix);
-      free(result);
-      result = updated;
+      end = Append(end, suffix);
 
       control &= ~(StrokeMask::WL | StrokeMask::BR);
     } else if ((control & (StrokeMask::RL | StrokeMask::RR)).IsNotEmpty()) {
       // Roman numerals
       if (i + 1 != length) {
-        free(result);
         return StenoDictionaryLookupResult::CreateInvalid();
       }
 
@@ -260,29 +253,46 @@ StenoJeffNumbersDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
           break;
         }
       }
-      free(result);
       if (value <= 0 || value >= 3999) {
         return StenoDictionaryLookupResult::CreateInvalid();
       }
-      ToRoman(scratch, value);
-      result = Str::Dup(scratch);
+      ToRoman(result, value);
       control &= ~(StrokeMask::RL | StrokeMask::RR);
     }
 
     control &= ~(StrokeMask::STAR | StrokeMask::DR | StrokeMask::ZR);
     if (control.IsNotEmpty()) {
-      free(result);
+      free(words);
       return StenoDictionaryLookupResult::CreateInvalid();
     }
   }
 
-  return StenoDictionaryLookupResult::CreateDynamicString(result);
+  if (words == nullptr) {
+    return StenoDictionaryLookupResult::CreateJoinedString(lookup.arena, result,
+                                                           nullptr);
+  }
+
+  StenoDictionaryLookupResult wordsResult =
+      StenoDictionaryLookupResult::CreateJoinedString(lookup.arena, words,
+                                                      nullptr);
+  free(words);
+  return wordsResult;
 }
 
 const char *StenoJeffNumbersDictionary::GetName() const {
   return "jeff-numbers";
 }
 
+StenoDictionaryLookupFilter
+StenoJeffNumbersDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter{
+      .strokeMask = StrokeMask::NUM,
+      .strokeMatch = StrokeMask::NUM,
+      .lengthMask = StenoDictionaryLookupFilter::GetLengthBits(
+          1, GetMaximumOutlineLength()),
+  };
+}
+
 StenoStroke StenoJeffNumbersDictionary::GetDigits(char *p,
                                                   StenoStroke stroke) const {
 
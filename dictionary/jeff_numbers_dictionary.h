@@ -15,6 +15,7 @@ public:
   using StenoDictionary::Lookup;
 
   virtual size_t GetMaximumOutlineLength() const { return 10; }
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const;
   virtual const char *GetName() const;
   virtual bool PrintDictionary(bool hasData) const { return false; }
 
@@ -71,7 +71,8 @@ struct PhrasingParts {
   const JeffPhrasingStructure *structure;
   const JeffPhrasingEnder *ender;
 
-  char *CreatePhrase() const;
+  // buffer must have PatternMatch::MAX_REPLACEMENT_SIZE bytes capacity.
+  void CreatePhrase(char *buffer) const;
 };
 
 //---------------------------------------------------------------------------
@@ -281,7 +282,10 @@ StenoJeffPhrasingDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
     return StenoDictionaryLookupResult::CreateInvalid();
   }
 
-  return StenoDictionaryLookupResult::CreateDynamicString(parts.CreatePhrase());
+  char buffer[PatternMatch::MAX_REPLACEMENT_SIZE];
+  parts.CreatePhrase(buffer);
+  return StenoDictionaryLookupResult::CreateJoinedString(lookup.arena, buffer,
+                                                         nullptr);
 }
 
 const StenoDictionary *StenoJeffPhrasingDictionary::GetLookupProvider(
@@ -292,7 +296,7 @@ const StenoDictionary *StenoJeffPhrasingDictionary::GetLookupProvider(
   return parts.IsValid() ? this : nullptr;
 }
 
-char *PhrasingParts::CreatePhrase() const {
+void PhrasingParts::CreatePhrase(char *buffer) const {
   VerbForm verbForm = pronoun->verbForm;
   const char *middleText =
       middle->word.LookupWithDefaultOrSelf((uint32_t)ender->tense)
@@ -327,13 +331,22 @@ char *PhrasingParts::CreatePhrase() const {
   match.captures[5] = verbText + strlen(verbText);
   match.captures[6] = ender->suffix;
   match.captures[7] = ender->suffix + strlen(ender->suffix);
-  return match.Replace(structureText);
+  match.Replace(buffer, structureText);
 }
 
 const char *StenoJeffPhrasingDictionary::GetName() const {
   return "jeff-phrasing";
 }
 
+StenoDictionaryLookupFilter
+StenoJeffPhrasingDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter{
+      .strokeMask = StrokeMask::NUM,
+      .strokeMatch = 0,
+      .lengthMask = StenoDictionaryLookupFilter::GetLengthBit(1),
+  };
+}
+
 void StenoJeffPhrasingDictionary::ReverseLookup(
     StenoReverseDictionaryLookup &result) const {
   // Maximum phrase is 7 words (6 spaces).
@@ -20,6 +20,7 @@ public:
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
 
   virtual size_t GetMaximumOutlineLength() const { return 1; }
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const;
   virtual const char *GetName() const;
   virtual bool PrintDictionary(bool hasData) const { return false; }
   virtual void ReverseLookup(StenoReverseDictionaryLookup &result) const;
@@ -39,7 +39,7 @@ StenoDictionaryLookupResult StenoJeffShowStrokeDictionary::Lookup(
 
   bool closed = (strokes[length - 1] == trigger);
 
-  char *base = (char *)malloc(maximumStringLength);
+  char *base = (char *)alloca(maximumStringLength);
   char *p = base;
   *p++ = '`';
 
@@ -50,7 +50,8 @@ StenoDictionaryLookupResult StenoJeffShowStrokeDictionary::Lookup(
     p[1] = '\0';
   }
 
-  return StenoDictionaryLookupResult::CreateDynamicString(base);
+  return StenoDictionaryLookupResult::CreateJoinedString(lookup.arena, base,
+                                                         nullptr);
 }
 
 const StenoDictionary *StenoJeffShowStrokeDictionary::GetLookupProvider(
@@ -77,6 +78,16 @@ const char *StenoJeffShowStrokeDictionary::GetName() const {
   return "jeff-show-stroke";
 }
 
+StenoDictionaryLookupFilter
+StenoJeffShowStrokeDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter{
+      .strokeMask = StrokeMask::ALL,
+      .strokeMatch = trigger,
+      .lengthMask = StenoDictionaryLookupFilter::GetLengthBits(
+          1, GetMaximumOutlineLength()),
+  };
+}
+
 //---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 
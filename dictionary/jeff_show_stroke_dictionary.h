@@ -17,6 +17,7 @@ public:
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
 
   virtual size_t GetMaximumOutlineLength() const { return 6; }
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const;
   virtual const char *GetName() const;
   virtual bool PrintDictionary(bool hasData) const { return false; }
 
@@ -19,6 +19,13 @@ const uint8_t data1[24] = {
 const StenoHashMapEntryBlock offsets1[] = {
   { 0x09000000, 0x00000000, 0x10000000, 0x00000080, 0 },
 };
+const uint8_t fingerprints1[4] = {
+  0x45, 0x50, 0x5e, 0xbc,
+};
+const size_t prefixFilterSize1 = 32;
+const uint32_t prefixFilter1[] = {
+  0x08000000,
+};
 
 const size_t hashMapSize2 = 128;
 const uint8_t data2[9] = {
@@ -27,6 +34,9 @@ const uint8_t data2[9] = {
 const StenoHashMapEntryBlock offsets2[] = {
   { 0x00000000, 0x00000080, 0x00000000, 0x00000000, 0 },
 };
+const uint8_t fingerprints2[1] = {
+  0x64,
+};
 
 
 const StenoMapDictionaryStrokesDefinition strokes[] = {
@@ -34,11 +44,18 @@ const StenoMapDictionaryStrokesDefinition strokes[] = {
   {.hashMapSize = hashMapSize2, .data = data2, .offsets = offsets2},
 };
 
+const StenoMapDictionaryStrokesExtension extensions[] = {
+  {.fingerprints = fingerprints1, .prefixFilterSize = prefixFilterSize1, .prefixFilter = prefixFilter1},
+  {.fingerprints = fingerprints2, .prefixFilterSize = 0, .prefixFilter = nullptr},
+};
+
 constexpr StenoMapDictionaryDefinition MainDictionary::definition = {
   true,
   2,
+  1,
   0,
   "main.json",
   textBlock,
   strokes,
+  extensions,
 };
@@ -17,6 +17,38 @@ size_t StenoHashMapEntryBlock::PopCount() const {
   return result;
 }
 
+size_t StenoHashMapEntryBlock::GetOffset(size_t bitIndex) const {
+  size_t maskIndex = bitIndex / 32;
+
+  // Take advantage of sign bit to test presence.
+  uint32_t mask = masks[maskIndex];
+  mask <<= (31 - bitIndex % 32);
+  if ((mask & 0x80000000) == 0) {
+    return (size_t)-1;
+  }
+
+  // mask << 1 prevents counting the current bit.
+  size_t result = Bit<sizeof(uint32_t)>::PopCount(mask << 1) + baseOffset;
+  for (size_t i = 0; i < maskIndex; ++i) {
+    result += Bit<sizeof(uint32_t)>::PopCount(masks[i]);
+  }
+
+  return result;
+}
+
+size_t StenoHashMapCountedEntryBlock::GetOffset(size_t bitIndex) const {
+  size_t maskIndex = bitIndex / 32;
+
+  uint32_t mask = masks[maskIndex];
+  mask <<= (31 - bitIndex % 32);
+  if ((mask & 0x80000000) == 0) {
+    return (size_t)-1;
+  }
+
+  return Bit<sizeof(uint32_t)>::PopCount(mask << 1) + baseOffset +
+         maskOffsets[maskIndex];
+}
+
 //---------------------------------------------------------------------------
 
 struct StenoMapDictionaryDataEntry {
@@ -46,56 +78,18 @@ void StenoMapDictionaryDataEntry::ExpandTo(StenoStroke *strokes,
 
 //---------------------------------------------------------------------------
 
-size_t StenoMapDictionaryStrokesDefinition::GetOffset(size_t index) const {
-  size_t blockIndex = index / 128;
-  size_t blockBitIndex = index % 128;
-  size_t maskIndex = blockBitIndex / 32;
-  size_t bitIndex = blockBitIndex % 32;
-
-  const StenoHashMapEntryBlock &block = offsets[blockIndex];
-
-  // Take advantage of sign bit to test presence.
-  uint32_t mask = block.masks[maskIndex];
-  mask <<= (31 - bitIndex);
-  if ((mask & 0x80000000) == 0) {
-    return (size_t)-1;
-  }
-
-  // mask << 1 prevents counting the current bit.
-  size_t result = Bit<sizeof(uint32_t)>::PopCount(mask << 1) + block.baseOffset;
-  for (size_t i = 0; i < maskIndex; ++i) {
-    result += Bit<sizeof(uint32_t)>::PopCount(block.masks[i]);
-  }
-
-  return result;
-}
-
-bool StenoMapDictionaryStrokesDefinition::HasEntry(size_t index) const {
-  size_t blockIndex = index / 128;
-  size_t blockBitIndex = index % 128;
-  size_t maskIndex = blockBitIndex / 32;
-  size_t bitIndex = blockBitIndex % 32;
-
-  const StenoHashMapEntryBlock &block = offsets[blockIndex];
-
-  // Take advantage of sign bit to test presence.
-  uint32_t mask = block.masks[maskIndex];
-  mask <<= (31 - bitIndex);
-  return (mask & 0x80000000) != 0;
-}
-
+template <typename T>
 size_t StenoMapDictionaryStrokesDefinition::GetEntryCount() const {
   size_t entryCount = 0;
-  for (size_t i = 0; i < hashMapSize / 128; ++i) {
-    entryCount += offsets[i].PopCount();
+  for (size_t i = 0; i < hashMapSize; i += 128) {
+    entryCount += GetBlock<T>(i).PopCount();
   }
   return entryCount;
 }
 
-bool StenoMapDictionaryStrokesDefinition::PrintDictionary(
-    bool hasData, size_t strokeLength, char *buffer,
-    const uint8_t *textBlock) const {
-  size_t entryCount = GetEntryCount();
+static bool PrintEntries(const uint8_t *data, bool hasData,
+                         size_t strokeLength, size_t entryCount, char *buffer,
+                         const uint8_t *textBlock) {
   for (size_t i = 0; i < entryCount; ++i) {
     if (!hasData) {
       hasData = true;
@@ -130,79 +124,145 @@ bool StenoMapDictionaryStrokesDefinition::PrintDictionary(
 
 //---------------------------------------------------------------------------
 
-StenoDictionaryLookupResult
-StenoMapDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
+size_t StenoMapDictionaryPerfectHashStrokes::GetSlot(const StenoStroke *strokes,
+                                                    size_t length) const {
+  uint32_t keyHash = GetKeyHash(strokes, length, seed);
+  size_t partition = GetPartition(keyHash);
+  size_t partitionOffset = partitionOffsets[partition];
+  size_t partitionSize = partitionOffsets[partition + 1] - partitionOffset;
+  uint32_t pilot = pilots[(partition << bucketBits) + GetBucket(keyHash)];
+  return partitionOffset + GetPilotSlot(keyHash, pilot, partitionSize);
+}
+
+//---------------------------------------------------------------------------
+
+const StenoMapDictionaryDataEntry *
+StenoMapDictionary::FindEntry(const StenoDictionaryLookup &lookup) const {
+  if (definition.HasPerfectHash()) {
+    return FindPerfectHashEntry(lookup);
+  }
+  if (definition.HasCountedBlocks()) {
+    return FindEntry<StenoHashMapCountedEntryBlock>(lookup);
+  }
+  return FindEntry<StenoHashMapEntryBlock>(lookup);
+}
+
+const StenoMapDictionaryDataEntry *StenoMapDictionary::FindPerfectHashEntry(
+    const StenoDictionaryLookup &lookup) const {
+  const StenoMapDictionaryPerfectHashStrokes &perfectHashStrokes =
+      definition.perfectHashStrokes[lookup.length - 1];
+  if (perfectHashStrokes.entryCount == 0) {
+    return nullptr;
+  }
+
+  // Size of StenoMapDictionaryDataEntry for this length.
+  const size_t entrySize = 3 + 3 * lookup.length;
+  size_t slot = perfectHashStrokes.GetSlot(lookup.strokes, lookup.length);
+  const StenoMapDictionaryDataEntry &entry =
+      (const StenoMapDictionaryDataEntry &)
+          perfectHashStrokes.data[slot * entrySize];
+
+  // Every slot is occupied, so misses are rejected by comparing strokes.
+  return entry.Equals(lookup.strokes, lookup.length) ? &entry : nullptr;
+}
+
+template <typename T>
+const StenoMapDictionaryDataEntry *
+StenoMapDictionary::FindEntry(const StenoDictionaryLookup &lookup) const {
   const StenoMapDictionaryStrokesDefinition &strokesDefinition =
       definition.strokes[lookup.length - 1];
   if (strokesDefinition.hashMapSize == 0) {
-    return StenoDictionaryLookupResult::CreateInvalid();
+    return nullptr;
   }
 
   size_t entryIndex = lookup.hash & (strokesDefinition.hashMapSize - 1);
-  const size_t offset = strokesDefinition.GetOffset(entryIndex);
+  size_t offset = strokesDefinition.GetOffset<T>(entryIndex);
   if (offset == (size_t)-1) {
-    return StenoDictionaryLookupResult::CreateInvalid();
+    return nullptr;
   }
 
+  const StenoMapDictionaryStrokesExtension *extension =
+      definition.GetExtension(lookup.length);
+  const uint8_t *fingerprints = extension ? extension->fingerprints : nullptr;
+  const uint8_t fingerprint =
+      StenoMapDictionaryStrokesExtension::GetFingerprint(lookup.hash);
+
   // Size of StenoMapDictionaryDataEntry for this length.
   const size_t entrySize = 3 + 3 * lookup.length;
-  size_t dataIndex = offset * entrySize;
 
   for (;;) {
-    const StenoMapDictionaryDataEntry &entry =
-        (const StenoMapDictionaryDataEntry &)strokesDefinition.data[dataIndex];
+    if (fingerprints == nullptr || fingerprints[offset] == fingerprint) {
+      const StenoMapDictionaryDataEntry &entry =
+          (const StenoMapDictionaryDataEntry &)
+              strokesDefinition.data[offset * entrySize];
 
-    if (entry.Equals(lookup.strokes, lookup.length)) {
-      const uint8_t *text = definition.textBlock + entry.textOffset.ToUint32();
-      return StenoDictionaryLookupResult::CreateStaticString(text);
+      if (entry.Equals(lookup.strokes, lookup.length)) {
+        return &entry;
+      }
     }
 
-    dataIndex += entrySize;
+    ++offset;
     if (++entryIndex >= strokesDefinition.hashMapSize) {
       entryIndex = 0;
-      dataIndex = 0;
+      offset = 0;
     }
 
-    if (!strokesDefinition.HasEntry(entryIndex)) {
-      return StenoDictionaryLookupResult::CreateInvalid();
+    if (!strokesDefinition.HasEntry<T>(entryIndex)) {
+      return nullptr;
     }
   }
 }
-const StenoDictionary *StenoMapDictionary::GetLookupProvider(
-    const StenoDictionaryLookup &lookup) const {
-  const StenoMapDictionaryStrokesDefinition &strokesDefinition =
-      definition.strokes[lookup.length - 1];
-  if (strokesDefinition.hashMapSize == 0) {
-    return nullptr;
-  }
 
-  size_t entryIndex = lookup.hash & (strokesDefinition.hashMapSize - 1);
-  const size_t offset = strokesDefinition.GetOffset(entryIndex);
-  if (offset == (size_t)-1) {
-    return nullptr;
+StenoDictionaryLookupResult
+StenoMapDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
+  const StenoMapDictionaryDataEntry *entry = FindEntry(lookup);
+  if (entry == nullptr) {
+    return StenoDictionaryLookupResult::CreateInvalid();
   }
 
-  const size_t entrySize = 3 + 3 * lookup.length;
-  size_t dataIndex = offset * entrySize;
+  const uint8_t *text = definition.textBlock + entry->textOffset.ToUint32();
+  return StenoDictionaryLookupResult::CreateStaticString(text);
+}
 
-  for (;;) {
-    const StenoMapDictionaryDataEntry &entry =
-        (const StenoMapDictionaryDataEntry &)strokesDefinition.data[dataIndex];
+StenoDictionaryLookupResult
+StenoMapDictionary::LookupLongest(const StenoDictionaryPrefixLookup &lookup,
+                                  size_t minimumLength, size_t maximumLength,
+                                  size_t &length) const {
+  if (maximumLength > definition.maximumStrokeCount) {
+    maximumLength = definition.maximumStrokeCount;
+  }
 
-    if (entry.Equals(lookup.strokes, lookup.length)) {
-      return this;
+  // No outline can extend a prefix that its filter rejects.
+  for (size_t i = 1; i < maximumLength; ++i) {
+    const StenoMapDictionaryStrokesExtension *extension =
+        definition.GetExtension(i);
+    if (extension == nullptr) {
+      break;
+    }
+    if (extension->HasPrefixFilter() &&
+        !extension->MayBePrefix(lookup.GetHash(i))) {
+      maximumLength = i;
+      break;
     }
+  }
 
-    dataIndex += entrySize;
-    if (++entryIndex >= strokesDefinition.hashMapSize) {
-      entryIndex = 0;
-      dataIndex = 0;
+  for (size_t i = maximumLength; i >= minimumLength && i > 0; --i) {
+    if (!definition.HasOutlines(i)) {
+      continue;
     }
 
-    if (!strokesDefinition.HasEntry(entryIndex)) {
-      return nullptr;
+    StenoDictionaryLookupResult result = Lookup(lookup.GetLookup(i));
+    if (result.IsValid()) {
+      length = i;
+      return result;
     }
   }
+  return StenoDictionaryLookupResult::CreateInvalid();
+}
+
+const StenoDictionary *StenoMapDictionary::GetLookupProvider(
+    const StenoDictionaryLookup &lookup) const {
+  return FindEntry(lookup) ? this : nullptr;
 }
 
 bool StenoMapDictionary::ReverseMapDictionaryLookup(
@@ -210,25 +270,33 @@ bool StenoMapDictionary::ReverseMapDictionaryLookup(
   const void *data = lookup.data;
 
   // Quick reject
-  if (data < definition.strokes[0].data) {
-    return false;
-  }
-  if (data >= definition.strokes[definition.maximumStrokeCount - 1].offsets) {
-    return false;
+  const size_t maximumStrokeCount = definition.maximumStrokeCount;
+  if (definition.HasPerfectHash()) {
+    if (data < definition.perfectHashStrokes[0].data) {
+      return false;
+    }
+    if (data >= definition.perfectHashStrokes[maximumStrokeCount - 1]
+                    .GetDataEnd(maximumStrokeCount)) {
+      return false;
+    }
+  } else {
+    if (data < definition.strokes[0].data) {
+      return false;
+    }
+    if (data >= definition.strokes[maximumStrokeCount - 1].offsets) {
+      return false;
+    }
   }
 
-  for (size_t i = 0; i < definition.maximumStrokeCount; ++i) {
-    const StenoMapDictionaryStrokesDefinition &strokeDefinition =
-        definition.strokes[i];
-
-    if (!strokeDefinition.ContainsData(data)) {
+  for (size_t i = 0; i < maximumStrokeCount; ++i) {
+    size_t strokeLength = i + 1;
+    if (!definition.ContainsData(data, strokeLength)) {
       continue;
     }
 
     // There is a match! Convert it to StenoStrokes.
     const StenoMapDictionaryDataEntry *entry =
         (const StenoMapDictionaryDataEntry *)data;
-    size_t strokeLength = i + 1;
     entry->ExpandTo(lookup.strokes, strokeLength);
     lookup.length = strokeLength;
     lookup.provider = this;
@@ -242,12 +310,22 @@ const char *StenoMapDictionary::GetName() const { return definition.name; }
 void StenoMapDictionary::PrintInfo(int depth) const {
   const uint8_t *start = (const uint8_t *)&definition;
 
-  const StenoMapDictionaryStrokesDefinition &lastStrokeDefinition =
-      definition.strokes[definition.maximumStrokeCount - 1];
-
-  const uint8_t *end =
-      (const uint8_t *)(lastStrokeDefinition.offsets +
-                        lastStrokeDefinition.hashMapSize / 128);
+  const size_t lastIndex = definition.maximumStrokeCount - 1;
+
+  const uint8_t *end;
+  if (definition.HasPerfectHash()) {
+    // Each length's pilots follow its data.
+    const StenoMapDictionaryPerfectHashStrokes &lastPerfectHashStrokes =
+        definition.perfectHashStrokes[lastIndex];
+    end = (const uint8_t *)(lastPerfectHashStrokes.pilots +
+                            lastPerfectHashStrokes.GetPilotCount());
+  } else if (definition.HasCountedBlocks()) {
+    end = (const uint8_t *)definition.strokes[lastIndex]
+              .GetOffsetsEnd<StenoHashMapCountedEntryBlock>();
+  } else {
+    end = (const uint8_t *)definition.strokes[lastIndex]
+              .GetOffsetsEnd<StenoHashMapEntryBlock>();
+  }
 
   Console::Printf("%s%s: %zu bytes\n", Spaces(depth), GetName(), end - start);
 }
@@ -255,8 +333,22 @@ void StenoMapDictionary::PrintInfo(int depth) const {
 bool StenoMapDictionary::PrintDictionary(bool hasData) const {
   char *buffer = (char *)malloc(2048);
   for (size_t i = 0; i < definition.maximumStrokeCount; ++i) {
-    if (definition.strokes[i].PrintDictionary(hasData, i + 1, buffer,
-                                              definition.textBlock)) {
+    const uint8_t *data;
+    size_t entryCount;
+    if (definition.HasPerfectHash()) {
+      data = definition.perfectHashStrokes[i].data;
+      entryCount = definition.perfectHashStrokes[i].entryCount;
+    } else {
+      const StenoMapDictionaryStrokesDefinition &strokesDefinition =
+          definition.strokes[i];
+      data = strokesDefinition.data;
+      entryCount =
+          definition.HasCountedBlocks()
+              ? strokesDefinition.GetEntryCount<StenoHashMapCountedEntryBlock>()
+              : strokesDefinition.GetEntryCount<StenoHashMapEntryBlock>();
+    }
+    if (PrintEntries(data, hasData, i + 1, entryCount, buffer,
+                     definition.textBlock)) {
       hasData = true;
     }
   }
@@ -270,6 +362,17 @@ size_t StenoMapDictionary::GetMaximumOutlineLength() const {
   return definition.maximumStrokeCount;
 }
 
+StenoDictionaryLookupFilter StenoMapDictionary::GetLookupFilter() const {
+  StenoDictionaryLookupFilter filter =
+      StenoDictionaryLookupFilter::CreateNone();
+  for (size_t i = 0; i < definition.maximumStrokeCount; ++i) {
+    if (definition.HasOutlines(i + 1)) {
+      filter.lengthMask |= StenoDictionaryLookupFilter::GetLengthBit(i + 1);
+    }
+  }
+  return filter;
+}
+
 //---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 
@@ -308,4 +411,200 @@ TEST_BEGIN("MapDictionary: Double stroke lookup test") {
 }
 TEST_END
 
+TEST_BEGIN("MapDictionary: LookupLongest finds the longest prefix") {
+  // spellchecker: disable
+  const StenoStroke strokes[3] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("-D"),
+  };
+  // spellchecker: enable
+
+  StenoDictionaryPrefixLookup prefixLookup(strokes, 3);
+  for (size_t i = 1; i <= 3; ++i) {
+    assert(prefixLookup.GetHash(i) == StenoStroke::Hash(strokes, i));
+  }
+
+  size_t length = 0;
+  auto lookup = mainDictionary.LookupLongest(prefixLookup, 1, 3, length);
+  assert(lookup.IsValid());
+  assert(length == 2);
+  assert(strcmp(lookup.GetText(), "tested") == 0);
+  lookup.Destroy();
+
+  lookup = mainDictionary.LookupLongest(prefixLookup, 1, 1, length);
+  assert(lookup.IsValid());
+  assert(length == 1);
+  assert(strcmp(lookup.GetText(), "test") == 0);
+  lookup.Destroy();
+
+  lookup = mainDictionary.LookupLongest(prefixLookup, 3, 3, length);
+  assert(!lookup.IsValid());
+}
+TEST_END
+
+TEST_BEGIN("MapDictionary: Prefix filter rejects impossible prefixes") {
+  // spellchecker: disable
+  const StenoMapDictionaryStrokesExtension *extension =
+      MainDictionary::definition.GetExtension(1);
+  assert(extension != nullptr);
+  assert(extension->HasPrefixFilter());
+  assert(extension->MayBePrefix(StenoStroke("TEFT").Hash()));
+  assert(!extension->MayBePrefix(StenoStroke("-G").Hash()));
+
+  // -G is a valid outline, and no longer outline starts with it.
+  const StenoStroke strokes[2] = {
+      StenoStroke("-G"),
+      StenoStroke("-D"),
+  };
+  // spellchecker: enable
+
+  size_t length = 0;
+  StenoDictionaryPrefixLookup prefixLookup(strokes, 2);
+  auto lookup = mainDictionary.LookupLongest(prefixLookup, 1, 2, length);
+  assert(lookup.IsValid());
+  assert(length == 1);
+  lookup.Destroy();
+
+  lookup = mainDictionary.LookupLongest(prefixLookup, 2, 2, length);
+  assert(!lookup.IsValid());
+}
+TEST_END
+
+TEST_BEGIN("MapDictionary: Layout version 0 lookups") {
+  // spellchecker: disable
+  const StenoStroke strokes[3] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("-G"),
+  };
+  // spellchecker: enable
+
+  StenoMapDictionaryDefinition definition = MainDictionary::definition;
+  definition.layoutVersion = 0;
+  definition.extensions = nullptr;
+  StenoMapDictionary dictionary(definition);
+
+  StenoDictionaryLookupResult lookup =
+      dictionary.Lookup(StenoDictionaryLookup(strokes, 1));
+  assert(lookup.IsValid());
+  assert(strcmp(lookup.GetText(), "test") == 0);
+  lookup.Destroy();
+
+  size_t length = 0;
+  StenoDictionaryPrefixLookup prefixLookup(strokes, 3);
+  lookup = dictionary.LookupLongest(prefixLookup, 1, 3, length);
+  assert(lookup.IsValid());
+  assert(length == 2);
+  assert(strcmp(lookup.GetText(), "tested") == 0);
+  lookup.Destroy();
+}
+TEST_END
+
+TEST_BEGIN("MapDictionary: Fingerprints reject entries before comparing") {
+  // spellchecker: disable
+  const StenoStroke strokes[1] = {
+      StenoStroke("TEFT"),
+  };
+  // spellchecker: enable
+  const StenoDictionaryLookup lookup(strokes, 1);
+
+  const StenoMapDictionaryDefinition &mainDefinition =
+      MainDictionary::definition;
+  const StenoMapDictionaryStrokesExtension *extension =
+      mainDefinition.GetExtension(1);
+  assert(extension != nullptr && extension->fingerprints != nullptr);
+
+  const size_t entryCount =
+      mainDefinition.strokes[0].GetEntryCount<StenoHashMapEntryBlock>();
+  uint8_t fingerprints[8];
+  assert(entryCount <= sizeof(fingerprints));
+  for (size_t i = 0; i < entryCount; ++i) {
+    fingerprints[i] = extension->fingerprints[i] ^ 0xff;
+  }
+
+  StenoMapDictionaryStrokesExtension extensions[2] = {
+      mainDefinition.extensions[0],
+      mainDefinition.extensions[1],
+  };
+  extensions[0].fingerprints = fingerprints;
+  StenoMapDictionaryDefinition definition = mainDefinition;
+  definition.extensions = extensions;
+
+  // Every fingerprint mismatches, so no entry is compared.
+  StenoMapDictionary dictionary(definition);
+  assert(!dictionary.Lookup(lookup).IsValid());
+}
+TEST_END
+
+static void CreateCountedBlocks(StenoHashMapCountedEntryBlock *countedBlocks,
+                                const StenoHashMapEntryBlock *blocks,
+                                size_t blockCount) {
+  for (size_t i = 0; i < blockCount; ++i) {
+    StenoHashMapCountedEntryBlock &countedBlock = countedBlocks[i];
+    (StenoHashMapEntryBlock &)countedBlock = blocks[i];
+
+    size_t maskOffset = 0;
+    for (size_t j = 0; j < 4; ++j) {
+      countedBlock.maskOffsets[j] = maskOffset;
+      maskOffset += Bit<sizeof(uint32_t)>::PopCount(blocks[i].masks[j]);
+    }
+  }
+}
+
+TEST_BEGIN("MapDictionary: Counted blocks match plain blocks") {
+  // spellchecker: disable
+  const StenoStroke strokes[3] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("-G"),
+  };
+  // spellchecker: enable
+
+  const StenoMapDictionaryDefinition &mainDefinition =
+      MainDictionary::definition;
+  assert(mainDefinition.maximumStrokeCount == 2);
+
+  StenoHashMapCountedEntryBlock countedBlocks[2][1];
+  StenoMapDictionaryStrokesDefinition strokesDefinitions[2];
+  for (size_t i = 0; i < 2; ++i) {
+    const StenoMapDictionaryStrokesDefinition &strokesDefinition =
+        mainDefinition.strokes[i];
+    assert(strokesDefinition.hashMapSize == 128);
+    CreateCountedBlocks(countedBlocks[i], strokesDefinition.offsets, 1);
+
+    strokesDefinitions[i] = strokesDefinition;
+    strokesDefinitions[i].offsets = countedBlocks[i];
+
+    for (size_t j = 0; j < strokesDefinition.hashMapSize; ++j) {
+      assert(strokesDefinition.GetOffset<StenoHashMapEntryBlock>(j) ==
+             strokesDefinitions[i]
+                 .GetOffset<StenoHashMapCountedEntryBlock>(j));
+    }
+    assert(strokesDefinition.GetEntryCount<StenoHashMapEntryBlock>() ==
+           strokesDefinitions[i]
+               .GetEntryCount<StenoHashMapCountedEntryBlock>());
+  }
+
+  StenoMapDictionaryDefinition definition = mainDefinition;
+  definition.layoutVersion = 2;
+  definition.strokes = strokesDefinitions;
+  assert(definition.HasCountedBlocks());
+  StenoMapDictionary dictionary(definition);
+
+  StenoDictionaryLookupResult lookup =
+      dictionary.Lookup(StenoDictionaryLookup(strokes, 1));
+  assert(lookup.IsValid());
+  assert(strcmp(lookup.GetText(), "test") == 0);
+  lookup.Destroy();
+
+  lookup = dictionary.Lookup(StenoDictionaryLookup(strokes, 2));
+  assert(lookup.IsValid());
+  assert(strcmp(lookup.GetText(), "tested") == 0);
+  lookup.Destroy();
+
+  assert(!dictionary.Lookup(StenoDictionaryLookup(strokes + 1, 1)).IsValid());
+}
+TEST_END
+
 //---------------------------------------------------------------------------
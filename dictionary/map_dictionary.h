@@ -5,6 +5,7 @@
 
 //---------------------------------------------------------------------------
 
+struct StenoMapDictionaryDataEntry;
 struct StenoMapDictionaryDefinition;
 
 //---------------------------------------------------------------------------
@@ -18,6 +19,10 @@ public:
   Lookup(const StenoDictionaryLookup &lookup) const;
   using StenoDictionary::Lookup;
 
+  virtual StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+                size_t maximumLength, size_t &length) const;
+
   virtual const StenoDictionary *
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
 
@@ -25,12 +30,26 @@ public:
   ReverseMapDictionaryLookup(StenoReverseMapDictionaryLookup &lookup) const;
 
   virtual size_t GetMaximumOutlineLength() const;
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const;
   virtual const char *GetName() const;
   virtual void PrintInfo(int depth) const;
   virtual bool PrintDictionary(bool hasData) const;
 
 private:
   const StenoMapDictionaryDefinition &definition;
+
+  // Returns nullptr if there is no entry for the lookup.
+  const StenoMapDictionaryDataEntry *
+  FindEntry(const StenoDictionaryLookup &lookup) const;
+
+  // T is the StenoHashMapEntryBlock type for the layout version.
+  template <typename T>
+  const StenoMapDictionaryDataEntry *
+  FindEntry(const StenoDictionaryLookup &lookup) const;
+
+  // Layout version 3.
+  const StenoMapDictionaryDataEntry *
+  FindPerfectHashEntry(const StenoDictionaryLookup &lookup) const;
 };
 
 //---------------------------------------------------------------------------
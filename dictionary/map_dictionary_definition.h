@@ -30,6 +30,68 @@
 //  Overall, this reduces the memory requirements from 512 bytes per 128
 //  hashmap entries to just 20 bytes -- a 25x savings.
 //
+//  Layout Versions:
+//
+//  Version 0 is the original JSC1 layout. Version 1 adds a
+//  StenoMapDictionaryStrokesExtension for each length, which is kept in a
+//  separate array so that StenoMapDictionaryStrokesDefinition, and with it
+//  any existing dictionary data, is unchanged.
+//
+//  Version 2 is version 1 with StenoHashMapCountedEntryBlock offsets. It
+//  must only be used in collections with
+//  STENO_MAP_DICTIONARY_COLLECTION_COUNTED_BLOCKS_MAGIC, since earlier
+//  firmware cannot read it.
+//
+//  Version 3 is version 1 with StenoMapDictionaryPerfectHashStrokes
+//  instead of StenoMapDictionaryStrokesDefinition. It must only be used in
+//  collections with STENO_MAP_DICTIONARY_COLLECTION_PERFECT_HASH_MAGIC,
+//  since earlier firmware cannot read it.
+//
+//  Counted Blocks:
+//
+//  A StenoHashMapEntryBlock offset lookup popcounts up to three preceding
+//  masks in addition to the one being inspected. Counted blocks also store
+//  the number of entries before each mask, which needs at most 7 bits, so
+//  an offset is a single popcount plus two adds.
+//
+//  This costs 4 bytes per block, i.e. 24 bytes instead of 20 per 128
+//  hashmap entries.
+//
+//  Perfect Hash:
+//
+//  Linear probing walks a chain on collisions, and misses walk until the
+//  next empty slot. Version 3 instead builds a minimal perfect hash offline
+//  for each length, so each outline has exactly one candidate entry and
+//  there is no occupancy bitmap. The entry's strokes are still compared,
+//  which rejects misses.
+//
+//  The hash is PTHash style: keys are split into partitions of about 1024
+//  keys, and each partition into buckets of about 4 keys. Each bucket has a
+//  16-bit pilot, found by the builder, which maps all of its keys to free
+//  slots in the partition. Bucket counts are powers of 2, so this costs
+//  between 4 and 8 bits per entry.
+//
+//  StenoStroke::Hash is CRC32 based, and CRC32 collisions between outlines
+//  cannot be separated by any pilot, so the key hash is a separate seeded
+//  hash, with the seed chosen by the builder.
+//
+//  Fingerprints:
+//
+//  Each entry has a 1 byte fingerprint of its hash, stored contiguously in
+//  data order. Probing compares fingerprints first, so entries in a probe
+//  chain that cannot match are rejected without reading their strokes.
+//
+//  Prefix Filter:
+//
+//  Most multi-stroke lookups miss, and would otherwise probe the hash map
+//  of every candidate length. The optional prefix filter for length k is a
+//  hashed bitset with a bit set for the hash of the first k strokes of
+//  every outline longer than k.
+//
+//  A clear bit proves that no longer outline starts with those strokes, so
+//  lookups can skip all of the longer lengths. A set bit may be a false
+//  positive. Lengths without a filter have prefixFilterSize == 0.
+//
 //---------------------------------------------------------------------------
 
 struct StenoHashMapEntryBlock {
@@ -37,23 +99,143 @@ struct StenoHashMapEntryBlock {
   uint32_t baseOffset;
 
   size_t PopCount() const;
+
+  bool HasEntry(size_t bitIndex) const {
+    return (masks[bitIndex / 32] >> (bitIndex % 32)) & 1;
+  }
+
+  // Returns (size_t)-1 if there is no entry at bitIndex.
+  size_t GetOffset(size_t bitIndex) const;
+};
+
+struct StenoHashMapCountedEntryBlock : public StenoHashMapEntryBlock {
+  // Number of entries in masks[0..i).
+  uint8_t maskOffsets[4];
+
+  // Returns (size_t)-1 if there is no entry at bitIndex.
+  size_t GetOffset(size_t bitIndex) const;
 };
 
+static_assert(sizeof(StenoHashMapEntryBlock) == 20);
+static_assert(sizeof(StenoHashMapCountedEntryBlock) == 24);
+
 struct StenoMapDictionaryStrokesDefinition {
   size_t hashMapSize;
 
   // Stroke -> text information.
   const uint8_t *data;
 
-  // Hash table information.
+  // Hash table information. This points to StenoHashMapCountedEntryBlocks
+  // for layout version 2.
   const StenoHashMapEntryBlock *offsets;
 
   bool ContainsData(const void *p) const { return data <= p && p < offsets; }
-  size_t GetOffset(size_t index) const;
-  bool HasEntry(size_t index) const;
-  size_t GetEntryCount() const;
-  bool PrintDictionary(bool hasData, size_t strokeLength, char *buffer,
-                       const uint8_t *textBlock) const;
+
+  // T is the block type for the layout version.
+  template <typename T> const T &GetBlock(size_t index) const {
+    return ((const T *)offsets)[index / 128];
+  }
+  template <typename T> size_t GetOffset(size_t index) const {
+    return GetBlock<T>(index).GetOffset(index % 128);
+  }
+  template <typename T> bool HasEntry(size_t index) const {
+    return GetBlock<T>(index).HasEntry(index % 128);
+  }
+  template <typename T> size_t GetEntryCount() const;
+  template <typename T> const void *GetOffsetsEnd() const {
+    return (const T *)offsets + hashMapSize / 128;
+  }
+};
+
+// JSC1 collections are read in place, so this layout must not change.
+// Later layout versions add fields through separate arrays.
+static_assert(sizeof(StenoMapDictionaryStrokesDefinition) ==
+              sizeof(size_t) + 2 * sizeof(void *));
+
+// Layout version 1 information for a StenoMapDictionaryStrokesDefinition.
+struct StenoMapDictionaryStrokesExtension {
+  // One per entry, in data order. nullptr if not present.
+  const uint8_t *fingerprints;
+
+  // Prefix filter information. The size is in bits, and is a power of 2.
+  size_t prefixFilterSize;
+  const uint32_t *prefixFilter;
+
+  static uint8_t GetFingerprint(uint32_t hash) {
+    // The low bits select the hash map index, so use the high bits.
+    return (uint8_t)(hash >> 24);
+  }
+
+  bool HasPrefixFilter() const { return prefixFilterSize != 0; }
+
+  // hash is the StenoStroke::Hash of a prefix of this length.
+  bool MayBePrefix(uint32_t hash) const {
+    size_t index = hash & (prefixFilterSize - 1);
+    return (prefixFilter[index / 32] >> (index % 32)) & 1;
+  }
+};
+
+// Layout version 3 replacement for StenoMapDictionaryStrokesDefinition.
+struct StenoMapDictionaryPerfectHashStrokes {
+  size_t entryCount;
+
+  // Stroke -> text information, indexed by slot.
+  const uint8_t *data;
+
+  uint32_t seed;
+  uint8_t partitionBits;
+  uint8_t bucketBits;
+  uint16_t _padding10;
+
+  // Slot of the first entry of each partition, plus a final entryCount.
+  const uint32_t *partitionOffsets;
+
+  // One per bucket, partition major.
+  const uint16_t *pilots;
+
+  const uint8_t *GetDataEnd(size_t strokeLength) const {
+    return data + entryCount * 3 * (1 + strokeLength);
+  }
+  bool ContainsData(const void *p, size_t strokeLength) const {
+    return data <= p && p < GetDataEnd(strokeLength);
+  }
+
+  // murmur3's finalizer, which is a bijection.
+  static uint32_t Mix(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x85ebca6b;
+    v ^= v >> 13;
+    v *= 0xc2b2ae35;
+    v ^= v >> 16;
+    return v;
+  }
+
+  static uint32_t GetKeyHash(const StenoStroke *strokes, size_t length,
+                             uint32_t seed) {
+    uint32_t keyHash = seed;
+    for (size_t i = 0; i < length; ++i) {
+      keyHash = Mix(keyHash ^ strokes[i].GetKeyState());
+    }
+    return keyHash;
+  }
+
+  static size_t GetPilotSlot(uint32_t keyHash, uint32_t pilot,
+                             size_t partitionSize) {
+    uint32_t slotHash = Mix(keyHash ^ (pilot * 0x9e3779b9));
+    return ((uint64_t)slotHash * partitionSize) >> 32;
+  }
+
+  size_t GetPartition(uint32_t keyHash) const {
+    return ((uint64_t)keyHash << partitionBits) >> 32;
+  }
+  size_t GetBucket(uint32_t keyHash) const {
+    return keyHash & ((1 << bucketBits) - 1);
+  }
+  size_t GetPilotCount() const {
+    return ((size_t)1 << partitionBits) << bucketBits;
+  }
+
+  size_t GetSlot(const StenoStroke *strokes, size_t length) const;
 };
 
 //---------------------------------------------------------------------------
@@ -61,16 +243,65 @@ struct StenoMapDictionaryStrokesDefinition {
 struct StenoMapDictionaryDefinition {
   bool defaultEnabled;
   uint8_t maximumStrokeCount;
-  uint16_t _padding2;
+  uint8_t layoutVersion;
+  uint8_t _padding3;
   const char *name;
   const uint8_t *textBlock;
-  const StenoMapDictionaryStrokesDefinition *strokes;
+  union {
+    const StenoMapDictionaryStrokesDefinition *strokes;
+
+    // Layout version 3.
+    const StenoMapDictionaryPerfectHashStrokes *perfectHashStrokes;
+  };
+
+  // Only present when layoutVersion >= 1.
+  const StenoMapDictionaryStrokesExtension *extensions;
+
+  const StenoMapDictionaryStrokesExtension *GetExtension(size_t length) const {
+    return layoutVersion >= 1 ? &extensions[length - 1] : nullptr;
+  }
+
+  bool HasCountedBlocks() const { return layoutVersion == 2; }
+  bool HasPerfectHash() const { return layoutVersion == 3; }
+
+  bool HasOutlines(size_t length) const {
+    return HasPerfectHash() ? perfectHashStrokes[length - 1].entryCount != 0
+                            : strokes[length - 1].hashMapSize != 0;
+  }
+
+  bool ContainsData(const void *p, size_t length) const {
+    return HasPerfectHash()
+               ? perfectHashStrokes[length - 1].ContainsData(p, length)
+               : strokes[length - 1].ContainsData(p);
+  }
 };
 
 //---------------------------------------------------------------------------
 
 constexpr uint32_t STENO_MAP_DICTIONARY_COLLECTION_MAGIC = 0x3243534a; // 'JSC1'
 
+// Collections with layout version 2 dictionaries.
+constexpr uint32_t STENO_MAP_DICTIONARY_COLLECTION_COUNTED_BLOCKS_MAGIC =
+    0x4243534a; // 'JSCB'
+
+// Collections with layout version 3 dictionaries.
+constexpr uint32_t STENO_MAP_DICTIONARY_COLLECTION_PERFECT_HASH_MAGIC =
+    0x3343534a; // 'JSC3'
+
+// Returns the magic for a collection whose dictionaries use |layoutVersion|
+// or earlier, so that firmware that cannot read them rejects it.
+constexpr uint32_t GetStenoMapDictionaryCollectionMagic(uint8_t layoutVersion) {
+  switch (layoutVersion) {
+  case 0:
+  case 1:
+    return STENO_MAP_DICTIONARY_COLLECTION_MAGIC;
+  case 2:
+    return STENO_MAP_DICTIONARY_COLLECTION_COUNTED_BLOCKS_MAGIC;
+  default:
+    return STENO_MAP_DICTIONARY_COLLECTION_PERFECT_HASH_MAGIC;
+  }
+}
+
 struct StenoMapDictionaryCollection {
   uint32_t magic;
   uint16_t dictionaryCount;
@@ -79,6 +310,12 @@ struct StenoMapDictionaryCollection {
   const uint8_t *textBlock;
   size_t textBlockLength;
   const StenoMapDictionaryDefinition *const dictionaries[];
+
+  bool HasValidMagic() const {
+    return magic == STENO_MAP_DICTIONARY_COLLECTION_MAGIC ||
+           magic == STENO_MAP_DICTIONARY_COLLECTION_COUNTED_BLOCKS_MAGIC ||
+           magic == STENO_MAP_DICTIONARY_COLLECTION_PERFECT_HASH_MAGIC;
+  }
 };
 
 //---------------------------------------------------------------------------
@@ -0,0 +1,232 @@
+//---------------------------------------------------------------------------
+
+#include "map_dictionary_file.h"
+
+#if defined(__linux__)
+
+#include "../crc32.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//---------------------------------------------------------------------------
+
+bool StenoMapDictionaryFile::Fail(const char *message) {
+  Close();
+  error = message;
+  return false;
+}
+
+bool StenoMapDictionaryFile::Open(const char *filename) {
+  Close();
+  error = nullptr;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return Fail("Unable to open file");
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 ||
+      (size_t)fileStat.st_size < sizeof(StenoMapDictionaryFileHeader)) {
+    close(fd);
+    return Fail("File is too small");
+  }
+
+  // Private and writable so that Relocate() only copies the pages it
+  // touches. The mapping is made read only afterwards.
+  mappingSize = fileStat.st_size;
+  mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                 fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    return Fail("Unable to map file");
+  }
+
+  const StenoMapDictionaryFileHeader &header =
+      *(const StenoMapDictionaryFileHeader *)mapping;
+  if (header.magic != STENO_MAP_DICTIONARY_FILE_MAGIC) {
+    return Fail("Invalid file magic");
+  }
+  if (header.pointerSize != sizeof(void *)) {
+    return Fail("Pointer size does not match this host");
+  }
+  if (header.imageSize > mappingSize ||
+      header.GetFileSize() != mappingSize) {
+    return Fail("File size does not match header");
+  }
+
+  const uint8_t *body = (const uint8_t *)mapping + sizeof(header);
+  if (Crc32(body, mappingSize - sizeof(header)) != header.crc32) {
+    return Fail("CRC32 mismatch");
+  }
+
+  uint8_t *image = (uint8_t *)mapping + sizeof(header);
+  if (!Relocate(image, header)) {
+    return false;
+  }
+  mprotect(mapping, mappingSize, PROT_READ);
+
+  const StenoMapDictionaryCollection &collection = GetCollection();
+  if (header.imageSize < sizeof(StenoMapDictionaryCollection) ||
+      !collection.HasValidMagic()) {
+    return Fail("Invalid collection magic");
+  }
+  if (sizeof(StenoMapDictionaryCollection) +
+          collection.dictionaryCount * sizeof(void *) >
+      header.imageSize) {
+    return Fail("Invalid dictionary count");
+  }
+  return true;
+}
+
+bool StenoMapDictionaryFile::Relocate(
+    uint8_t *image, const StenoMapDictionaryFileHeader &header) {
+  const uint32_t *relocations =
+      (const uint32_t *)((const uint8_t *)mapping +
+                         header.GetRelocationsOffset());
+
+  for (size_t i = 0; i < header.relocationCount; ++i) {
+    uint32_t offset = relocations[i];
+    if (offset % sizeof(uintptr_t) != 0 ||
+        offset + sizeof(uintptr_t) > header.imageSize) {
+      return Fail("Invalid relocation");
+    }
+
+    uintptr_t &pointer = *(uintptr_t *)(image + offset);
+    if (pointer > header.imageSize) {
+      return Fail("Invalid relocation target");
+    }
+    pointer += (uintptr_t)image;
+  }
+  return true;
+}
+
+void StenoMapDictionaryFile::Close() {
+  if (mapping) {
+    munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+  }
+}
+
+//---------------------------------------------------------------------------
+
+#if RUN_TESTS
+
+#include "../unit_test.h"
+#include <assert.h>
+#include <vector>
+
+// Returns whether a file with the given contents opens.
+static bool OpenTestFile(StenoMapDictionaryFile &dictionaryFile,
+                         const std::vector<uint8_t> &contents) {
+  char filename[] = "/tmp/javelin_dictionary_XXXXXX";
+  int fd = mkstemp(filename);
+  assert(fd >= 0);
+  assert(write(fd, contents.data(), contents.size()) ==
+         (ssize_t)contents.size());
+  close(fd);
+
+  bool result = dictionaryFile.Open(filename);
+  unlink(filename);
+  return result;
+}
+
+TEST_BEGIN("MapDictionaryFile: Invalid files are rejected") {
+  // A collection with no dictionaries, and a relocated text block pointer.
+  StenoMapDictionaryFileHeader header = {
+      .magic = STENO_MAP_DICTIONARY_FILE_MAGIC,
+      .pointerSize = sizeof(void *),
+      ._padding5 = {},
+      .crc32 = 0,
+      .relocationCount = 1,
+      .imageSize = sizeof(StenoMapDictionaryCollection),
+  };
+  std::vector<uint8_t> contents(header.GetFileSize());
+
+  StenoMapDictionaryCollection &collection =
+      *(StenoMapDictionaryCollection *)&contents[sizeof(header)];
+  collection.magic = STENO_MAP_DICTIONARY_COLLECTION_MAGIC;
+  collection.textBlock = (const uint8_t *)offsetof(
+      StenoMapDictionaryCollection, textBlockLength);
+
+  uint32_t relocation = offsetof(StenoMapDictionaryCollection, textBlock);
+  memcpy(&contents[header.GetRelocationsOffset()], &relocation,
+         sizeof(relocation));
+
+  header.crc32 =
+      Crc32(&contents[sizeof(header)], contents.size() - sizeof(header));
+  memcpy(contents.data(), &header, sizeof(header));
+
+  StenoMapDictionaryFile dictionaryFile;
+  assert(OpenTestFile(dictionaryFile, contents));
+  assert(dictionaryFile.GetCollection().textBlock ==
+         dictionaryFile.GetBaseAddress() +
+             offsetof(StenoMapDictionaryCollection, textBlockLength));
+
+  std::vector<uint8_t> corrupted = contents;
+  corrupted.back() ^= 1;
+  assert(!OpenTestFile(dictionaryFile, corrupted));
+  assert(strcmp(dictionaryFile.error, "CRC32 mismatch") == 0);
+  assert(!dictionaryFile.IsOpen());
+
+  corrupted = contents;
+  corrupted[0] ^= 1;
+  assert(!OpenTestFile(dictionaryFile, corrupted));
+  assert(strcmp(dictionaryFile.error, "Invalid file magic") == 0);
+
+  corrupted = contents;
+  corrupted.pop_back();
+  assert(!OpenTestFile(dictionaryFile, corrupted));
+  assert(strcmp(dictionaryFile.error, "File size does not match header") ==
+         0);
+
+  assert(!dictionaryFile.Open("/nonexistent/dictionary"));
+}
+TEST_END
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#if RUN_BENCHMARKS
+
+#include "../benchmark.h"
+#include <stdio.h>
+
+// Run with --file= set to a collection written by the dictionary compiler
+// with --format=relocatable.
+BENCHMARK_BEGIN("MapDictionaryFile: Open time") {
+  const char *filename = Benchmark::GetOption("file", nullptr);
+  if (!filename) {
+    printf("  Skipped: --file is not set\n");
+    return;
+  }
+
+  const size_t repeatCount = atoi(Benchmark::GetOption("repeat", "20"));
+  std::vector<uint64_t> samples;
+  for (size_t i = 0; i < repeatCount; ++i) {
+    StenoMapDictionaryFile dictionaryFile;
+    uint64_t startTime = Benchmark::GetTime();
+    bool success = dictionaryFile.Open(filename);
+    samples.push_back(Benchmark::GetTime() - startTime);
+    if (!success) {
+      printf("  Unable to open %s: %s\n", filename, dictionaryFile.error);
+      return;
+    }
+  }
+  Benchmark::PrintLatency("Open", samples);
+}
+BENCHMARK_END
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#endif
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,90 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "map_dictionary_definition.h"
+
+//---------------------------------------------------------------------------
+//
+// Relocatable collection files.
+//
+// StenoMapDictionaryCollection contains absolute pointers, so firmware links
+// it in as constant data at a known address. Hosts instead load collection
+// files written by the dictionary compiler with --format=relocatable:
+//
+//  StenoMapDictionaryFileHeader
+//  Image: a StenoMapDictionaryCollection where each pointer is an offset
+//         from the start of the image.
+//  Relocations: uint32_t image offset of every non-null pointer.
+//
+// The loader maps the file copy-on-write and adds the image address to each
+// pointer, so only the pages holding definitions are copied. Hash tables,
+// entry data and the text block are used in place.
+//
+//---------------------------------------------------------------------------
+
+constexpr uint32_t STENO_MAP_DICTIONARY_FILE_MAGIC = 0x5243534a; // 'JSCR'
+
+struct StenoMapDictionaryFileHeader {
+  uint32_t magic;
+  uint8_t pointerSize;
+  uint8_t _padding5[3];
+
+  // Crc32 of everything after the header.
+  uint32_t crc32;
+
+  uint32_t relocationCount;
+  uint64_t imageSize;
+
+  // Relocations follow the image, 4 byte aligned.
+  uint64_t GetRelocationsOffset() const {
+    return (sizeof(StenoMapDictionaryFileHeader) + imageSize + 3) & ~3;
+  }
+  uint64_t GetFileSize() const {
+    return GetRelocationsOffset() + 4 * (uint64_t)relocationCount;
+  }
+};
+
+static_assert(sizeof(StenoMapDictionaryFileHeader) == 24);
+
+//---------------------------------------------------------------------------
+
+#if defined(__linux__)
+
+class StenoMapDictionaryFile {
+public:
+  StenoMapDictionaryFile() = default;
+  ~StenoMapDictionaryFile() { Close(); }
+
+  StenoMapDictionaryFile(const StenoMapDictionaryFile &) = delete;
+  StenoMapDictionaryFile &operator=(const StenoMapDictionaryFile &) = delete;
+
+  // Returns false, with error set, if the file cannot be mapped or is not
+  // a valid collection for this host.
+  bool Open(const char *filename);
+  void Close();
+
+  bool IsOpen() const { return mapping != nullptr; }
+
+  // Only valid while the file is open.
+  const StenoMapDictionaryCollection &GetCollection() const {
+    return *(const StenoMapDictionaryCollection *)GetBaseAddress();
+  }
+
+  // Reverse lookup offsets are relative to this.
+  const uint8_t *GetBaseAddress() const {
+    return (const uint8_t *)mapping + sizeof(StenoMapDictionaryFileHeader);
+  }
+
+  const char *error = nullptr;
+
+private:
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+
+  bool Fail(const char *message);
+  bool Relocate(uint8_t *image, const StenoMapDictionaryFileHeader &header);
+};
+
+#endif
+
+//---------------------------------------------------------------------------
@@ -10,8 +10,11 @@ void StenoReverseMapDictionary::ReverseLookup(
   StenoReverseDictionaryLookup value(result.strokeThreshold, result.lookup);
 
   dictionary->ReverseLookup(value);
-  AddMapDictionaryResults(value);
   AddValidLookupProviders(result, value);
+
+  // Map dictionary results are already validated by
+  // ReverseMapDictionaryLookup.
+  AddMapDictionaryResults(result);
 }
 
 void StenoReverseMapDictionary::AddMapDictionaryResults(
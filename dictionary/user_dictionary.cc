@@ -1,6 +1,7 @@
 //---------------------------------------------------------------------------
 
 #include "user_dictionary.h"
+#include "../clock.h"
 #include "../console.h"
 #include "../crc32.h"
 #include "../flash.h"
@@ -16,7 +17,7 @@ constexpr size_t OFFSET_DELETED = 0;
 constexpr size_t OFFSET_DATA = 1;
 
 static const uint32_t USER_DICTIONARY_MAGIC = 0x4455534a; // 'JSUD'
-static const uint32_t USER_DICTIONARY_VERSION = 1;
+static const uint32_t USER_DICTIONARY_VERSION = 2;
 
 // Offset within the flash page where descriptors will be stored.
 const size_t DESCRIPTOR_OFFSET = 64;
@@ -24,6 +25,23 @@ const size_t DESCRIPTOR_OFFSET = 64;
 static_assert(sizeof(StenoUserDictionaryDescriptor) <= DESCRIPTOR_OFFSET,
               "Descriptor size is larger than expected");
 
+// Version 1 descriptors have no dataBlockStart, and their data block was
+// never reused. They are upgraded when the dictionary is opened.
+struct StenoUserDictionaryDescriptorV1 {
+  uint32_t magic;
+  uint32_t version;
+  struct {
+    const uint32_t *hashTable;
+    size_t hashTableSize;
+    const uint8_t *dataBlock;
+    size_t dataBlockSize;
+    uint32_t maximumStrokeCount;
+  } data;
+  uint32_t crc32;
+
+  bool IsValid(const StenoUserDictionaryData &layout) const;
+};
+
 //---------------------------------------------------------------------------
 
 struct StrokeListParser {
@@ -67,6 +85,401 @@ bool StrokeListParser::Set(const char *p) {
 
 //---------------------------------------------------------------------------
 
+// Parses a JSON dictionary object as it arrives, and imports each entry once
+// its translation ends. Outlines are parsed into strokes directly, so
+// nothing is allocated.
+class StenoUserDictionaryJsonParser {
+public:
+  StenoUserDictionaryJsonParser(StenoUserDictionary &dictionary)
+      : dictionary(&dictionary) {}
+
+  // Returns the number of bytes used. Parsing stops after the closing brace.
+  // After an error, the rest of the object is skipped rather than parsed, so
+  // that it is not mistaken for commands.
+  size_t Parse(const char *data, size_t length);
+
+  bool IsDone() const { return state == State::DONE; }
+
+  // Set if the input is not a valid dictionary, or an entry could not be
+  // imported.
+  const char *GetError() const { return error; }
+
+private:
+  enum class State : uint8_t {
+    OBJECT_START,
+    FIRST_KEY,
+    KEY,
+    COLON,
+    VALUE,
+    COMMA,
+    STRING,
+    ESCAPE,
+    UNICODE_ESCAPE,
+    DISCARD,
+    DONE,
+  };
+
+  // Members are all private, and there are no references, so that the
+  // import that holds this is standard layout.
+  StenoUserDictionary *dictionary;
+  const char *error = nullptr;
+  State state = State::OBJECT_START;
+  bool isKey = false;
+
+  uint32_t codePoint = 0;
+  size_t hexDigitCount = 0;
+  uint32_t highSurrogate = 0;
+
+  StenoStroke strokes[StenoUserDictionary::MAX_STROKE_COUNT];
+  size_t strokeCount = 0;
+  char strokeText[32];
+  size_t strokeTextLength = 0;
+
+  char word[256];
+  size_t wordLength = 0;
+
+  // Nesting of the object being skipped after an error.
+  size_t discardDepth = 0;
+  bool isDiscardString = false;
+  bool isDiscardEscape = false;
+
+  bool ParseCharacter(char c);
+  bool Fail(const char *message) {
+    error = message;
+    return false;
+  }
+
+  void StartString(bool isKey);
+  bool EndString();
+  bool EndStroke();
+  bool AddCharacter(char c);
+  bool AddEscapedCodePoint();
+
+  void StartDiscard(State failedState, char c);
+  void Discard(char c);
+};
+
+size_t StenoUserDictionaryJsonParser::Parse(const char *data, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    State previousState = state;
+    if (state == State::DISCARD) {
+      Discard(data[i]);
+    } else if (!ParseCharacter(data[i])) {
+      StartDiscard(previousState, data[i]);
+    }
+    if (state == State::DONE) {
+      return i + 1;
+    }
+  }
+  return length;
+}
+
+bool StenoUserDictionaryJsonParser::ParseCharacter(char c) {
+  switch (state) {
+  case State::STRING:
+    if (highSurrogate != 0 && c != '\\') {
+      return Fail("Invalid surrogate pair");
+    }
+    if (c == '\"') {
+      return EndString();
+    }
+    if (c == '\\') {
+      state = State::ESCAPE;
+      return true;
+    }
+    if ((uint8_t)c < 0x20) {
+      return Fail("Unterminated string");
+    }
+    return AddCharacter(c);
+
+  case State::ESCAPE:
+    state = State::STRING;
+    if (highSurrogate != 0 && c != 'u') {
+      return Fail("Invalid surrogate pair");
+    }
+    switch (c) {
+    case 'b':
+      return AddCharacter('\b');
+    case 'f':
+      return AddCharacter('\f');
+    case 'n':
+      return AddCharacter('\n');
+    case 'r':
+      return AddCharacter('\r');
+    case 't':
+      return AddCharacter('\t');
+    case 'u':
+      state = State::UNICODE_ESCAPE;
+      codePoint = 0;
+      hexDigitCount = 0;
+      return true;
+    default:
+      return AddCharacter(c);
+    }
+
+  case State::UNICODE_ESCAPE:
+    if ('0' <= c && c <= '9') {
+      codePoint = codePoint * 16 + c - '0';
+    } else if ('a' <= (c | 0x20) && (c | 0x20) <= 'f') {
+      codePoint = codePoint * 16 + (c | 0x20) - 'a' + 10;
+    } else {
+      return Fail("Invalid \\u escape");
+    }
+    if (++hexDigitCount < 4) {
+      return true;
+    }
+    state = State::STRING;
+    return AddEscapedCodePoint();
+
+  default:
+    break;
+  }
+
+  if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+    return true;
+  }
+
+  switch (state) {
+  case State::OBJECT_START:
+    if (c != '{') {
+      return Fail("Expected {");
+    }
+    state = State::FIRST_KEY;
+    return true;
+
+  case State::FIRST_KEY:
+    if (c == '}') {
+      state = State::DONE;
+      return true;
+    }
+    [[clang::fallthrough]];
+  case State::KEY:
+    if (c != '\"') {
+      return Fail("Expected outline");
+    }
+    StartString(true);
+    return true;
+
+  case State::COLON:
+    if (c != ':') {
+      return Fail("Expected :");
+    }
+    state = State::VALUE;
+    return true;
+
+  case State::VALUE:
+    if (c != '\"') {
+      return Fail("Expected translation");
+    }
+    StartString(false);
+    return true;
+
+  case State::COMMA:
+    if (c == ',') {
+      state = State::KEY;
+    } else if (c == '}') {
+      state = State::DONE;
+    } else {
+      return Fail("Expected , or }");
+    }
+    return true;
+
+  default:
+    return Fail("Unexpected input");
+  }
+}
+
+void StenoUserDictionaryJsonParser::StartString(bool isKey) {
+  state = State::STRING;
+  this->isKey = isKey;
+  if (isKey) {
+    strokeCount = 0;
+    strokeTextLength = 0;
+  } else {
+    wordLength = 0;
+  }
+}
+
+bool StenoUserDictionaryJsonParser::EndString() {
+  if (isKey) {
+    if (!EndStroke()) {
+      return false;
+    }
+    state = State::COLON;
+    return true;
+  }
+
+  word[wordLength] = '\0';
+  if (!dictionary->ImportEntry(strokes, strokeCount, word)) {
+    return Fail("Unable to write to user dictionary");
+  }
+  state = State::COMMA;
+  return true;
+}
+
+bool StenoUserDictionaryJsonParser::EndStroke() {
+  if (strokeCount == StenoUserDictionary::MAX_STROKE_COUNT) {
+    return Fail("Too many strokes");
+  }
+  strokeText[strokeTextLength] = '\0';
+  strokes[strokeCount].Set(strokeText);
+  if (strokes[strokeCount].IsEmpty()) {
+    return Fail("Cannot parse stroke");
+  }
+  ++strokeCount;
+  strokeTextLength = 0;
+  return true;
+}
+
+bool StenoUserDictionaryJsonParser::AddCharacter(char c) {
+  if (!isKey) {
+    if (wordLength == sizeof(word) - 1) {
+      return Fail("Translation is too long");
+    }
+    word[wordLength++] = c;
+    return true;
+  }
+
+  if (c == '/') {
+    return EndStroke();
+  }
+  if (strokeTextLength == sizeof(strokeText) - 1) {
+    return Fail("Cannot parse stroke");
+  }
+  strokeText[strokeTextLength++] = c;
+  return true;
+}
+
+// |failedState| and |c| give where the error was found, which is enough to
+// know whether the rest of the input starts inside a string.
+void StenoUserDictionaryJsonParser::StartDiscard(State failedState, char c) {
+  if (failedState == State::OBJECT_START) {
+    // There is no object to skip.
+    state = State::DONE;
+    return;
+  }
+
+  state = State::DISCARD;
+  discardDepth = 1;
+  isDiscardEscape = false;
+  switch (failedState) {
+  case State::STRING:
+  case State::UNICODE_ESCAPE:
+    // A quote ends the string, even when it is what was rejected.
+    isDiscardString = c != '\"';
+    break;
+  case State::ESCAPE:
+    isDiscardString = true;
+    break;
+  default:
+    // The rejected character may itself open a string or a nested value.
+    isDiscardString = false;
+    Discard(c);
+    break;
+  }
+}
+
+void StenoUserDictionaryJsonParser::Discard(char c) {
+  if (isDiscardString) {
+    if (isDiscardEscape) {
+      isDiscardEscape = false;
+    } else if (c == '\\') {
+      isDiscardEscape = true;
+    } else if (c == '\"') {
+      isDiscardString = false;
+    }
+    return;
+  }
+
+  switch (c) {
+  case '\"':
+    isDiscardString = true;
+    break;
+  case '{':
+  case '[':
+    ++discardDepth;
+    break;
+  case '}':
+  case ']':
+    if (--discardDepth == 0) {
+      state = State::DONE;
+    }
+    break;
+  }
+}
+
+bool StenoUserDictionaryJsonParser::AddEscapedCodePoint() {
+  if (highSurrogate != 0) {
+    if (codePoint < 0xdc00 || codePoint >= 0xe000) {
+      return Fail("Invalid surrogate pair");
+    }
+    codePoint =
+        0x10000 + ((highSurrogate - 0xd800) << 10) + (codePoint - 0xdc00);
+    highSurrogate = 0;
+  } else if (0xd800 <= codePoint && codePoint < 0xdc00) {
+    highSurrogate = codePoint;
+    return true;
+  } else if (0xdc00 <= codePoint && codePoint < 0xe000) {
+    return Fail("Invalid surrogate pair");
+  }
+
+  if (codePoint == 0) {
+    return Fail("Strings cannot contain \\u0000");
+  }
+  if (codePoint < 0x80) {
+    return AddCharacter(codePoint);
+  }
+  if (codePoint < 0x800) {
+    return AddCharacter(0xc0 | (codePoint >> 6)) &&
+           AddCharacter(0x80 | (codePoint & 0x3f));
+  }
+  if (codePoint < 0x10000) {
+    return AddCharacter(0xe0 | (codePoint >> 12)) &&
+           AddCharacter(0x80 | ((codePoint >> 6) & 0x3f)) &&
+           AddCharacter(0x80 | (codePoint & 0x3f));
+  }
+  return AddCharacter(0xf0 | (codePoint >> 18)) &&
+         AddCharacter(0x80 | ((codePoint >> 12) & 0x3f)) &&
+         AddCharacter(0x80 | ((codePoint >> 6) & 0x3f)) &&
+         AddCharacter(0x80 | (codePoint & 0x3f));
+}
+
+//---------------------------------------------------------------------------
+
+// Held while an import is in progress.
+struct StenoUserDictionaryImport {
+  StenoUserDictionaryImport(StenoUserDictionary &dictionary)
+      : parser(dictionary) {}
+
+  // The data page being filled. Entries are written through it a word at a
+  // time, and Flash::Write() compares it in size_t words, so it comes first
+  // and is aligned for both.
+  alignas(size_t) uint8_t page[Flash::BLOCK_SIZE];
+  size_t pageStart;
+  bool isPageChanged;
+
+  StenoUserDictionaryJsonParser parser;
+
+  // Set when the import is fed by console input, which is released if no
+  // input arrives for IMPORT_TIMEOUT milliseconds.
+  bool isCapturingInput;
+  uint32_t lastInputTime;
+
+  // Bulk imports write the log directly. Otherwise, when the hash table
+  // cannot be rehashed, entries are added through the pending overlay.
+  bool isBulk;
+
+  // Log position after the last imported entry.
+  size_t dataBlockSize;
+  uint32_t maximumStrokeCount;
+  size_t entryCount;
+};
+
+static_assert(offsetof(StenoUserDictionaryImport, page) % sizeof(size_t) == 0,
+              "Import page is not word aligned");
+
+//---------------------------------------------------------------------------
+
 struct StenoUserDictionaryEntry {
   uint32_t strokeLength;
   StenoStroke strokes[1];
@@ -74,8 +487,54 @@ struct StenoUserDictionaryEntry {
 
   void Print(char *buffer) const;
   char *GetText() const { return (char *)(strokes + strokeLength); }
+
+  bool HasOutline(const StenoStroke *outline, size_t length) const {
+    return strokeLength == length &&
+           memcmp(strokes, outline, sizeof(StenoStroke) * length) == 0;
+  }
+
+  size_t GetDataLength() const {
+    return GetDataLength(strokeLength, strlen(GetText()));
+  }
+  static size_t GetDataLength(size_t strokeLength, size_t wordLength) {
+    // Need to store null terminator + round up to nearest 4 bytes.
+    return sizeof(uint32_t) + sizeof(StenoStroke) * strokeLength +
+           ((wordLength + 4) & -4);
+  }
 };
 
+static const StenoUserDictionaryEntry *
+GetFlashEntry(const StenoUserDictionaryData &data, uint32_t offset) {
+  return (const StenoUserDictionaryEntry *)(data.dataBlock + offset -
+                                            OFFSET_DATA);
+}
+
+static bool IsDataOffset(uint32_t offset) {
+  return offset != OFFSET_EMPTY && offset != OFFSET_DELETED;
+}
+
+// Hash tables are a power of two in size, aligned to their size within the
+// layout's region.
+static bool IsValidHashTable(const StenoUserDictionaryData &data,
+                             const StenoUserDictionaryData &layout) {
+  size_t offset = (uintptr_t)data.hashTable - (uintptr_t)layout.hashTable;
+  size_t size = data.hashTableSize * sizeof(uint32_t);
+  return data.hashTableSize != 0 &&
+         (data.hashTableSize & (data.hashTableSize - 1)) == 0 &&
+         data.hashTableSize <= layout.hashTableSize && offset % size == 0 &&
+         offset < layout.hashTableSize * sizeof(uint32_t);
+}
+
+// Entries never straddle a page, so that each page of the log can be
+// reused on its own.
+static size_t GetAppendPosition(size_t position, size_t dataLength) {
+  size_t pageOffset = position & (Flash::BLOCK_SIZE - 1);
+  if (pageOffset + dataLength > Flash::BLOCK_SIZE) {
+    position += Flash::BLOCK_SIZE - pageOffset;
+  }
+  return position;
+}
+
 //---------------------------------------------------------------------------
 
 template <typename T> T *RoundToPage(T *p, size_t pageSize) {
@@ -89,9 +548,10 @@ template <typename T> T *RoundToPage(T *p, size_t pageSize) {
 bool StenoUserDictionaryDescriptor::IsValid(
     const StenoUserDictionaryData &layout) const {
   return magic == USER_DICTIONARY_MAGIC && version == USER_DICTIONARY_VERSION &&
-         data.hashTable == layout.hashTable &&
-         data.hashTableSize == layout.hashTableSize &&
-         data.dataBlock == layout.dataBlock &&
+         IsValidHashTable(data, layout) && data.dataBlock == layout.dataBlock &&
+         data.dataBlockStart <= data.dataBlockSize &&
+         data.dataBlockSize - data.dataBlockStart <=
+             (layout.dataBlockSize & -Flash::BLOCK_SIZE) &&
          Crc32(&data, sizeof(data)) == crc32;
 }
 
@@ -99,14 +559,31 @@ void StenoUserDictionaryDescriptor::UpdateCrc32() {
   crc32 = Crc32(&data, sizeof(data));
 }
 
+bool StenoUserDictionaryDescriptorV1::IsValid(
+    const StenoUserDictionaryData &layout) const {
+  return magic == USER_DICTIONARY_MAGIC && version == 1 &&
+         data.hashTable == layout.hashTable &&
+         data.hashTableSize == layout.hashTableSize &&
+         data.dataBlock == layout.dataBlock &&
+         data.dataBlockSize <= (layout.dataBlockSize & -Flash::BLOCK_SIZE) &&
+         Crc32(&data, sizeof(data)) == crc32;
+}
+
 //---------------------------------------------------------------------------
 
 StenoUserDictionary::StenoUserDictionary(const StenoUserDictionaryData &layout)
     : descriptorBase(layout.GetDescriptor()), layout(layout) {
   activeDescriptor = FindMostRecentDescriptor();
-  if (activeDescriptor == nullptr) {
+  if (activeDescriptor == nullptr && !UpgradeDescriptor()) {
     Reset();
   }
+  ScanHashTable();
+  hashTablePagesToRebuild = GetHashTablePageCount();
+}
+
+StenoUserDictionary::~StenoUserDictionary() {
+  CancelImport();
+  Flush();
 }
 
 const StenoUserDictionaryDescriptor *
@@ -117,127 +594,213 @@ StenoUserDictionary::FindMostRecentDescriptor() const {
     const StenoUserDictionaryDescriptor *test =
         (const StenoUserDictionaryDescriptor *)((intptr_t)descriptorBase + i);
 
-    if (test->IsValid(layout)) {
-      if (!result) {
-        result = test;
-      } else {
-        if (test->data.dataBlockSize > result->data.dataBlockSize) {
-          result = test;
-        }
-      }
+    // Sequence numbers can wrap around, but the valid descriptors in the
+    // page are always consecutive.
+    if (test->IsValid(layout) &&
+        (!result || (int32_t)(test->data.sequenceNumber -
+                              result->data.sequenceNumber) > 0)) {
+      result = test;
     }
   }
 
   return result;
 }
 
+// The version 1 data block is the start of the log, so only the descriptor
+// needs to be rewritten.
+bool StenoUserDictionary::UpgradeDescriptor() {
+  const StenoUserDictionaryDescriptorV1 *result = nullptr;
+
+  for (size_t i = 0; i < Flash::BLOCK_SIZE; i += DESCRIPTOR_OFFSET) {
+    const StenoUserDictionaryDescriptorV1 *test =
+        (const StenoUserDictionaryDescriptorV1 *)((intptr_t)descriptorBase +
+                                                  i);
+
+    if (test->IsValid(layout) &&
+        (!result || test->data.dataBlockSize > result->data.dataBlockSize)) {
+      result = test;
+    }
+  }
+  if (!result) {
+    return false;
+  }
+
+  char *buffer = (char *)malloc(Flash::BLOCK_SIZE);
+  memcpy(buffer, descriptorBase, Flash::BLOCK_SIZE);
+
+  size_t freshDescriptorOffset =
+      ((intptr_t)result - (intptr_t)descriptorBase + DESCRIPTOR_OFFSET) %
+      Flash::BLOCK_SIZE;
+  // Use 0xff rather than 0 to reduce flash I/O.
+  memset(buffer + freshDescriptorOffset, 0xff, DESCRIPTOR_OFFSET);
+  StenoUserDictionaryDescriptor *freshDescriptor =
+      (StenoUserDictionaryDescriptor *)(buffer + freshDescriptorOffset);
+  freshDescriptor->magic = USER_DICTIONARY_MAGIC;
+  freshDescriptor->version = USER_DICTIONARY_VERSION;
+  freshDescriptor->data.hashTable = layout.hashTable;
+  freshDescriptor->data.hashTableSize = layout.hashTableSize;
+  freshDescriptor->data.dataBlock = layout.dataBlock;
+  freshDescriptor->data.dataBlockSize = result->data.dataBlockSize;
+  freshDescriptor->data.maximumStrokeCount = result->data.maximumStrokeCount;
+  freshDescriptor->data.sequenceNumber = 0;
+  freshDescriptor->data.dataBlockStart = 0;
+  freshDescriptor->UpdateCrc32();
+
+  Flash::Write(descriptorBase, buffer, Flash::BLOCK_SIZE);
+
+  free(buffer);
+  activeDescriptor =
+      (StenoUserDictionaryDescriptor *)((intptr_t)descriptorBase +
+                                        freshDescriptorOffset);
+  return true;
+}
+
 size_t StenoUserDictionary::GetNextDescriptorToWriteOffset() const {
   size_t activeOffset = (intptr_t)activeDescriptor - (intptr_t)descriptorBase;
   size_t nextOffset = (activeOffset + DESCRIPTOR_OFFSET) % Flash::BLOCK_SIZE;
   return nextOffset;
 }
 
-StenoDictionaryLookupResult
-StenoUserDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
+const StenoUserDictionaryEntry *
+StenoUserDictionary::FindEntry(const StenoDictionaryLookup &lookup) const {
+  const PendingEntry *pendingEntry =
+      FindPendingEntry(lookup.strokes, lookup.length);
+  if (pendingEntry) {
+    return pendingEntry->isRemoved ? nullptr : pendingEntry->entry;
+  }
+  return FindFlashEntry(lookup);
+}
+
+const StenoUserDictionaryEntry *
+StenoUserDictionary::FindFlashEntry(const StenoDictionaryLookup &lookup) const {
   if (lookup.length > activeDescriptor->data.maximumStrokeCount) {
-    return StenoDictionaryLookupResult::CreateInvalid();
+    return nullptr;
   }
 
   size_t entryIndex = lookup.hash;
-  for (;;) {
+  for (size_t probeCount = 0; probeCount < MAX_PROBE_COUNT; ++probeCount) {
     entryIndex = entryIndex & (activeDescriptor->data.hashTableSize - 1);
 
     uint32_t offset = activeDescriptor->data.hashTable[entryIndex];
     switch (offset) {
     case OFFSET_EMPTY:
-      return StenoDictionaryLookupResult::CreateInvalid();
+      return nullptr;
 
     case OFFSET_DELETED:
       break;
 
     default:
       const StenoUserDictionaryEntry *entry =
-          (const StenoUserDictionaryEntry *)(activeDescriptor->data.dataBlock +
-                                             offset - OFFSET_DATA);
-
-      if (entry->strokeLength == lookup.length &&
-          memcmp(lookup.strokes, entry->strokes,
-                 sizeof(StenoStroke) * lookup.length) == 0) {
-        return StenoDictionaryLookupResult::CreateStaticString(
-            entry->GetText());
+          GetFlashEntry(activeDescriptor->data, offset);
+      if (entry->HasOutline(lookup.strokes, lookup.length)) {
+        return entry;
       }
     }
 
     ++entryIndex;
   }
+  return nullptr;
 }
 
-const StenoDictionary *StenoUserDictionary::GetLookupProvider(
-    const StenoDictionaryLookup &lookup) const {
-  if (lookup.length > activeDescriptor->data.maximumStrokeCount) {
-    return nullptr;
+StenoDictionaryLookupResult
+StenoUserDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
+  const StenoUserDictionaryEntry *entry = FindEntry(lookup);
+  if (entry == nullptr) {
+    return StenoDictionaryLookupResult::CreateInvalid();
   }
 
-  size_t entryIndex = lookup.hash;
-  for (;;) {
-    entryIndex = entryIndex & (activeDescriptor->data.hashTableSize - 1);
-
-    uint32_t offset = activeDescriptor->data.hashTable[entryIndex];
-    switch (offset) {
-    case OFFSET_EMPTY:
-      return nullptr;
-
-    case OFFSET_DELETED:
-      break;
+  // Pending entries are freed by Flush(), so results need their own copy.
+  if (pendingEntryCount != 0 &&
+      FindPendingEntry(lookup.strokes, lookup.length) != nullptr) {
+    return StenoDictionaryLookupResult::CreateDynamicString(
+        Str::Dup(entry->GetText()));
+  }
+  return StenoDictionaryLookupResult::CreateStaticString(entry->GetText());
+}
 
-    default:
-      const StenoUserDictionaryEntry *entry =
-          (const StenoUserDictionaryEntry *)(activeDescriptor->data.dataBlock +
-                                             offset - OFFSET_DATA);
+StenoDictionaryLookupResult
+StenoUserDictionary::LookupLongest(const StenoDictionaryPrefixLookup &lookup,
+                                   size_t minimumLength, size_t maximumLength,
+                                   size_t &length) const {
+  if (maximumLength > GetMaximumOutlineLength()) {
+    maximumLength = GetMaximumOutlineLength();
+  }
 
-      if (entry->strokeLength == lookup.length &&
-          memcmp(lookup.strokes, entry->strokes,
-                 sizeof(StenoStroke) * lookup.length) == 0) {
-        return this;
-      }
+  for (size_t i = maximumLength; i >= minimumLength && i > 0; --i) {
+    StenoDictionaryLookupResult result = Lookup(lookup.GetLookup(i));
+    if (result.IsValid()) {
+      length = i;
+      return result;
     }
-
-    ++entryIndex;
   }
+  return StenoDictionaryLookupResult::CreateInvalid();
+}
+
+const StenoDictionary *StenoUserDictionary::GetLookupProvider(
+    const StenoDictionaryLookup &lookup) const {
+  return FindEntry(lookup) ? this : nullptr;
 }
 
 size_t StenoUserDictionary::GetMaximumOutlineLength() const {
-  return activeDescriptor->data.maximumStrokeCount;
+  uint32_t maximumStrokeCount = activeDescriptor->data.maximumStrokeCount;
+  return pendingMaximumStrokeCount > maximumStrokeCount
+             ? pendingMaximumStrokeCount
+             : maximumStrokeCount;
+}
+
+// The maximum stroke count grows as entries are added, so the filter allows
+// every length that can be added.
+StenoDictionaryLookupFilter StenoUserDictionary::GetLookupFilter() const {
+  return StenoDictionaryLookupFilter::CreateAny(MAX_STROKE_COUNT);
 }
 
 //---------------------------------------------------------------------------
 
 void StenoUserDictionary::Reset() {
+  ++updateCount;
+  CancelImport();
+  ClearPendingEntries();
   Flash::Erase(layout.hashTable, layout.hashTableSize * sizeof(uint32_t));
 
-  StenoUserDictionaryDescriptor *freshDescriptor =
-      (StenoUserDictionaryDescriptor *)malloc(Flash::BLOCK_SIZE);
-
   // Use 0xff rather than 0 to reduce flash I/O.
-  memset(freshDescriptor, 0xff, Flash::BLOCK_SIZE);
+  uint8_t *buffer = (uint8_t *)malloc(Flash::BLOCK_SIZE);
+  memset(buffer, 0xff, Flash::BLOCK_SIZE);
+  StenoUserDictionaryDescriptor *freshDescriptor =
+      (StenoUserDictionaryDescriptor *)buffer;
 
   freshDescriptor->magic = USER_DICTIONARY_MAGIC;
   freshDescriptor->version = USER_DICTIONARY_VERSION;
   freshDescriptor->data.hashTable = layout.hashTable;
-  freshDescriptor->data.hashTableSize = layout.hashTableSize;
+  freshDescriptor->data.hashTableSize =
+      INITIAL_HASH_TABLE_SIZE < GetMaximumHashTableSize()
+          ? INITIAL_HASH_TABLE_SIZE
+          : GetMaximumHashTableSize();
   freshDescriptor->data.dataBlock = layout.dataBlock;
   freshDescriptor->data.dataBlockSize = 0;
   freshDescriptor->data.maximumStrokeCount = 0;
+  freshDescriptor->data.sequenceNumber = 0;
+  freshDescriptor->data.dataBlockStart = 0;
   freshDescriptor->UpdateCrc32();
 
-  Flash::Write(descriptorBase, freshDescriptor, Flash::BLOCK_SIZE);
+  Flash::Write(descriptorBase, buffer, Flash::BLOCK_SIZE);
 
-  free(freshDescriptor);
+  free(buffer);
   activeDescriptor = descriptorBase;
+  liveDataLength = 0;
+  hashTableEntryCount = 0;
+  hashTableTombstoneCount = 0;
+  hashTablePagesToRebuild = 0;
+  nextHashTablePageToRebuild = 0;
 }
 
+//---------------------------------------------------------------------------
+
 bool StenoUserDictionary::Add(const StenoStroke *strokes, size_t length,
                               const char *word) {
+  if (IsBulkImporting()) {
+    return false;
+  }
+
   // Verify that it doesn't already exist.
   StenoDictionaryLookupResult lookup =
       Lookup(StenoDictionaryLookup(strokes, length));
@@ -248,64 +811,502 @@ bool StenoUserDictionary::Add(const StenoStroke *strokes, size_t length,
   }
   lookup.Destroy();
 
-  AddToDataBlockResult data = AddToDataBlock(strokes, (uint32_t)length, word);
-  if (data.length == 0) {
+  return AddPendingEntry(strokes, length, word);
+}
+
+bool StenoUserDictionary::Remove(const StenoStroke *strokes, size_t length) {
+  if (IsBulkImporting() || !FindEntry(StenoDictionaryLookup(strokes, length))) {
     return false;
   }
-  AddToDescriptor(length, data.length);
-  return AddToHashTable(strokes, length, data.offset);
+  return AddPendingEntry(strokes, length, nullptr);
 }
 
-StenoUserDictionary::AddToDataBlockResult
-StenoUserDictionary::AddToDataBlock(const StenoStroke *strokes, uint32_t length,
-                                    const char *word) {
-  size_t wordLength = strlen(word);
-
-  // Need to store null terminator + round up to nearest 4 bytes.
-  size_t wordStorageLength = (wordLength + 4) & -4;
-
-  size_t offset = activeDescriptor->data.dataBlockSize;
-
+bool StenoUserDictionary::AddPendingEntry(const StenoStroke *strokes,
+                                          size_t length, const char *word) {
+  size_t wordLength = word ? strlen(word) : 0;
   size_t totalLength =
-      sizeof(uint32_t) + sizeof(StenoStroke) * length + wordStorageLength;
+      StenoUserDictionaryEntry::GetDataLength(length, wordLength);
 
   // Safeguard...
-  if (totalLength > 256 || activeDescriptor->data.dataBlockSize + totalLength >
-                               layout.dataBlockSize) {
-    return AddToDataBlockResult(0, 0);
+  if (word && (totalLength > 256 ||
+               (!HasSpaceForPendingEntry(totalLength, COMPACTION_RESERVE) &&
+                !MakeSpace(totalLength)))) {
+    return false;
   }
 
-  // Allocate memory for two pages, since the data could span both.
-  uint8_t *buffer = (uint8_t *)malloc(Flash::BLOCK_SIZE * 2);
-  memset(buffer, 0xff, Flash::BLOCK_SIZE * 2);
+  // Use 0xff padding, as in flash.
+  uint8_t *buffer = (uint8_t *)malloc(totalLength);
+  memset(buffer, 0xff, totalLength);
+  StenoUserDictionaryEntry *entry = (StenoUserDictionaryEntry *)buffer;
+  entry->strokeLength = (uint32_t)length;
+  memcpy(entry->strokes, strokes, sizeof(StenoStroke) * length);
+  if (word) {
+    memcpy(entry->GetText(), word, wordLength + 1);
+  }
 
-  const uint8_t *originalData = activeDescriptor->data.dataBlock + offset;
-  const uint8_t *originalDataPage =
-      RoundToPage(originalData, Flash::BLOCK_SIZE);
-  memcpy(buffer, originalDataPage, originalData - originalDataPage);
+  PushPendingEntry(entry, totalLength, word == nullptr);
+  lastChangeTime = Clock::GetCurrentTime();
+  ++updateCount;
 
-  uint8_t *p = &buffer[originalData - originalDataPage];
-  memcpy(p, &length, sizeof(length));
-  p += sizeof(length);
-  memcpy(p, strokes, sizeof(StenoStroke) * length);
-  p += sizeof(StenoStroke) * length;
-  memcpy(p, word, wordLength + 1);
-  p += wordStorageLength;
+  if (pendingEntryCount == MAX_PENDING_ENTRY_COUNT) {
+    return Flush();
+  }
+  return true;
+}
 
-  size_t bytesToWrite =
-      ((p - buffer) + (Flash::BLOCK_SIZE - 1)) & -Flash::BLOCK_SIZE;
+void StenoUserDictionary::PushPendingEntry(StenoUserDictionaryEntry *entry,
+                                           size_t dataLength, bool isRemoved) {
+  if (!isRemoved) {
+    pendingDataEnd =
+        GetAppendPosition(GetPendingDataEnd(), dataLength) + dataLength;
+  }
+  pendingEntries[pendingEntryCount++] = {
+      .isRemoved = isRemoved,
+      .dataLength = dataLength,
+      .entry = entry,
+  };
+  if (entry->strokeLength > pendingMaximumStrokeCount) {
+    pendingMaximumStrokeCount = entry->strokeLength;
+  }
+}
 
-  assert(bytesToWrite <= Flash::BLOCK_SIZE * 2);
-  Flash::Write(originalDataPage, buffer, bytesToWrite);
+void StenoUserDictionary::ClearPendingEntries() {
+  for (size_t i = 0; i < pendingEntryCount; ++i) {
+    free(pendingEntries[i].entry);
+  }
+  pendingEntryCount = 0;
+  pendingMaximumStrokeCount = 0;
+}
 
-  free(buffer);
+size_t StenoUserDictionary::GetPendingDataEnd() const {
+  return pendingEntryCount != 0 ? pendingDataEnd
+                                : activeDescriptor->data.dataBlockSize;
+}
 
-  return AddToDataBlockResult(offset, totalLength);
+// Superseded pending entries are counted, so this is conservative.
+bool StenoUserDictionary::HasSpaceForPendingEntry(size_t dataLength,
+                                                  size_t reserve) const {
+  size_t end = GetAppendPosition(GetPendingDataEnd(), dataLength) + dataLength;
+  return end + reserve <= GetAppendLimit();
 }
 
-void StenoUserDictionary::AddToDescriptor(size_t strokeLength,
-                                          size_t dataLength) {
-  char *buffer = (char *)malloc(Flash::BLOCK_SIZE);
+const StenoUserDictionary::PendingEntry *
+StenoUserDictionary::FindPendingEntry(const StenoStroke *strokes,
+                                      size_t length) const {
+  for (size_t i = pendingEntryCount; i > 0; --i) {
+    const PendingEntry &pendingEntry = pendingEntries[i - 1];
+    if (pendingEntry.entry->strokeLength == length &&
+        memcmp(strokes, pendingEntry.entry->strokes,
+               sizeof(StenoStroke) * length) == 0) {
+      return &pendingEntry;
+    }
+  }
+  return nullptr;
+}
+
+bool StenoUserDictionary::IsMostRecentPendingEntry(size_t index) const {
+  const StenoUserDictionaryEntry *entry = pendingEntries[index].entry;
+  return FindPendingEntry(entry->strokes, entry->strokeLength) ==
+         &pendingEntries[index];
+}
+
+//---------------------------------------------------------------------------
+
+size_t StenoUserDictionary::GetAppendLimit() const {
+  return (activeDescriptor->data.dataBlockStart & -Flash::BLOCK_SIZE) +
+         GetLogCapacity();
+}
+
+const StenoUserDictionaryEntry *
+StenoUserDictionary::GetLogEntry(size_t position) const {
+  const StenoUserDictionaryEntry *entry =
+      (const StenoUserDictionaryEntry *)(layout.dataBlock +
+                                         GetDataOffset(position));
+  return entry->strokeLength == 0xffffffff ? nullptr : entry;
+}
+
+bool StenoUserDictionary::IsLiveFlashEntry(
+    const StenoUserDictionaryEntry *entry) const {
+  return FindFlashEntry(StenoDictionaryLookup(
+             entry->strokes, entry->strokeLength)) == entry;
+}
+
+void StenoUserDictionary::ScanHashTable() {
+  liveDataLength = 0;
+  hashTableEntryCount = 0;
+  hashTableTombstoneCount = 0;
+
+  for (size_t i = 0; i < activeDescriptor->data.hashTableSize; ++i) {
+    uint32_t offset = activeDescriptor->data.hashTable[i];
+    if (IsDataOffset(offset)) {
+      liveDataLength +=
+          GetFlashEntry(activeDescriptor->data, offset)->GetDataLength();
+      ++hashTableEntryCount;
+    } else if (offset == OFFSET_DELETED) {
+      ++hashTableTombstoneCount;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void StenoUserDictionary::Tick() {
+  if (import && import->isCapturingInput &&
+      Clock::GetCurrentTime() - import->lastInputTime >= IMPORT_TIMEOUT) {
+    if (!import->parser.GetError()) {
+      Console::Printf("ERR Import timed out\n\n");
+    }
+    Console::ReleaseInput();
+    CancelImport();
+  }
+
+  if (IsBulkImporting() ||
+      Clock::GetCurrentTime() - lastChangeTime < FLUSH_DELAY) {
+    return;
+  }
+  if (pendingEntryCount != 0) {
+    Flush();
+    return;
+  }
+
+  // Each slice writes a few pages, so slices are spaced out to keep flash
+  // stalls away from typing.
+  if (RunCompactionSlice()) {
+    lastChangeTime = Clock::GetCurrentTime();
+  }
+}
+
+// Hash table values that differ from flash while flushing. There is at most
+// one per pending entry.
+class StenoUserDictionaryHashTableUpdates {
+public:
+  StenoUserDictionaryHashTableUpdates(const StenoUserDictionaryData &data)
+      : data(data) {}
+
+  // Returns false if the entry could not be placed.
+  bool Add(const StenoUserDictionaryEntry *entry, uint32_t offset);
+  void Remove(const StenoUserDictionaryEntry *entry);
+
+  // Removes the slot that references offset, if any.
+  void RemoveOffset(const StenoUserDictionaryEntry *entry, uint32_t offset);
+
+  bool IsFull() const {
+    return updateCount == StenoUserDictionary::MAX_PENDING_ENTRY_COUNT;
+  }
+
+  // Length of the flash entries that are no longer referenced.
+  size_t GetRemovedDataLength() const { return removedDataLength; }
+
+  ptrdiff_t GetEntryCountChange() const { return entryCountChange; }
+  ptrdiff_t GetTombstoneCountChange() const { return tombstoneCountChange; }
+
+  // Writes each touched page once, in page order.
+  void Write();
+
+private:
+  struct Update {
+    size_t entryIndex;
+    uint32_t offset;
+  };
+
+  const StenoUserDictionaryData data;
+  size_t updateCount = 0;
+  size_t removedDataLength = 0;
+  ptrdiff_t entryCountChange = 0;
+  ptrdiff_t tombstoneCountChange = 0;
+  Update updates[StenoUserDictionary::MAX_PENDING_ENTRY_COUNT];
+
+  const Update *FindUpdate(size_t entryIndex) const;
+  uint32_t GetOffset(size_t entryIndex) const;
+  void SetOffset(size_t entryIndex, uint32_t offset);
+  void RemoveEntryIndex(size_t entryIndex, uint32_t offset);
+
+  // Entries written by this flush are never compared, since each outline
+  // is written at most once.
+  bool IsFlashEntry(size_t entryIndex, uint32_t offset,
+                    const StenoUserDictionaryEntry *entry) const;
+
+  static int CompareUpdates(const void *a, const void *b);
+};
+
+const StenoUserDictionaryHashTableUpdates::Update *
+StenoUserDictionaryHashTableUpdates::FindUpdate(size_t entryIndex) const {
+  for (size_t i = 0; i < updateCount; ++i) {
+    if (updates[i].entryIndex == entryIndex) {
+      return &updates[i];
+    }
+  }
+  return nullptr;
+}
+
+uint32_t
+StenoUserDictionaryHashTableUpdates::GetOffset(size_t entryIndex) const {
+  const Update *update = FindUpdate(entryIndex);
+  return update ? update->offset : data.hashTable[entryIndex];
+}
+
+void StenoUserDictionaryHashTableUpdates::SetOffset(size_t entryIndex,
+                                                    uint32_t offset) {
+  uint32_t previousOffset = GetOffset(entryIndex);
+  entryCountChange += IsDataOffset(offset) - IsDataOffset(previousOffset);
+  tombstoneCountChange +=
+      (offset == OFFSET_DELETED) - (previousOffset == OFFSET_DELETED);
+
+  Update *update = (Update *)FindUpdate(entryIndex);
+  if (update) {
+    update->offset = offset;
+    return;
+  }
+  assert(!IsFull());
+  updates[updateCount++] = {.entryIndex = entryIndex, .offset = offset};
+}
+
+void StenoUserDictionaryHashTableUpdates::RemoveEntryIndex(size_t entryIndex,
+                                                           uint32_t offset) {
+  removedDataLength += GetFlashEntry(data, offset)->GetDataLength();
+  SetOffset(entryIndex, OFFSET_DELETED);
+}
+
+bool StenoUserDictionaryHashTableUpdates::IsFlashEntry(
+    size_t entryIndex, uint32_t offset,
+    const StenoUserDictionaryEntry *entry) const {
+  return FindUpdate(entryIndex) == nullptr &&
+         GetFlashEntry(data, offset)->HasOutline(entry->strokes,
+                                                 entry->strokeLength);
+}
+
+// The whole chain is checked for the outline before a tombstone is reused,
+// otherwise an older definition further along would return once the new
+// one is removed.
+bool StenoUserDictionaryHashTableUpdates::Add(
+    const StenoUserDictionaryEntry *entry, uint32_t offset) {
+  size_t entryIndex = StenoStroke::Hash(entry->strokes, entry->strokeLength);
+  size_t freeEntryIndex = (size_t)-1;
+
+  for (size_t probeCount = 0;
+       probeCount < StenoUserDictionary::MAX_PROBE_COUNT; ++probeCount) {
+    entryIndex = entryIndex & (data.hashTableSize - 1);
+
+    uint32_t existingOffset = GetOffset(entryIndex);
+    if (existingOffset == OFFSET_EMPTY || existingOffset == OFFSET_DELETED) {
+      if (freeEntryIndex == (size_t)-1) {
+        freeEntryIndex = entryIndex;
+      }
+      if (existingOffset == OFFSET_EMPTY) {
+        break;
+      }
+    } else if (IsFlashEntry(entryIndex, existingOffset, entry)) {
+      removedDataLength += GetFlashEntry(data, existingOffset)->GetDataLength();
+      SetOffset(entryIndex, offset);
+      return true;
+    }
+    ++entryIndex;
+  }
+
+  if (freeEntryIndex == (size_t)-1) {
+    return false;
+  }
+  SetOffset(freeEntryIndex, offset);
+  return true;
+}
+
+void StenoUserDictionaryHashTableUpdates::Remove(
+    const StenoUserDictionaryEntry *entry) {
+  size_t entryIndex = StenoStroke::Hash(entry->strokes, entry->strokeLength);
+  for (size_t probeCount = 0;
+       probeCount < StenoUserDictionary::MAX_PROBE_COUNT; ++probeCount) {
+    entryIndex = entryIndex & (data.hashTableSize - 1);
+
+    uint32_t offset = GetOffset(entryIndex);
+    switch (offset) {
+    case OFFSET_EMPTY:
+      return;
+
+    case OFFSET_DELETED:
+      break;
+
+    default:
+      if (IsFlashEntry(entryIndex, offset, entry)) {
+        RemoveEntryIndex(entryIndex, offset);
+        return;
+      }
+    }
+
+    ++entryIndex;
+  }
+}
+
+void StenoUserDictionaryHashTableUpdates::RemoveOffset(
+    const StenoUserDictionaryEntry *entry, uint32_t offset) {
+  size_t entryIndex = StenoStroke::Hash(entry->strokes, entry->strokeLength);
+  for (size_t probeCount = 0;
+       probeCount < StenoUserDictionary::MAX_PROBE_COUNT; ++probeCount) {
+    entryIndex = entryIndex & (data.hashTableSize - 1);
+
+    uint32_t existingOffset = GetOffset(entryIndex);
+    if (existingOffset == OFFSET_EMPTY) {
+      return;
+    }
+    if (existingOffset == offset) {
+      RemoveEntryIndex(entryIndex, offset);
+      return;
+    }
+    ++entryIndex;
+  }
+}
+
+int StenoUserDictionaryHashTableUpdates::CompareUpdates(const void *a,
+                                                        const void *b) {
+  size_t entryIndexA = ((const Update *)a)->entryIndex;
+  size_t entryIndexB = ((const Update *)b)->entryIndex;
+  return entryIndexA < entryIndexB ? -1 : entryIndexA > entryIndexB;
+}
+
+void StenoUserDictionaryHashTableUpdates::Write() {
+  qsort(updates, updateCount, sizeof(Update), CompareUpdates);
+
+  const size_t ENTRIES_PER_PAGE = Flash::BLOCK_SIZE / sizeof(uint32_t);
+  uint32_t *buffer = (uint32_t *)malloc(Flash::BLOCK_SIZE);
+
+  size_t i = 0;
+  while (i < updateCount) {
+    size_t pageStart = updates[i].entryIndex & -ENTRIES_PER_PAGE;
+    const uint32_t *page = &data.hashTable[pageStart];
+    memcpy(buffer, page, Flash::BLOCK_SIZE);
+
+    for (; i < updateCount &&
+           updates[i].entryIndex < pageStart + ENTRIES_PER_PAGE;
+         ++i) {
+      buffer[updates[i].entryIndex - pageStart] = updates[i].offset;
+    }
+    Flash::Write(page, buffer, Flash::BLOCK_SIZE);
+  }
+
+  free(buffer);
+}
+
+// Writes are ordered data, descriptor, then hash table, so that the hash
+// table never references data that a valid descriptor does not cover.
+bool StenoUserDictionary::Flush() {
+  if (pendingEntryCount == 0) {
+    return true;
+  }
+
+  // Each pending entry is counted as an add, so this is conservative.
+  size_t rehashSize = GetRehashSize(pendingEntryCount);
+  if (rehashSize != 0) {
+    RehashHashTable(rehashSize);
+  }
+
+  // Only the most recent change to each outline is written.
+  StenoUserDictionaryHashTableUpdates hashTableUpdates(activeDescriptor->data);
+  bool isWritten[MAX_PENDING_ENTRY_COUNT];
+  bool success = true;
+  size_t dataBlockSize = activeDescriptor->data.dataBlockSize;
+  size_t writtenDataLength = 0;
+  uint32_t maximumStrokeCount = activeDescriptor->data.maximumStrokeCount;
+
+  for (size_t i = 0; i < pendingEntryCount; ++i) {
+    const PendingEntry &pendingEntry = pendingEntries[i];
+    isWritten[i] = false;
+    if (!IsMostRecentPendingEntry(i)) {
+      continue;
+    }
+
+    if (pendingEntry.isRemoved) {
+      hashTableUpdates.Remove(pendingEntry.entry);
+      continue;
+    }
+
+    size_t position =
+        GetAppendPosition(dataBlockSize, pendingEntry.dataLength);
+    if (!hashTableUpdates.Add(pendingEntry.entry,
+                              GetDataOffset(position) + OFFSET_DATA)) {
+      success = false;
+      continue;
+    }
+
+    isWritten[i] = true;
+    dataBlockSize = position + pendingEntry.dataLength;
+    writtenDataLength += pendingEntry.dataLength;
+    if (pendingEntry.entry->strokeLength > maximumStrokeCount) {
+      maximumStrokeCount = pendingEntry.entry->strokeLength;
+    }
+  }
+  assert(dataBlockSize <= GetAppendLimit());
+
+  if (dataBlockSize != activeDescriptor->data.dataBlockSize) {
+    WriteDataBlock(isWritten);
+
+    StenoUserDictionaryData data = activeDescriptor->data;
+    data.dataBlockSize = dataBlockSize;
+    data.maximumStrokeCount = maximumStrokeCount;
+    WriteDescriptor(data);
+  }
+  hashTableUpdates.Write();
+
+  liveDataLength += writtenDataLength;
+  liveDataLength -= hashTableUpdates.GetRemovedDataLength();
+  hashTableEntryCount += hashTableUpdates.GetEntryCountChange();
+  hashTableTombstoneCount += hashTableUpdates.GetTombstoneCountChange();
+  if (hashTableTombstoneCount != 0) {
+    hashTablePagesToRebuild = GetHashTablePageCount();
+  }
+  ClearPendingEntries();
+
+  // Lookups now return flash pointers.
+  ++updateCount;
+  return success;
+}
+
+// Mirrors the placement in Flush(). Only the first page can hold earlier
+// entries.
+void StenoUserDictionary::WriteDataBlock(const bool *isWritten) {
+  const uint8_t *dataBlock = activeDescriptor->data.dataBlock;
+  size_t position = activeDescriptor->data.dataBlockSize;
+  size_t pageStart = position & -Flash::BLOCK_SIZE;
+  bool isPageChanged = false;
+
+  uint8_t *buffer = (uint8_t *)malloc(Flash::BLOCK_SIZE);
+  memset(buffer, 0xff, Flash::BLOCK_SIZE);
+  memcpy(buffer, dataBlock + GetDataOffset(pageStart), position - pageStart);
+
+  for (size_t i = 0; i < pendingEntryCount; ++i) {
+    if (!isWritten[i]) {
+      continue;
+    }
+
+    const PendingEntry &pendingEntry = pendingEntries[i];
+    position = GetAppendPosition(position, pendingEntry.dataLength);
+    if (position >= pageStart + Flash::BLOCK_SIZE) {
+      if (isPageChanged) {
+        Flash::Write(dataBlock + GetDataOffset(pageStart), buffer,
+                     Flash::BLOCK_SIZE);
+      }
+      pageStart = position & -Flash::BLOCK_SIZE;
+      memset(buffer, 0xff, Flash::BLOCK_SIZE);
+    }
+
+    memcpy(buffer + position - pageStart, pendingEntry.entry,
+           pendingEntry.dataLength);
+    position += pendingEntry.dataLength;
+    isPageChanged = true;
+  }
+
+  if (isPageChanged) {
+    Flash::Write(dataBlock + GetDataOffset(pageStart), buffer,
+                 Flash::BLOCK_SIZE);
+  }
+  free(buffer);
+}
+
+// Descriptors rotate through the slots of the descriptor page, and a blank
+// slot is programmed without an erase. When the rotation wraps around, the
+// page is erased and programmed again with every descriptor. This is not
+// crash safe: losing power between the erase and the program leaves no
+// valid descriptor, and the dictionary is reset when it is next opened.
+void StenoUserDictionary::WriteDescriptor(const StenoUserDictionaryData &data) {
+  char *buffer = (char *)malloc(Flash::BLOCK_SIZE);
 
   memcpy(buffer, descriptorBase, Flash::BLOCK_SIZE);
 
@@ -315,11 +1316,14 @@ void StenoUserDictionary::AddToDescriptor(size_t strokeLength,
 
   memcpy(freshDescriptor, activeDescriptor,
          sizeof(StenoUserDictionaryDescriptor));
-  freshDescriptor->data.dataBlockSize =
-      activeDescriptor->data.dataBlockSize + dataLength;
-  if (strokeLength > activeDescriptor->data.maximumStrokeCount) {
-    freshDescriptor->data.maximumStrokeCount = (uint32_t)strokeLength;
-  }
+  // Assigned field by field, so that padding matches flash.
+  freshDescriptor->data.hashTable = data.hashTable;
+  freshDescriptor->data.hashTableSize = data.hashTableSize;
+  freshDescriptor->data.dataBlockStart = data.dataBlockStart;
+  freshDescriptor->data.dataBlockSize = data.dataBlockSize;
+  freshDescriptor->data.maximumStrokeCount = data.maximumStrokeCount;
+  freshDescriptor->data.sequenceNumber =
+      activeDescriptor->data.sequenceNumber + 1;
   freshDescriptor->UpdateCrc32();
 
   Flash::Write(descriptorBase, buffer, Flash::BLOCK_SIZE);
@@ -331,77 +1335,536 @@ void StenoUserDictionary::AddToDescriptor(size_t strokeLength,
                                         freshDescriptorOffset);
 }
 
-bool StenoUserDictionary::AddToHashTable(const StenoStroke *strokes,
-                                         size_t length, size_t dataOffset) {
-  size_t entryIndex = StenoStroke::Hash(strokes, length);
+//---------------------------------------------------------------------------
 
-  for (int probeCount = 0; probeCount < 128; ++probeCount) {
-    entryIndex = entryIndex & (activeDescriptor->data.hashTableSize - 1);
+bool StenoUserDictionary::BeginImport() {
+  if (import) {
+    return false;
+  }
+  Flush();
+
+  const StenoUserDictionaryData &data = activeDescriptor->data;
+  import = new StenoUserDictionaryImport(*this);
+  import->isBulk = FindFreshHashTableRegion(data.hashTableSize) != nullptr;
+  import->dataBlockSize = data.dataBlockSize;
+  import->maximumStrokeCount = data.maximumStrokeCount;
+  import->entryCount = 0;
+  import->isCapturingInput = false;
+  StartImportPage(data.dataBlockSize);
+  return true;
+}
 
-    uint32_t offset = activeDescriptor->data.hashTable[entryIndex];
-    switch (offset) {
-    case OFFSET_EMPTY:
-    case OFFSET_DELETED:
-      WriteEntryIndex(entryIndex, dataOffset + OFFSET_DATA);
+// Mirrors AddPendingEntry() and the placement in Flush().
+bool StenoUserDictionary::ImportEntry(const StenoStroke *strokes,
+                                      size_t length, const char *word) {
+  assert(import);
+  if (!import->isBulk) {
+    return Add(strokes, length, word);
+  }
+
+  size_t wordLength = strlen(word);
+  size_t dataLength =
+      StenoUserDictionaryEntry::GetDataLength(length, wordLength);
+  if (length == 0 || length > MAX_STROKE_COUNT || dataLength > 256) {
+    return false;
+  }
+
+  // When the log is full, the entries so far are added so that compaction
+  // can make space.
+  size_t position = GetAppendPosition(import->dataBlockSize, dataLength);
+  if (position + dataLength + COMPACTION_RESERVE > GetAppendLimit()) {
+    if (!CommitImport() || !MakeSpace(dataLength)) {
+      return false;
+    }
+    import->dataBlockSize = activeDescriptor->data.dataBlockSize;
+    StartImportPage(import->dataBlockSize);
+    position = GetAppendPosition(import->dataBlockSize, dataLength);
+  }
+
+  if (position >= import->pageStart + Flash::BLOCK_SIZE) {
+    WriteImportPage();
+    StartImportPage(position);
+  }
+
+  StenoUserDictionaryEntry *entry =
+      (StenoUserDictionaryEntry *)(import->page + position -
+                                   import->pageStart);
+  entry->strokeLength = (uint32_t)length;
+  memcpy(entry->strokes, strokes, sizeof(StenoStroke) * length);
+  memcpy(entry->GetText(), word, wordLength + 1);
+  import->isPageChanged = true;
+
+  import->dataBlockSize = position + dataLength;
+  ++import->entryCount;
+  if (length > import->maximumStrokeCount) {
+    import->maximumStrokeCount = (uint32_t)length;
+  }
+  return true;
+}
+
+bool StenoUserDictionary::EndImport() {
+  assert(import);
+  bool success = import->isBulk ? CommitImport() : Flush();
+  delete import;
+  import = nullptr;
+  return success;
+}
+
+void StenoUserDictionary::CancelImport() {
+  delete import;
+  import = nullptr;
+}
+
+bool StenoUserDictionary::IsBulkImporting() const {
+  return import && import->isBulk;
+}
+
+// Only the page holding the end of the log has earlier entries to keep.
+void StenoUserDictionary::StartImportPage(size_t position) {
+  import->pageStart = position & -Flash::BLOCK_SIZE;
+  import->isPageChanged = false;
+  memset(import->page, 0xff, Flash::BLOCK_SIZE);
+  memcpy(import->page, layout.dataBlock + GetDataOffset(import->pageStart),
+         position - import->pageStart);
+}
+
+void StenoUserDictionary::WriteImportPage() {
+  if (import->isPageChanged) {
+    Flash::Write(layout.dataBlock + GetDataOffset(import->pageStart),
+                 import->page, Flash::BLOCK_SIZE);
+    import->isPageChanged = false;
+  }
+}
+
+// Adds the imported entries with a rehash into a table sized for them, which
+// also writes the descriptor. Smaller tables are tried if there is no region
+// for the larger one.
+bool StenoUserDictionary::CommitImport() {
+  WriteImportPage();
+  if (import->entryCount == 0) {
+    return true;
+  }
+
+  const size_t currentSize = activeDescriptor->data.hashTableSize;
+  size_t hashTableSize = currentSize;
+  while ((hashTableEntryCount + import->entryCount) * 4 > hashTableSize * 3 &&
+         hashTableSize < GetMaximumHashTableSize()) {
+    hashTableSize *= 2;
+  }
+
+  for (; hashTableSize >= currentSize; hashTableSize /= 2) {
+    if (BuildHashTable(hashTableSize, import->dataBlockSize,
+                       import->maximumStrokeCount)) {
+      import->entryCount = 0;
+      ++updateCount;
       return true;
+    }
+  }
+  return false;
+}
 
-    default:
-      const StenoUserDictionaryEntry *entry =
-          (const StenoUserDictionaryEntry *)(activeDescriptor->data.dataBlock +
-                                             offset - OFFSET_DATA);
+//---------------------------------------------------------------------------
 
-      if (entry->strokeLength == length &&
-          memcmp(strokes, entry->strokes, sizeof(StenoStroke) * length) == 0) {
-        WriteEntryIndex(entryIndex, dataOffset + OFFSET_DATA);
-        return true;
-      }
-      ++entryIndex;
+bool StenoUserDictionary::RunCompactionSlice() {
+  if (NeedsDataBlockCompaction() && CompactDataBlock()) {
+    return true;
+  }
+
+  size_t rehashSize = GetRehashSize(0);
+  if (rehashSize != 0 && RehashHashTable(rehashSize)) {
+    return true;
+  }
+
+  while (hashTablePagesToRebuild != 0) {
+    --hashTablePagesToRebuild;
+    size_t page = nextHashTablePageToRebuild;
+    nextHashTablePageToRebuild = (page + 1) % GetHashTablePageCount();
+    if (RebuildHashTablePage(page)) {
+      return true;
     }
   }
   return false;
 }
 
-bool StenoUserDictionary::Remove(const StenoStroke *strokes, size_t length) {
-  size_t entryIndex = StenoStroke::Hash(strokes, length);
-  for (;;) {
-    entryIndex = entryIndex & (activeDescriptor->data.hashTableSize - 1);
+// Page padding is at most 1/16 of the log, so requiring 1/8 of the log to
+// be dead stops compaction from endlessly copying live entries.
+bool StenoUserDictionary::NeedsDataBlockCompaction() const {
+  const StenoUserDictionaryData &data = activeDescriptor->data;
+  size_t usedLength = data.dataBlockSize - data.dataBlockStart;
+  return GetAppendLimit() - data.dataBlockSize < GetLogCapacity() / 4 &&
+         usedLength - liveDataLength >= GetLogCapacity() / 8;
+}
 
-    uint32_t offset = activeDescriptor->data.hashTable[entryIndex];
-    switch (offset) {
-    case OFFSET_EMPTY:
+// Copies the live entries at the start of the log to the end, up to the end
+// of the first page, then advances dataBlockStart past them. Slots that
+// still reference dead entries there, which version 1 could leave behind,
+// are removed first. dataBlockStart is written last, so that an interrupted
+// slice leaves the old copies in place.
+//
+// Returns false if nothing could be moved.
+bool StenoUserDictionary::CompactDataBlock() {
+  assert(pendingEntryCount == 0);
+  const size_t start = activeDescriptor->data.dataBlockStart;
+  const size_t end = activeDescriptor->data.dataBlockSize;
+  const size_t pageEnd = (start & -Flash::BLOCK_SIZE) + Flash::BLOCK_SIZE;
+
+  StenoUserDictionaryHashTableUpdates staleEntries(activeDescriptor->data);
+  size_t position = start;
+  while (position < end && position < pageEnd &&
+         pendingEntryCount < MAX_PENDING_ENTRY_COUNT &&
+         !staleEntries.IsFull()) {
+    const StenoUserDictionaryEntry *entry = GetLogEntry(position);
+    if (entry == nullptr) {
+      position = pageEnd;
+      break;
+    }
+
+    size_t dataLength = entry->GetDataLength();
+    if (IsLiveFlashEntry(entry)) {
+      if (!HasSpaceForPendingEntry(dataLength, 0)) {
+        break;
+      }
+      StenoUserDictionaryEntry *copy =
+          (StenoUserDictionaryEntry *)malloc(dataLength);
+      memcpy(copy, entry, dataLength);
+      PushPendingEntry(copy, dataLength, false);
+    } else {
+      staleEntries.RemoveOffset(entry, GetDataOffset(position) + OFFSET_DATA);
+    }
+    position += dataLength;
+  }
+
+  if (position == start) {
+    return false;
+  }
+
+  // Before Flush(), which can rehash.
+  staleEntries.Write();
+  liveDataLength -= staleEntries.GetRemovedDataLength();
+  hashTableEntryCount += staleEntries.GetEntryCountChange();
+  hashTableTombstoneCount += staleEntries.GetTombstoneCountChange();
+  Flush();
+
+  StenoUserDictionaryData data = activeDescriptor->data;
+  data.dataBlockStart = position < end ? position : end;
+  WriteDescriptor(data);
+  return true;
+}
+
+// For when adds have outpaced idle compaction. A full pass over the log
+// packs every live entry, so compaction stops there.
+bool StenoUserDictionary::MakeSpace(size_t dataLength) {
+  Flush();
+
+  const size_t end = activeDescriptor->data.dataBlockSize;
+  while (!HasSpaceForPendingEntry(dataLength, COMPACTION_RESERVE)) {
+    if (activeDescriptor->data.dataBlockStart >= end || !CompactDataBlock()) {
       return false;
+    }
+  }
+  return true;
+}
 
-    case OFFSET_DELETED:
-      break;
+size_t StenoUserDictionary::GetHashTablePageCount() const {
+  return activeDescriptor->data.hashTableSize * sizeof(uint32_t) /
+         Flash::BLOCK_SIZE;
+}
 
-    default:
-      const StenoUserDictionaryEntry *entry =
-          (const StenoUserDictionaryEntry *)(activeDescriptor->data.dataBlock +
-                                             offset - OFFSET_DATA);
+// Tables larger than half the region would overlap the current table
+// wherever they were placed, so could not be built beside it.
+size_t StenoUserDictionary::GetMaximumHashTableSize() const {
+  const size_t ENTRIES_PER_PAGE = Flash::BLOCK_SIZE / sizeof(uint32_t);
+  size_t halfSize = layout.hashTableSize / 2;
+  return halfSize >= ENTRIES_PER_PAGE ? halfSize : layout.hashTableSize;
+}
+
+// Tables grow past 3/4 load, and are rebuilt at the same size once 1/8 of
+// their slots are tombstones.
+size_t StenoUserDictionary::GetRehashSize(size_t addCount) const {
+  size_t hashTableSize = activeDescriptor->data.hashTableSize;
+  if ((hashTableEntryCount + addCount) * 4 > hashTableSize * 3 &&
+      hashTableSize < GetMaximumHashTableSize()) {
+    return 2 * hashTableSize;
+  }
+  if (hashTableTombstoneCount * 8 > hashTableSize) {
+    return hashTableSize;
+  }
+  return 0;
+}
+
+// Each rehash moves to the next aligned region that does not overlap the
+// current table, which also spreads hash table writes across the region.
+const uint32_t *
+StenoUserDictionary::FindFreshHashTableRegion(size_t hashTableSize) const {
+  const size_t ENTRIES_PER_PAGE = Flash::BLOCK_SIZE / sizeof(uint32_t);
+  if (hashTableSize < ENTRIES_PER_PAGE ||
+      hashTableSize > GetMaximumHashTableSize()) {
+    return nullptr;
+  }
+
+  const size_t currentStart =
+      activeDescriptor->data.hashTable - layout.hashTable;
+  const size_t currentEnd =
+      currentStart + activeDescriptor->data.hashTableSize;
+
+  size_t start = (currentEnd + hashTableSize - 1) & -hashTableSize;
+  for (size_t i = 0; i < layout.hashTableSize / hashTableSize; ++i) {
+    start %= layout.hashTableSize;
+    if (start + hashTableSize <= currentStart || start >= currentEnd) {
+      return layout.hashTable + start;
+    }
+    start += hashTableSize;
+  }
+  return nullptr;
+}
+
+bool StenoUserDictionary::RehashHashTable(size_t hashTableSize) {
+  return BuildHashTable(hashTableSize, activeDescriptor->data.dataBlockSize,
+                        activeDescriptor->data.maximumStrokeCount);
+}
+
+// Builds the new table a page at a time beside the current one, then
+// switches to it with a single descriptor write, so an interrupted rehash
+// leaves the current table in use. Each page gathers the entries that hash
+// into it, and entries that overflow a page continue at the start of the
+// next. The first page is written last, since the last page can overflow
+// into it.
+//
+// Returns false, leaving the current table, if there is no free region or
+// an entry could not be placed within MAX_PROBE_COUNT slots.
+bool StenoUserDictionary::BuildHashTable(size_t hashTableSize,
+                                         size_t dataBlockSize,
+                                         uint32_t maximumStrokeCount) {
+  const uint32_t *hashTable = FindFreshHashTableRegion(hashTableSize);
+  if (hashTable == nullptr) {
+    return false;
+  }
+
+  const size_t ENTRIES_PER_PAGE = Flash::BLOCK_SIZE / sizeof(uint32_t);
+  const StenoUserDictionaryData &data = activeDescriptor->data;
+  const size_t mask = hashTableSize - 1;
+  const size_t pageCount = hashTableSize / ENTRIES_PER_PAGE;
+
+  struct Overflow {
+    uint32_t offset;
+    size_t entryIndex;
+    bool isAppended;
+  };
+  Overflow overflows[MAX_PROBE_COUNT];
+  size_t overflowCount = 0;
+
+  uint32_t *firstPage = (uint32_t *)malloc(Flash::BLOCK_SIZE);
+  uint32_t *buffer = (uint32_t *)malloc(Flash::BLOCK_SIZE);
+  bool success = true;
+
+  for (size_t page = 0; page <= pageCount && success; ++page) {
+    const size_t pageStart = (page % pageCount) * ENTRIES_PER_PAGE;
+    uint32_t *slots = page % pageCount == 0 ? firstPage : buffer;
+    if (page != pageCount) {
+      memset(slots, 0xff, Flash::BLOCK_SIZE);
+    }
+
+    // Overflow from the previous page first, then the entries in the current
+    // table and the appended entries that hash into this page, unless this is
+    // the first page again. Overflow cannot fill a page, so it is all read
+    // before any more is added.
+    size_t previousOverflowCount = overflowCount;
+    overflowCount = 0;
+    size_t position = data.dataBlockSize;
+    for (size_t i = 0;; ++i) {
+      uint32_t offset;
+      size_t entryIndex;
+      bool isAppended;
+      if (i < previousOverflowCount) {
+        offset = overflows[i].offset;
+        entryIndex = overflows[i].entryIndex;
+        isAppended = overflows[i].isAppended;
+      } else {
+        if (page == pageCount) {
+          break;
+        }
+        if (i < previousOverflowCount + data.hashTableSize) {
+          offset = data.hashTable[i - previousOverflowCount];
+          if (!IsDataOffset(offset)) {
+            continue;
+          }
+          isAppended = false;
+        } else if (position < dataBlockSize) {
+          const StenoUserDictionaryEntry *entry = GetLogEntry(position);
+          if (entry == nullptr) {
+            position = (position & -Flash::BLOCK_SIZE) + Flash::BLOCK_SIZE;
+            continue;
+          }
+          offset = GetDataOffset(position) + OFFSET_DATA;
+          position += entry->GetDataLength();
+          isAppended = true;
+        } else {
+          break;
+        }
+        const StenoUserDictionaryEntry *entry = GetFlashEntry(data, offset);
+        entryIndex =
+            StenoStroke::Hash(entry->strokes, entry->strokeLength) & mask;
+        if (entryIndex - pageStart >= ENTRIES_PER_PAGE) {
+          continue;
+        }
+      }
 
-      if (entry->strokeLength == length &&
-          memcmp(strokes, entry->strokes, sizeof(StenoStroke) * length) == 0) {
-        WriteEntryIndex(entryIndex, OFFSET_DELETED);
-        return true;
+      // Outlines that version 1 could duplicate keep their first slot, and
+      // appended entries replace the definition before them.
+      const StenoUserDictionaryEntry *entry = GetFlashEntry(data, offset);
+      size_t slot = i < previousOverflowCount ? 0 : entryIndex - pageStart;
+      while (slot < ENTRIES_PER_PAGE && slots[slot] != OFFSET_EMPTY &&
+             !GetFlashEntry(data, slots[slot])
+                  ->HasOutline(entry->strokes, entry->strokeLength)) {
+        ++slot;
+      }
+
+      if (slot == ENTRIES_PER_PAGE) {
+        if (page == pageCount || overflowCount == MAX_PROBE_COUNT) {
+          success = false;
+          break;
+        }
+        overflows[overflowCount++] = {
+            .offset = offset,
+            .entryIndex = entryIndex,
+            .isAppended = isAppended,
+        };
+      } else if (slots[slot] == OFFSET_EMPTY) {
+        if (((pageStart + slot - entryIndex) & mask) >= MAX_PROBE_COUNT) {
+          success = false;
+          break;
+        }
+        slots[slot] = offset;
+      } else if (isAppended) {
+        slots[slot] = offset;
       }
     }
 
-    ++entryIndex;
+    if (success && page != 0 && page != pageCount) {
+      Flash::Write(hashTable + pageStart, buffer, Flash::BLOCK_SIZE);
+    }
   }
+
+  if (success) {
+    Flash::Write(hashTable, firstPage, Flash::BLOCK_SIZE);
+
+    StenoUserDictionaryData newData = activeDescriptor->data;
+    newData.hashTable = hashTable;
+    newData.hashTableSize = hashTableSize;
+    newData.dataBlockSize = dataBlockSize;
+    newData.maximumStrokeCount = maximumStrokeCount;
+    WriteDescriptor(newData);
+
+    ScanHashTable();
+    hashTablePagesToRebuild = 0;
+    nextHashTablePageToRebuild = 0;
+  }
+
+  free(buffer);
+  free(firstPage);
+  return success;
 }
 
-void StenoUserDictionary::WriteEntryIndex(size_t entryIndex, size_t offset) {
-  const uint32_t *entry = &activeDescriptor->data.hashTable[entryIndex];
-  uint32_t *buffer = (uint32_t *)malloc(Flash::BLOCK_SIZE);
-  const uint32_t *entryPage = RoundToPage(entry, Flash::BLOCK_SIZE);
-  memcpy(buffer, entryPage, Flash::BLOCK_SIZE);
+// Rebuilds each cluster in the page that has tombstones, by clearing it and
+// reinserting its live entries. Every entry in a cluster hashes into that
+// cluster, so reinserting stays within it. Clusters that continue into a
+// neighboring page are left, so that the page is written on its own.
+//
+// Returns true if the page was written.
+bool StenoUserDictionary::RebuildHashTablePage(size_t page) {
+  const size_t ENTRIES_PER_PAGE = Flash::BLOCK_SIZE / sizeof(uint32_t);
+  const StenoUserDictionaryData &data = activeDescriptor->data;
+  const size_t mask = data.hashTableSize - 1;
+  const size_t pageStart = page * ENTRIES_PER_PAGE;
+  const uint32_t *slots = &data.hashTable[pageStart];
+  uint32_t *buffer = nullptr;
+
+  // Clusters in a one page table can wrap around its end, so the scan
+  // starts at an empty slot. Scan positions are relative to it.
+  size_t scanStart = 0;
+  if (data.hashTableSize == ENTRIES_PER_PAGE) {
+    while (scanStart < ENTRIES_PER_PAGE && slots[scanStart] != OFFSET_EMPTY) {
+      ++scanStart;
+    }
+    if (scanStart == ENTRIES_PER_PAGE) {
+      return false;
+    }
+  }
+  const size_t scanMask = ENTRIES_PER_PAGE - 1;
 
-  buffer[entry - entryPage] = (uint32_t)offset;
-  Flash::Write(entryPage, buffer, Flash::BLOCK_SIZE);
+  size_t i = 0;
+  while (i < ENTRIES_PER_PAGE) {
+    if (slots[(scanStart + i) & scanMask] == OFFSET_EMPTY) {
+      ++i;
+      continue;
+    }
 
+    const size_t clusterStart = i;
+    bool hasTombstones = false;
+    for (; i < ENTRIES_PER_PAGE &&
+           slots[(scanStart + i) & scanMask] != OFFSET_EMPTY;
+         ++i) {
+      hasTombstones |= slots[(scanStart + i) & scanMask] == OFFSET_DELETED;
+    }
+    if (!hasTombstones ||
+        data.hashTable[(pageStart + scanStart + clusterStart - 1) & mask] !=
+            OFFSET_EMPTY ||
+        data.hashTable[(pageStart + scanStart + i) & mask] != OFFSET_EMPTY) {
+      continue;
+    }
+
+    if (buffer == nullptr) {
+      buffer = (uint32_t *)malloc(Flash::BLOCK_SIZE);
+      memcpy(buffer, slots, Flash::BLOCK_SIZE);
+    }
+    for (size_t j = clusterStart; j < i; ++j) {
+      uint32_t &slot = buffer[(scanStart + j) & scanMask];
+      hashTableTombstoneCount -= slot == OFFSET_DELETED;
+      slot = OFFSET_EMPTY;
+    }
+
+    for (size_t j = clusterStart; j < i; ++j) {
+      uint32_t offset = slots[(scanStart + j) & scanMask];
+      if (offset == OFFSET_DELETED) {
+        continue;
+      }
+
+      // The first slot for an outline is the one lookups find.
+      const StenoUserDictionaryEntry *entry = GetFlashEntry(data, offset);
+      size_t entryIndex =
+          StenoStroke::Hash(entry->strokes, entry->strokeLength) & mask;
+      for (;;) {
+        assert(((entryIndex - pageStart - scanStart) & scanMask) >=
+                   clusterStart &&
+               ((entryIndex - pageStart - scanStart) & scanMask) < i);
+        uint32_t &slot = buffer[(entryIndex - pageStart) & scanMask];
+        if (slot == OFFSET_EMPTY) {
+          slot = offset;
+          break;
+        }
+        if (GetFlashEntry(data, slot)
+                ->HasOutline(entry->strokes, entry->strokeLength)) {
+          liveDataLength -= entry->GetDataLength();
+          --hashTableEntryCount;
+          break;
+        }
+        entryIndex = (entryIndex + 1) & mask;
+      }
+    }
+  }
+
+  if (buffer == nullptr) {
+    return false;
+  }
+  Flash::Write(slots, buffer, Flash::BLOCK_SIZE);
   free(buffer);
+  return true;
 }
 
+//---------------------------------------------------------------------------
+
+// Flash entries changed by pending entries are skipped, and the pending
+// entries are printed after them.
 bool StenoUserDictionary::PrintDictionary(bool hasData) const {
   char *buffer = (char *)malloc(2048);
 
@@ -413,20 +1876,37 @@ bool StenoUserDictionary::PrintDictionary(bool hasData) const {
       break;
 
     default:
+      const StenoUserDictionaryEntry *entry =
+          (const StenoUserDictionaryEntry *)(activeDescriptor->data.dataBlock +
+                                             offset - OFFSET_DATA);
+      if (FindPendingEntry(entry->strokes, entry->strokeLength)) {
+        break;
+      }
+
       if (!hasData) {
         hasData = true;
         Console::Write("\n\t", 2);
       } else {
         Console::Write(",\n\t", 3);
       }
-      const StenoUserDictionaryEntry *entry =
-          (const StenoUserDictionaryEntry *)(activeDescriptor->data.dataBlock +
-                                             offset - OFFSET_DATA);
-
       entry->Print(buffer);
     }
   }
 
+  for (size_t i = 0; i < pendingEntryCount; ++i) {
+    if (pendingEntries[i].isRemoved || !IsMostRecentPendingEntry(i)) {
+      continue;
+    }
+
+    if (!hasData) {
+      hasData = true;
+      Console::Write("\n\t", 2);
+    } else {
+      Console::Write(",\n\t", 3);
+    }
+    pendingEntries[i].entry->Print(buffer);
+  }
+
   free(buffer);
   return hasData;
 }
@@ -451,29 +1931,72 @@ void StenoUserDictionaryEntry::Print(char *buffer) const {
   Console::Write(buffer, p - buffer);
 }
 
-const char *StenoUserDictionary::GetName() const { return "user_dictionary"; }
+// Probe lengths are grouped by powers of two.
+void StenoUserDictionary::PrintOccupancy() const {
+  const StenoUserDictionaryData &data = activeDescriptor->data;
+  const size_t mask = data.hashTableSize - 1;
+  const size_t BUCKET_COUNT = 9;
+  size_t bucketCounts[BUCKET_COUNT] = {};
+  size_t maximumProbeLength = 0;
+
+  for (size_t i = 0; i < data.hashTableSize; ++i) {
+    uint32_t offset = data.hashTable[i];
+    if (!IsDataOffset(offset)) {
+      continue;
+    }
 
-void StenoUserDictionary::PrintInfo(int depth) const {
-  size_t hashTableUsed = 0;
-  for (size_t i = 0; i < activeDescriptor->data.hashTableSize; ++i) {
-    switch (activeDescriptor->data.hashTable[i]) {
-    case OFFSET_EMPTY:
-    case OFFSET_DELETED:
-      break;
+    const StenoUserDictionaryEntry *entry = GetFlashEntry(data, offset);
+    size_t entryIndex = StenoStroke::Hash(entry->strokes, entry->strokeLength);
+    size_t probeLength = ((i - entryIndex) & mask) + 1;
+    if (probeLength > maximumProbeLength) {
+      maximumProbeLength = probeLength;
+    }
 
-    default:
-      ++hashTableUsed;
+    size_t bucket = 0;
+    for (size_t n = probeLength - 1; n != 0; n >>= 1) {
+      ++bucket;
+    }
+    ++bucketCounts[bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1];
+  }
+
+  Console::Printf("Hash table size: %zu\n", data.hashTableSize);
+  Console::Printf("Entries: %zu\n", hashTableEntryCount);
+  Console::Printf("Tombstones: %zu\n", hashTableTombstoneCount);
+  Console::Printf("Load: %zu%%\n",
+                  100 * hashTableEntryCount / data.hashTableSize);
+  Console::Printf("Probe lengths:\n");
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    size_t low = i == 0 ? 1 : (1 << (i - 1)) + 1;
+    size_t high = 1 << i;
+    if (low == high) {
+      Console::Printf("  %zu: %zu\n", low, bucketCounts[i]);
+    } else if (i == BUCKET_COUNT - 1) {
+      Console::Printf("  %zu+: %zu\n", low, bucketCounts[i]);
+    } else {
+      Console::Printf("  %zu-%zu: %zu\n", low, high, bucketCounts[i]);
     }
   }
+  Console::Printf("Maximum probe length: %zu\n\n", maximumProbeLength);
+}
+
+const char *StenoUserDictionary::GetName() const { return "user_dictionary"; }
 
+void StenoUserDictionary::PrintInfo(int depth) const {
   Console::Printf("%s%s\n", Spaces(depth), GetName());
 
   const char *prefix = Spaces(depth + 2);
   Console::Printf("%sFormat version: %u\n", prefix, USER_DICTIONARY_VERSION);
-  Console::Printf("%sHash table usage: %zu/%zu\n", prefix, hashTableUsed,
-                  activeDescriptor->data.hashTableSize);
+  Console::Printf("%sHash table usage: %zu/%zu\n", prefix,
+                  hashTableEntryCount, activeDescriptor->data.hashTableSize);
+  Console::Printf("%sHash table tombstones: %zu\n", prefix,
+                  hashTableTombstoneCount);
   Console::Printf("%sData block usage: %zu/%zu\n", prefix,
-                  activeDescriptor->data.dataBlockSize, layout.dataBlockSize);
+                  activeDescriptor->data.dataBlockSize -
+                      activeDescriptor->data.dataBlockStart,
+                  GetLogCapacity());
+  Console::Printf("%sLive data: %zu\n", prefix, liveDataLength);
+  Console::Printf("%sPending changes: %zu/%zu\n", prefix, pendingEntryCount,
+                  MAX_PENDING_ENTRY_COUNT);
 }
 
 //---------------------------------------------------------------------------
@@ -516,27 +2039,97 @@ void StenoUserDictionary::AddEntry_Binding(void *context,
     Console::Printf("ERR Unable to write to user dictionary\n\n");
     return;
   }
-
+
+  Console::Write("OK\n\n", 4);
+}
+
+void StenoUserDictionary::RemoveEntry_Binding(void *context,
+                                              const char *commandLine) {
+  const char *strokeStart = strchr(commandLine, ' ');
+  if (!strokeStart) {
+    Console::Printf("ERR No stroke specified\n\n");
+    return;
+  }
+
+  StrokeListParser parser;
+  if (!parser.Set(strokeStart + 1)) {
+    Console::Printf("ERR Cannot parse stroke near %s\n\n", parser.failureOrEnd);
+    return;
+  }
+
+  StenoUserDictionary *userDictionary = (StenoUserDictionary *)context;
+  userDictionary->Remove(parser.strokes, parser.length);
+  Console::Write("OK\n\n", 4);
+}
+
+void StenoUserDictionary::PrintOccupancy_Binding(void *context,
+                                                 const char *commandLine) {
+  const StenoUserDictionary *userDictionary =
+      (const StenoUserDictionary *)context;
+  userDictionary->PrintOccupancy();
+}
+
+void StenoUserDictionary::Flush_Binding(void *context,
+                                        const char *commandLine) {
+  StenoUserDictionary *userDictionary = (StenoUserDictionary *)context;
+  if (!userDictionary->Flush()) {
+    Console::Printf("ERR Unable to write all entries to user dictionary\n\n");
+    return;
+  }
   Console::Write("OK\n\n", 4);
 }
 
-void StenoUserDictionary::RemoveEntry_Binding(void *context,
-                                              const char *commandLine) {
-  const char *strokeStart = strchr(commandLine, ' ');
-  if (!strokeStart) {
-    Console::Printf("ERR No stroke specified\n\n");
+void StenoUserDictionary::Import_Binding(void *context,
+                                         const char *commandLine) {
+  StenoUserDictionary *userDictionary = (StenoUserDictionary *)context;
+  if (!userDictionary->BeginImport()) {
+    Console::Printf("ERR Import already in progress\n\n");
     return;
   }
 
-  StrokeListParser parser;
-  if (!parser.Set(strokeStart + 1)) {
-    Console::Printf("ERR Cannot parse stroke near %s\n\n", parser.failureOrEnd);
-    return;
+  userDictionary->import->isCapturingInput = true;
+  userDictionary->import->lastInputTime = Clock::GetCurrentTime();
+  Console::CaptureInput(ImportInput, context);
+  const char *json = strchr(commandLine, ' ');
+  if (json) {
+    ImportInput(context, json, strlen(json));
   }
+}
 
+size_t StenoUserDictionary::ImportInput(void *context, const char *data,
+                                        size_t length) {
   StenoUserDictionary *userDictionary = (StenoUserDictionary *)context;
-  userDictionary->Remove(parser.strokes, parser.length);
-  Console::Write("OK\n\n", 4);
+  if (!userDictionary->import) {
+    Console::ReleaseInput();
+    return 0;
+  }
+
+  StenoUserDictionaryImport *import = userDictionary->import;
+  StenoUserDictionaryJsonParser &parser = import->parser;
+  bool hadError = parser.GetError() != nullptr;
+  import->lastInputTime = Clock::GetCurrentTime();
+  size_t usedLength = parser.Parse(data, length);
+  if (parser.GetError()) {
+    // The error is reported straight away, but input is captured until the
+    // rest of the object has been skipped. Nothing more is imported, so
+    // edits no longer need to wait for the import.
+    if (!hadError) {
+      import->isBulk = false;
+      Console::Printf("ERR %s\n\n", parser.GetError());
+    }
+    if (parser.IsDone()) {
+      Console::ReleaseInput();
+      userDictionary->CancelImport();
+    }
+  } else if (parser.IsDone()) {
+    Console::ReleaseInput();
+    if (!userDictionary->EndImport()) {
+      Console::Printf("ERR Unable to write to user dictionary\n\n");
+    } else {
+      Console::Write("OK\n\n", 4);
+    }
+  }
+  return usedLength;
 }
 
 //---------------------------------------------------------------------------
@@ -544,6 +2137,8 @@ void StenoUserDictionary::RemoveEntry_Binding(void *context,
 
 #include "../str.h"
 #include "../unit_test.h"
+#include <stdio.h>
+#include <string>
 
 static uint8_t userDictionaryBuffer[512 * 1024];
 
@@ -572,7 +2167,8 @@ TEST_BEGIN("StenoUserDictionary will reset if descriptor is invalid") {
   assert(IsEmpty(userDictionaryBuffer, 64 * 1024));
   assert(!IsEmpty(userDictionaryBuffer + 64 * 1024, 256));
   assert(descriptor->data.hashTable == (void *)userDictionaryBuffer);
-  assert(descriptor->data.hashTableSize == 16 * 1024);
+  assert(descriptor->data.hashTableSize ==
+         StenoUserDictionary::INITIAL_HASH_TABLE_SIZE);
   assert(descriptor->data.dataBlock ==
          (void *)&userDictionaryBuffer[64 * 1024]);
   assert(descriptor->data.dataBlockSize == 0);
@@ -612,7 +2208,662 @@ TEST_BEGIN("StenoUserDictionary add and lookup test") {
 }
 TEST_END
 
+TEST_BEGIN("StenoUserDictionary batches pending changes until Flush") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  for (size_t i = 0; i < sizeof(userDictionaryBuffer); ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  const StenoStroke TKOG[] = {StenoStroke("TKOG")};
+  const StenoStroke KAPBG_RAO[] = {StenoStroke("KAPBG"), StenoStroke("RAO")};
+
+  uint32_t erasedBytes = Flash::erasedBytes;
+  assert(userDictionary.Add(KAT, 1, "cat"));
+  assert(userDictionary.Add(TKOG, 1, "dog"));
+  assert(userDictionary.Add(KAPBG_RAO, 2, "kangaroo"));
+  assert(userDictionary.Add(KAT, 1, "kat"));
+  assert(userDictionary.Remove(TKOG, 1));
+  assert(!userDictionary.Remove(TKOG, 1));
+  assert(Flash::erasedBytes == erasedBytes);
+  assert(userDictionary.HasPendingChanges());
+  assert(userDictionary.GetMaximumOutlineLength() == 2);
+
+  StenoDictionaryLookupResult lookup = userDictionary.Lookup(KAT, 1);
+  assert(Str::Eq(lookup.GetText(), "kat"));
+  lookup.Destroy();
+  assert(!userDictionary.Lookup(TKOG, 1).IsValid());
+
+  // One data page, the descriptor page, and at most one hash table page for
+  // each of the two written outlines.
+  assert(userDictionary.Flush());
+  assert(!userDictionary.HasPendingChanges());
+  assert(Flash::erasedBytes - erasedBytes <= 4 * Flash::BLOCK_SIZE);
+
+  StenoUserDictionary reloadedDictionary(layout);
+  assert(Str::Eq(reloadedDictionary.Lookup(KAT, 1).GetText(), "kat"));
+  assert(Str::Eq(reloadedDictionary.Lookup(KAPBG_RAO, 2).GetText(),
+                 "kangaroo"));
+  assert(!reloadedDictionary.Lookup(TKOG, 1).IsValid());
+
+  // Removing a flushed entry.
+  assert(userDictionary.Remove(KAT, 1));
+  assert(!userDictionary.Lookup(KAT, 1).IsValid());
+  assert(userDictionary.Flush());
+  assert(!StenoUserDictionary(layout).Lookup(KAT, 1).IsValid());
+  // spellchecker: enable
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary flushes from Tick and when full") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  for (size_t i = 0; i < sizeof(userDictionaryBuffer); ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  // spellchecker: enable
+
+  userDictionary.Add(KAT, 1, "cat");
+  userDictionary.Tick();
+  assert(userDictionary.HasPendingChanges());
+  Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+  userDictionary.Tick();
+  assert(!userDictionary.HasPendingChanges());
+  assert(Str::Eq(StenoUserDictionary(layout).Lookup(KAT, 1).GetText(), "cat"));
+
+  // Entries span several data pages, and all are written.
+  char word[32];
+  for (size_t i = 0; i < StenoUserDictionary::MAX_PENDING_ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu with some padding text", i);
+    assert(userDictionary.Add(strokes, 2, word));
+  }
+  assert(!userDictionary.HasPendingChanges());
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < StenoUserDictionary::MAX_PENDING_ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu with some padding text", i);
+    assert(Str::Eq(reloadedDictionary.Lookup(strokes, 2).GetText(), word));
+  }
+}
+TEST_END
+
 #if RUN_TESTS
+
+// Returns the value on the line of PrintOccupancy() output starting name.
+static size_t GetOccupancyValue(const StenoUserDictionary &userDictionary,
+                                const char *name) {
+  Console::history.clear();
+  userDictionary.PrintOccupancy();
+  Console::history.push_back(0);
+
+  const char *line = strstr(&Console::history.front(), name);
+  assert(line != nullptr);
+  size_t value = atoi(line + strlen(name));
+  Console::history.clear();
+  return value;
+}
+
+TEST_BEGIN("StenoUserDictionary reuses the data block after churn") {
+  // 13 pages of log and 2048 hash table slots.
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // Each round replaces the previous round's entries, so the log is written
+  // many times over.
+  const size_t ROUND_COUNT = 300;
+  const size_t ENTRY_COUNT = 20;
+  char word[160];
+  for (size_t round = 0; round < ROUND_COUNT; ++round) {
+    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+      StenoStroke strokes[2] = {StenoStroke(round * ENTRY_COUNT + i + 1),
+                                StenoStroke(i + 1)};
+      snprintf(word, sizeof(word), "%zu %zu %0100d", round, i, 0);
+      assert(userDictionary.Add(strokes, 2, word));
+
+      if (round != 0) {
+        strokes[0] = StenoStroke((round - 1) * ENTRY_COUNT + i + 1);
+        assert(userDictionary.Remove(strokes, 2));
+      }
+    }
+
+    // Flush, then one compaction slice.
+    Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+    userDictionary.Tick();
+    Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+    userDictionary.Tick();
+  }
+
+  for (size_t i = 0; i < 100; ++i) {
+    Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+    userDictionary.Tick();
+  }
+  assert(GetOccupancyValue(userDictionary, "Tombstones: ") == 0);
+  assert(GetOccupancyValue(userDictionary, "Entries: ") == ENTRY_COUNT);
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {
+        StenoStroke((ROUND_COUNT - 1) * ENTRY_COUNT + i + 1),
+        StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "%zu %zu %0100d", ROUND_COUNT - 1, i, 0);
+    assert(Str::Eq(reloadedDictionary.Lookup(strokes, 2).GetText(), word));
+
+    strokes[0] = StenoStroke((ROUND_COUNT - 2) * ENTRY_COUNT + i + 1);
+    assert(!reloadedDictionary.Lookup(strokes, 2).IsValid());
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary compacts when adds outpace Tick") {
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // Without Tick(), replacing one definition many times.
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  // spellchecker: enable
+  char word[160];
+  for (size_t i = 0; i < 2000; ++i) {
+    snprintf(word, sizeof(word), "%zu %0100d", i, 0);
+    assert(userDictionary.Add(KAT, 1, word));
+  }
+  assert(userDictionary.Flush());
+  assert(Str::Eq(StenoUserDictionary(layout).Lookup(KAT, 1).GetText(), word));
+
+  // Live entries are never dropped to make space.
+  size_t count = 0;
+  for (;; ++count) {
+    StenoStroke strokes[2] = {StenoStroke(count + 1), StenoStroke(count + 1)};
+    snprintf(word, sizeof(word), "%zu %0100d", count, 0);
+    if (!userDictionary.Add(strokes, 2, word)) {
+      break;
+    }
+  }
+  assert(count > 300);
+  assert(userDictionary.Flush());
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < count; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "%zu %0100d", i, 0);
+    assert(Str::Eq(reloadedDictionary.Lookup(strokes, 2).GetText(), word));
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary upgrades version 1 descriptors") {
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  memset(userDictionaryBuffer, 0xff, 64 * 1024);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  const StenoStroke TKOG[] = {StenoStroke("TKOG")};
+
+  StenoUserDictionaryEntry *entry =
+      (StenoUserDictionaryEntry *)layout.dataBlock;
+  entry->strokeLength = 1;
+  entry->strokes[0] = KAT[0];
+  strcpy(entry->GetText(), "cat");
+  ((uint32_t *)layout.hashTable)[StenoStroke::Hash(KAT, 1) &
+                                 (layout.hashTableSize - 1)] = OFFSET_DATA;
+
+  StenoUserDictionaryDescriptorV1 *descriptor =
+      (StenoUserDictionaryDescriptorV1 *)layout.GetDescriptor();
+  descriptor->magic = USER_DICTIONARY_MAGIC;
+  descriptor->version = 1;
+  descriptor->data.hashTable = layout.hashTable;
+  descriptor->data.hashTableSize = layout.hashTableSize;
+  descriptor->data.dataBlock = layout.dataBlock;
+  descriptor->data.dataBlockSize = entry->GetDataLength();
+  descriptor->data.maximumStrokeCount = 1;
+  descriptor->crc32 = Crc32(&descriptor->data, sizeof(descriptor->data));
+
+  StenoUserDictionary userDictionary(layout);
+  assert(Str::Eq(userDictionary.Lookup(KAT, 1).GetText(), "cat"));
+  assert(layout.GetDescriptor()[1].version == USER_DICTIONARY_VERSION);
+
+  assert(userDictionary.Add(TKOG, 1, "dog"));
+  assert(userDictionary.Flush());
+
+  StenoUserDictionary reloadedDictionary(layout);
+  assert(Str::Eq(reloadedDictionary.Lookup(KAT, 1).GetText(), "cat"));
+  assert(Str::Eq(reloadedDictionary.Lookup(TKOG, 1).GetText(), "dog"));
+  // spellchecker: enable
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary grows its hash table") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  for (size_t i = 0; i < sizeof(userDictionaryBuffer); ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+  const size_t ENTRY_COUNT = 3500;
+  char word[32];
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    assert(userDictionary.Add(strokes, 2, word));
+  }
+  assert(userDictionary.Flush());
+  assert(GetOccupancyValue(userDictionary, "Hash table size: ") ==
+         2 * StenoUserDictionary::INITIAL_HASH_TABLE_SIZE);
+  assert(GetOccupancyValue(userDictionary, "Entries: ") == ENTRY_COUNT);
+  assert(GetOccupancyValue(userDictionary, "Maximum probe length: ") <=
+         StenoUserDictionary::MAX_PROBE_COUNT);
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    assert(Str::Eq(reloadedDictionary.Lookup(strokes, 2).GetText(), word));
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary rehashes tables full of tombstones") {
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  // A new table starts at the beginning of the region. Every slot is made
+  // a tombstone.
+  StenoUserDictionary(layout).Reset();
+  uint32_t *tombstones = (uint32_t *)malloc(Flash::BLOCK_SIZE);
+  memset(tombstones, 0, Flash::BLOCK_SIZE);
+  Flash::Write(layout.hashTable, tombstones, Flash::BLOCK_SIZE);
+  free(tombstones);
+
+  StenoUserDictionary userDictionary(layout);
+  assert(GetOccupancyValue(userDictionary, "Tombstones: ") == 1024);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  assert(!userDictionary.Lookup(KAT, 1).IsValid());
+  assert(!userDictionary.Remove(KAT, 1));
+
+  // Flush() rehashes before placing the entry.
+  assert(userDictionary.Add(KAT, 1, "cat"));
+  assert(userDictionary.Flush());
+  assert(GetOccupancyValue(userDictionary, "Tombstones: ") == 0);
+  assert(Str::Eq(StenoUserDictionary(layout).Lookup(KAT, 1).GetText(), "cat"));
+  // spellchecker: enable
+
+  // Tombstones from removes are cleared while idle.
+  char word[32];
+  for (size_t i = 0; i < 200; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    assert(userDictionary.Add(strokes, 2, word));
+  }
+  assert(userDictionary.Flush());
+  for (size_t i = 0; i < 150; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    assert(userDictionary.Remove(strokes, 2));
+  }
+  for (size_t i = 0; i < 10; ++i) {
+    Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+    userDictionary.Tick();
+  }
+  assert(GetOccupancyValue(userDictionary, "Tombstones: ") == 0);
+  assert(GetOccupancyValue(userDictionary, "Entries: ") == 51);
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < 200; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    StenoDictionaryLookupResult lookup = reloadedDictionary.Lookup(strokes, 2);
+    assert(lookup.IsValid() == (i >= 150));
+    assert(i < 150 || Str::Eq(lookup.GetText(), word));
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary reloads the table from a same size rehash") {
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+  char word[32];
+  for (size_t i = 0; i < 200; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    assert(userDictionary.Add(strokes, 2, word));
+  }
+  assert(userDictionary.Flush());
+  for (size_t i = 0; i < 150; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    assert(userDictionary.Remove(strokes, 2));
+  }
+
+  // Flush, then a rehash into a table of the same size. Its descriptor
+  // covers the same log as the one before it.
+  const size_t hashTableSize =
+      GetOccupancyValue(userDictionary, "Hash table size: ");
+  Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+  userDictionary.Tick();
+  Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+  userDictionary.Tick();
+  assert(GetOccupancyValue(userDictionary, "Tombstones: ") == 0);
+  assert(GetOccupancyValue(userDictionary, "Hash table size: ") ==
+         hashTableSize);
+
+  // Removes write no descriptor, only a tombstone in the new table.
+  const StenoStroke REMOVED[2] = {StenoStroke(161), StenoStroke(161)};
+  assert(userDictionary.Remove(REMOVED, 2));
+  assert(userDictionary.Flush());
+  assert(!userDictionary.Lookup(REMOVED, 2).IsValid());
+
+  StenoUserDictionary reloadedDictionary(layout);
+  assert(!reloadedDictionary.Lookup(REMOVED, 2).IsValid());
+  for (size_t i = 150; i < 200; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    StenoDictionaryLookupResult lookup = reloadedDictionary.Lookup(strokes, 2);
+    assert(lookup.IsValid() == (i != 160));
+    assert(i == 160 || Str::Eq(lookup.GetText(), word));
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary prints occupancy") {
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  // spellchecker: enable
+  assert(userDictionary.Add(KAT, 1, "cat"));
+  assert(userDictionary.Flush());
+
+  Console::history.clear();
+  StenoUserDictionary::PrintOccupancy_Binding(&userDictionary,
+                                              "print_user_occupancy");
+  Console::history.push_back(0);
+  assert(Str::Eq(&Console::history.front(), "Hash table size: 1024\n"
+                                            "Entries: 1\n"
+                                            "Tombstones: 0\n"
+                                            "Load: 0%\n"
+                                            "Probe lengths:\n"
+                                            "  1: 1\n"
+                                            "  2: 0\n"
+                                            "  3-4: 0\n"
+                                            "  5-8: 0\n"
+                                            "  9-16: 0\n"
+                                            "  17-32: 0\n"
+                                            "  33-64: 0\n"
+                                            "  65-128: 0\n"
+                                            "  129+: 0\n"
+                                            "Maximum probe length: 1\n\n"));
+  Console::history.clear();
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary imports a streamed JSON dictionary") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  for (size_t i = 0; i < sizeof(userDictionaryBuffer); ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  const StenoStroke TKOG[] = {StenoStroke("TKOG")};
+  const StenoStroke KAPBG_RAO[] = {StenoStroke("KAPBG"), StenoStroke("RAO")};
+  const StenoStroke TPHAOEF[] = {StenoStroke("TPHAOEF")};
+  const StenoStroke PWEUFRD[] = {StenoStroke("PWEUFRD")};
+
+  userDictionary.Add(TKOG, 1, "old dog");
+  userDictionary.Add(PWEUFRD, 1, "bird");
+  assert(userDictionary.Flush());
+
+  const char json[] = "\n"
+                      "\t\"KAT\": \"cat\",\n"
+                      "\t\"TKOG\": \"dog \\\"quoted\\\"\",\n"
+                      "\t\"KAPBG/RAO\": \"kangaroo\",\n"
+                      "\t\"KAT\": \"cat again\",\n"
+                      "\t\"TPHAOEF\": \"na\\u00efve \\ud83d\\ude00\"\n"
+                      "}\n"
+                      "asdf\n";
+  // spellchecker: enable
+
+  // One data page, the four pages of the rebuilt hash table, and the
+  // descriptor.
+  uint32_t programmedBytes = Flash::programmedBytes;
+  Console console;
+  Console::history.clear();
+  StenoUserDictionary::Import_Binding(&userDictionary,
+                                      "import_user_dictionary {");
+  for (size_t i = 0; i < sizeof(json) - 1; i += 3) {
+    size_t length = sizeof(json) - 1 - i < 3 ? sizeof(json) - 1 - i : 3;
+    console.HandleInput(json + i, length);
+  }
+  assert(Flash::programmedBytes - programmedBytes == 6 * Flash::BLOCK_SIZE);
+
+  Console::history.push_back(0);
+  assert(
+      Str::Eq(&Console::history.front(),
+              "OK\n\n"
+              "ERR Invalid command. Use \"help\" for a list of commands\n\n"));
+  Console::history.clear();
+
+  StenoUserDictionary reloadedDictionary(layout);
+  assert(Str::Eq(reloadedDictionary.Lookup(KAT, 1).GetText(), "cat again"));
+  assert(Str::Eq(reloadedDictionary.Lookup(TKOG, 1).GetText(),
+                 "dog \"quoted\""));
+  assert(Str::Eq(reloadedDictionary.Lookup(KAPBG_RAO, 2).GetText(),
+                 "kangaroo"));
+  assert(Str::Eq(reloadedDictionary.Lookup(TPHAOEF, 1).GetText(),
+                 "na\xc3\xaf" "ve \xf0\x9f\x98\x80"));
+  assert(Str::Eq(reloadedDictionary.Lookup(PWEUFRD, 1).GetText(), "bird"));
+  assert(GetOccupancyValue(reloadedDictionary, "Entries: ") == 5);
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary discards imports with invalid JSON") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  for (size_t i = 0; i < sizeof(userDictionaryBuffer); ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  const char *const lines[] = {
+      "{\"KAT\": \"cat\",\n",
+      "\"TKOG\" \"dog\",\n",
+      "\"TEFT\": \"{\\\"}\",\n",
+      "\"TEFTS\": [\"x\", {\"y\": \"}\"}]\n",
+      "}\n",
+      "unknown\n",
+  };
+  // spellchecker: enable
+
+  Console console;
+  Console::history.clear();
+  StenoUserDictionary::Import_Binding(&userDictionary,
+                                      "import_user_dictionary");
+  for (const char *line : lines) {
+    console.HandleInput(line, strlen(line));
+  }
+  assert(!userDictionary.IsImporting());
+
+  // The rest of the object is skipped, and input after it is a command.
+  Console::history.push_back(0);
+  assert(Str::Eq(&Console::history.front(),
+                 "ERR Expected :\n\n"
+                 "ERR Invalid command. Use \"help\" for a list of commands"
+                 "\n\n"));
+  Console::history.clear();
+
+  assert(!userDictionary.Lookup(KAT, 1).IsValid());
+  assert(userDictionary.Add(KAT, 1, "cat"));
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary releases input when an import stops") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  memset(userDictionaryBuffer, 0, sizeof(userDictionaryBuffer));
+
+  StenoUserDictionary userDictionary(layout);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  const char json[] = "{\"KAT\": \"cat\", \"TKOG\": \"do";
+  // spellchecker: enable
+
+  Console console;
+  Console::history.clear();
+  StenoUserDictionary::Import_Binding(&userDictionary,
+                                      "import_user_dictionary");
+  console.HandleInput(json, sizeof(json) - 1);
+
+  Clock::AdvanceTime(StenoUserDictionary::IMPORT_TIMEOUT - 1);
+  userDictionary.Tick();
+  assert(userDictionary.IsImporting());
+
+  Clock::AdvanceTime(1);
+  userDictionary.Tick();
+  assert(!userDictionary.IsImporting());
+  assert(!userDictionary.Lookup(KAT, 1).IsValid());
+
+  console.HandleInput("unknown\n", 8);
+  Console::history.push_back(0);
+  assert(Str::Eq(&Console::history.front(),
+                 "ERR Import timed out\n\n"
+                 "ERR Invalid command. Use \"help\" for a list of commands"
+                 "\n\n"));
+  Console::history.clear();
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary imports large dictionaries in one pass") {
+  StenoUserDictionaryData layout(userDictionaryBuffer,
+                                 sizeof(userDictionaryBuffer));
+  for (size_t i = 0; i < sizeof(userDictionaryBuffer); ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+  const size_t ENTRY_COUNT = 5000;
+  std::string json = "{";
+  size_t dataBlockSize = 0;
+  char buffer[64];
+  char word[32];
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    *StenoStroke::ToString(strokes, 2, buffer) = '\0';
+    json += i == 0 ? "\n\"" : ",\n\"";
+    json += buffer;
+    json += "\": \"";
+    json += word;
+    json += "\"";
+
+    size_t dataLength =
+        StenoUserDictionaryEntry::GetDataLength(2, strlen(word));
+    dataBlockSize = GetAppendPosition(dataBlockSize, dataLength) + dataLength;
+  }
+  json += "\n}\n";
+
+  // Each data page and each page of the grown hash table is written once,
+  // then the descriptor.
+  uint32_t programmedBytes = Flash::programmedBytes;
+  Console console;
+  Console::history.clear();
+  StenoUserDictionary::Import_Binding(&userDictionary,
+                                      "import_user_dictionary");
+  for (size_t i = 0; i < json.size(); i += 64) {
+    size_t length = json.size() - i < 64 ? json.size() - i : 64;
+    console.HandleInput(json.data() + i, length);
+  }
+  Console::history.push_back(0);
+  assert(Str::Eq(&Console::history.front(), "OK\n\n"));
+  Console::history.clear();
+
+  const size_t dataPageCount =
+      (dataBlockSize + Flash::BLOCK_SIZE - 1) / Flash::BLOCK_SIZE;
+  const size_t hashTableSize = 2 * StenoUserDictionary::INITIAL_HASH_TABLE_SIZE;
+  const size_t hashTablePageCount =
+      hashTableSize * sizeof(uint32_t) / Flash::BLOCK_SIZE;
+  assert(Flash::programmedBytes - programmedBytes ==
+         (dataPageCount + hashTablePageCount + 1) * Flash::BLOCK_SIZE);
+  assert(GetOccupancyValue(userDictionary, "Hash table size: ") ==
+         hashTableSize);
+  assert(GetOccupancyValue(userDictionary, "Entries: ") == ENTRY_COUNT);
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    StenoStroke strokes[2] = {StenoStroke(i + 1), StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word %zu", i);
+    assert(Str::Eq(reloadedDictionary.Lookup(strokes, 2).GetText(), word));
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoUserDictionary compacts when an import fills the log") {
+  // 13 pages of log and 2048 hash table slots.
+  StenoUserDictionaryData layout(userDictionaryBuffer, 64 * 1024);
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    userDictionaryBuffer[i] = rand();
+  }
+
+  StenoUserDictionary userDictionary(layout);
+  const size_t ENTRY_COUNT = 500;
+  char word[32];
+  assert(userDictionary.BeginImport());
+  for (size_t round = 0; round < 5; ++round) {
+    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+      StenoStroke strokes[1] = {StenoStroke(i + 1)};
+      snprintf(word, sizeof(word), "word %zu %zu", round, i);
+      assert(userDictionary.ImportEntry(strokes, 1, word));
+    }
+  }
+  assert(userDictionary.EndImport());
+
+  StenoUserDictionary reloadedDictionary(layout);
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    StenoStroke strokes[1] = {StenoStroke(i + 1)};
+    snprintf(word, sizeof(word), "word 4 %zu", i);
+    assert(Str::Eq(reloadedDictionary.Lookup(strokes, 1).GetText(), word));
+  }
+  assert(GetOccupancyValue(reloadedDictionary, "Entries: ") == ENTRY_COUNT);
+}
+TEST_END
+
 TEST_BEGIN("StenoUserDictionary will dump Json dictionary") {
   const StenoUserDictionaryDescriptor *descriptor =
       (const StenoUserDictionaryDescriptor *)(userDictionaryBuffer +
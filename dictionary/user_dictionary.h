@@ -9,6 +9,8 @@
 
 class Console;
 struct StenoUserDictionaryDescriptor;
+struct StenoUserDictionaryEntry;
+struct StenoUserDictionaryImport;
 
 struct StenoUserDictionaryData {
   StenoUserDictionaryData();
@@ -19,14 +21,30 @@ struct StenoUserDictionaryData {
     dataBlock = mem + size / 8;
     dataBlockSize = size - 4 * hashTableSize - Flash::BLOCK_SIZE;
     maximumStrokeCount = 0;
+    sequenceNumber = 0;
+    dataBlockStart = 0;
   }
 
+  // In a layout, the region that hash tables are placed in. In a
+  // descriptor, the current table: a power of two in size, and aligned to
+  // its size within the region.
   const uint32_t *hashTable;
   size_t hashTableSize; // Number of uint32_t, not number of bytes
   const uint8_t *dataBlock;
+
+  // In a layout, the capacity of the data block. In a descriptor, the log
+  // position after the most recent entry.
   size_t dataBlockSize;
   uint32_t maximumStrokeCount;
 
+  // In a descriptor, one more than the descriptor it replaces, so that the
+  // most recent one can be found. Rehashes and compaction can write
+  // descriptors whose other fields match an earlier one.
+  uint32_t sequenceNumber;
+
+  // Log position of the oldest entry that may still be live.
+  size_t dataBlockStart;
+
   const StenoUserDictionaryDescriptor *GetDescriptor() const {
     return (const StenoUserDictionaryDescriptor *)(dataBlock + dataBlockSize);
   }
@@ -44,59 +62,216 @@ struct StenoUserDictionaryDescriptor {
 
 //---------------------------------------------------------------------------
 
+// Adds and removes are held in a RAM overlay, which lookups check before
+// flash, and are written to flash as a single batch by Flush(). A batch
+// writes each touched data and hash table page once, and a single
+// descriptor. Losing power while the descriptor page is erased, which
+// happens once per page of descriptors, resets the dictionary.
+//
+// The data block is a circular log: entries are appended at the end, never
+// straddle a page, and log positions map to data block offsets modulo the
+// page-rounded capacity. Idle Tick() slices compact the log by copying the
+// live entries at dataBlockStart to the end, so that the pages they were in
+// can be reused, and rebuild hash table pages without tombstones. Appends
+// therefore rotate through every data page.
+//
+// The hash table starts at INITIAL_HASH_TABLE_SIZE slots, and is rehashed
+// into the next free part of its region when its load or tombstone count
+// gets too high. No entry is placed more than MAX_PROBE_COUNT slots from where
+// it hashes to, so every probe is bounded.
+//
+// Bulk imports bypass the overlay. Entries are appended to the log a page at
+// a time, and added to the hash table by a single rehash and descriptor
+// write when the import ends, so each page is written once.
 class StenoUserDictionary final : public StenoDictionary {
 public:
   StenoUserDictionary(const StenoUserDictionaryData &layout);
+  ~StenoUserDictionary();
 
   virtual StenoDictionaryLookupResult
   Lookup(const StenoDictionaryLookup &lookup) const final;
   using StenoDictionary::Lookup;
 
+  virtual StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+                size_t maximumLength, size_t &length) const final;
+
   virtual const StenoDictionary *
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
 
   virtual size_t GetMaximumOutlineLength() const final;
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const final;
   virtual const char *GetName() const final;
   virtual void PrintInfo(int depth) const final;
   virtual bool PrintDictionary(bool hasData) const final;
 
   void PrintJsonDictionary() const;
+  void PrintOccupancy() const;
   void Reset();
 
+  // Incremented whenever entries are added or removed, allowing conversions
+  // that used earlier entries to be invalidated.
+  size_t GetUpdateCount() const { return updateCount; }
+
   // Returns true if successful.
   virtual bool Add(const StenoStroke *strokes, size_t length, const char *word);
 
   // Returns true if successful.
   virtual bool Remove(const StenoStroke *strokes, size_t length);
 
+  // Writes pending adds and removes to flash. Returns false if any entry
+  // could not be placed in the hash table.
+  bool Flush();
+  bool HasPendingChanges() const { return pendingEntryCount != 0; }
+
+  // Imported entries are not visible until EndImport(), and Add() and
+  // Remove() fail while an import is in progress. Later definitions of an
+  // outline replace earlier ones.
+  //
+  // Returns false if an import is already in progress.
+  bool BeginImport();
+  // Returns false if the entry could not be written.
+  bool ImportEntry(const StenoStroke *strokes, size_t length,
+                   const char *word);
+  // Returns false if the imported entries could not be added.
+  bool EndImport();
+  // Entries that have not been added are discarded.
+  void CancelImport();
+  bool IsImporting() const { return import != nullptr; }
+
+  // Called from the main loop. Flushes once there have been no changes for
+  // FLUSH_DELAY milliseconds, then runs one compaction slice per
+  // FLUSH_DELAY while there is compaction to do. Also cancels a console
+  // import that has had no input for IMPORT_TIMEOUT milliseconds.
+  void Tick();
+
   static void PrintJsonDictionary_Binding(void *context,
                                           const char *commandLine);
   static void Reset_Binding(void *context, const char *commandLine);
   static void AddEntry_Binding(void *context, const char *commandLine);
   static void RemoveEntry_Binding(void *context, const char *commandLine);
+  static void Flush_Binding(void *context, const char *commandLine);
+  static void PrintOccupancy_Binding(void *context, const char *commandLine);
+
+  // The JSON dictionary follows the command, on the same line or the lines
+  // after it, and is imported as it arrives.
+  static void Import_Binding(void *context, const char *commandLine);
 
   static const size_t MAX_STROKE_COUNT = 16;
 
+  // Reaching this many pending changes flushes immediately.
+  static const size_t MAX_PENDING_ENTRY_COUNT = 64;
+  static const uint32_t FLUSH_DELAY = 1000;
+  static const uint32_t IMPORT_TIMEOUT = 5000;
+
+  // Space that adds leave free, so that compaction can always move entries.
+  static const size_t COMPACTION_RESERVE = 2 * Flash::BLOCK_SIZE;
+
+  static const size_t MAX_PROBE_COUNT = 128;
+  static const size_t INITIAL_HASH_TABLE_SIZE = 4096;
+
 private:
   const StenoUserDictionaryDescriptor *descriptorBase;
   const StenoUserDictionaryDescriptor *activeDescriptor;
   const StenoUserDictionaryData &layout;
+  size_t updateCount = 0;
 
-  struct AddToDataBlockResult {
-    AddToDataBlockResult(size_t offset, size_t length)
-        : offset(offset), length(length) {}
-
-    size_t offset;
-    size_t length;
+  // entry is in the flash data format. Removes have no text.
+  struct PendingEntry {
+    bool isRemoved;
+    size_t dataLength;
+    StenoUserDictionaryEntry *entry;
   };
 
-  AddToDataBlockResult AddToDataBlock(const StenoStroke *strokes,
-                                      uint32_t length, const char *word);
-  void AddToDescriptor(size_t strokeLength, size_t dataLength);
-  bool AddToHashTable(const StenoStroke *strokes, size_t length, size_t offset);
-  void WriteEntryIndex(size_t entryIndex, size_t offset);
+  PendingEntry pendingEntries[MAX_PENDING_ENTRY_COUNT];
+  size_t pendingEntryCount = 0;
+  size_t pendingDataEnd = 0;
+  uint32_t pendingMaximumStrokeCount = 0;
+  uint32_t lastChangeTime = 0;
+
+  // Bytes of log data referenced by the hash table.
+  size_t liveDataLength = 0;
+
+  // Counted when the dictionary is opened, and kept up to date.
+  size_t hashTableEntryCount = 0;
+  size_t hashTableTombstoneCount = 0;
+
+  // Hash table pages still to be checked for tombstones.
+  size_t hashTablePagesToRebuild = 0;
+  size_t nextHashTablePageToRebuild = 0;
+
+  StenoUserDictionaryImport *import = nullptr;
+
+  bool AddPendingEntry(const StenoStroke *strokes, size_t length,
+                       const char *word);
+  void PushPendingEntry(StenoUserDictionaryEntry *entry, size_t dataLength,
+                        bool isRemoved);
+  void ClearPendingEntries();
+
+  // Log position after the pending entries, once written.
+  size_t GetPendingDataEnd() const;
+  bool HasSpaceForPendingEntry(size_t dataLength, size_t reserve) const;
+
+  // Returns the most recent pending change for the outline, or nullptr.
+  const PendingEntry *FindPendingEntry(const StenoStroke *strokes,
+                                       size_t length) const;
+
+  // Whether pendingEntries[index] is the most recent change to its outline.
+  bool IsMostRecentPendingEntry(size_t index) const;
+
+  void WriteDataBlock(const bool *isWritten);
+  void WriteDescriptor(const StenoUserDictionaryData &data);
+
+  size_t GetLogCapacity() const {
+    return layout.dataBlockSize & -Flash::BLOCK_SIZE;
+  }
+  size_t GetDataOffset(size_t position) const {
+    return position % GetLogCapacity();
+  }
+
+  // Appends may not reach the page holding dataBlockStart.
+  size_t GetAppendLimit() const;
+
+  // Returns nullptr for the unused space at the end of a page.
+  const StenoUserDictionaryEntry *GetLogEntry(size_t position) const;
+  bool IsLiveFlashEntry(const StenoUserDictionaryEntry *entry) const;
+
+  // Sets liveDataLength and the hash table counts.
+  void ScanHashTable();
+
+  // Returns true if anything was written.
+  bool RunCompactionSlice();
+  bool NeedsDataBlockCompaction() const;
+  bool CompactDataBlock();
+  bool MakeSpace(size_t dataLength);
+  bool RebuildHashTablePage(size_t page);
+  size_t GetHashTablePageCount() const;
+
+  // Returns 0 if no rehash is needed once addCount more entries are added.
+  size_t GetRehashSize(size_t addCount) const;
+  bool RehashHashTable(size_t hashTableSize);
+
+  // Entries in the log between the descriptor's dataBlockSize and
+  // dataBlockSize are added too, replacing earlier definitions.
+  bool BuildHashTable(size_t hashTableSize, size_t dataBlockSize,
+                      uint32_t maximumStrokeCount);
+  const uint32_t *FindFreshHashTableRegion(size_t hashTableSize) const;
+  size_t GetMaximumHashTableSize() const;
+
+  // Returns nullptr if there is no entry for the lookup.
+  const StenoUserDictionaryEntry *
+  FindEntry(const StenoDictionaryLookup &lookup) const;
+  const StenoUserDictionaryEntry *
+  FindFlashEntry(const StenoDictionaryLookup &lookup) const;
+
+  static size_t ImportInput(void *context, const char *data, size_t length);
+  bool IsBulkImporting() const;
+  void StartImportPage(size_t position);
+  void WriteImportPage();
+  bool CommitImport();
 
   const StenoUserDictionaryDescriptor *FindMostRecentDescriptor() const;
+  bool UpgradeDescriptor();
   size_t GetNextDescriptorToWriteOffset() const;
 };
 
@@ -9,6 +9,19 @@ StenoWrappedDictionary::Lookup(const StenoDictionaryLookup &lookup) const {
   return dictionary->Lookup(lookup);
 }
 
+StenoDictionaryLookupResult StenoWrappedDictionary::LookupWithProvider(
+    const StenoDictionaryLookup &lookup,
+    const StenoDictionary *&provider) const {
+  return dictionary->LookupWithProvider(lookup, provider);
+}
+
+StenoDictionaryLookupResult StenoWrappedDictionary::LookupLongest(
+    const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+    size_t maximumLength, size_t &length) const {
+  return dictionary->LookupLongest(lookup, minimumLength, maximumLength,
+                                   length);
+}
+
 const StenoDictionary *StenoWrappedDictionary::GetLookupProvider(
     const StenoDictionaryLookup &lookup) const {
   return dictionary->GetLookupProvider(lookup);
@@ -28,6 +41,10 @@ size_t StenoWrappedDictionary::GetMaximumOutlineLength() const {
   return dictionary->GetMaximumOutlineLength();
 }
 
+StenoDictionaryLookupFilter StenoWrappedDictionary::GetLookupFilter() const {
+  return dictionary->GetLookupFilter();
+}
+
 void StenoWrappedDictionary::PrintInfo(int depth) const {
   return dictionary->PrintInfo(depth);
 }
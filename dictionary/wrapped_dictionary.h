@@ -18,6 +18,14 @@ public:
     return Lookup(StenoDictionaryLookup(strokes, length));
   }
 
+  virtual StenoDictionaryLookupResult
+  LookupWithProvider(const StenoDictionaryLookup &lookup,
+                     const StenoDictionary *&provider) const;
+
+  virtual StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+                size_t maximumLength, size_t &length) const;
+
   virtual const StenoDictionary *
   GetLookupProvider(const StenoDictionaryLookup &lookup) const;
 
@@ -31,6 +39,7 @@ public:
   ReverseMapDictionaryLookup(StenoReverseMapDictionaryLookup &lookup) const;
 
   virtual size_t GetMaximumOutlineLength() const;
+  virtual StenoDictionaryLookupFilter GetLookupFilter() const;
   virtual const char *GetName() const = 0;
 
   virtual void PrintInfo(int depth) const;
@@ -52,38 +52,83 @@ void StenoEngine::Process(const StenoKeyState &value, StenoAction action) {
 }
 
 void StenoEngine::ProcessStroke(StenoStroke stroke) {
+  phaseStats.Start();
+
   switch (mode) {
   case StenoEngineMode::NORMAL:
     ProcessNormalModeStroke(stroke);
-    return;
+    break;
 
   case StenoEngineMode::ADD_TRANSLATION:
     ProcessAddTranslationModeStroke(stroke);
-    return;
+    break;
   }
+
+  RecordPhaseStats();
 }
 
 void StenoEngine::ProcessUndo() {
+  phaseStats.Start();
+
   switch (mode) {
   case StenoEngineMode::NORMAL:
     ProcessNormalModeUndo();
-    return;
+    break;
 
   case StenoEngineMode::ADD_TRANSLATION:
     ProcessAddTranslationModeUndo();
-    return;
+    break;
+  }
+
+  RecordPhaseStats();
+}
+
+// Lets the user dictionary flush and compact while idle.
+void StenoEngine::Tick() {
+  if (userDictionary) {
+    userDictionary->Tick();
   }
 }
 
+void StenoEngine::RecordPhaseStats() {
+  phaseStats.Stop();
+  stats.Record(phaseStats);
+
+#if JAVELIN_ALLOCATION_STATS
+  assert(phaseStats.allocationCounts[(size_t)StenoEnginePhase::TOTAL] <=
+         strokeAllocationBudget);
+#endif
+}
+
 //---------------------------------------------------------------------------
 
 void StenoEngine::ResetState() {
+  InvalidateCarriedConversion();
+  InvalidateLookupCache();
   history.Reset();
   addTranslationHistory.Reset();
   state.Reset();
   state.joinNext = true;
 }
 
+void StenoEngine::InvalidateLookupCache() {
+  lookupCache.Invalidate();
+  if (userDictionary) {
+    userDictionaryUpdateCount = userDictionary->GetUpdateCount();
+  }
+}
+
+// The user dictionary can be updated through console commands, which do not
+// go through the engine. Carried segments and cached lookups can hold text
+// from entries that have changed, or that compaction has since moved.
+void StenoEngine::InvalidateIfUserDictionaryUpdated() {
+  if (userDictionary &&
+      userDictionary->GetUpdateCount() != userDictionaryUpdateCount) {
+    InvalidateCarriedConversion();
+    InvalidateLookupCache();
+  }
+}
+
 //---------------------------------------------------------------------------
 
 void StenoEngine::PrintInfo() const {
@@ -91,6 +136,7 @@ void StenoEngine::PrintInfo() const {
   Console::Printf("    Strokes: %u\n", strokeCount);
   Console::Printf("    Unicode mode: %s\n", emitter.GetUnicodeModeName());
   Console::Printf("    Keyboard layout: %s\n", Key::GetKeyboardLayoutName());
+  lookupCache.PrintInfo();
 
   orthography.PrintInfo();
 
@@ -107,14 +153,20 @@ void StenoEngine::PrintDictionary() const {
 void StenoEngine::ListDictionaries() { dictionary.ListDictionaries(); }
 
 bool StenoEngine::EnableDictionary(const char *name) {
+  InvalidateCarriedConversion();
+  InvalidateLookupCache();
   return dictionary.EnableDictionary(name);
 }
 
 bool StenoEngine::DisableDictionary(const char *name) {
+  InvalidateCarriedConversion();
+  InvalidateLookupCache();
   return dictionary.DisableDictionary(name);
 }
 
 bool StenoEngine::ToggleDictionary(const char *name) {
+  InvalidateCarriedConversion();
+  InvalidateLookupCache();
   return dictionary.ToggleDictionary(name);
 }
 
@@ -149,6 +201,7 @@ void StenoEngine::ReverseLookup(StenoReverseDictionaryLookup &result) {
 void StenoEngine::SendText(const uint8_t *p) {
   const char *ccp = (const char *)p;
 
+  InvalidateCarriedConversion();
   nextConversionBuffer.keyCodeBuffer.Reset();
   nextConversionBuffer.keyCodeBuffer.AppendTextNoCaseModeOverride(
       ccp, strlen(ccp), StenoCaseMode::NORMAL);
@@ -163,6 +216,7 @@ void StenoEngine::SendText(const uint8_t *p) {
 #include "key_code.h"
 #include "unit_test.h"
 #include <stdio.h>
+#include <string>
 
 #include "dictionary/dictionary_list.h"
 #include "dictionary/emily_symbols_dictionary.h"
@@ -189,6 +243,8 @@ public:
   static void TestEngine(StenoEngine &engine);
   static void TestAddTranslation(StenoEngine &engine);
   static void VerifyTextBuffer(StenoEngine &engine, const char *expected);
+  static void VerifyIncrementalConversion(StenoEngine &engine);
+  static const char *GetCarriedSegmentText(StenoEngine &engine, size_t index);
 };
 
 void StenoEngineTester::VerifyTextBuffer(StenoEngine &engine,
@@ -201,6 +257,37 @@ void StenoEngineTester::VerifyTextBuffer(StenoEngine &engine,
   free(p);
 }
 
+void StenoEngineTester::VerifyIncrementalConversion(StenoEngine &engine) {
+  if (!engine.carriedConversion.isValid) {
+    return;
+  }
+
+  StenoEngine::ConversionBuffer *buffer = new StenoEngine::ConversionBuffer;
+  buffer->keyCodeBuffer.orthography = &engine.orthography;
+  buffer->keyCodeBuffer.rootDictionary = &engine.dictionary;
+
+  StenoSegmentList segmentList;
+  StenoPhaseStats phaseStats;
+  phaseStats.Start();
+  engine.UpdateNormalModeTextBuffer(engine.history.GetCount(), *buffer,
+                                    engine.carriedConversion.strokeCount,
+                                    segmentList, nullptr, phaseStats);
+
+  const StenoKeyCodeBuffer &expected = buffer->keyCodeBuffer;
+  const StenoKeyCodeBuffer &actual = engine.nextConversionBuffer.keyCodeBuffer;
+  assert(expected.count == actual.count);
+  for (size_t i = 0; i < expected.count; ++i) {
+    assert(expected.buffer[i] == actual.buffer[i]);
+  }
+  delete buffer;
+}
+
+const char *StenoEngineTester::GetCarriedSegmentText(StenoEngine &engine,
+                                                    size_t index) {
+  assert(engine.carriedConversion.isValid);
+  return engine.carriedConversion.segmentList[index].lookup.GetText();
+}
+
 void StenoEngineTester::TestSymbols(StenoEngine &engine) {
   // spellchecker: disable
   engine.ProcessStroke(StenoStroke("SKWHEUFPL"));
@@ -285,6 +372,98 @@ TEST_BEGIN("Engine: Random spam") {
 }
 TEST_END
 
+TEST_BEGIN("Engine: Incremental conversion matches full conversion") {
+  static const StenoDictionary *DICTIONARIES[] = {
+      &StenoJeffShowStrokeDictionary::instance,
+      &StenoJeffPhrasingDictionary::instance,
+      &StenoJeffNumbersDictionary::instance,
+      &StenoEmilySymbolsDictionary::instance,
+      &mainDictionary,
+  };
+
+  StenoDictionaryList dictionaryList(
+      DICTIONARIES, sizeof(DICTIONARIES) / sizeof(*DICTIONARIES)); // NOLINT
+
+  StenoCompiledOrthography orthography(StenoOrthography::emptyOrthography);
+  StenoEngine engine(dictionaryList, orthography);
+
+  Key::DisableHistory();
+
+  srand(0x5678);
+  for (size_t i = 0; i < 2000; ++i) {
+    if ((rand() & 15) == 0) {
+      engine.ProcessUndo();
+      continue;
+    }
+
+    // Bias towards the test dictionary so that multi-stroke outlines occur.
+    // spellchecker: disable
+    static const StenoStroke STROKES[] = {
+        StenoStroke("TEFT"),
+        StenoStroke("-D"),
+        StenoStroke("-G"),
+    };
+    // spellchecker: enable
+    StenoStroke stroke = (rand() & 1) ? STROKES[rand() % 3]
+                                      : StenoStroke(rand() & StrokeMask::ALL);
+    engine.ProcessStroke(stroke);
+    StenoEngineTester::VerifyIncrementalConversion(engine);
+  }
+
+  Key::EnableHistory();
+}
+TEST_END
+
+#if JAVELIN_ALLOCATION_STATS
+TEST_BEGIN("Engine: Steady state strokes stay within allocation budget") {
+  // Ratchet: lower this as allocations are removed from the stroke path.
+  // Currently the worst stroke is a full reconversion, which makes 68
+  // allocations, or 102 when threaded.
+  const size_t STROKE_ALLOCATION_BUDGET = 102;
+
+  static const StenoDictionary *DICTIONARIES[] = {
+      &StenoJeffPhrasingDictionary::instance,
+      &StenoJeffNumbersDictionary::instance,
+      &StenoEmilySymbolsDictionary::instance,
+      &mainDictionary,
+  };
+
+  StenoDictionaryList dictionaryList(
+      DICTIONARIES, sizeof(DICTIONARIES) / sizeof(*DICTIONARIES)); // NOLINT
+
+  StenoCompiledOrthography orthography(StenoOrthography::emptyOrthography);
+  StenoEngine engine(dictionaryList, orthography);
+
+  // spellchecker: disable
+  static const StenoStroke STROKES[] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("SWRAO"),
+      StenoStroke("#ST"),
+      StenoStroke("TEFT"),
+      StenoStroke("-G"),
+  };
+  // spellchecker: enable
+
+  Key::DisableHistory();
+
+  // Fill the stroke history and the lookup cache before measuring.
+  const size_t STROKE_COUNT = sizeof(STROKES) / sizeof(*STROKES); // NOLINT
+  for (size_t i = 0; i < 100; ++i) {
+    engine.ProcessStroke(STROKES[i % STROKE_COUNT]);
+  }
+
+  engine.SetStrokeAllocationBudget(STROKE_ALLOCATION_BUDGET);
+  for (size_t i = 0; i < 1000; ++i) {
+    engine.ProcessStroke(STROKES[i % STROKE_COUNT]);
+  }
+  engine.SetStrokeAllocationBudget(SIZE_MAX);
+
+  Key::EnableHistory();
+}
+TEST_END
+#endif
+
 TEST_BEGIN("Engine: Add Translation Test") {
   StenoEngineTester tester;
   uint8_t *buffer = new uint8_t[512 * 1024];
@@ -307,4 +486,381 @@ TEST_BEGIN("Engine: Add Translation Test") {
 }
 TEST_END
 
+TEST_BEGIN("Engine: User dictionary updates invalidate carried conversions") {
+  uint8_t *buffer = new uint8_t[512 * 1024];
+  memset(buffer, 0, 512 * 1024);
+  StenoUserDictionaryData layout(buffer, 512 * 1024);
+  StenoUserDictionary *userDictionary = new StenoUserDictionary(layout);
+
+  static const StenoDictionary *dictionaries[] = {
+      userDictionary,
+      &mainDictionary,
+  };
+
+  StenoDictionaryList dictionaryList(
+      dictionaries, sizeof(dictionaries) / sizeof(*dictionaries)); // NOLINT
+  StenoCompiledOrthography orthography(StenoOrthography::emptyOrthography);
+  StenoEngine engine(dictionaryList, orthography, userDictionary);
+
+  // Enough strokes follow KAT for its segment to be carried as stable.
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  std::string expected = "KAT";
+  engine.ProcessStroke(StenoStroke("KAT"));
+  for (size_t i = 0; i < 24; ++i) {
+    engine.ProcessStroke(StenoStroke("TEFT"));
+    expected += " test";
+  }
+  StenoEngineTester::VerifyTextBuffer(engine, expected.c_str());
+
+  // As the add_entry console command does.
+  assert(userDictionary->Add(KAT, 1, "cat"));
+  engine.ProcessStroke(StenoStroke("TEFT"));
+  expected.replace(0, 3, "cat");
+  expected += " test";
+  StenoEngineTester::VerifyTextBuffer(engine, expected.c_str());
+  // spellchecker: enable
+
+  delete userDictionary;
+  delete[] buffer;
+}
+TEST_END
+
+TEST_BEGIN("Engine: Tick flushes the user dictionary") {
+  uint8_t *buffer = new uint8_t[512 * 1024];
+  memset(buffer, 0, 512 * 1024);
+  StenoUserDictionaryData layout(buffer, 512 * 1024);
+  StenoUserDictionary *userDictionary = new StenoUserDictionary(layout);
+
+  StenoDictionaryList dictionaryList(DICTIONARIES, 2);
+  StenoCompiledOrthography orthography(StenoOrthography::emptyOrthography);
+  StenoEngine engine(dictionaryList, orthography, userDictionary);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  // spellchecker: enable
+  assert(userDictionary->Add(KAT, 1, "cat"));
+  engine.Tick();
+  assert(userDictionary->HasPendingChanges());
+
+  Clock::AdvanceTime(StenoUserDictionary::FLUSH_DELAY);
+  engine.Tick();
+  assert(!userDictionary->HasPendingChanges());
+
+  delete userDictionary;
+  delete[] buffer;
+}
+TEST_END
+
+TEST_BEGIN("Engine: User dictionary compaction keeps carried text valid") {
+  // 13 pages of log, so churn soon reuses the page holding KAT.
+  uint8_t *buffer = new uint8_t[64 * 1024];
+  memset(buffer, 0, 64 * 1024);
+  StenoUserDictionaryData layout(buffer, 64 * 1024);
+  StenoUserDictionary *userDictionary = new StenoUserDictionary(layout);
+
+  static const StenoDictionary *dictionaries[] = {
+      userDictionary,
+      &mainDictionary,
+  };
+
+  StenoDictionaryList dictionaryList(
+      dictionaries, sizeof(dictionaries) / sizeof(*dictionaries)); // NOLINT
+  StenoCompiledOrthography orthography(StenoOrthography::emptyOrthography);
+  StenoEngine engine(dictionaryList, orthography, userDictionary);
+
+  // spellchecker: disable
+  const StenoStroke KAT[] = {StenoStroke("KAT")};
+  const StenoStroke TKOG[] = {StenoStroke("TKOG")};
+  assert(userDictionary->Add(KAT, 1, "cat"));
+  assert(userDictionary->Flush());
+
+  std::string expected = "cat";
+  engine.ProcessStroke(StenoStroke("KAT"));
+  for (size_t i = 0; i < 24; ++i) {
+    engine.ProcessStroke(StenoStroke("TEFT"));
+    expected += " test";
+  }
+  StenoEngineTester::VerifyTextBuffer(engine, expected.c_str());
+
+  // Each add appends to the log, and compaction moves KAT to make space.
+  char word[256];
+  for (size_t i = 0; i < 400; ++i) {
+    snprintf(word, sizeof(word), "%0200zu", i);
+    assert(userDictionary->Add(TKOG, 1, word));
+    assert(userDictionary->Flush());
+  }
+
+  // The carried KAT segment must not reference the page it moved from.
+  engine.ProcessStroke(StenoStroke("TEFT"));
+  expected += " test";
+  StenoEngineTester::VerifyTextBuffer(engine, expected.c_str());
+  assert(Str::Eq(StenoEngineTester::GetCarriedSegmentText(engine, 0), "cat"));
+  // spellchecker: enable
+
+  delete userDictionary;
+  delete[] buffer;
+}
+TEST_END
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#if RUN_BENCHMARKS
+
+#include "allocation_count.h"
+#include "benchmark.h"
+#include "dictionary/wrapped_dictionary.h"
+#include <atomic>
+#include <string>
+
+// Counts the lookups that reach the dictionaries, i.e. those that are not
+// answered by the engine's lookup cache. A LookupLongest call counts once,
+// regardless of how many lengths it probes.
+class StenoLookupCountingDictionary final : public StenoWrappedDictionary {
+public:
+  StenoLookupCountingDictionary(StenoDictionary *dictionary)
+      : StenoWrappedDictionary(dictionary) {}
+
+  virtual StenoDictionaryLookupResult
+  Lookup(const StenoDictionaryLookup &lookup) const {
+    ++lookupCount;
+    return dictionary->Lookup(lookup);
+  }
+
+  virtual StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+                size_t maximumLength, size_t &length) const {
+    ++lookupCount;
+    return dictionary->LookupLongest(lookup, minimumLength, maximumLength,
+                                     length);
+  }
+
+  virtual const char *GetName() const { return "lookup-counting"; }
+
+  mutable std::atomic<uint64_t> lookupCount = 0;
+};
+
+static const StenoDictionary *const BENCHMARK_DICTIONARIES[] = {
+    &StenoJeffShowStrokeDictionary::instance,
+    &StenoJeffPhrasingDictionary::instance,
+    &StenoJeffNumbersDictionary::instance,
+    &StenoEmilySymbolsDictionary::instance,
+    &mainDictionary,
+};
+
+static const struct {
+  const char *name;
+  const StenoOrthography *orthography;
+} BENCHMARK_ORTHOGRAPHIES[] = {
+    {"empty", &StenoOrthography::emptyOrthography},
+};
+
+// Adds each stroke of a '/' separated outline.
+static void AddOutline(std::vector<StenoStroke> &strokes, const char *p,
+                       const char *end) {
+  while (p < end) {
+    const char *strokeEnd = p;
+    while (strokeEnd < end && *strokeEnd != '/') {
+      ++strokeEnd;
+    }
+
+    char buffer[64];
+    size_t length = strokeEnd - p;
+    if (0 < length && length < sizeof(buffer)) {
+      memcpy(buffer, p, length);
+      buffer[length] = '\0';
+      StenoStroke stroke;
+      stroke.Set(buffer);
+      strokes.push_back(stroke);
+    }
+    p = strokeEnd + 1;
+  }
+}
+
+// Loads either an RTF/CRE transcript, which has strokes in {\*\cxs ...}
+// groups, or plain text with one stroke or outline per line. Blank lines and
+// lines starting with '#' are ignored.
+static bool LoadStrokeCorpus(const char *filename,
+                             std::vector<StenoStroke> &strokes) {
+  FILE *file = fopen(filename, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  std::string text;
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+    text.append(buffer, length);
+  }
+  fclose(file);
+
+  const char *p = text.c_str();
+  const char *end = p + text.size();
+  if (strncmp(p, "{\\rtf", 5) == 0) {
+    static const char STROKE_TAG[] = "\\cxs ";
+    while ((p = strstr(p, STROKE_TAG)) != nullptr) {
+      p += sizeof(STROKE_TAG) - 1;
+      const char *groupEnd = strchr(p, '}');
+      if (groupEnd == nullptr) {
+        break;
+      }
+      AddOutline(strokes, p, groupEnd);
+      p = groupEnd;
+    }
+    return true;
+  }
+
+  while (p < end) {
+    const char *lineEnd = strchr(p, '\n');
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+
+    const char *trimmedEnd = lineEnd;
+    while (trimmedEnd > p && IsWhitespace(trimmedEnd[-1])) {
+      --trimmedEnd;
+    }
+    while (p < trimmedEnd && IsWhitespace(*p)) {
+      ++p;
+    }
+    if (p < trimmedEnd && *p != '#') {
+      AddOutline(strokes, p, trimmedEnd);
+    }
+    p = lineEnd + 1;
+  }
+  return true;
+}
+
+// Replays a stroke corpus through the engine.
+//
+// Options:
+//   --strokes=FILE         RTF/CRE or one stroke per line. Defaults to
+//                          10,000 random strokes.
+//   --dictionaries=A,B,... Names of the dictionaries to use, in order.
+//                          Defaults to all built in dictionaries.
+//   --orthography=NAME     Defaults to empty.
+//   --repeat=N             Number of times to replay the corpus.
+//
+// Build with and without JAVELIN_THREADS to compare both configurations.
+BENCHMARK_BEGIN("Engine: Stroke corpus replay") {
+  std::vector<StenoStroke> strokes;
+  const char *filename = Benchmark::GetOption("strokes", nullptr);
+  if (filename) {
+    if (!LoadStrokeCorpus(filename, strokes)) {
+      printf("  Unable to read %s\n", filename);
+      return;
+    }
+  } else {
+    srand(0x1234);
+    for (size_t i = 0; i < 10000; ++i) {
+      strokes.push_back(StenoStroke(rand() & StrokeMask::ALL));
+    }
+  }
+
+  std::vector<const StenoDictionary *> dictionaries;
+  const char *dictionaryNames = Benchmark::GetOption("dictionaries", nullptr);
+  for (const StenoDictionary *dictionary : BENCHMARK_DICTIONARIES) {
+    if (dictionaryNames == nullptr) {
+      dictionaries.push_back(dictionary);
+    }
+  }
+  while (dictionaryNames && *dictionaryNames) {
+    const char *nameEnd = strchr(dictionaryNames, ',');
+    size_t nameLength =
+        nameEnd ? nameEnd - dictionaryNames : strlen(dictionaryNames);
+    const StenoDictionary *match = nullptr;
+    for (const StenoDictionary *dictionary : BENCHMARK_DICTIONARIES) {
+      const char *name = dictionary->GetName();
+      if (strlen(name) == nameLength &&
+          strncmp(name, dictionaryNames, nameLength) == 0) {
+        match = dictionary;
+      }
+    }
+    if (match == nullptr) {
+      printf("  Unknown dictionary: %.*s\n", (int)nameLength,
+             dictionaryNames);
+      return;
+    }
+    dictionaries.push_back(match);
+    dictionaryNames += nameLength + (nameEnd ? 1 : 0);
+  }
+
+  const char *orthographyName = Benchmark::GetOption("orthography", "empty");
+  const StenoOrthography *orthographyData = nullptr;
+  for (const auto &entry : BENCHMARK_ORTHOGRAPHIES) {
+    if (Str::Eq(entry.name, orthographyName)) {
+      orthographyData = entry.orthography;
+    }
+  }
+  if (orthographyData == nullptr) {
+    printf("  Unknown orthography: %s\n", orthographyName);
+    return;
+  }
+
+  size_t repeatCount = atoi(Benchmark::GetOption("repeat", "1"));
+
+  StenoDictionaryList dictionaryList(dictionaries.data(), dictionaries.size());
+  StenoLookupCountingDictionary countingDictionary(&dictionaryList);
+  StenoCompiledOrthography orthography(*orthographyData);
+  StenoEngine *engine = new StenoEngine(countingDictionary, orthography);
+
+  Key::DisableHistory();
+
+  std::vector<uint64_t> samples;
+  samples.reserve(strokes.size() * repeatCount);
+
+#if JAVELIN_ALLOCATION_STATS
+  AllocationCount startAllocationCount = AllocationCount::GetProcessTotal();
+#endif
+  uint64_t startTime = Benchmark::GetTime();
+  for (size_t i = 0; i < repeatCount; ++i) {
+    for (StenoStroke stroke : strokes) {
+      uint64_t strokeStartTime = Benchmark::GetTime();
+      if (stroke == StenoStroke(StrokeMask::STAR)) {
+        engine->ProcessUndo();
+      } else {
+        engine->ProcessStroke(stroke);
+      }
+      samples.push_back(Benchmark::GetTime() - strokeStartTime);
+    }
+  }
+  uint64_t elapsedTime = Benchmark::GetTime() - startTime;
+#if JAVELIN_ALLOCATION_STATS
+  AllocationCount allocationCount =
+      AllocationCount::GetProcessTotal() - startAllocationCount;
+#endif
+
+  Key::EnableHistory();
+
+  size_t strokeCount = samples.size();
+  printf("  Threads: %s\n",
+#if JAVELIN_THREADS
+         "enabled"
+#else
+         "disabled"
+#endif
+  );
+  printf("  Dictionaries: %zu, orthography: %s\n", dictionaries.size(),
+         orthographyName);
+  printf("  Strokes: %zu in %.1fms, %.0f strokes/s\n", strokeCount,
+         elapsedTime / 1e6, strokeCount * 1e9 / elapsedTime);
+  Benchmark::PrintLatency("Stroke latency", samples);
+  printf("  Dictionary lookups: %.2f per stroke\n",
+         double(countingDictionary.lookupCount) / strokeCount);
+#if JAVELIN_ALLOCATION_STATS
+  printf("  Allocations: %.2f per stroke (%.0f bytes)\n",
+         double(allocationCount.count) / strokeCount,
+         double(allocationCount.bytes) / strokeCount);
+#else
+  printf("  Allocations: not counted (build with JAVELIN_ALLOCATION_STATS)\n");
+#endif
+
+  delete engine;
+}
+BENCHMARK_END
+
+#endif
+
 //---------------------------------------------------------------------------
@@ -1,6 +1,9 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include "engine_stats.h"
+#include "lookup_arena.h"
+#include "lookup_cache.h"
 #include "orthography.h"
 #include "processor/processor.h"
 #include "steno_key_code_buffer.h"
@@ -30,7 +33,7 @@ public:
   void Process(const StenoKeyState &value, StenoAction action);
   void ProcessUndo();
   void ProcessStroke(StenoStroke stroke);
-  void Tick() {}
+  void Tick();
 
   void SendText(const uint8_t *p);
   void PrintInfo() const;
@@ -46,6 +49,13 @@ public:
   void EnablePaperTape() { paperTapeEnabled = true; }
   void DisablePaperTape() { paperTapeEnabled = false; }
 
+#if JAVELIN_ALLOCATION_STATS
+  // Asserts that processing a stroke makes at most this many allocations.
+  void SetStrokeAllocationBudget(size_t budget) {
+    strokeAllocationBudget = budget;
+  }
+#endif
+
   bool IsSuggestionsEnabled() const { return suggestionsEnabled; }
   void EnableSuggestions() { suggestionsEnabled = true; }
   void DisableSuggestions() { suggestionsEnabled = false; }
@@ -61,10 +71,15 @@ public:
   static void DisableSuggestions_Binding(void *context,
                                          const char *commandLine);
   static void Lookup_Binding(void *context, const char *commandLine);
+  static void EngineStats_Binding(void *context, const char *commandLine);
 
 private:
   static const StenoStroke UNDO_STROKE;
   static const size_t SEGMENT_CONVERSION_LIMIT = 32;
+
+  // Incremental conversions keep their window start fixed, growing the window
+  // up to this many strokes before it is rebased to SEGMENT_CONVERSION_LIMIT.
+  static const size_t INCREMENTAL_SEGMENT_CONVERSION_LIMIT = 40;
   static const size_t PAPER_TAPE_SUGGESTION_SEGMENT_LIMIT = 8;
 
   bool paperTapeEnabled = false;
@@ -75,6 +90,7 @@ private:
   StenoDictionary &dictionary;
   const StenoCompiledOrthography orthography;
   StenoUserDictionary *userDictionary;
+  size_t userDictionaryUpdateCount = 0;
 
   StenoState state;
   StenoState addTranslationState;
@@ -85,13 +101,43 @@ private:
   StenoStrokeHistory addTranslationHistory;
 
   struct ConversionBuffer {
-    StenoStrokeHistory strokeHistory;
+    StenoStrokeHistoryWindow strokeHistory;
     StenoKeyCodeBuffer keyCodeBuffer;
+
+    // Generated text of the segments built from this buffer. It is reset
+    // by full conversions, and grows across incremental conversions, since
+    // those keep segments of the carried conversion.
+    StenoLookupArena lookupArena;
   };
 
   ConversionBuffer previousConversionBuffer;
   ConversionBuffer nextConversionBuffer;
 
+  // The result of the last normal mode stroke, which is used as the
+  // "previous" conversion of the following stroke instead of rebuilding it.
+  //
+  // The segments reference the states of history. Conversions that made a
+  // private copy of their window are not carried.
+  struct CarriedConversion {
+    bool isValid = false;
+    size_t strokeCount;
+    size_t maximumOutlineLength;
+    size_t stableSegmentCount;
+    StenoSegmentList segmentList;
+  };
+
+  CarriedConversion carriedConversion;
+
+  StenoLookupCache lookupCache;
+
+  // Phases of the stroke being processed, and their histograms.
+  StenoPhaseStats phaseStats;
+  StenoEngineStats stats;
+
+#if JAVELIN_ALLOCATION_STATS
+  size_t strokeAllocationBudget = SIZE_MAX;
+#endif
+
   struct UpdateNormalModeTextBufferThreadData;
 
   void ProcessNormalModeUndo();
@@ -104,12 +150,28 @@ private:
   void AddTranslation(size_t newlineIndex);
   void DeleteTranslation(size_t newlineIndex);
   void ResetState();
-
-  // Returns the number of segments
-  void UpdateNormalModeTextBuffer(size_t sourceStrokeCount,
-                                  ConversionBuffer &buffer,
-                                  size_t conversionLimit,
-                                  StenoSegmentList &segmentList);
+  void RecordPhaseStats();
+  void InvalidateLookupCache();
+
+  bool CanUpdateNormalModeTextBufferIncrementally() const;
+  void InvalidateCarriedConversion() { carriedConversion.isValid = false; }
+  void InvalidateIfUserDictionaryUpdated();
+  void CarryConversion(size_t strokeCount, size_t stableSegmentCount,
+                       StenoSegmentList &segmentList);
+
+  // Returns the number of stable segments.
+  size_t UpdateNormalModeTextBuffer(size_t sourceStrokeCount,
+                                    ConversionBuffer &buffer,
+                                    size_t conversionLimit,
+                                    StenoSegmentList &segmentList,
+                                    StenoLookupCache *lookupCache,
+                                    StenoPhaseStats &phaseStats);
+
+  // Updates nextConversionBuffer from the carried conversion, reusing its
+  // stable segments and only segmenting the remaining strokes.
+  size_t UpdateNormalModeTextBufferIncremental(
+      const StenoSegmentList &previousSegmentList,
+      StenoSegmentList &segmentList, StenoPhaseStats &phaseStats);
 
   void PrintPaperTape(StenoStroke stroke,
                       const StenoSegmentList &previousSegmentList,
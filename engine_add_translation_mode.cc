@@ -17,6 +17,7 @@ static const char TRANSLATION_PROMPT[] = "; Translation: ";
 
 void StenoEngine::InitiateAddTranslationMode() {
   mode = StenoEngineMode::ADD_TRANSLATION;
+  InvalidateCarriedConversion();
 
   addTranslationHistory.Reset();
   addTranslationState = state;
@@ -133,14 +134,11 @@ StenoEngine::UpdateAddTranslationModeTextBuffer(ConversionBuffer &buffer) {
   StenoSegmentList segmentList;
   BuildSegmentContext context(segmentList, dictionary, orthography);
 
-  buffer.strokeHistory.TransferFrom(addTranslationHistory,
-                                    addTranslationHistory.GetCount(),
-                                    StenoStrokeHistory::BUFFER_SIZE);
+  buffer.strokeHistory.SetView(addTranslationHistory.GetView());
   buffer.strokeHistory.CreateSegments(context, i);
 
-  StenoTokenizer *tokenizer = segmentList.CreateTokenizer();
+  StenoSegmentListTokenizer tokenizer(segmentList);
   buffer.keyCodeBuffer.Append(tokenizer);
-  delete tokenizer;
   return i + segmentList.GetCount();
 }
 
@@ -163,18 +161,16 @@ void StenoEngine::AddTranslation(size_t newlineIndex) {
   StenoSegmentList segmentList;
   BuildSegmentContext context(segmentList, dictionary, orthography);
 
-  nextConversionBuffer.strokeHistory.TransferFrom(
-      addTranslationHistory, addTranslationHistory.GetCount(),
-      StenoStrokeHistory::BUFFER_SIZE);
+  nextConversionBuffer.strokeHistory.SetView(addTranslationHistory.GetView());
   nextConversionBuffer.strokeHistory.CreateSegments(context, newlineIndex + 1);
 
-  StenoTokenizer *tokenizer = segmentList.CreateTokenizer();
+  StenoSegmentListTokenizer tokenizer(segmentList);
   nextConversionBuffer.keyCodeBuffer.Append(tokenizer);
-  delete tokenizer;
 
   char *word = nextConversionBuffer.keyCodeBuffer.ToString();
   userDictionary->Add(&addTranslationHistory.GetStroke(0), newlineIndex, word);
   free(word);
+  InvalidateLookupCache();
 }
 
 void StenoEngine::DeleteTranslation(size_t newlineIndex) {
@@ -183,6 +179,7 @@ void StenoEngine::DeleteTranslation(size_t newlineIndex) {
   }
 
   userDictionary->Remove(&addTranslationHistory.GetStroke(0), newlineIndex);
+  InvalidateLookupCache();
 }
 
 //---------------------------------------------------------------------------
@@ -3,6 +3,7 @@
 #include "engine.h"
 
 #include "console.h"
+#include "str.h"
 
 //---------------------------------------------------------------------------
 
@@ -121,4 +122,22 @@ void StenoEngine::Lookup_Binding(void *context, const char *commandLine) {
   Console::Write("\n]\n\n", 4);
 }
 
+void StenoEngine::EngineStats_Binding(void *context,
+                                      const char *commandLine) {
+  StenoEngine *engine = (StenoEngine *)context;
+  const char *subcommand = strchr(commandLine, ' ');
+  if (subcommand == nullptr) {
+    engine->stats.Print();
+    return;
+  }
+
+  ++subcommand;
+  if (Str::Eq(subcommand, "reset")) {
+    engine->stats.Reset();
+    Console::Write("OK\n\n", 4);
+  } else {
+    Console::Printf("ERR Unknown subcommand: \"%s\"\n\n", subcommand);
+  }
+}
+
 //---------------------------------------------------------------------------
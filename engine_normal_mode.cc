@@ -16,12 +16,18 @@ struct StenoEngine::UpdateNormalModeTextBufferThreadData {
   StenoEngine *engine;
   size_t sourceStrokeCount;
   ConversionBuffer *conversionBuffer;
-  StenoSegmentList segmentList;
+  StenoSegmentList *segmentList;
   size_t conversionLimit;
+  StenoLookupCache *lookupCache;
+  size_t stableSegmentCount;
+  StenoPhaseStats phaseStats;
 
   void Run() {
-    engine->UpdateNormalModeTextBuffer(sourceStrokeCount, *conversionBuffer,
-                                       conversionLimit, segmentList);
+    phaseStats.Start();
+    stableSegmentCount = engine->UpdateNormalModeTextBuffer(
+        sourceStrokeCount, *conversionBuffer, conversionLimit, *segmentList,
+        lookupCache, phaseStats);
+    phaseStats.Stop();
   }
   static void EntryPoint(void *data) {
     ((UpdateNormalModeTextBufferThreadData *)data)->Run();
@@ -31,39 +37,70 @@ struct StenoEngine::UpdateNormalModeTextBufferThreadData {
 #endif
 
 void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
+  InvalidateIfUserDictionaryUpdated();
   history.ShiftIfFull();
 
-#if JAVELIN_THREADS
-  UpdateNormalModeTextBufferThreadData threadData[2];
-  threadData[0].engine = this;
-  threadData[0].sourceStrokeCount = history.GetCount();
-  threadData[0].conversionBuffer = &previousConversionBuffer;
-  threadData[0].conversionLimit = SEGMENT_CONVERSION_LIMIT - 1;
+  StenoSegmentList previousSegmentList;
+  StenoSegmentList nextSegmentList;
+  size_t nextStrokeCount;
+  size_t stableSegmentCount;
 
-  history.Add(stroke, state);
+  bool isIncremental = CanUpdateNormalModeTextBufferIncrementally();
+  InvalidateCarriedConversion();
 
-  threadData[1].engine = this;
-  threadData[1].sourceStrokeCount = history.GetCount();
-  threadData[1].conversionBuffer = &nextConversionBuffer;
-  threadData[1].conversionLimit = SEGMENT_CONVERSION_LIMIT;
+  if (isIncremental) {
+    // The previous conversion is the result of the last stroke.
+    previousSegmentList = (StenoSegmentList &&)carriedConversion.segmentList;
+    previousConversionBuffer.keyCodeBuffer = nextConversionBuffer.keyCodeBuffer;
 
-  RunParallel(&UpdateNormalModeTextBufferThreadData::EntryPoint, &threadData[0],
-              &UpdateNormalModeTextBufferThreadData::EntryPoint,
-              &threadData[1]);
+    history.Add(stroke, state);
 
-  StenoSegmentList &previousSegmentList = threadData[0].segmentList;
-  StenoSegmentList &nextSegmentList = threadData[1].segmentList;
+    nextStrokeCount = carriedConversion.strokeCount + 1;
+    stableSegmentCount = UpdateNormalModeTextBufferIncremental(
+        previousSegmentList, nextSegmentList, phaseStats);
+  } else {
+#if JAVELIN_THREADS
+    UpdateNormalModeTextBufferThreadData threadData[2];
+    threadData[0].engine = this;
+    threadData[0].sourceStrokeCount = history.GetCount();
+    threadData[0].conversionBuffer = &previousConversionBuffer;
+    threadData[0].segmentList = &previousSegmentList;
+    threadData[0].conversionLimit = SEGMENT_CONVERSION_LIMIT - 1;
+    // The cache is not thread safe, so only one thread uses it.
+    threadData[0].lookupCache = nullptr;
+
+    history.Add(stroke, state);
+
+    threadData[1].engine = this;
+    threadData[1].sourceStrokeCount = history.GetCount();
+    threadData[1].conversionBuffer = &nextConversionBuffer;
+    threadData[1].segmentList = &nextSegmentList;
+    threadData[1].conversionLimit = SEGMENT_CONVERSION_LIMIT;
+    threadData[1].lookupCache = &lookupCache;
+
+    RunParallel(&UpdateNormalModeTextBufferThreadData::EntryPoint,
+                &threadData[0],
+                &UpdateNormalModeTextBufferThreadData::EntryPoint,
+                &threadData[1]);
+
+    stableSegmentCount = threadData[1].stableSegmentCount;
+    phaseStats.Add(threadData[0].phaseStats);
+    phaseStats.Add(threadData[1].phaseStats);
 #else
-  StenoSegmentList previousSegmentList;
-  UpdateNormalModeTextBuffer(history.GetCount(), previousConversionBuffer,
-                             SEGMENT_CONVERSION_LIMIT - 1, previousSegmentList);
+    UpdateNormalModeTextBuffer(history.GetCount(), previousConversionBuffer,
+                               SEGMENT_CONVERSION_LIMIT - 1,
+                               previousSegmentList, &lookupCache, phaseStats);
 
-  history.Add(stroke, state);
+    history.Add(stroke, state);
 
-  StenoSegmentList nextSegmentList;
-  UpdateNormalModeTextBuffer(history.GetCount(), nextConversionBuffer,
-                             SEGMENT_CONVERSION_LIMIT, nextSegmentList);
+    stableSegmentCount = UpdateNormalModeTextBuffer(
+        history.GetCount(), nextConversionBuffer, SEGMENT_CONVERSION_LIMIT,
+        nextSegmentList, &lookupCache, phaseStats);
 #endif
+    nextStrokeCount = history.GetCount() < SEGMENT_CONVERSION_LIMIT
+                          ? history.GetCount()
+                          : SEGMENT_CONVERSION_LIMIT;
+  }
 
   state = nextConversionBuffer.keyCodeBuffer.state;
   state.shouldCombineUndo = false;
@@ -79,8 +116,12 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
   }
 
   bool printSuggestions = true;
-  if (emitter.Process(previousConversionBuffer.keyCodeBuffer,
-                      nextConversionBuffer.keyCodeBuffer)) {
+  phaseStats.Enter(StenoEnginePhase::EMIT);
+  bool shouldCombineUndo =
+      emitter.Process(previousConversionBuffer.keyCodeBuffer,
+                      nextConversionBuffer.keyCodeBuffer);
+
+  if (shouldCombineUndo) {
     history.SetBackCombineUndo();
 
     if (previousConversionBuffer.keyCodeBuffer.count ==
@@ -90,19 +131,45 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
     }
   }
 
+  phaseStats.Enter(StenoEnginePhase::PAPER_TAPE);
   PrintPaperTape(stroke, previousSegmentList, nextSegmentList);
+
   if (printSuggestions) {
+    phaseStats.Enter(StenoEnginePhase::SUGGESTIONS);
     PrintSuggestions(previousSegmentList, nextSegmentList);
   }
+  phaseStats.Enter(StenoEnginePhase::OTHER);
 
   if (nextConversionBuffer.keyCodeBuffer.resetStateCount >
       previousConversionBuffer.keyCodeBuffer.resetStateCount) {
     ResetState();
     return;
   }
+
+  // Stable segments were borrowed from the previous list. Take ownership
+  // before the previous list is destroyed.
+  for (size_t i = 0; i < stableSegmentCount && i < nextSegmentList.GetCount() &&
+                     i < previousSegmentList.GetCount();
+       ++i) {
+    StenoDictionaryLookupResult &lookup = nextSegmentList[i].lookup;
+    StenoDictionaryLookupResult &previousLookup = previousSegmentList[i].lookup;
+    if (lookup.context == previousLookup.context) {
+      StenoDictionaryLookupResult temp = lookup;
+      lookup = previousLookup;
+      previousLookup = temp;
+    }
+  }
+
+  // Segments of a private copy would be overwritten by the next conversion.
+  if (!nextConversionBuffer.strokeHistory.IsPrivateCopy()) {
+    CarryConversion(nextStrokeCount, stableSegmentCount, nextSegmentList);
+  }
 }
 
 void StenoEngine::ProcessNormalModeUndo() {
+  InvalidateCarriedConversion();
+  InvalidateIfUserDictionaryUpdated();
+
   size_t undoCount = history.GetUndoCount(SEGMENT_CONVERSION_LIMIT);
   if (undoCount == 0) {
     Key::Press(KeyCode::BACKSPACE);
@@ -111,59 +178,154 @@ void StenoEngine::ProcessNormalModeUndo() {
     return;
   }
 
+  StenoSegmentList previousSegmentList;
+  StenoSegmentList nextSegmentList;
+
 #if JAVELIN_THREADS
   UpdateNormalModeTextBufferThreadData threadData[2];
   threadData[0].engine = this;
   threadData[0].sourceStrokeCount = history.GetCount();
   threadData[0].conversionBuffer = &previousConversionBuffer;
+  threadData[0].segmentList = &previousSegmentList;
   threadData[0].conversionLimit = SEGMENT_CONVERSION_LIMIT;
+  threadData[0].lookupCache = nullptr;
 
   threadData[1].engine = this;
   threadData[1].sourceStrokeCount = history.GetCount() - undoCount;
   threadData[1].conversionBuffer = &nextConversionBuffer;
+  threadData[1].segmentList = &nextSegmentList;
   threadData[1].conversionLimit = SEGMENT_CONVERSION_LIMIT - undoCount;
+  threadData[1].lookupCache = &lookupCache;
 
   RunParallel(&UpdateNormalModeTextBufferThreadData::EntryPoint, &threadData[0],
               &UpdateNormalModeTextBufferThreadData::EntryPoint,
               &threadData[1]);
+  phaseStats.Add(threadData[0].phaseStats);
+  phaseStats.Add(threadData[1].phaseStats);
 
   state = history.BackState(undoCount);
   state.shouldCombineUndo = false;
   history.PopCount(undoCount);
 #else
-  StenoSegmentList previousSegmentList;
   UpdateNormalModeTextBuffer(history.GetCount(), previousConversionBuffer,
-                             SEGMENT_CONVERSION_LIMIT, previousSegmentList);
+                             SEGMENT_CONVERSION_LIMIT, previousSegmentList,
+                             &lookupCache, phaseStats);
 
   state = history.BackState(undoCount);
   state.shouldCombineUndo = false;
   history.PopCount(undoCount);
 
-  StenoSegmentList nextSegmentList;
   UpdateNormalModeTextBuffer(history.GetCount(), nextConversionBuffer,
                              SEGMENT_CONVERSION_LIMIT - undoCount,
-                             nextSegmentList);
+                             nextSegmentList, &lookupCache, phaseStats);
 #endif
 
+  phaseStats.Enter(StenoEnginePhase::EMIT);
   emitter.Process(previousConversionBuffer.keyCodeBuffer,
                   nextConversionBuffer.keyCodeBuffer);
 
+  phaseStats.Enter(StenoEnginePhase::PAPER_TAPE);
   PrintPaperTapeUndo(undoCount);
+  phaseStats.Enter(StenoEnginePhase::OTHER);
 }
 
-void StenoEngine::UpdateNormalModeTextBuffer(size_t sourceStrokeCount,
-                                             ConversionBuffer &buffer,
-                                             size_t conversionLimit,
-                                             StenoSegmentList &segmentList) {
-  buffer.strokeHistory.TransferFrom(history, sourceStrokeCount,
-                                    conversionLimit);
-  BuildSegmentContext context(segmentList, dictionary, orthography);
+size_t StenoEngine::UpdateNormalModeTextBuffer(size_t sourceStrokeCount,
+                                               ConversionBuffer &buffer,
+                                               size_t conversionLimit,
+                                               StenoSegmentList &segmentList,
+                                               StenoLookupCache *lookupCache,
+                                               StenoPhaseStats &phaseStats) {
+  StenoEnginePhase previousPhase = phaseStats.Enter(StenoEnginePhase::SEGMENT);
+  buffer.strokeHistory.SetView(
+      history.GetView(sourceStrokeCount, conversionLimit));
+  buffer.lookupArena.Reset();
+  BuildSegmentContext context(segmentList, dictionary, orthography,
+                              lookupCache);
+  context.arena = &buffer.lookupArena;
+  // Lookups made while segmenting are reported separately.
+  context.phaseStats = &phaseStats;
 
   buffer.strokeHistory.CreateSegments(context);
 
-  StenoTokenizer *tokenizer = segmentList.CreateTokenizer();
-  buffer.keyCodeBuffer.Populate(tokenizer);
-  delete tokenizer;
+  phaseStats.Enter(StenoEnginePhase::POPULATE);
+  buffer.keyCodeBuffer.Populate(segmentList);
+
+  phaseStats.Enter(StenoEnginePhase::SEGMENT);
+  size_t stableSegmentCount =
+      buffer.strokeHistory.GetStableSegmentCount(context);
+  phaseStats.Enter(previousPhase);
+  return stableSegmentCount;
+}
+
+//---------------------------------------------------------------------------
+
+bool StenoEngine::CanUpdateNormalModeTextBufferIncrementally() const {
+  return carriedConversion.isValid &&
+         carriedConversion.strokeCount < INCREMENTAL_SEGMENT_CONVERSION_LIMIT &&
+         carriedConversion.strokeCount <= history.GetCount() &&
+         carriedConversion.maximumOutlineLength ==
+             dictionary.GetMaximumOutlineLength();
+}
+
+void StenoEngine::CarryConversion(size_t strokeCount,
+                                  size_t stableSegmentCount,
+                                  StenoSegmentList &segmentList) {
+  carriedConversion.isValid = true;
+  carriedConversion.strokeCount = strokeCount;
+  carriedConversion.maximumOutlineLength = dictionary.GetMaximumOutlineLength();
+  carriedConversion.stableSegmentCount = stableSegmentCount;
+  carriedConversion.segmentList = (StenoSegmentList &&)segmentList;
+}
+
+size_t StenoEngine::UpdateNormalModeTextBufferIncremental(
+    const StenoSegmentList &previousSegmentList,
+    StenoSegmentList &segmentList, StenoPhaseStats &phaseStats) {
+  ConversionBuffer &buffer = nextConversionBuffer;
+
+  // The window start is unchanged, so stable segments continue to reference
+  // the same strokes and states.
+  StenoEnginePhase previousPhase = phaseStats.Enter(StenoEnginePhase::SEGMENT);
+  buffer.strokeHistory.SetView(
+      history.GetView(history.GetCount(), carriedConversion.strokeCount + 1));
+  BuildSegmentContext context(segmentList, dictionary, orthography,
+                              &lookupCache);
+  context.arena = &buffer.lookupArena;
+  context.phaseStats = &phaseStats;
+
+  size_t offset = 0;
+  for (size_t i = 0; i < carriedConversion.stableSegmentCount; ++i) {
+    const StenoSegment &segment = previousSegmentList[i];
+    segmentList.Add(StenoSegment(
+        segment.strokeLength, segment.state,
+        StenoDictionaryLookupResult::CreateStaticString(
+            segment.lookup.GetText())));
+    offset += segment.strokeLength;
+  }
+
+  buffer.strokeHistory.CreateSegments(context, offset);
+
+  phaseStats.Enter(StenoEnginePhase::POPULATE);
+  // The key code buffer was last populated from previousSegmentList, so the
+  // output of the leading segments that are unchanged can be reused.
+  size_t unchangedSegmentCount = 0;
+  while (unchangedSegmentCount < previousSegmentList.GetCount() &&
+         unchangedSegmentCount < segmentList.GetCount()) {
+    const StenoSegment &previous = previousSegmentList[unchangedSegmentCount];
+    const StenoSegment &next = segmentList[unchangedSegmentCount];
+    if (previous.strokeLength != next.strokeLength ||
+        previous.state != next.state ||
+        !Str::Eq(previous.lookup.GetText(), next.lookup.GetText())) {
+      break;
+    }
+    ++unchangedSegmentCount;
+  }
+  buffer.keyCodeBuffer.Populate(segmentList, unchangedSegmentCount);
+
+  phaseStats.Enter(StenoEnginePhase::SEGMENT);
+  size_t stableSegmentCount =
+      buffer.strokeHistory.GetStableSegmentCount(context);
+  phaseStats.Enter(previousPhase);
+  return stableSegmentCount;
 }
 
 //---------------------------------------------------------------------------
@@ -204,25 +366,20 @@ void StenoEngine::PrintPaperTape(StenoStroke stroke,
     Console::Printf(",\"undo\":%zu", undoCount);
   }
 
-  StenoSegmentList newSegments;
-  for (size_t i = commonIndex; i < nextSegmentList.GetCount(); ++i) {
-    newSegments.Add(nextSegmentList[i]);
-  }
-
   Console::Printf(",\"text\":\"");
-  StenoTokenizer *tokenizer = newSegments.CreateTokenizer();
+  StenoSegmentListTokenizer tokenizer(nextSegmentList.GetData() + commonIndex,
+                                      nextSegmentList.GetCount() - commonIndex);
   bool isFirstToken = true;
-  while (tokenizer->HasMore()) {
+  while (tokenizer.HasMore()) {
     if (isFirstToken) {
       isFirstToken = false;
     } else {
       Console::Write(" ", 1);
     }
-    Console::WriteAsJson(tokenizer->GetNext().text, buffer);
+    StenoToken token = tokenizer.GetNext();
+    Console::WriteAsJson(token.text, token.length, buffer);
   }
-  delete tokenizer;
 
-  newSegments.Reset();
   Console::Write("\"}\n\n", 4);
 }
 
@@ -330,23 +487,21 @@ char *StenoEngine::PrintSegmentSuggestion(size_t wordCount,
     return nullptr;
   }
 
-  StenoSegmentList testSegments;
+  const StenoSegment *testSegments = segmentList.GetData() + startSegmentIndex;
+  size_t testSegmentCount = segmentList.GetCount() - startSegmentIndex;
 
   size_t strokeThresholdCount = 0;
-  for (size_t i = startSegmentIndex; i < segmentList.GetCount(); ++i) {
-    testSegments.Add(segmentList[i]);
-    strokeThresholdCount += segmentList[i].strokeLength;
+  for (size_t i = 0; i < testSegmentCount; ++i) {
+    strokeThresholdCount += testSegments[i].strokeLength;
   }
 
-  StenoTokenizer *tokenizer = testSegments.CreateTokenizer();
+  StenoSegmentListTokenizer tokenizer(testSegments, testSegmentCount);
   previousConversionBuffer.keyCodeBuffer.Populate(tokenizer);
-  delete tokenizer;
 
   // Special case {*!} to avoid suggestions.
-  if (testSegments.GetCount() == 2 &&
+  if (testSegmentCount == 2 &&
       (Str::Eq(testSegments[0].lookup.GetText(), "{*!}") ||
        Str::Eq(testSegments[1].lookup.GetText(), "{*!}"))) {
-    testSegments.Reset();
     return Str::Dup("");
   }
 
@@ -361,8 +516,6 @@ char *StenoEngine::PrintSegmentSuggestion(size_t wordCount,
   }
   char *spaceRemoved = *lookup == ' ' ? lookup + 1 : lookup;
 
-  testSegments.Reset();
-
   bool printSuggestion = true;
   if (lastLookup) {
     char *lastLookupSpaceRemoved =
@@ -0,0 +1,209 @@
+//---------------------------------------------------------------------------
+
+#include "engine_stats.h"
+#include "bit.h"
+#include "clock.h"
+#include "console.h"
+#include <string.h>
+
+//---------------------------------------------------------------------------
+
+void StenoLatencyHistogram::Reset() {
+  count = 0;
+  maximum = 0;
+  memset(buckets, 0, sizeof(buckets));
+}
+
+void StenoLatencyHistogram::Add(uint32_t value) {
+  ++count;
+  if (value > maximum) {
+    maximum = value;
+  }
+  ++buckets[GetBucketIndex(value)];
+}
+
+// Values below 4 have a bucket each. Above that, the two bits following the
+// most significant bit select one of four buckets for each power of two.
+size_t StenoLatencyHistogram::GetBucketIndex(uint32_t value) {
+  if (value > MAXIMUM_VALUE) {
+    value = MAXIMUM_VALUE;
+  }
+  if (value < 4) {
+    return value;
+  }
+  uint32_t exponent = 31 - Bit<4>::CountLeadingZeros(value);
+  return 4 * (exponent - 1) + ((value >> (exponent - 2)) & 3);
+}
+
+uint32_t StenoLatencyHistogram::GetBucketUpperBound(size_t index) {
+  if (index < 4) {
+    return index;
+  }
+  if (index == BUCKET_COUNT - 1) {
+    // Values above MAXIMUM_VALUE are also counted in the last bucket.
+    return UINT32_MAX;
+  }
+  uint32_t exponent = index / 4 + 1;
+  uint32_t subBucket = index % 4;
+  return ((5 + subBucket) << (exponent - 2)) - 1;
+}
+
+uint32_t StenoLatencyHistogram::GetPercentile(uint32_t percentile) const {
+  if (count == 0) {
+    return 0;
+  }
+
+  uint32_t target = uint32_t((uint64_t(count) * percentile + 99) / 100);
+  if (target == 0) {
+    target = 1;
+  }
+
+  uint32_t total = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    total += buckets[i];
+    if (total >= target) {
+      uint32_t upperBound = GetBucketUpperBound(i);
+      return upperBound < maximum ? upperBound : maximum;
+    }
+  }
+  return maximum;
+}
+
+//---------------------------------------------------------------------------
+
+void StenoPhaseStats::Start() {
+  memset(times, 0, sizeof(times));
+#if JAVELIN_ALLOCATION_STATS
+  memset(allocationCounts, 0, sizeof(allocationCounts));
+  memset(allocationBytes, 0, sizeof(allocationBytes));
+  phaseStartAllocations = AllocationCount::GetThreadTotal();
+#endif
+
+  phase = StenoEnginePhase::OTHER;
+  startTime = Clock::GetCurrentTimeUs();
+  phaseStartTime = startTime;
+}
+
+void StenoPhaseStats::Stop() {
+  Enter(StenoEnginePhase::OTHER);
+  times[(size_t)StenoEnginePhase::TOTAL] = phaseStartTime - startTime;
+
+#if JAVELIN_ALLOCATION_STATS
+  const size_t TOTAL = (size_t)StenoEnginePhase::TOTAL;
+  for (size_t i = 0; i < TOTAL; ++i) {
+    allocationCounts[TOTAL] += allocationCounts[i];
+    allocationBytes[TOTAL] += allocationBytes[i];
+  }
+#endif
+}
+
+StenoEnginePhase StenoPhaseStats::Enter(StenoEnginePhase newPhase) {
+  uint32_t now = Clock::GetCurrentTimeUs();
+  times[(size_t)phase] += now - phaseStartTime;
+  phaseStartTime = now;
+
+#if JAVELIN_ALLOCATION_STATS
+  AllocationCount allocations = AllocationCount::GetThreadTotal();
+  AllocationCount phaseAllocations = allocations - phaseStartAllocations;
+  allocationCounts[(size_t)phase] += phaseAllocations.count;
+  allocationBytes[(size_t)phase] += phaseAllocations.bytes;
+  phaseStartAllocations = allocations;
+#endif
+
+  StenoEnginePhase previousPhase = phase;
+  phase = newPhase;
+  return previousPhase;
+}
+
+void StenoPhaseStats::Add(const StenoPhaseStats &stats) {
+  for (size_t i = 0; i < (size_t)StenoEnginePhase::TOTAL; ++i) {
+    times[i] += stats.times[i];
+#if JAVELIN_ALLOCATION_STATS
+    allocationCounts[i] += stats.allocationCounts[i];
+    allocationBytes[i] += stats.allocationBytes[i];
+#endif
+  }
+}
+
+//---------------------------------------------------------------------------
+
+const char *const StenoEngineStats::PHASE_NAMES[] = {
+    "other", "segment",    "lookup",      "populate",
+    "emit",  "paper_tape", "suggestions", "total",
+};
+
+void StenoEngineStats::Reset() {
+  for (StenoLatencyHistogram &histogram : histograms) {
+    histogram.Reset();
+  }
+#if JAVELIN_ALLOCATION_STATS
+  memset(allocationCounts, 0, sizeof(allocationCounts));
+  memset(allocationBytes, 0, sizeof(allocationBytes));
+#endif
+}
+
+void StenoEngineStats::Record(const StenoPhaseStats &stats) {
+  for (size_t i = 0; i < (size_t)StenoEnginePhase::COUNT; ++i) {
+    histograms[i].Add(stats.times[i]);
+#if JAVELIN_ALLOCATION_STATS
+    allocationCounts[i] += stats.allocationCounts[i];
+    allocationBytes[i] += stats.allocationBytes[i];
+#endif
+  }
+}
+
+void StenoEngineStats::Print() const {
+  uint32_t strokeCount =
+      histograms[(size_t)StenoEnginePhase::TOTAL].GetCount();
+  Console::Printf("Strokes: %u\n", strokeCount);
+  for (size_t i = 0; i < (size_t)StenoEnginePhase::COUNT; ++i) {
+    const StenoLatencyHistogram &histogram = histograms[i];
+    Console::Printf("  %-12s p50: %uus, p99: %uus, max: %uus",
+                    PHASE_NAMES[i], histogram.GetPercentile(50),
+                    histogram.GetPercentile(99), histogram.GetMaximum());
+#if JAVELIN_ALLOCATION_STATS
+    if (strokeCount != 0) {
+      uint32_t tenthsPerStroke =
+          uint32_t(allocationCounts[i] * 10 / strokeCount);
+      Console::Printf(", allocations: %u.%u (%u bytes) per stroke",
+                      tenthsPerStroke / 10, tenthsPerStroke % 10,
+                      uint32_t(allocationBytes[i] / strokeCount));
+    }
+#endif
+    Console::Printf("\n");
+  }
+  Console::Printf("\n");
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("EngineStats: Histogram percentiles") {
+  StenoLatencyHistogram histogram;
+  assert(histogram.GetPercentile(50) == 0);
+
+  for (uint32_t i = 1; i <= 100; ++i) {
+    histogram.Add(i);
+  }
+  histogram.Add(100000000);
+
+  assert(histogram.GetCount() == 101);
+  assert(histogram.GetMaximum() == 100000000);
+
+  // Buckets are within 25% of the value.
+  uint32_t p50 = histogram.GetPercentile(50);
+  assert(51 <= p50 && p50 <= 51 * 5 / 4);
+  uint32_t p99 = histogram.GetPercentile(99);
+  assert(100 <= p99 && p99 <= 125);
+  assert(histogram.GetPercentile(100) == 100000000);
+
+  histogram.Reset();
+  histogram.Add(3);
+  assert(histogram.GetPercentile(50) == 3);
+  assert(histogram.GetPercentile(99) == 3);
+}
+TEST_END
+
+//---------------------------------------------------------------------------
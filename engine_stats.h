@@ -0,0 +1,106 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "allocation_count.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// Histogram of latencies in microseconds.
+//
+// Buckets are logarithmic, with four buckets per power of two, so that
+// percentiles are reported within 25% of their true value.
+class StenoLatencyHistogram {
+public:
+  void Reset();
+  void Add(uint32_t value);
+
+  uint32_t GetCount() const { return count; }
+  uint32_t GetMaximum() const { return maximum; }
+
+  // Returns the upper bound of the bucket that contains the percentile,
+  // limited to the maximum recorded value.
+  uint32_t GetPercentile(uint32_t percentile) const;
+
+private:
+  static const uint32_t MAXIMUM_VALUE = (1 << 24) - 1;
+  static const size_t BUCKET_COUNT = 92;
+
+  uint32_t count = 0;
+  uint32_t maximum = 0;
+  uint32_t buckets[BUCKET_COUNT] = {};
+
+  static size_t GetBucketIndex(uint32_t value);
+  static uint32_t GetBucketUpperBound(size_t index);
+};
+
+//---------------------------------------------------------------------------
+
+enum class StenoEnginePhase : uint8_t {
+  OTHER,
+  SEGMENT,
+  LOOKUP,
+  POPULATE,
+  EMIT,
+  PAPER_TAPE,
+  SUGGESTIONS,
+  TOTAL,
+  COUNT,
+};
+
+// Measures the time, and with JAVELIN_ALLOCATION_STATS the heap allocations,
+// of each phase while processing a single stroke.
+//
+// Exactly one phase is active at a time, starting with OTHER. Enter()
+// attributes everything since the previous call to the active phase, so
+// nested phases are not counted twice.
+class StenoPhaseStats {
+public:
+  void Start();
+  void Stop();
+
+  // Returns the previously active phase, to be entered again once the phase
+  // completes.
+  StenoEnginePhase Enter(StenoEnginePhase phase);
+
+  // Adds the phases of another thread. TOTAL is not added.
+  void Add(const StenoPhaseStats &stats);
+
+  uint32_t times[(size_t)StenoEnginePhase::COUNT];
+
+#if JAVELIN_ALLOCATION_STATS
+  uint32_t allocationCounts[(size_t)StenoEnginePhase::COUNT];
+  uint32_t allocationBytes[(size_t)StenoEnginePhase::COUNT];
+#endif
+
+private:
+  StenoEnginePhase phase;
+  uint32_t startTime;
+  uint32_t phaseStartTime;
+
+#if JAVELIN_ALLOCATION_STATS
+  AllocationCount phaseStartAllocations;
+#endif
+};
+
+//---------------------------------------------------------------------------
+
+class StenoEngineStats {
+public:
+  void Reset();
+  void Record(const StenoPhaseStats &stats);
+  void Print() const;
+
+private:
+  StenoLatencyHistogram histograms[(size_t)StenoEnginePhase::COUNT];
+
+#if JAVELIN_ALLOCATION_STATS
+  uint64_t allocationCounts[(size_t)StenoEnginePhase::COUNT] = {};
+  uint64_t allocationBytes[(size_t)StenoEnginePhase::COUNT] = {};
+#endif
+
+  static const char *const PHASE_NAMES[];
+};
+
+//---------------------------------------------------------------------------
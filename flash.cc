@@ -13,19 +13,44 @@ uint32_t Flash::reprogrammedBytes = 0;
 
 //---------------------------------------------------------------------------
 
+// Blocks that are already erased are skipped.
 __attribute((weak)) void Flash::Erase(const void *target, size_t size) {
-  erasedBytes += size;
   assert((size & (BLOCK_SIZE - 1)) == 0);
-  memset((void *)target, 0xff, size);
+  for (size_t offset = 0; offset < size; offset += BLOCK_SIZE) {
+    uint8_t *block = (uint8_t *)target + offset;
+    if (RequiresErase(block, BLOCK_SIZE)) {
+      erasedBytes += BLOCK_SIZE;
+      memset(block, 0xff, BLOCK_SIZE);
+    }
+  }
 }
 
+// Each block is compared with its current contents. Unchanged blocks are
+// skipped, blocks that only clear bits are programmed in place, and the rest
+// are erased first, then programmed unless the data is blank.
 __attribute((weak)) void Flash::Write(const void *target, const void *data,
                                       size_t size) {
-  erasedBytes += size;
-  programmedBytes += size;
   assert(target != data);
   assert((size & (BLOCK_SIZE - 1)) == 0);
-  memcpy((void *)target, data, size);
+  for (size_t offset = 0; offset < size; offset += BLOCK_SIZE) {
+    uint8_t *block = (uint8_t *)target + offset;
+    const uint8_t *blockData = (const uint8_t *)data + offset;
+    if (!RequiresProgram(block, blockData, BLOCK_SIZE)) {
+      continue;
+    }
+
+    if (RequiresErase(block, blockData, BLOCK_SIZE)) {
+      erasedBytes += BLOCK_SIZE;
+      memset(block, 0xff, BLOCK_SIZE);
+      if (!RequiresErase(blockData, BLOCK_SIZE)) {
+        continue;
+      }
+    } else {
+      reprogrammedBytes += BLOCK_SIZE;
+    }
+    programmedBytes += BLOCK_SIZE;
+    memcpy(block, blockData, BLOCK_SIZE);
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -73,3 +98,58 @@ void Flash::PrintInfo() {
 }
 
 //---------------------------------------------------------------------------
+
+#if RUN_TESTS
+
+#include "unit_test.h"
+
+static uint8_t flashBuffer[2 * Flash::BLOCK_SIZE]
+    __attribute__((aligned(Flash::BLOCK_SIZE)));
+
+TEST_BEGIN("Flash: Write only erases and programs changed blocks") {
+  uint8_t *data = (uint8_t *)malloc(sizeof(flashBuffer));
+  memset(flashBuffer, 0, sizeof(flashBuffer));
+  Flash::Erase(flashBuffer, sizeof(flashBuffer));
+
+  uint32_t erasedBytes = Flash::erasedBytes;
+  uint32_t programmedBytes = Flash::programmedBytes;
+  uint32_t reprogrammedBytes = Flash::reprogrammedBytes;
+
+  // Erased blocks are not erased again.
+  Flash::Erase(flashBuffer, sizeof(flashBuffer));
+  assert(Flash::erasedBytes == erasedBytes);
+
+  // Clearing bits in the second block programs it without an erase.
+  memset(data, 0xff, sizeof(flashBuffer));
+  data[Flash::BLOCK_SIZE] = 0x0f;
+  Flash::Write(flashBuffer, data, sizeof(flashBuffer));
+  assert(Flash::erasedBytes == erasedBytes);
+  assert(Flash::programmedBytes - programmedBytes == Flash::BLOCK_SIZE);
+  assert(Flash::reprogrammedBytes - reprogrammedBytes == Flash::BLOCK_SIZE);
+
+  // Unchanged blocks are skipped.
+  Flash::Write(flashBuffer, data, sizeof(flashBuffer));
+  assert(Flash::programmedBytes - programmedBytes == Flash::BLOCK_SIZE);
+
+  // Setting bits erases, then programs.
+  data[Flash::BLOCK_SIZE] = 0xf0;
+  Flash::Write(flashBuffer, data, sizeof(flashBuffer));
+  assert(Flash::erasedBytes - erasedBytes == Flash::BLOCK_SIZE);
+  assert(Flash::programmedBytes - programmedBytes == 2 * Flash::BLOCK_SIZE);
+  assert(Flash::reprogrammedBytes - reprogrammedBytes == Flash::BLOCK_SIZE);
+  assert(memcmp(flashBuffer, data, sizeof(flashBuffer)) == 0);
+
+  // Blank data only needs the erase.
+  data[Flash::BLOCK_SIZE] = 0xff;
+  Flash::Write(flashBuffer, data, sizeof(flashBuffer));
+  assert(Flash::erasedBytes - erasedBytes == 2 * Flash::BLOCK_SIZE);
+  assert(Flash::programmedBytes - programmedBytes == 2 * Flash::BLOCK_SIZE);
+  assert(memcmp(flashBuffer, data, sizeof(flashBuffer)) == 0);
+
+  free(data);
+}
+TEST_END
+
+#endif
+
+//---------------------------------------------------------------------------
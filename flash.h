@@ -11,6 +11,7 @@ public:
   // Sets all bits in the region to 1.
   static void Erase(const void *target, size_t size);
 
+  // Only erases and programs the blocks that differ from data.
   static void Write(const void *target, const void *data, size_t size);
 
   static const size_t BLOCK_SIZE = 4096;
@@ -19,6 +20,8 @@ public:
 
   static uint32_t erasedBytes;
   static uint32_t programmedBytes;
+
+  // Bytes programmed without an erase first. Included in programmedBytes.
   static uint32_t reprogrammedBytes;
 
 private:
@@ -16,6 +16,14 @@ public:
     other.buffer = nullptr;
     other.count = 0;
   }
+  void operator=(_ListBase &&other) {
+    uint8_t *toFree = buffer;
+    buffer = other.buffer;
+    count = other.count;
+    other.buffer = nullptr;
+    other.count = 0;
+    free(toFree);
+  }
 
   bool IsEmpty() const { return count == 0; }
   bool IsNotEmpty() const { return count != 0; }
@@ -53,6 +61,7 @@ template <typename T> class List : public _ListBase {
 public:
   List() = default;
   List(List &&other) : _ListBase((_ListBase &&) other) {}
+  void operator=(List &&other) { _ListBase::operator=((_ListBase &&) other); }
 
   void Add(const T &v) { _ListBase::Add(&v, sizeof(T)); }
 
@@ -0,0 +1,85 @@
+//---------------------------------------------------------------------------
+
+#include "lookup_arena.h"
+#include <assert.h>
+#include <stdlib.h>
+
+//---------------------------------------------------------------------------
+
+StenoLookupArena::~StenoLookupArena() { FreeBlocks(); }
+
+char *StenoLookupArena::Allocate(size_t size) {
+  if (block == nullptr || blockOffset + size > block->size) {
+    size_t blockSize = block ? 2 * block->size : MINIMUM_BLOCK_SIZE;
+    if (blockSize < size) {
+      blockSize = size;
+    }
+    AddBlock(blockSize);
+  }
+
+  char *result = block->GetData() + blockOffset;
+  blockOffset += size;
+  usedSize += size;
+  return result;
+}
+
+void StenoLookupArena::Reset() {
+  if (block != nullptr && block->next != nullptr) {
+    size_t totalSize = 0;
+    for (Block *b = block; b; b = b->next) {
+      totalSize += b->size;
+    }
+    FreeBlocks();
+    AddBlock(totalSize);
+  }
+
+  blockOffset = 0;
+  usedSize = 0;
+}
+
+void StenoLookupArena::AddBlock(size_t size) {
+  Block *newBlock = (Block *)malloc(sizeof(Block) + size);
+  newBlock->next = block;
+  newBlock->size = size;
+  block = newBlock;
+  blockOffset = 0;
+}
+
+void StenoLookupArena::FreeBlocks() {
+  while (block) {
+    Block *next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("LookupArena: Reset merges blocks") {
+  StenoLookupArena arena;
+
+  arena.Allocate(16);
+  for (size_t i = 0; i < 200; ++i) {
+    char *p = arena.Allocate(16);
+    p[15] = (char)i;
+  }
+  assert(arena.GetUsedSize() == 201 * 16);
+
+  arena.Reset();
+  assert(arena.GetUsedSize() == 0);
+
+  // The merged block holds the previous high water mark, so allocations
+  // are contiguous.
+  char *p = arena.Allocate(16);
+  for (size_t i = 0; i < 200; ++i) {
+    char *next = arena.Allocate(16);
+    assert(next == p + 16);
+    p = next;
+  }
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,49 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// A bump allocator for text generated during a conversion, such as raw
+// stroke fallbacks, auto-suffix joins and algorithmic dictionary output.
+//
+// Allocations are never freed individually. Reset() releases everything at
+// once, and merges the blocks that were needed into a single block so that
+// subsequent conversions of a similar size do not call malloc at all.
+class StenoLookupArena {
+public:
+  StenoLookupArena() = default;
+  ~StenoLookupArena();
+
+  // Returns unaligned storage, suitable for text.
+  char *Allocate(size_t size);
+
+  // Invalidates all previous allocations.
+  void Reset();
+
+  size_t GetUsedSize() const { return usedSize; }
+
+  static const size_t MINIMUM_BLOCK_SIZE = 1024;
+
+private:
+  struct Block {
+    Block *next;
+    size_t size;
+
+    char *GetData() { return (char *)(this + 1); }
+  };
+
+  // The most recently allocated block, which allocations are made from.
+  Block *block = nullptr;
+  size_t blockOffset = 0;
+  size_t usedSize = 0;
+
+  void AddBlock(size_t size);
+  void FreeBlocks();
+
+  StenoLookupArena(const StenoLookupArena &) = delete;
+};
+
+//---------------------------------------------------------------------------
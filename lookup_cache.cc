@@ -0,0 +1,223 @@
+//---------------------------------------------------------------------------
+
+#include "lookup_cache.h"
+#include "console.h"
+#include <string.h>
+
+//---------------------------------------------------------------------------
+
+inline bool
+StenoLookupCache::Entry::Matches(const StenoDictionaryLookup &lookup) const {
+  return length == lookup.length && hash == lookup.hash &&
+         memcmp(strokes, lookup.strokes, sizeof(StenoStroke) * length) == 0;
+}
+
+inline void StenoLookupCache::Entry::Set(const StenoDictionaryLookup &lookup,
+                                          const char *text) {
+  length = (uint8_t)lookup.length;
+  hash = lookup.hash;
+  memcpy(strokes, lookup.strokes, sizeof(StenoStroke) * lookup.length);
+  this->text = text;
+}
+
+//---------------------------------------------------------------------------
+
+StenoDictionaryLookupResult
+StenoLookupCache::Lookup(const StenoDictionary &dictionary,
+                         const StenoDictionaryLookup &lookup) {
+  if (lookup.length > MAX_STROKE_COUNT) {
+    return dictionary.Lookup(lookup);
+  }
+
+  Entry &entry = entries[lookup.hash & (ENTRY_COUNT - 1)];
+  if (entry.Matches(lookup)) {
+    ++hitCount;
+    if (entry.text == nullptr) {
+      return StenoDictionaryLookupResult::CreateInvalid();
+    }
+    return StenoDictionaryLookupResult::CreateStaticString(entry.text);
+  }
+
+  ++missCount;
+  StenoDictionaryLookupResult result = dictionary.Lookup(lookup);
+  if (result.IsValid() && !result.IsStaticString()) {
+    return result;
+  }
+
+  entry.Set(lookup, result.IsValid() ? result.GetText() : nullptr);
+  return result;
+}
+
+StenoDictionaryLookupResult
+StenoLookupCache::LookupLongest(const StenoDictionary &dictionary,
+                                const StenoDictionaryPrefixLookup &lookup,
+                                size_t maximumLength, size_t &length) {
+  // Lengths are resolved from the longest down. Each run of lengths that are
+  // not in the cache goes to the dictionary in a single call.
+  size_t uncachedLength = 0;
+  for (size_t i = maximumLength; i > 0; --i) {
+    StenoDictionaryLookup lengthLookup = lookup.GetLookup(i);
+    const Entry &entry = entries[lengthLookup.hash & (ENTRY_COUNT - 1)];
+    if (i > MAX_STROKE_COUNT || !entry.Matches(lengthLookup)) {
+      ++missCount;
+      if (uncachedLength == 0) {
+        uncachedLength = i;
+      }
+      continue;
+    }
+
+    ++hitCount;
+    const char *text = entry.text;
+    if (uncachedLength != 0) {
+      StenoDictionaryLookupResult result =
+          LookupRun(dictionary, lookup, i + 1, uncachedLength, length);
+      if (result.IsValid()) {
+        return result;
+      }
+      uncachedLength = 0;
+    }
+
+    if (text != nullptr) {
+      length = i;
+      return StenoDictionaryLookupResult::CreateStaticString(text);
+    }
+  }
+
+  if (uncachedLength != 0) {
+    return LookupRun(dictionary, lookup, 1, uncachedLength, length);
+  }
+  return StenoDictionaryLookupResult::CreateInvalid();
+}
+
+StenoDictionaryLookupResult
+StenoLookupCache::LookupRun(const StenoDictionary &dictionary,
+                            const StenoDictionaryPrefixLookup &lookup,
+                            size_t minimumLength, size_t maximumLength,
+                            size_t &length) {
+  size_t resultLength = minimumLength - 1;
+  StenoDictionaryLookupResult result = dictionary.LookupLongest(
+      lookup, minimumLength, maximumLength, resultLength);
+
+  // Every length above resultLength is known to be invalid.
+  size_t lastLength =
+      maximumLength < MAX_STROKE_COUNT ? maximumLength : MAX_STROKE_COUNT;
+  for (size_t i = resultLength + 1; i <= lastLength; ++i) {
+    StenoDictionaryLookup lengthLookup = lookup.GetLookup(i);
+    entries[lengthLookup.hash & (ENTRY_COUNT - 1)].Set(lengthLookup, nullptr);
+  }
+
+  if (!result.IsValid()) {
+    return result;
+  }
+
+  if (result.IsStaticString() && resultLength <= MAX_STROKE_COUNT) {
+    StenoDictionaryLookup lengthLookup = lookup.GetLookup(resultLength);
+    entries[lengthLookup.hash & (ENTRY_COUNT - 1)].Set(lengthLookup,
+                                                       result.GetText());
+  }
+  length = resultLength;
+  return result;
+}
+
+void StenoLookupCache::Invalidate() {
+  for (Entry &entry : entries) {
+    entry.length = 0;
+  }
+}
+
+void StenoLookupCache::PrintInfo() const {
+  uint32_t lookupCount = hitCount + missCount;
+  Console::Printf("    Lookup cache: %u/%u hits", hitCount, lookupCount);
+  if (lookupCount != 0) {
+    Console::Printf(" (%u%%)",
+                    uint32_t(uint64_t(hitCount) * 100 / lookupCount));
+  }
+  Console::Printf("\n");
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#include "dictionary/main_dictionary.h"
+#include "dictionary/map_dictionary.h"
+#include "str.h"
+#include "unit_test.h"
+
+constexpr StenoMapDictionary mainDictionary(MainDictionary::definition);
+
+TEST_BEGIN("LookupCache: Repeated lookups hit the cache") {
+  StenoLookupCache *cache = new StenoLookupCache;
+
+  // spellchecker: disable
+  const StenoStroke strokes[2] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+  };
+  // spellchecker: enable
+
+  for (size_t i = 0; i < 2; ++i) {
+    StenoDictionaryLookupResult lookup =
+        cache->Lookup(mainDictionary, StenoDictionaryLookup(strokes, 2));
+    assert(lookup.IsValid());
+    assert(Str::Eq(lookup.GetText(), "tested"));
+    lookup.Destroy();
+
+    lookup = cache->Lookup(mainDictionary, StenoDictionaryLookup(strokes, 1));
+    assert(lookup.IsValid());
+    assert(Str::Eq(lookup.GetText(), "test"));
+    lookup.Destroy();
+
+    lookup =
+        cache->Lookup(mainDictionary, StenoDictionaryLookup(strokes + 1, 1));
+    assert(!lookup.IsValid());
+  }
+  assert(cache->missCount == 3);
+  assert(cache->hitCount == 3);
+
+  cache->Invalidate();
+  StenoDictionaryLookupResult lookup =
+      cache->Lookup(mainDictionary, StenoDictionaryLookup(strokes, 1));
+  assert(Str::Eq(lookup.GetText(), "test"));
+  assert(cache->missCount == 4);
+
+  delete cache;
+}
+TEST_END
+
+TEST_BEGIN("LookupCache: LookupLongest caches every length it resolves") {
+  StenoLookupCache *cache = new StenoLookupCache;
+
+  // spellchecker: disable
+  const StenoStroke strokes[3] = {
+      StenoStroke("TEFT"),
+      StenoStroke("-D"),
+      StenoStroke("-D"),
+  };
+  // spellchecker: enable
+
+  StenoDictionaryPrefixLookup prefixLookup(strokes, 3);
+  for (size_t i = 0; i < 2; ++i) {
+    size_t length = 0;
+    StenoDictionaryLookupResult lookup =
+        cache->LookupLongest(mainDictionary, prefixLookup, 3, length);
+    assert(lookup.IsValid());
+    assert(length == 2);
+    assert(Str::Eq(lookup.GetText(), "tested"));
+    lookup.Destroy();
+  }
+
+  // The first call misses every length, and caches lengths 3 and 2. The
+  // second finds both in the cache.
+  assert(cache->missCount == 3);
+  assert(cache->hitCount == 2);
+
+  StenoDictionaryLookupResult lookup =
+      cache->Lookup(mainDictionary, StenoDictionaryLookup(strokes, 3));
+  assert(!lookup.IsValid());
+  assert(cache->hitCount == 3);
+
+  delete cache;
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,73 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "dictionary/dictionary.h"
+#include "stroke.h"
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// Memoizes dictionary lookups across strokes.
+//
+// Every stroke re-segments the conversion window, which repeats the same
+// (strokes, length) lookups that were made on previous strokes. The cache
+// is direct mapped by the lookup hash, and stores whether the lookup was
+// valid, along with the text if it is a static string.
+//
+// Dynamic strings are owned by their segments and are never cached -- those
+// lookups always go through to the dictionary.
+//
+// The cache must be invalidated whenever the dictionary contents change.
+class StenoLookupCache {
+public:
+  StenoLookupCache() { Invalidate(); }
+
+  StenoDictionaryLookupResult Lookup(const StenoDictionary &dictionary,
+                                     const StenoDictionaryLookup &lookup);
+
+  // As StenoDictionary::LookupLongest. Lengths that are cached are resolved
+  // first, and the remainder go to the dictionary in a single call.
+  StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionary &dictionary,
+                const StenoDictionaryPrefixLookup &lookup, size_t maximumLength,
+                size_t &length);
+
+  void Invalidate();
+  void ResetStatistics() {
+    hitCount = 0;
+    missCount = 0;
+  }
+
+  void PrintInfo() const;
+
+  static const size_t ENTRY_COUNT = 256;
+  static const size_t MAX_STROKE_COUNT = 8;
+
+  uint32_t hitCount = 0;
+  uint32_t missCount = 0;
+
+private:
+  struct Entry {
+    // Zero indicates an empty entry.
+    uint8_t length;
+    uint32_t hash;
+    StenoStroke strokes[MAX_STROKE_COUNT];
+
+    // nullptr for invalid lookups.
+    const char *text;
+
+    bool Matches(const StenoDictionaryLookup &lookup) const;
+    void Set(const StenoDictionaryLookup &lookup, const char *text);
+  };
+
+  Entry entries[ENTRY_COUNT];
+
+  // Looks up a run of lengths that are not in the cache, and caches the
+  // lengths that are resolved.
+  StenoDictionaryLookupResult
+  LookupRun(const StenoDictionary &dictionary,
+            const StenoDictionaryPrefixLookup &lookup, size_t minimumLength,
+            size_t maximumLength, size_t &length);
+};
+
+//---------------------------------------------------------------------------
@@ -338,16 +338,21 @@ char *Pattern::Replace(char *text, const char *templ) const {
 //---------------------------------------------------------------------------
 
 char *PatternMatch::Replace(const char *s) const {
+  char buffer[MAX_REPLACEMENT_SIZE];
+  size_t length = Replace(buffer, s);
+  return Str::DupN(buffer, length);
+}
+
+size_t PatternMatch::Replace(char *buffer, const char *s) const {
   assert(match);
 
-  char *buffer = (char *)malloc(256);
   char *d = buffer;
   for (;;) {
     switch (*s) {
     case '\0':
-      *d++ = '\0';
-      assert(d <= buffer + 256);
-      return (char *)realloc(buffer, d - buffer);
+      *d = '\0';
+      assert(d < buffer + MAX_REPLACEMENT_SIZE);
+      return d - buffer;
 
     case '\\': {
       ++s;
@@ -14,8 +14,14 @@ struct PatternMatch {
   bool match;
   const char *captures[8];
 
+  static const size_t MAX_REPLACEMENT_SIZE = 256;
+
   char *Replace(const char *s) const;
 
+  // buffer must have MAX_REPLACEMENT_SIZE bytes capacity.
+  // Returns the length of the replacement.
+  size_t Replace(char *buffer, const char *s) const;
+
   friend class Pattern;
 };
 
@@ -17,35 +17,29 @@ StenoSegmentList::~StenoSegmentList() {
   }
 }
 
-//---------------------------------------------------------------------------
-
-class StenoSegmentListTokenizer final : public StenoTokenizer {
-public:
-  StenoSegmentListTokenizer(const StenoSegmentList &list) : list(list) {
-    if (list.IsEmpty()) {
-      p = elementText = nullptr;
-    } else {
-      p = "";
-      PrepareNextP();
-    }
+void StenoSegmentList::operator=(StenoSegmentList &&other) {
+  for (size_t i = 0; i < count; ++i) {
+    (*this)[i].lookup.Destroy();
   }
-  virtual ~StenoSegmentListTokenizer() { free(scratch); }
-
-  bool HasMore() const final { return p != nullptr; }
-
-  StenoToken GetNext() final;
+  List::operator=((List<StenoSegment> &&)other);
+}
 
-private:
-  const StenoSegmentList &list;
-  size_t elementIndex = 0;
-  const char *elementText;
-  const char *p;
-  const StenoState *nextState = nullptr;
+//---------------------------------------------------------------------------
 
-  char *scratch = nullptr;
+StenoSegmentListTokenizer::StenoSegmentListTokenizer(
+    const StenoSegmentList &list)
+    : StenoSegmentListTokenizer(list.GetData(), list.GetCount()) {}
 
-  void PrepareNextP();
-};
+StenoSegmentListTokenizer::StenoSegmentListTokenizer(
+    const StenoSegment *segments, size_t count)
+    : segments(segments), segmentCount(count) {
+  if (count == 0) {
+    p = nullptr;
+  } else {
+    p = "";
+    PrepareNextP();
+  }
+}
 
 StenoToken StenoSegmentListTokenizer::GetNext() {
   const StenoState *state = nextState;
@@ -60,7 +54,7 @@ StenoToken StenoSegmentListTokenizer::GetNext() {
     if (*p == '\0') {
       // Unterminated command... drop it.
       PrepareNextP();
-      return StenoToken("{}", state);
+      return StenoToken("{}", 2, state);
     }
     ++p;
   } else {
@@ -73,11 +67,11 @@ StenoToken StenoSegmentListTokenizer::GetNext() {
 
       case '\\':
         if (p[1] == '\0') {
-          free(scratch);
-          scratch = Str::DupN(start, p - start);
+          // Drop the trailing backslash.
+          StenoToken token(start, p - start, state);
           ++p;
           PrepareNextP();
-          return StenoToken(scratch, state);
+          return token;
         }
         p += 2;
         break;
@@ -89,14 +83,9 @@ StenoToken StenoSegmentListTokenizer::GetNext() {
   }
 
 ReturnSpan:
-  const char *result = elementText;
-  if (start != elementText || *p != '\0') {
-    free(scratch);
-    result = scratch = Str::DupN(start, p - start);
-  }
-
+  StenoToken token(start, p - start, state);
   PrepareNextP();
-  return StenoToken(result, state);
+  return token;
 }
 
 void StenoSegmentListTokenizer::PrepareNextP() {
@@ -107,21 +96,17 @@ void StenoSegmentListTokenizer::PrepareNextP() {
     if (*p != '\0') {
       return;
     }
-    if (elementIndex == list.GetCount()) {
-      p = elementText = nullptr;
+    if (segmentIndex == segmentCount) {
+      p = nullptr;
       return;
     }
 
-    const StenoSegment &segment = list[elementIndex++];
-    p = elementText = segment.lookup.GetText();
+    const StenoSegment &segment = segments[segmentIndex++];
+    p = segment.lookup.GetText();
     nextState = segment.state;
   }
 }
 
-StenoTokenizer *StenoSegmentList::CreateTokenizer() {
-  return new StenoSegmentListTokenizer(*this);
-}
-
 //---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 
@@ -146,16 +131,40 @@ TEST_BEGIN("Segment tests") {
       StenoOrthography::emptyOrthography);
   BuildSegmentContext context(segmentList, dictionary, compiledOrthography);
 
-  history.CreateSegments(context);
+  StenoStrokeHistoryWindow window(history.GetView());
+  window.CreateSegments(context);
 
-  StenoTokenizer *tokenizer = segmentList.CreateTokenizer();
+  StenoSegmentListTokenizer tokenizer(segmentList);
 
-  assert(tokenizer->HasMore());
-  assert(Str::Eq(tokenizer->GetNext().text, "test"));
-  assert(tokenizer->HasMore());
-  assert(Str::Eq(tokenizer->GetNext().text, "{^ing}"));
-  assert(!tokenizer->HasMore());
-  delete tokenizer;
+  assert(tokenizer.HasMore());
+  StenoToken token = tokenizer.GetNext();
+  assert(token.length == 4 && memcmp(token.text, "test", 4) == 0);
+  assert(tokenizer.HasMore());
+  token = tokenizer.GetNext();
+  assert(token.length == 6 && memcmp(token.text, "{^ing}", 6) == 0);
+  assert(!tokenizer.HasMore());
+}
+TEST_END
+
+TEST_BEGIN("Segment: Tokens are spans of the segment text") {
+  StenoState state;
+  StenoSegment segments[] = {
+      StenoSegment(1, &state,
+                   StenoDictionaryLookupResult::CreateStaticString(
+                       "a{-|}b  c\\")),
+      StenoSegment(1, nullptr,
+                   StenoDictionaryLookupResult::CreateStaticString("{^")),
+  };
+
+  StenoSegmentListTokenizer tokenizer(segments, 2);
+  static const char *const EXPECTED[] = {"a", "{-|}", "b", "c", "{}"};
+  for (const char *expected : EXPECTED) {
+    assert(tokenizer.HasMore());
+    StenoToken token = tokenizer.GetNext();
+    assert(token.length == strlen(expected));
+    assert(memcmp(token.text, expected, token.length) == 0);
+  }
+  assert(!tokenizer.HasMore());
 }
 TEST_END
 
@@ -31,22 +31,39 @@ struct StenoSegment {
 
 //---------------------------------------------------------------------------
 
+// A span of segment text. It is not null terminated.
 struct StenoToken {
-  StenoToken(const char *text, const StenoState *state)
-      : text(text), state(state) {}
+  StenoToken(const char *text, size_t length, const StenoState *state)
+      : text(text), length(length), state(state) {}
 
   const char *text;
+  size_t length;
 
   // This can be null -- meaning that the state should be inferred.
   const StenoState *state;
 };
 
-class StenoTokenizer {
+class StenoSegmentList;
+
+// Splits the text of a run of segments into tokens. Tokens reference the
+// segment text directly, so the tokenizer does not allocate, and the
+// segments must outlive it.
+class StenoSegmentListTokenizer {
 public:
-  virtual ~StenoTokenizer() {}
+  StenoSegmentListTokenizer(const StenoSegmentList &list);
+  StenoSegmentListTokenizer(const StenoSegment *segments, size_t count);
+
+  bool HasMore() const { return p != nullptr; }
+  StenoToken GetNext();
+
+private:
+  const StenoSegment *segments;
+  size_t segmentCount;
+  size_t segmentIndex = 0;
+  const char *p;
+  const StenoState *nextState = nullptr;
 
-  virtual bool HasMore() const = 0;
-  virtual StenoToken GetNext() = 0;
+  void PrepareNextP();
 };
 
 //---------------------------------------------------------------------------
@@ -58,7 +75,7 @@ public:
       : List((List<StenoSegment> &&) other) {}
   ~StenoSegmentList();
 
-  StenoTokenizer *CreateTokenizer();
+  void operator=(StenoSegmentList &&other);
 };
 
 //---------------------------------------------------------------------------
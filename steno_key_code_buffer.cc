@@ -16,37 +16,106 @@ void StenoKeyCodeBuffer::Reset() {
   addTranslationCount = 0;
   resetStateCount = 0;
   state.Reset();
+  checkpointCount = 0;
 }
 
-void StenoKeyCodeBuffer::Populate(StenoTokenizer *tokenizer) {
+void StenoKeyCodeBuffer::operator=(const StenoKeyCodeBuffer &o) {
+  orthography = o.orthography;
+  rootDictionary = o.rootDictionary;
+  count = o.count;
+  addTranslationCount = o.addTranslationCount;
+  resetStateCount = o.resetStateCount;
+  state = o.state;
+  memcpy(buffer, o.buffer, sizeof(StenoKeyCode) * count);
+  checkpointCount = 0;
+}
+
+void StenoKeyCodeBuffer::Populate(StenoSegmentListTokenizer &tokenizer) {
   Reset();
   Append(tokenizer);
 }
 
-void StenoKeyCodeBuffer::Append(StenoTokenizer *tokenizer) {
-  while (tokenizer->HasMore()) {
-    StenoToken token = tokenizer->GetNext();
+void StenoKeyCodeBuffer::Populate(const StenoSegmentList &segmentList,
+                                  size_t unchangedSegmentCount) {
+  size_t segmentCount = segmentList.GetCount();
+  size_t segmentIndex = RestoreCheckpoint(unchangedSegmentCount);
+  reusedSegmentCount = segmentIndex;
+
+  for (; segmentIndex < segmentCount; ++segmentIndex) {
+    lowestModifiedIndex = SIZE_MAX;
+    StenoSegmentListTokenizer tokenizer(&segmentList[segmentIndex], 1);
+    Append(tokenizer);
+
+    if (segmentIndex < MAX_CHECKPOINT_COUNT) {
+      Checkpoint &checkpoint = checkpoints[segmentIndex];
+      checkpoint.count = count;
+      checkpoint.addTranslationCount = addTranslationCount;
+      checkpoint.resetStateCount = resetStateCount;
+      checkpoint.state = state;
+      checkpoint.lowestModifiedIndex = lowestModifiedIndex;
+    }
+  }
+
+  // Segments without checkpoints could have modified any of the output.
+  checkpointCount = segmentCount <= MAX_CHECKPOINT_COUNT ? segmentCount : 0;
+}
+
+size_t StenoKeyCodeBuffer::RestoreCheckpoint(size_t unchangedSegmentCount) {
+  if (unchangedSegmentCount > checkpointCount) {
+    unchangedSegmentCount = checkpointCount;
+  }
+
+  // A checkpoint can only be restored if no later segment of the last run
+  // modified the output before it.
+  size_t laterModifiedIndex = SIZE_MAX;
+  for (size_t i = unchangedSegmentCount; i < checkpointCount; ++i) {
+    if (checkpoints[i].lowestModifiedIndex < laterModifiedIndex) {
+      laterModifiedIndex = checkpoints[i].lowestModifiedIndex;
+    }
+  }
+
+  for (size_t i = unchangedSegmentCount; i > 0; --i) {
+    const Checkpoint &checkpoint = checkpoints[i - 1];
+    if (checkpoint.count <= laterModifiedIndex) {
+      count = checkpoint.count;
+      addTranslationCount = checkpoint.addTranslationCount;
+      resetStateCount = checkpoint.resetStateCount;
+      state = checkpoint.state;
+      return i;
+    }
+    if (checkpoint.lowestModifiedIndex < laterModifiedIndex) {
+      laterModifiedIndex = checkpoint.lowestModifiedIndex;
+    }
+  }
+
+  Reset();
+  return 0;
+}
+
+void StenoKeyCodeBuffer::Append(StenoSegmentListTokenizer &tokenizer) {
+  while (tokenizer.HasMore()) {
+    StenoToken token = tokenizer.GetNext();
     if (token.state != nullptr) {
       state = *token.state;
     }
     if (token.text[0] == '{') {
-      ProcessCommand(token.text);
+      ProcessCommand(token.text, token.length);
     } else {
-      ProcessText(token.text);
+      ProcessText(token.text, token.length);
     }
   }
 }
 
 //---------------------------------------------------------------------------
 
-void StenoKeyCodeBuffer::ProcessText(const char *text) {
-  bool isAutoGlue = IsGlue(text);
+void StenoKeyCodeBuffer::ProcessText(const char *text, size_t length) {
+  bool isAutoGlue = IsGlue(text, length);
   if (!state.joinNext && !(isAutoGlue && state.isGlue)) {
     AppendText(state.spaceCharacter, state.spaceCharacterLength,
                StenoCaseMode::NORMAL);
   }
 
-  AppendText(text, strlen(text), state.caseMode);
+  AppendText(text, length, state.caseMode);
   state.joinNext = false;
   state.isGlue = isAutoGlue;
   state.isManualStateChange = false;
@@ -114,21 +183,20 @@ void StenoKeyCodeBuffer::AppendTextNoCaseModeOverride(const char *p, size_t n,
   }
 }
 
-bool StenoKeyCodeBuffer::IsGlue(const char *p) {
+bool StenoKeyCodeBuffer::IsGlue(const char *p, size_t length) {
   // Pure digits are considered glue.
-  while (*p) {
-    if (!IsAsciiDigit(*p)) {
+  for (size_t i = 0; i < length; ++i) {
+    if (!IsAsciiDigit(p[i])) {
       return false;
     }
-    ++p;
   }
   return true;
 }
 
 //---------------------------------------------------------------------------
 
-void StenoKeyCodeBuffer::ProcessCommand(const char *p) {
-  const char *end = p + strlen(p);
+void StenoKeyCodeBuffer::ProcessCommand(const char *p, size_t length) {
+  const char *end = p + length;
 
   assert(*p == '{');
   assert(end[-1] == '}');
@@ -344,6 +412,7 @@ void StenoKeyCodeBuffer::ProcessOrthographicSuffix(const char *text,
 
   char *word = orthography->AddSuffix(orthographicScratchPad, suffix);
 
+  MarkModified(start);
   count = start;
 
   char *pWord = word;
@@ -517,4 +586,67 @@ TEST_BEGIN("StenoKeyCodeBuffer tests") {
 }
 TEST_END
 
+static void PopulateSegments(StenoKeyCodeBuffer &buffer,
+                             const char *const *texts, size_t count,
+                             const StenoState *states,
+                             size_t unchangedSegmentCount) {
+  StenoSegmentList segmentList;
+  for (size_t i = 0; i < count; ++i) {
+    StenoDictionaryLookupResult lookup =
+        StenoDictionaryLookupResult::CreateStaticString(texts[i]);
+    segmentList.Add(StenoSegment(1, &states[i], lookup));
+  }
+  buffer.Populate(segmentList, unchangedSegmentCount);
+}
+
+static void VerifyEqual(const StenoKeyCodeBuffer &a,
+                        const StenoKeyCodeBuffer &b) {
+  assert(a.count == b.count);
+  for (size_t i = 0; i < a.count; ++i) {
+    assert(a.buffer[i] == b.buffer[i]);
+  }
+}
+
+TEST_BEGIN("StenoKeyCodeBuffer: Populate resumes from checkpoints") {
+  StenoCompiledOrthography orthography(StenoOrthography::emptyOrthography);
+  StenoKeyCodeBuffer *buffer = new StenoKeyCodeBuffer();
+  StenoKeyCodeBuffer *expected = new StenoKeyCodeBuffer();
+  buffer->orthography = &orthography;
+  expected->orthography = &orthography;
+
+  StenoState states[5];
+  for (StenoState &state : states) {
+    state.Reset();
+  }
+
+  static const char *const FIRST[] = {"test", "{^ing}", "hello", "{*-|}",
+                                      "world"};
+  static const char *const SECOND[] = {"test", "{^ing}", "hello", "{*-|}",
+                                       "there"};
+  static const char *const THIRD[] = {"test", "{^ing}", "hello", "again"};
+
+  PopulateSegments(*buffer, FIRST, 5, states, 0);
+  PopulateSegments(*buffer, SECOND, 5, states, 4);
+  PopulateSegments(*expected, SECOND, 5, states, 0);
+  assert(buffer->GetReusedSegmentCount() == 4);
+  VerifyEqual(*buffer, *expected);
+
+  // The retroactive capitalization rewrote the output of earlier segments,
+  // so none of it can be reused.
+  PopulateSegments(*buffer, THIRD, 4, states, 3);
+  PopulateSegments(*expected, THIRD, 4, states, 0);
+  assert(buffer->GetReusedSegmentCount() == 0);
+  VerifyEqual(*buffer, *expected);
+
+  // The last run only appended after the unchanged segments.
+  PopulateSegments(*buffer, SECOND, 4, states, 3);
+  PopulateSegments(*expected, SECOND, 4, states, 0);
+  assert(buffer->GetReusedSegmentCount() == 3);
+  VerifyEqual(*buffer, *expected);
+
+  delete expected;
+  delete buffer;
+}
+TEST_END
+
 //---------------------------------------------------------------------------
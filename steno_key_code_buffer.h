@@ -1,6 +1,7 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "dictionary/dictionary.h"
@@ -23,10 +24,25 @@ class StenoCompiledOrthography;
 // applied directly on them.
 class StenoKeyCodeBuffer {
 public:
-  void Populate(StenoTokenizer *tokenizer);
-  void Append(StenoTokenizer *tokenizer);
+  void Populate(StenoSegmentListTokenizer &tokenizer);
+  void Append(StenoSegmentListTokenizer &tokenizer);
+
+  // Populates the buffer from segmentList, recording a checkpoint after each
+  // segment.
+  //
+  // If the buffer was last populated by this method, the first
+  // unchangedSegmentCount segments must be equal to those of that run. Their
+  // output is then reused, rather than processed again, unless a later
+  // segment of the last run modified it.
+  void Populate(const StenoSegmentList &segmentList,
+                size_t unchangedSegmentCount = 0);
+
+  // Returns the number of segments whose output was reused by the last
+  // Populate().
+  size_t GetReusedSegmentCount() const { return reusedSegmentCount; }
 
   static const size_t BUFFER_SIZE = 2048;
+  static const size_t MAX_CHECKPOINT_COUNT = 64;
 
   const StenoCompiledOrthography *orthography;
   StenoDictionary *rootDictionary;
@@ -39,8 +55,8 @@ public:
 
   void Reset();
 
-  void ProcessText(const char *text);
-  void ProcessCommand(const char *command);
+  void ProcessText(const char *text, size_t length);
+  void ProcessCommand(const char *command, size_t length);
   void ProcessOrthographicSuffix(const char *text, size_t length);
 
   void AppendText(const char *p, size_t n, StenoCaseMode outputCaseMode);
@@ -50,7 +66,7 @@ public:
   char *ToString();
   char *ToUnresolvedString();
 
-  static bool IsGlue(const char *p);
+  static bool IsGlue(const char *p, size_t length);
 
   bool ProcessKeyPresses(const char *p, const char *end);
 
@@ -86,6 +102,35 @@ public:
   void operator=(const StenoKeyCodeBuffer &o);
 
 private:
+  struct Checkpoint {
+    size_t count;
+    size_t addTranslationCount;
+    size_t resetStateCount;
+    StenoState state;
+
+    // The lowest index of buffer that was rewritten while processing the
+    // segment, or SIZE_MAX if the segment only appended.
+    size_t lowestModifiedIndex;
+  };
+
+  size_t checkpointCount = 0;
+  size_t reusedSegmentCount = 0;
+  size_t lowestModifiedIndex = SIZE_MAX;
+  Checkpoint checkpoints[MAX_CHECKPOINT_COUNT];
+
+  // Called before buffer entries below count are rewritten, or count is
+  // reduced.
+  void MarkModified(size_t index) {
+    if (index < lowestModifiedIndex) {
+      lowestModifiedIndex = index;
+    }
+  }
+
+  // Restores the latest usable checkpoint within the first
+  // unchangedSegmentCount segments, and returns the number of segments it
+  // covers.
+  size_t RestoreCheckpoint(size_t unchangedSegmentCount);
+
   static void Reverse(StenoKeyCode *start, StenoKeyCode *end);
 };
 
@@ -73,6 +73,7 @@ void StenoKeyCodeBuffer::Backspace(int backspaceCount) {
     }
   }
 
+  MarkModified(d - buffer);
   StenoKeyCode *s = d;
   while (s < pEnd) {
     if (s->IsRawKeyCode() || backspaceCount == 0) {
@@ -86,6 +87,8 @@ void StenoKeyCodeBuffer::Backspace(int backspaceCount) {
 }
 
 void StenoKeyCodeBuffer::RetroactiveCapitalize(int wordCount) {
+  // Retroactive functions reach back an arbitrary number of words.
+  MarkModified(0);
   if (count == 0) {
     return;
   }
@@ -126,6 +129,7 @@ epilog:
 }
 
 void StenoKeyCodeBuffer::RetroactiveUncapitalize(int wordCount) {
+  MarkModified(0);
   StenoKeyCode *p = buffer + count - 1;
   while (wordCount > 0) {
     for (;;) {
@@ -158,6 +162,7 @@ void StenoKeyCodeBuffer::RetroactiveUncapitalize(int wordCount) {
 }
 
 void StenoKeyCodeBuffer::RetroactiveTitleCase(int wordCount) {
+  MarkModified(0);
   StenoKeyCode *p = buffer + count - 1;
   while (wordCount > 0) {
     for (;;) {
@@ -191,6 +196,7 @@ void StenoKeyCodeBuffer::RetroactiveTitleCase(int wordCount) {
 }
 
 void StenoKeyCodeBuffer::RetroactiveUpperCase(int wordCount) {
+  MarkModified(0);
   StenoKeyCode *p = buffer + count - 1;
   while (wordCount > 0) {
     for (;;) {
@@ -220,6 +226,7 @@ void StenoKeyCodeBuffer::RetroactiveUpperCase(int wordCount) {
 }
 
 void StenoKeyCodeBuffer::RetroactiveLowerCase(int wordCount) {
+  MarkModified(0);
   StenoKeyCode *p = buffer + count - 1;
   while (wordCount > 0) {
     for (;;) {
@@ -251,6 +258,7 @@ void StenoKeyCodeBuffer::RetroactiveLowerCase(int wordCount) {
 void StenoKeyCodeBuffer::RetroactiveQuotes(int wordCount,
                                            const char *startQuote,
                                            const char *endQuote) {
+  MarkModified(0);
   if (count == 0) {
     return;
   }
@@ -301,6 +309,7 @@ void StenoKeyCodeBuffer::RetroactiveDeleteSpace() {
   StenoKeyCode *p = end - 1;
   while (p >= buffer) {
     if (p->IsWhitespace()) {
+      MarkModified(p - buffer);
       count--;
       memmove(p, p + 1, sizeof(StenoKeyCode) * (end - p - 1));
       return;
@@ -88,8 +88,9 @@ bool Str::HasPrefix(const char *p, const char *prefix) {
   return strncmp(prefix, p, strlen(prefix)) == 0;
 }
 
-char *Str::WriteJson(char *p, const char *text) {
-  while (*text) {
+char *Str::WriteJson(char *p, const char *text, size_t length) {
+  const char *end = text + length;
+  while (text < end) {
     switch (*text) {
     case '\f':
       *p++ = '\\';
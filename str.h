@@ -30,7 +30,10 @@ public:
 
   // Returns the end of the write area. p must have enough space to store
   // the result;
-  static char *WriteJson(char *p, const char *text);
+  static char *WriteJson(char *p, const char *text) {
+    return WriteJson(p, text, strlen(text));
+  }
+  static char *WriteJson(char *p, const char *text, size_t length);
 };
 
 //---------------------------------------------------------------------------
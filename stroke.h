@@ -74,7 +74,7 @@ class StenoStroke {
 public:
   constexpr StenoStroke(uint32_t keyState = 0) : keyState(keyState) {}
 
-  // Only for use in tests.
+  // Only for use on hosts: tests, benchmarks and the dictionary compiler.
   void Set(const char *string);
   template <size_t N> StenoStroke(const char (&s)[N]) { Set(s); }
 
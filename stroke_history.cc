@@ -2,30 +2,62 @@
 
 #include "stroke_history.h"
 #include "dictionary/dictionary.h"
+#include "lookup_cache.h"
 #include "orthography.h"
 #include "segment.h"
-#include "str.h"
 
 //---------------------------------------------------------------------------
 
 BuildSegmentContext::BuildSegmentContext(
     StenoSegmentList &segmentList, const StenoDictionary &dictionary,
-    const StenoCompiledOrthography &orthography)
+    const StenoCompiledOrthography &orthography,
+    StenoLookupCache *lookupCache)
     : segmentList(segmentList), dictionary(dictionary),
       maximumOutlineLength(dictionary.GetMaximumOutlineLength()),
-      orthography(orthography) {}
+      orthography(orthography), lookupCache(lookupCache) {}
+
+StenoDictionaryLookupResult
+BuildSegmentContext::Lookup(const StenoStroke *strokes, size_t length,
+                            uint32_t hash) {
+  StenoEnginePhase previousPhase = StenoEnginePhase::OTHER;
+  if (phaseStats) {
+    previousPhase = phaseStats->Enter(StenoEnginePhase::LOOKUP);
+  }
 
-//---------------------------------------------------------------------------
+  StenoDictionaryLookup lookup(strokes, length, hash);
+  lookup.arena = arena;
+  StenoDictionaryLookupResult result =
+      lookupCache ? lookupCache->Lookup(dictionary, lookup)
+                  : dictionary.Lookup(lookup);
 
-void StenoStrokeHistory::Shift() {
-  if (count == 0) {
-    return;
+  if (phaseStats) {
+    phaseStats->Enter(previousPhase);
   }
-  --count;
-  memmove(strokes, strokes + 1, count * sizeof(StenoStroke));
-  memmove(states, states + 1, count * sizeof(StenoState));
+  return result;
 }
 
+StenoDictionaryLookupResult
+BuildSegmentContext::LookupLongest(const StenoDictionaryPrefixLookup &lookup,
+                                   size_t maximumLength, size_t &length) {
+  StenoEnginePhase previousPhase = StenoEnginePhase::OTHER;
+  if (phaseStats) {
+    previousPhase = phaseStats->Enter(StenoEnginePhase::LOOKUP);
+  }
+
+  StenoDictionaryLookupResult result =
+      lookupCache
+          ? lookupCache->LookupLongest(dictionary, lookup, maximumLength,
+                                       length)
+          : dictionary.LookupLongest(lookup, 1, maximumLength, length);
+
+  if (phaseStats) {
+    phaseStats->Enter(previousPhase);
+  }
+  return result;
+}
+
+//---------------------------------------------------------------------------
+
 size_t StenoStrokeHistory::GetUndoCount(size_t maxCount) const {
   if (count == 0) {
     return 0;
@@ -33,30 +65,96 @@ size_t StenoStrokeHistory::GetUndoCount(size_t maxCount) const {
 
   size_t result = 1;
   while (result < maxCount && result < count &&
-         states[count - result].shouldCombineUndo) {
+         states[start + count - result].shouldCombineUndo) {
     ++result;
   }
   return result;
 }
 
-void StenoStrokeHistory::TransferFrom(const StenoStrokeHistory &source,
-                                      size_t sourceStrokeCount,
-                                      size_t maxCount) {
-  size_t offset =
-      sourceStrokeCount <= maxCount ? 0 : sourceStrokeCount - maxCount;
-  count = sourceStrokeCount - offset;
+StenoStrokeHistoryView StenoStrokeHistory::GetView(size_t endIndex,
+                                                   size_t maxCount) const {
+  assert(endIndex <= count);
+  size_t offset = endIndex <= maxCount ? 0 : endIndex - maxCount;
+  size_t index = GetIndex(offset);
+  return StenoStrokeHistoryView{
+      .strokes = strokes + index,
+      .states = states + index,
+      .count = endIndex - offset,
+  };
+}
+
+//---------------------------------------------------------------------------
 
-  memcpy(strokes, source.strokes + offset, count * sizeof(StenoStroke));
-  memcpy(states, source.states + offset, count * sizeof(StenoState));
+StenoStrokeHistoryWindow::~StenoStrokeHistoryWindow() {
+  free(privateStrokes);
+  free(privateStates);
 }
 
-void StenoStrokeHistory::CreateSegments(BuildSegmentContext &context,
-                                        size_t minimumStartOffset) {
+void StenoStrokeHistoryWindow::SetView(const StenoStrokeHistoryView &view) {
+  strokes = view.strokes;
+  states = view.states;
+  count = view.count;
+  isPrivateCopy = false;
+}
+
+void StenoStrokeHistoryWindow::MakePrivateCopy(BuildSegmentContext &context) {
+  if (isPrivateCopy) {
+    return;
+  }
+
+  // Retroactive commands remove at least one stroke before inserting one,
+  // so one spare entry is always sufficient.
+  if (privateCapacity < count + 1) {
+    free(privateStrokes);
+    free(privateStates);
+    privateCapacity = count + 1;
+    privateStrokes =
+        (StenoStroke *)malloc(sizeof(StenoStroke) * privateCapacity);
+    privateStates = (StenoState *)malloc(sizeof(StenoState) * privateCapacity);
+  }
+
+  memcpy(privateStrokes, strokes, sizeof(StenoStroke) * count);
+  memcpy(privateStates, states, sizeof(StenoState) * count);
+
+  for (size_t i = 0; i < context.segmentList.GetCount(); ++i) {
+    StenoSegment &segment = context.segmentList[i];
+    if (states <= segment.state && segment.state < states + count) {
+      segment.state = privateStates + (segment.state - states);
+    }
+  }
+
+  strokes = privateStrokes;
+  states = privateStates;
+  isPrivateCopy = true;
+}
+
+void StenoStrokeHistoryWindow::CreateSegments(BuildSegmentContext &context,
+                                              size_t minimumStartOffset) {
   AddSegments(context, minimumStartOffset);
 }
 
-void StenoStrokeHistory::AddSegments(BuildSegmentContext &context,
-                                     size_t offset) {
+size_t StenoStrokeHistoryWindow::GetStableSegmentCount(
+    const BuildSegmentContext &context) const {
+  // Retroactive commands rewrite strokes and reevaluate earlier segments, so
+  // none of the segments can be relied upon.
+  if (context.hasRetroactiveEdit) {
+    return 0;
+  }
+
+  size_t result = 0;
+  while (result < context.segmentList.GetCount()) {
+    const StenoSegment &segment = context.segmentList[result];
+    size_t endOffset = segment.state - states + segment.strokeLength;
+    if (endOffset + context.maximumOutlineLength > count) {
+      break;
+    }
+    ++result;
+  }
+  return result;
+}
+
+void StenoStrokeHistoryWindow::AddSegments(BuildSegmentContext &context,
+                                           size_t offset) {
   char buffer[32];
 
   while (offset < count) {
@@ -68,73 +166,82 @@ void StenoStrokeHistory::AddSegments(BuildSegmentContext &context,
     }
 
     strokes[offset].ToString(buffer);
-    context.segmentList.Add(StenoSegment(
-        1, states + offset,
-        StenoDictionaryLookupResult::CreateDynamicString(Str::Dup(buffer))));
+    context.segmentList.Add(
+        StenoSegment(1, states + offset,
+                     StenoDictionaryLookupResult::CreateJoinedString(
+                         context.arena, buffer, nullptr)));
     ++offset;
   }
 }
 
-bool StenoStrokeHistory::DirectLookup(BuildSegmentContext &context,
-                                      size_t &offset) {
+bool StenoStrokeHistoryWindow::DirectLookup(BuildSegmentContext &context,
+                                            size_t &offset) {
   size_t startLength = count - offset;
   if (startLength > context.maximumOutlineLength) {
     startLength = context.maximumOutlineLength;
   }
 
-  for (size_t length = startLength; length > 0; --length) {
-    StenoDictionaryLookupResult lookup =
-        context.dictionary.Lookup(strokes + offset, length);
-
-    if (lookup.IsValid()) {
-      const char *lookupText = lookup.GetText();
-      if (strstr(lookupText, "{*")) {
-        if (strstr(lookupText, "{*?}")) {
-          lookup.Destroy();
-          RemoveOffset(context, offset, length);
-          HandleRetroactiveInsertSpace(context, offset);
-          ReevaluateSegments(context, offset);
-          return true;
-        }
-        if (strstr(lookupText, "{*}")) {
-          lookup.Destroy();
-          RemoveOffset(context, offset, length);
-          HandleRetroactiveToggleAsterisk(context, offset);
-          ReevaluateSegments(context, offset);
-          return true;
-        }
-        if (strstr(lookupText, "{*+}")) {
-          StenoState state = states[offset];
-          lookup.Destroy();
-          RemoveOffset(context, offset, length);
-          HandleRepeatLastStroke(context, offset, state);
-          ReevaluateSegments(context, offset);
-          return true;
-        }
-      }
+  StenoDictionaryPrefixLookup prefixLookup(strokes + offset, startLength);
+  prefixLookup.arena = context.arena;
+
+  size_t length;
+  StenoDictionaryLookupResult lookup =
+      context.LookupLongest(prefixLookup, prefixLookup.count, length);
 
-      context.segmentList.Add(StenoSegment(length, states + offset, lookup));
-      offset += length;
+  if (!lookup.IsValid()) {
+    return false;
+  }
+
+  const char *lookupText = lookup.GetText();
+  if (strstr(lookupText, "{*")) {
+    if (strstr(lookupText, "{*?}")) {
+      lookup.Destroy();
+      context.hasRetroactiveEdit = true;
+      RemoveOffset(context, offset, length);
+      HandleRetroactiveInsertSpace(context, offset);
+      ReevaluateSegments(context, offset);
+      return true;
+    }
+    if (strstr(lookupText, "{*}")) {
+      lookup.Destroy();
+      context.hasRetroactiveEdit = true;
+      RemoveOffset(context, offset, length);
+      HandleRetroactiveToggleAsterisk(context, offset);
+      ReevaluateSegments(context, offset);
+      return true;
+    }
+    if (strstr(lookupText, "{*+}")) {
+      StenoState state = states[offset];
+      lookup.Destroy();
+      context.hasRetroactiveEdit = true;
+      RemoveOffset(context, offset, length);
+      HandleRepeatLastStroke(context, offset, state);
+      ReevaluateSegments(context, offset);
       return true;
     }
   }
 
-  return false;
+  context.segmentList.Add(StenoSegment(length, states + offset, lookup));
+  offset += length;
+  return true;
 }
 
-void StenoStrokeHistory::RemoveOffset(BuildSegmentContext &context,
-                                      size_t &offset, size_t length) {
+void StenoStrokeHistoryWindow::RemoveOffset(BuildSegmentContext &context,
+                                            size_t &offset, size_t length) {
   assert(offset + length <= count);
   size_t remaining = count - offset - length;
-  memmove(strokes + offset, strokes + offset + length,
-          sizeof(StenoStroke) * remaining);
-  memmove(states + offset, states + offset + length,
-          sizeof(StenoState) * remaining);
+  if (remaining != 0) {
+    MakePrivateCopy(context);
+    memmove(privateStrokes + offset, privateStrokes + offset + length,
+            sizeof(StenoStroke) * remaining);
+    memmove(privateStates + offset, privateStates + offset + length,
+            sizeof(StenoState) * remaining);
+  }
   count -= length;
 }
 
-bool StenoStrokeHistory::AutoSuffixLookup(BuildSegmentContext &context,
-                                          size_t &offset) {
+bool StenoStrokeHistoryWindow::AutoSuffixLookup(BuildSegmentContext &context,
+                                                size_t &offset) {
 
   // See which historical translations can be extended with auto-suffixes.
   const StenoState *oldestState =
@@ -181,9 +288,10 @@ bool StenoStrokeHistory::AutoSuffixLookup(BuildSegmentContext &context,
   return true;
 }
 
-StenoSegment StenoStrokeHistory::AutoSuffixTest(BuildSegmentContext &context,
-                                                const StenoSegment &segment,
-                                                size_t offset) {
+StenoSegment
+StenoStrokeHistoryWindow::AutoSuffixTest(BuildSegmentContext &context,
+                                         const StenoSegment &segment,
+                                         size_t offset) {
   size_t lastStrokeOffset = segment.state - states;
   size_t startLength = count - lastStrokeOffset > context.maximumOutlineLength
                            ? context.maximumOutlineLength
@@ -192,17 +300,32 @@ StenoSegment StenoStrokeHistory::AutoSuffixTest(BuildSegmentContext &context,
   return AutoSuffixTest(context, lastStrokeOffset, startLength, minimumLength);
 }
 
-StenoSegment StenoStrokeHistory::AutoSuffixTest(BuildSegmentContext &context,
-                                                size_t offset,
-                                                size_t startLength,
-                                                size_t minimumLength) {
+StenoSegment StenoStrokeHistoryWindow::AutoSuffixTest(
+    BuildSegmentContext &context, size_t offset, size_t startLength,
+    size_t minimumLength) {
+  const StenoOrthography &orthography = context.orthography.data;
+
+  // Only strokes with auto-suffix keys can end a candidate.
+  while (startLength >= minimumLength &&
+         (strokes[offset + startLength - 1] & orthography.autoSuffixMask)
+             .IsEmpty()) {
+    --startLength;
+  }
+  if (startLength < minimumLength) {
+    return StenoSegment(0, nullptr,
+                        StenoDictionaryLookupResult::CreateInvalid());
+  }
+
   StenoStroke *localStrokes =
       (StenoStroke *)alloca(sizeof(StenoStroke) * startLength);
   memcpy(localStrokes, strokes + offset, sizeof(StenoStroke) * startLength);
 
-  const StenoOrthography &orthography = context.orthography.data;
+  // Each candidate differs from a prefix of the original strokes only in its
+  // last stroke, so its hash continues from the prefix hash.
+  StenoDictionaryPrefixLookup prefixLookup(strokes + offset, startLength);
 
-  for (size_t length = startLength; length >= minimumLength; --length) {
+  for (size_t length = prefixLookup.count; length >= minimumLength;
+       --length) {
     if ((strokes[offset + length - 1] & orthography.autoSuffixMask).IsEmpty()) {
       continue;
     }
@@ -214,16 +337,16 @@ StenoSegment StenoStrokeHistory::AutoSuffixTest(BuildSegmentContext &context,
       }
       localStrokes[length - 1] = strokes[offset + length - 1] & ~suffix.stroke;
 
-      StenoDictionaryLookupResult lookup =
-          context.dictionary.Lookup(localStrokes, length);
+      StenoDictionaryLookupResult lookup = context.Lookup(
+          localStrokes, length,
+          prefixLookup.GetHash(length, localStrokes[length - 1]));
 
       if (lookup.IsValid()) {
-        const char *text = lookup.GetText();
-        const char *result = Str::Join(text, suffix.text, nullptr);
+        StenoDictionaryLookupResult result =
+            StenoDictionaryLookupResult::CreateJoinedString(
+                context.arena, lookup.GetText(), suffix.text, nullptr);
         lookup.Destroy();
-        return StenoSegment(
-            length, states + offset,
-            StenoDictionaryLookupResult::CreateDynamicString(result));
+        return StenoSegment(length, states + offset, result);
       }
     }
   }
@@ -231,8 +354,8 @@ StenoSegment StenoStrokeHistory::AutoSuffixTest(BuildSegmentContext &context,
   return StenoSegment(0, nullptr, StenoDictionaryLookupResult::CreateInvalid());
 }
 
-void StenoStrokeHistory::ReevaluateSegments(BuildSegmentContext &context,
-                                            size_t &offset) {
+void StenoStrokeHistoryWindow::ReevaluateSegments(
+    BuildSegmentContext &context, size_t &offset) {
   size_t currentOffset = offset;
   while (context.segmentList.IsNotEmpty()) {
     StenoSegment &lastSegment = context.segmentList.Back();
@@ -246,46 +369,53 @@ void StenoStrokeHistory::ReevaluateSegments(BuildSegmentContext &context,
   }
 }
 
-void StenoStrokeHistory::HandleRetroactiveInsertSpace(
+void StenoStrokeHistoryWindow::HandleRetroactiveInsertSpace(
     BuildSegmentContext &context, size_t currentOffset) {
   if (currentOffset == 0) {
     return;
   }
 
+  MakePrivateCopy(context);
+  assert(count < privateCapacity);
+
   ++count;
   size_t remaining = count - currentOffset;
-  memmove(strokes + currentOffset, strokes + currentOffset - 1,
+  memmove(privateStrokes + currentOffset, privateStrokes + currentOffset - 1,
           sizeof(StenoStroke) * remaining);
-  memmove(states + currentOffset, states + currentOffset - 1,
+  memmove(privateStates + currentOffset, privateStates + currentOffset - 1,
           sizeof(StenoState) * remaining);
 
-  strokes[currentOffset - 1] = StenoStroke(0);
+  privateStrokes[currentOffset - 1] = StenoStroke(0);
 }
 
-void StenoStrokeHistory::HandleRetroactiveToggleAsterisk(
+void StenoStrokeHistoryWindow::HandleRetroactiveToggleAsterisk(
     BuildSegmentContext &context, size_t currentOffset) {
   if (currentOffset == 0) {
     return;
   }
 
-  strokes[currentOffset - 1] ^= StrokeMask::STAR;
+  MakePrivateCopy(context);
+  privateStrokes[currentOffset - 1] ^= StrokeMask::STAR;
 }
 
-void StenoStrokeHistory::HandleRepeatLastStroke(BuildSegmentContext &context,
-                                                size_t currentOffset,
-                                                const StenoState &state) {
+void StenoStrokeHistoryWindow::HandleRepeatLastStroke(
+    BuildSegmentContext &context, size_t currentOffset,
+    const StenoState &state) {
   if (currentOffset == 0) {
     return;
   }
 
+  MakePrivateCopy(context);
+  assert(count < privateCapacity);
+
   size_t remaining = count - currentOffset;
-  memmove(strokes + currentOffset + 1, strokes + currentOffset,
+  memmove(privateStrokes + currentOffset + 1, privateStrokes + currentOffset,
           sizeof(StenoStroke) * remaining);
-  memmove(states + currentOffset + 1, states + currentOffset,
+  memmove(privateStates + currentOffset + 1, privateStates + currentOffset,
           sizeof(StenoState) * remaining);
 
-  strokes[currentOffset] = strokes[currentOffset - 1];
-  states[currentOffset] = state;
+  privateStrokes[currentOffset] = privateStrokes[currentOffset - 1];
+  privateStates[currentOffset] = state;
   ++count;
 }
 
@@ -320,7 +450,8 @@ TEST_BEGIN("StrokeHistory: Test single segment") {
       StenoOrthography::emptyOrthography);
 
   BuildSegmentContext context(segmentList, dictionary, orthography);
-  history.CreateSegments(context);
+  StenoStrokeHistoryWindow window(history.GetView());
+  window.CreateSegments(context);
 
   assert(segmentList.GetCount() == 1);
   assert(Str::Eq(segmentList[0].lookup.GetText(), "test"));
@@ -342,7 +473,8 @@ TEST_BEGIN("StrokeHistory: Test two segments, with multi-stroke") {
       StenoOrthography::emptyOrthography);
 
   BuildSegmentContext context(segmentList, dictionary, orthography);
-  history.CreateSegments(context);
+  StenoStrokeHistoryWindow window(history.GetView());
+  window.CreateSegments(context);
 
   assert(segmentList.GetCount() == 2);
   assert(Str::Eq(segmentList[0].lookup.GetText(), "test"));
@@ -365,7 +497,8 @@ TEST_BEGIN("StrokeHistory: Test *? splits strokes") {
       StenoOrthography::emptyOrthography);
 
   BuildSegmentContext context(segmentList, dictionary, orthography);
-  history.CreateSegments(context);
+  StenoStrokeHistoryWindow window(history.GetView());
+  window.CreateSegments(context);
 
   assert(segmentList.GetCount() == 3);
   assert(Str::Eq(segmentList[0].lookup.GetText(), "test"));
@@ -389,11 +522,81 @@ TEST_BEGIN("StrokeHistory: Test * toggles ") {
       StenoOrthography::emptyOrthography);
 
   BuildSegmentContext context(segmentList, dictionary, orthography);
-  history.CreateSegments(context);
+  StenoStrokeHistoryWindow window(history.GetView());
+  window.CreateSegments(context);
 
   assert(segmentList.GetCount() == 1);
   assert(Str::Eq(segmentList[0].lookup.GetText(), "T*EFT"));
 }
 TEST_END
 
+TEST_BEGIN("StrokeHistory: Retroactive edits copy the window") {
+  StenoDebugDictionary dictionary;
+  dictionary.SetResponse("{*}");
+
+  StenoStrokeHistory history;
+  // spellchecker: disable
+  history.Add(StenoStroke("TEFT"), StenoState());
+  history.Add(StenoStroke("#EU"), StenoState());
+  // spellchecker: enable
+
+  StenoSegmentList segmentList;
+  const StenoCompiledOrthography orthography(
+      StenoOrthography::emptyOrthography);
+
+  BuildSegmentContext context(segmentList, dictionary, orthography);
+  StenoStrokeHistoryWindow window(history.GetView());
+  window.CreateSegments(context);
+
+  assert(window.IsPrivateCopy());
+  assert(window.GetCount() == 1);
+  assert(history.GetCount() == 2);
+  assert(history.GetStroke(0) == StenoStroke("TEFT"));
+  assert(segmentList[0].state != &history.BackState(2));
+}
+TEST_END
+
+TEST_BEGIN("StrokeHistory: Windows remain contiguous after wrapping") {
+  StenoStrokeHistory history;
+  for (size_t i = 0; i < StenoStrokeHistory::BUFFER_SIZE + 100; ++i) {
+    history.Add(StenoStroke(i), StenoState());
+  }
+  assert(history.IsFull());
+
+  const StenoStroke *strokes = &history.GetStroke(0);
+  for (size_t i = 0; i < history.GetCount(); ++i) {
+    assert(strokes[i] == StenoStroke(i + 100));
+  }
+
+  history.Add(StenoStroke(1000), StenoState());
+  history.SetBackCombineUndo();
+  assert(history.GetUndoCount(10) == 2);
+
+  StenoStrokeHistoryView view =
+      history.GetView(history.GetCount(), StenoStrokeHistory::BUFFER_SIZE);
+  assert(view.count == StenoStrokeHistory::BUFFER_SIZE);
+  assert(view.strokes[0] == StenoStroke(101));
+  assert(view.strokes[view.count - 1] == StenoStroke(1000));
+  assert(view.states[view.count - 1].shouldCombineUndo);
+
+  history.Pop();
+  history.Pop();
+  history.Add(StenoStroke(2000), StenoState());
+  assert(history.GetStroke(history.GetCount() - 1) == StenoStroke(2000));
+
+  view = history.GetView(history.GetCount(), 8);
+  assert(view.count == 8);
+  assert(view.strokes[7] == StenoStroke(2000));
+  assert(view.strokes[0] ==
+         StenoStroke(StenoStrokeHistory::BUFFER_SIZE + 100 - 8));
+
+  // Entries keep their address as the history wraps.
+  const StenoStroke *lastStroke = &view.strokes[view.count - 1];
+  for (size_t i = 0; i < StenoStrokeHistory::BUFFER_SIZE - 1; ++i) {
+    history.Add(StenoStroke(3000), StenoState());
+  }
+  assert(history.GetView(1, 1).strokes == lastStroke);
+}
+TEST_END
+
 //---------------------------------------------------------------------------
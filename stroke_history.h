@@ -2,6 +2,7 @@
 
 #pragma once
 #include "dictionary/dictionary.h"
+#include "engine_stats.h"
 #include "segment.h"
 #include "state.h"
 #include "stroke.h"
@@ -12,22 +13,69 @@
 
 struct StenoSegment;
 class StenoCompiledOrthography;
+class StenoLookupArena;
+class StenoLookupCache;
 
 //---------------------------------------------------------------------------
 
 struct BuildSegmentContext {
   BuildSegmentContext(StenoSegmentList &segmentList,
                       const StenoDictionary &dictionary,
-                      const StenoCompiledOrthography &orthography);
+                      const StenoCompiledOrthography &orthography,
+                      StenoLookupCache *lookupCache = nullptr);
 
   StenoSegmentList &segmentList;
   const StenoDictionary &dictionary;
   const size_t maximumOutlineLength;
   const StenoCompiledOrthography &orthography;
+
+  // Optional. Lookups are memoized across strokes when provided.
+  StenoLookupCache *lookupCache;
+
+  // Set when a retroactive command has edited the strokes being segmented.
+  bool hasRetroactiveEdit = false;
+
+  // Optional. Generated text is allocated from the arena when provided, and
+  // must not be used after the arena is reset.
+  StenoLookupArena *arena = nullptr;
+
+  // Optional. Lookups are measured as StenoEnginePhase::LOOKUP when provided.
+  StenoPhaseStats *phaseStats = nullptr;
+
+  StenoDictionaryLookupResult Lookup(const StenoStroke *strokes,
+                                     size_t length) {
+    return Lookup(strokes, length, StenoStroke::Hash(strokes, length));
+  }
+
+  // hash must be StenoStroke::Hash(strokes, length).
+  StenoDictionaryLookupResult Lookup(const StenoStroke *strokes, size_t length,
+                                     uint32_t hash);
+
+  // Returns the longest valid lookup of strokes[0, length), with
+  // length <= maximumLength, and sets length to match.
+  StenoDictionaryLookupResult
+  LookupLongest(const StenoDictionaryPrefixLookup &lookup,
+                size_t maximumLength, size_t &length);
+};
+
+//---------------------------------------------------------------------------
+
+// A contiguous, read only window of a StenoStrokeHistory.
+struct StenoStrokeHistoryView {
+  const StenoStroke *strokes;
+  const StenoState *states;
+  size_t count;
 };
 
 //---------------------------------------------------------------------------
 
+// Stroke history is a circular buffer, so that Add, Shift and Pop are O(1)
+// once the history is full.
+//
+// Every entry is stored twice, BUFFER_SIZE apart, which means that any
+// window of the history is contiguous in memory. Each view starts at the
+// first copy of its first entry, so an entry is seen at the same address
+// for as long as it remains in the history.
 class StenoStrokeHistory {
 public:
   bool IsEmpty() const { return count == 0; }
@@ -35,7 +83,13 @@ public:
   bool IsFull() const { return count == BUFFER_SIZE; }
   size_t GetCount() const { return count; }
 
-  void Shift();
+  void Shift() {
+    if (count == 0) {
+      return;
+    }
+    --count;
+    start = GetIndex(1);
+  }
 
   void ShiftIfFull() {
     if (count == BUFFER_SIZE) {
@@ -45,8 +99,11 @@ public:
 
   void Add(StenoStroke stroke, StenoState state) {
     ShiftIfFull();
-    strokes[count] = stroke;
-    states[count] = state;
+    size_t index = GetIndex(count);
+    strokes[index] = stroke;
+    strokes[index + BUFFER_SIZE] = stroke;
+    states[index] = state;
+    states[index + BUFFER_SIZE] = state;
     ++count;
   }
 
@@ -55,7 +112,10 @@ public:
     --count;
   }
 
-  void Reset() { count = 0; }
+  void Reset() {
+    start = 0;
+    count = 0;
+  }
 
   // When undo is pressed, returns how many items should be removed
   // from the list up to maxCount.
@@ -63,29 +123,88 @@ public:
 
   void PopCount(size_t popCount) { count -= popCount; }
 
-  void TransferFrom(const StenoStrokeHistory &source, size_t sourceStrokeCount,
-                    size_t maxCount);
+  // Returns the window of up to maxCount entries that end at endIndex.
+  StenoStrokeHistoryView GetView(size_t endIndex, size_t maxCount) const;
+  StenoStrokeHistoryView GetView() const { return GetView(count, count); }
 
-  void SetBackCombineUndo() { states[count - 1].shouldCombineUndo = true; }
+  void SetBackCombineUndo() {
+    size_t index = GetIndex(count - 1);
+    states[index].shouldCombineUndo = true;
+    states[index + BUFFER_SIZE].shouldCombineUndo = true;
+  }
   void SetBackHasManualStateChange() {
-    states[count - 1].isManualStateChange = true;
+    size_t index = GetIndex(count - 1);
+    states[index].isManualStateChange = true;
+    states[index + BUFFER_SIZE].isManualStateChange = true;
   }
 
   const StenoState &BackState(size_t fromEnd = 1) const {
-    return states[count - fromEnd];
+    return states[start + count - fromEnd];
   }
 
+  const StenoStroke &GetStroke(size_t i) const { return strokes[start + i]; }
+
+  static const size_t BUFFER_SIZE = 256;
+
+private:
+  size_t start = 0;
+  size_t count = 0;
+  StenoStroke strokes[2 * BUFFER_SIZE];
+  StenoState states[2 * BUFFER_SIZE];
+
+  // Returns the index of the first copy of entry i.
+  size_t GetIndex(size_t i) const {
+    size_t index = start + i;
+    return index >= BUFFER_SIZE ? index - BUFFER_SIZE : index;
+  }
+};
+
+//---------------------------------------------------------------------------
+
+// Segments a view of the stroke history without copying it.
+//
+// Retroactive commands ({*?}, {*} and {*+}) edit the strokes they apply to.
+// The first such edit copies the view into a private buffer, which is
+// reused by subsequent conversions. Segments reference the states of the
+// view, or of the private copy once one has been made.
+class StenoStrokeHistoryWindow {
+public:
+  StenoStrokeHistoryWindow() = default;
+  StenoStrokeHistoryWindow(const StenoStrokeHistoryView &view) {
+    SetView(view);
+  }
+  StenoStrokeHistoryWindow(const StenoStrokeHistoryWindow &) = delete;
+  ~StenoStrokeHistoryWindow();
+
+  void operator=(const StenoStrokeHistoryWindow &) = delete;
+
+  void SetView(const StenoStrokeHistoryView &view);
+
+  size_t GetCount() const { return count; }
+  bool IsPrivateCopy() const { return isPrivateCopy; }
+
   void CreateSegments(BuildSegmentContext &context,
                       size_t minimumStartOffset = 0);
 
-  const StenoStroke &GetStroke(size_t i) const { return strokes[i]; }
-
-  static const size_t BUFFER_SIZE = 256;
+  // Returns the number of leading segments that CreateSegments is guaranteed
+  // to reproduce if another stroke is appended to this history.
+  //
+  // A segment is stable once every lookup that led to it only inspected
+  // strokes that precede the end of the history by at least
+  // maximumOutlineLength.
+  size_t GetStableSegmentCount(const BuildSegmentContext &context) const;
 
 private:
+  const StenoStroke *strokes = nullptr;
+  const StenoState *states = nullptr;
   size_t count = 0;
-  StenoStroke strokes[BUFFER_SIZE];
-  StenoState states[BUFFER_SIZE];
+
+  bool isPrivateCopy = false;
+  size_t privateCapacity = 0;
+  StenoStroke *privateStrokes = nullptr;
+  StenoState *privateStates = nullptr;
+
+  void MakePrivateCopy(BuildSegmentContext &context);
 
   void AddSegments(BuildSegmentContext &context, size_t offset);
 
@@ -1,14 +1,112 @@
 //---------------------------------------------------------------------------
 
+#include "thread.h"
 #include <pthread.h>
 
 //---------------------------------------------------------------------------
 
 #ifdef JAVELIN_THREADS
 
+// A long lived worker thread with a single slot mailbox.
+//
+// Creating a thread for every call puts thread creation on the keystroke
+// latency path, so the worker is created on first use and then parked on a
+// condition variable until work is posted.
+class ParallelWorker {
+public:
+  void Run(void (*func)(void *context), void *context);
+  void Wait();
+
+  static ParallelWorker &GetInstance();
+
+private:
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t workAvailable = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t workComplete = PTHREAD_COND_INITIALIZER;
+
+  // nullptr when the mailbox is empty.
+  void (*func)(void *context) = nullptr;
+  void *context = nullptr;
+
+  ParallelWorker();
+
+  static void *EntryPoint(void *data);
+  void Loop();
+};
+
+ParallelWorker::ParallelWorker() {
+  pthread_t thread;
+  pthread_create(&thread, nullptr, &ParallelWorker::EntryPoint, this);
+  pthread_detach(thread);
+}
+
+ParallelWorker &ParallelWorker::GetInstance() {
+  static ParallelWorker instance;
+  return instance;
+}
+
+void *ParallelWorker::EntryPoint(void *data) {
+  ((ParallelWorker *)data)->Loop();
+  return nullptr;
+}
+
+void ParallelWorker::Loop() {
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    while (func == nullptr) {
+      pthread_cond_wait(&workAvailable, &mutex);
+    }
+
+    pthread_mutex_unlock(&mutex);
+    (*func)(context);
+    pthread_mutex_lock(&mutex);
+
+    func = nullptr;
+    pthread_cond_signal(&workComplete);
+  }
+}
+
+void ParallelWorker::Run(void (*func)(void *context), void *context) {
+  pthread_mutex_lock(&mutex);
+  assert(this->func == nullptr);
+  this->func = func;
+  this->context = context;
+  pthread_cond_signal(&workAvailable);
+  pthread_mutex_unlock(&mutex);
+}
+
+void ParallelWorker::Wait() {
+  pthread_mutex_lock(&mutex);
+  while (func != nullptr) {
+    pthread_cond_wait(&workComplete, &mutex);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+//---------------------------------------------------------------------------
+
 void RunParallel(void (*func1)(void *context), void *context1,
                  void (*func2)(void *context), void *context2) {
+  ParallelWorker &worker = ParallelWorker::GetInstance();
+  worker.Run(func1, context1);
+  (*func2)(context2);
+  worker.Wait();
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
 
+#if defined(RUN_BENCHMARKS) && defined(JAVELIN_THREADS)
+
+#include "benchmark.h"
+
+// The previous implementation, for comparison.
+static void RunParallelCreateThread(void (*func1)(void *context),
+                                    void *context1,
+                                    void (*func2)(void *context),
+                                    void *context2) {
   pthread_t thread;
   pthread_create(&thread, nullptr, (void *(*)(void *))func1, context1);
   (*func2)(context2);
@@ -17,6 +115,38 @@ void RunParallel(void (*func1)(void *context), void *context1,
   pthread_join(thread, &result);
 }
 
+// Approximates the work of one side of a stroke conversion.
+static void SimulatedWork(void *context) {
+  volatile uint32_t *value = (volatile uint32_t *)context;
+  for (size_t i = 0; i < 2000; ++i) {
+    *value = *value * 1664525 + 1013904223;
+  }
+}
+
+static void BenchmarkRunParallel(const char *label,
+                                 void (*runParallel)(void (*)(void *), void *,
+                                                     void (*)(void *),
+                                                     void *)) {
+  const size_t ITERATIONS = 20000;
+  std::vector<uint64_t> samples;
+  samples.reserve(ITERATIONS);
+
+  uint32_t values[2] = {0, 0};
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    uint64_t start = Benchmark::GetTime();
+    (*runParallel)(&SimulatedWork, &values[0], &SimulatedWork, &values[1]);
+    samples.push_back(Benchmark::GetTime() - start);
+  }
+
+  Benchmark::PrintLatency(label, samples);
+}
+
+BENCHMARK_BEGIN("RunParallel: per stroke latency") {
+  BenchmarkRunParallel("pthread_create per call", &RunParallelCreateThread);
+  BenchmarkRunParallel("persistent worker", &RunParallel);
+}
+BENCHMARK_END
+
 #endif
 
 //---------------------------------------------------------------------------